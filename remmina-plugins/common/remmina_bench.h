@@ -0,0 +1,130 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Shared helpers for the headless replay benchmarks. Include it from
+ * exactly one source file of each benchmark executable: it defines the
+ * malloc family used to count heap allocations. */
+
+#ifndef __REMMINABENCH_H__
+#define __REMMINABENCH_H__
+
+#include <glib.h>
+#include <time.h>
+#include <stdlib.h>
+
+/* Only the thread which turned counting on is measured, so the thread
+ * feeding the capture does not show up in the numbers */
+static __thread gboolean remmina_bench_counting = FALSE;
+static guint64 remmina_bench_allocs = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	if (remmina_bench_counting)
+		remmina_bench_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (remmina_bench_counting)
+		remmina_bench_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (remmina_bench_counting)
+		remmina_bench_allocs++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+typedef struct _RemminaBenchResult
+{
+	guint64 frames;
+	gint64 wall_start;
+	gint64 cpu_start;
+	gint64 wall;
+	gint64 cpu;
+	guint64 allocs;
+} RemminaBenchResult;
+
+static gint64 remmina_bench_cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static void remmina_bench_start(RemminaBenchResult *result)
+{
+	result->frames = 0;
+	result->allocs = 0;
+	result->wall_start = g_get_monotonic_time();
+	result->cpu_start = remmina_bench_cpu_time();
+	remmina_bench_allocs = 0;
+	remmina_bench_counting = TRUE;
+}
+
+static void remmina_bench_stop(RemminaBenchResult *result)
+{
+	remmina_bench_counting = FALSE;
+	result->allocs = remmina_bench_allocs;
+	result->cpu = remmina_bench_cpu_time() - result->cpu_start;
+	result->wall = g_get_monotonic_time() - result->wall_start;
+}
+
+static G_GNUC_UNUSED void remmina_bench_report(const gchar *capture, const RemminaBenchResult *result)
+{
+	g_print("capture      %s\n", capture);
+	g_print("frames       %" G_GUINT64_FORMAT "\n", result->frames);
+	g_print("wall time    %.3f s\n", result->wall / 1000000.0);
+	g_print("fps          %.1f\n", result->wall > 0 ? result->frames * 1000000.0 / result->wall : 0);
+	g_print("cpu/frame    %.1f us\n", result->frames ? (gdouble) result->cpu / result->frames : 0);
+#ifdef __GLIBC__
+	g_print("allocs/frame %.1f\n", result->frames ? (gdouble) result->allocs / result->frames : 0);
+#else
+	g_print("allocs/frame n/a\n");
+#endif
+}
+
+#endif /* __REMMINABENCH_H__ */
+
@@ -0,0 +1,232 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "common/remmina_capture.h"
+#include "remmina/remmina_trace_calls.h"
+
+#define REMMINA_CAPTURE_RECORD_HEADER_SIZE 16
+
+struct _RemminaCapture
+{
+	FILE *fp;
+	gchar *filename;
+	gboolean writing;
+	gint64 start_time;
+	pthread_mutex_t mu;
+
+	guchar *buffer;
+	guint32 buffer_size;
+};
+
+static RemminaCapture* remmina_capture_new(FILE *fp, const gchar *filename, gboolean writing)
+{
+	TRACE_CALL("remmina_capture_new");
+	RemminaCapture *capture;
+
+	capture = g_new0(RemminaCapture, 1);
+	capture->fp = fp;
+	capture->filename = g_strdup(filename);
+	capture->writing = writing;
+	capture->start_time = g_get_monotonic_time();
+	pthread_mutex_init(&capture->mu, NULL);
+	return capture;
+}
+
+RemminaCapture* remmina_capture_open_write(const gchar *prefix, GError **error)
+{
+	TRACE_CALL("remmina_capture_open_write");
+	const gchar *dir;
+	gchar *basename;
+	gchar *filename;
+	gchar *stamp;
+	GDateTime *now;
+	RemminaCapture *capture;
+	FILE *fp;
+
+	dir = g_getenv("REMMINA_CAPTURE_DIR");
+	if (!dir || !g_file_test(dir, G_FILE_TEST_IS_DIR))
+		return NULL;
+
+	now = g_date_time_new_now_local();
+	stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+	basename = g_strdup_printf("%s-%s-%d.rmcap", prefix, stamp, (gint) getpid());
+	g_free(stamp);
+	g_date_time_unref(now);
+	filename = g_build_filename(dir, basename, NULL);
+	g_free(basename);
+
+	fp = g_fopen(filename, "wb");
+	if (!fp)
+	{
+		g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno), "Unable to create capture file %s: %s",
+				filename, g_strerror(errno));
+		g_free(filename);
+		return NULL;
+	}
+	fwrite(REMMINA_CAPTURE_MAGIC, 1, 8, fp);
+	capture = remmina_capture_new(fp, filename, TRUE);
+	g_free(filename);
+
+	return capture;
+}
+
+RemminaCapture* remmina_capture_open_read(const gchar *filename)
+{
+	TRACE_CALL("remmina_capture_open_read");
+	gchar magic[8];
+	FILE *fp;
+
+	fp = g_fopen(filename, "rb");
+	if (!fp)
+		return NULL;
+	if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, REMMINA_CAPTURE_MAGIC, 8) != 0)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	return remmina_capture_new(fp, filename, FALSE);
+}
+
+const gchar* remmina_capture_get_filename(RemminaCapture *capture)
+{
+	TRACE_CALL("remmina_capture_get_filename");
+	return capture->filename;
+}
+
+void remmina_capture_write(RemminaCapture *capture, RemminaCaptureRecordType type, const guchar *data, guint32 len)
+{
+	TRACE_CALL("remmina_capture_write");
+	guchar header[REMMINA_CAPTURE_RECORD_HEADER_SIZE];
+	guint32 v32;
+	guint64 v64;
+	gint oldtype;
+
+	/* Called from the protocol threads, which may run with asynchronous
+	 * cancellation: never leave the mutex locked */
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+	pthread_mutex_lock(&capture->mu);
+	v32 = GUINT32_TO_BE((guint32) type);
+	memcpy(header, &v32, 4);
+	v32 = GUINT32_TO_BE(len);
+	memcpy(header + 4, &v32, 4);
+	v64 = GUINT64_TO_BE((guint64) (g_get_monotonic_time() - capture->start_time));
+	memcpy(header + 8, &v64, 8);
+	fwrite(header, 1, sizeof(header), capture->fp);
+	if (len > 0)
+		fwrite(data, 1, len, capture->fp);
+	pthread_mutex_unlock(&capture->mu);
+	pthread_setcanceltype(oldtype, NULL);
+}
+
+gboolean remmina_capture_read(RemminaCapture *capture, RemminaCaptureRecordType *type, gint64 *timestamp,
+		const guchar **data, guint32 *len)
+{
+	TRACE_CALL("remmina_capture_read");
+	guchar header[REMMINA_CAPTURE_RECORD_HEADER_SIZE];
+	guint32 v32;
+	guint64 v64;
+
+	if (fread(header, 1, sizeof(header), capture->fp) != sizeof(header))
+		return FALSE;
+
+	memcpy(&v32, header, 4);
+	*type = (RemminaCaptureRecordType) GUINT32_FROM_BE(v32);
+	memcpy(&v32, header + 4, 4);
+	*len = GUINT32_FROM_BE(v32);
+	memcpy(&v64, header + 8, 8);
+	*timestamp = (gint64) GUINT64_FROM_BE(v64);
+
+	if (*len > capture->buffer_size)
+	{
+		capture->buffer = g_realloc(capture->buffer, *len);
+		capture->buffer_size = *len;
+	}
+	if (*len > 0 && fread(capture->buffer, 1, *len, capture->fp) != *len)
+		return FALSE;
+	*data = capture->buffer;
+	return TRUE;
+}
+
+void remmina_capture_close(RemminaCapture *capture)
+{
+	TRACE_CALL("remmina_capture_close");
+	if (!capture)
+		return;
+	fclose(capture->fp);
+	pthread_mutex_destroy(&capture->mu);
+	g_free(capture->filename);
+	g_free(capture->buffer);
+	g_free(capture);
+}
+
+void remmina_capture_put_uint16(GByteArray *buf, guint16 v)
+{
+	TRACE_CALL("remmina_capture_put_uint16");
+	v = GUINT16_TO_BE(v);
+	g_byte_array_append(buf, (const guint8*) &v, 2);
+}
+
+void remmina_capture_put_uint32(GByteArray *buf, guint32 v)
+{
+	TRACE_CALL("remmina_capture_put_uint32");
+	v = GUINT32_TO_BE(v);
+	g_byte_array_append(buf, (const guint8*) &v, 4);
+}
+
+guint16 remmina_capture_get_uint16(const guchar *p)
+{
+	TRACE_CALL("remmina_capture_get_uint16");
+	guint16 v;
+
+	memcpy(&v, p, 2);
+	return GUINT16_FROM_BE(v);
+}
+
+guint32 remmina_capture_get_uint32(const guchar *p)
+{
+	TRACE_CALL("remmina_capture_get_uint32");
+	guint32 v;
+
+	memcpy(&v, p, 4);
+	return GUINT32_FROM_BE(v);
+}
+
@@ -0,0 +1,90 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINACAPTURE_H__
+#define __REMMINACAPTURE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Protocol capture files.
+ *
+ * A capture starts with an 8 byte magic, followed by records made of a
+ * big endian header (type, payload length, microseconds since the capture
+ * was opened) and the payload. The first record is always a
+ * REMMINA_CAPTURE_RECORD_HEADER whose payload is protocol specific.
+ *
+ * Captures are written only when the REMMINA_CAPTURE_DIR environment
+ * variable points to an existing directory, and are replayed by the
+ * benchmark tools built with -DWITH_BENCHMARKS=ON. */
+
+#define REMMINA_CAPTURE_MAGIC "RMNCAP01"
+
+typedef enum
+{
+	REMMINA_CAPTURE_RECORD_HEADER = 0,
+	/* Raw bytes received from the server */
+	REMMINA_CAPTURE_RECORD_DATA = 1,
+	/* A decrypted RDP surface bits command */
+	REMMINA_CAPTURE_RECORD_SURFACE_BITS = 2,
+	/* End of a paint cycle, when the protocol has one */
+	REMMINA_CAPTURE_RECORD_FRAME = 3
+} RemminaCaptureRecordType;
+
+typedef struct _RemminaCapture RemminaCapture;
+
+/* Returns NULL without setting error when REMMINA_CAPTURE_DIR is not set */
+RemminaCapture* remmina_capture_open_write(const gchar *prefix, GError **error);
+RemminaCapture* remmina_capture_open_read(const gchar *filename);
+const gchar* remmina_capture_get_filename(RemminaCapture *capture);
+/* Thread safe, may be called from a relay thread while another thread writes */
+void remmina_capture_write(RemminaCapture *capture, RemminaCaptureRecordType type, const guchar *data, guint32 len);
+/* Returns FALSE at end of file. The returned data belongs to the capture and
+ * stays valid until the next read */
+gboolean remmina_capture_read(RemminaCapture *capture, RemminaCaptureRecordType *type, gint64 *timestamp,
+		const guchar **data, guint32 *len);
+void remmina_capture_close(RemminaCapture *capture);
+
+/* Helpers to build and parse the big endian record payloads */
+void remmina_capture_put_uint16(GByteArray *buf, guint16 v);
+void remmina_capture_put_uint32(GByteArray *buf, guint32 v);
+guint16 remmina_capture_get_uint16(const guchar *p);
+guint32 remmina_capture_get_uint32(const guchar *p);
+
+G_END_DECLS
+
+#endif /* __REMMINACAPTURE_H__ */
+
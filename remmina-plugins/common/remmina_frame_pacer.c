@@ -0,0 +1,266 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <gtk/gtk.h>
+#include <pthread.h>
+#include "common/remmina_frame_pacer.h"
+#include "remmina/remmina_trace_calls.h"
+
+/* Refresh interval assumed when the frame clock cannot tell, in microseconds */
+#define REMMINA_FRAME_PACER_DEFAULT_INTERVAL 16667
+/* Never skip more refresh cycles than this in a row */
+#define REMMINA_FRAME_PACER_MAX_SKIP 8
+
+struct _RemminaFramePacer
+{
+	GtkWidget *widget;
+	RemminaFramePacerFunc func;
+	gpointer data;
+
+	pthread_mutex_t mu;
+	cairo_region_t *damage;
+	/* Protocol frames completed since the last presentation */
+	gint frames;
+	/* A tick callback is installed or about to be */
+	gboolean scheduled;
+	guint start_handler;
+
+	/* Main thread only */
+	guint tick_id;
+	gint skip;
+	/* Moving average of the paint time */
+	gint64 paint_time;
+};
+
+/* Damage and frames are reported from the protocol threads, which may run
+ * with asynchronous cancellation: cancellation is deferred while the mutex
+ * is held, or a cancelled thread could leave it locked */
+static void remmina_frame_pacer_lock(RemminaFramePacer *pacer, gint *oldtype)
+{
+	TRACE_CALL("remmina_frame_pacer_lock");
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, oldtype);
+	pthread_mutex_lock(&pacer->mu);
+}
+
+static void remmina_frame_pacer_unlock(RemminaFramePacer *pacer, gint oldtype)
+{
+	TRACE_CALL("remmina_frame_pacer_unlock");
+	pthread_mutex_unlock(&pacer->mu);
+	pthread_setcanceltype(oldtype, NULL);
+}
+
+static void remmina_frame_pacer_present(RemminaFramePacer *pacer)
+{
+	TRACE_CALL("remmina_frame_pacer_present");
+	cairo_region_t *damage;
+	gint dropped;
+	gint oldtype;
+
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	damage = pacer->damage;
+	pacer->damage = cairo_region_create();
+	dropped = MAX(0, pacer->frames - 1);
+	pacer->frames = 0;
+	remmina_frame_pacer_unlock(pacer, oldtype);
+
+	pacer->func(pacer->data, damage, dropped);
+	cairo_region_destroy(damage);
+}
+
+#if GTK_CHECK_VERSION(3, 8, 0)
+static gboolean remmina_frame_pacer_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data)
+{
+	TRACE_CALL("remmina_frame_pacer_tick");
+	RemminaFramePacer *pacer = (RemminaFramePacer*) data;
+	gint64 interval = 0;
+	gint oldtype;
+
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	if (cairo_region_is_empty(pacer->damage))
+	{
+		/* Nothing to show: stop ticking until the next damage */
+		pacer->scheduled = FALSE;
+		pacer->tick_id = 0;
+		remmina_frame_pacer_unlock(pacer, oldtype);
+		return G_SOURCE_REMOVE;
+	}
+	remmina_frame_pacer_unlock(pacer, oldtype);
+
+	if (pacer->skip > 0)
+	{
+		/* The last paint did not fit in a refresh interval, keep accumulating */
+		pacer->skip--;
+		return G_SOURCE_CONTINUE;
+	}
+
+	remmina_frame_pacer_present(pacer);
+
+	gdk_frame_clock_get_refresh_info(frame_clock, gdk_frame_clock_get_frame_time(frame_clock), &interval, NULL);
+	if (interval <= 0)
+		interval = REMMINA_FRAME_PACER_DEFAULT_INTERVAL;
+	pacer->skip = MIN(pacer->paint_time / interval, REMMINA_FRAME_PACER_MAX_SKIP);
+
+	return G_SOURCE_CONTINUE;
+}
+#endif
+
+static gboolean remmina_frame_pacer_start(RemminaFramePacer *pacer)
+{
+	TRACE_CALL("remmina_frame_pacer_start");
+	gint oldtype;
+
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	pacer->start_handler = 0;
+	remmina_frame_pacer_unlock(pacer, oldtype);
+
+#if GTK_CHECK_VERSION(3, 8, 0)
+	if (!pacer->tick_id)
+		pacer->tick_id = gtk_widget_add_tick_callback(pacer->widget, remmina_frame_pacer_tick, pacer, NULL);
+#else
+	/* No frame clock: present as soon as the main loop is idle */
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	pacer->scheduled = FALSE;
+	remmina_frame_pacer_unlock(pacer, oldtype);
+	remmina_frame_pacer_present(pacer);
+#endif
+	return FALSE;
+}
+
+/* Called with pacer->mu locked */
+static void remmina_frame_pacer_schedule(RemminaFramePacer *pacer)
+{
+	TRACE_CALL("remmina_frame_pacer_schedule");
+	if (pacer->scheduled)
+		return;
+	pacer->scheduled = TRUE;
+	pacer->start_handler = gdk_threads_add_idle((GSourceFunc) remmina_frame_pacer_start, pacer);
+}
+
+RemminaFramePacer* remmina_frame_pacer_new(GtkWidget *widget, RemminaFramePacerFunc func, gpointer data)
+{
+	TRACE_CALL("remmina_frame_pacer_new");
+	RemminaFramePacer *pacer;
+
+	pacer = g_new0(RemminaFramePacer, 1);
+	pacer->widget = g_object_ref(widget);
+	pacer->func = func;
+	pacer->data = data;
+	pthread_mutex_init(&pacer->mu, NULL);
+	pacer->damage = cairo_region_create();
+	return pacer;
+}
+
+void remmina_frame_pacer_free(RemminaFramePacer *pacer)
+{
+	TRACE_CALL("remmina_frame_pacer_free");
+	guint start_handler;
+	gint oldtype;
+
+	if (!pacer)
+		return;
+	/* Cleared under the mutex, the protocol thread may still be scheduling */
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	start_handler = pacer->start_handler;
+	pacer->start_handler = 0;
+	remmina_frame_pacer_unlock(pacer, oldtype);
+	if (start_handler)
+		g_source_remove(start_handler);
+#if GTK_CHECK_VERSION(3, 8, 0)
+	if (pacer->tick_id)
+		gtk_widget_remove_tick_callback(pacer->widget, pacer->tick_id);
+#endif
+	g_object_unref(pacer->widget);
+	cairo_region_destroy(pacer->damage);
+	pthread_mutex_destroy(&pacer->mu);
+	g_free(pacer);
+}
+
+void remmina_frame_pacer_damage(RemminaFramePacer *pacer, gint x, gint y, gint w, gint h)
+{
+	TRACE_CALL("remmina_frame_pacer_damage");
+	cairo_rectangle_int_t rect;
+	gint oldtype;
+
+	if (!pacer || w <= 0 || h <= 0)
+		return;
+
+	rect.x = x;
+	rect.y = y;
+	rect.width = w;
+	rect.height = h;
+
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	cairo_region_union_rectangle(pacer->damage, &rect);
+	remmina_frame_pacer_schedule(pacer);
+	remmina_frame_pacer_unlock(pacer, oldtype);
+}
+
+void remmina_frame_pacer_damage_region(RemminaFramePacer *pacer, const cairo_region_t *region)
+{
+	TRACE_CALL("remmina_frame_pacer_damage_region");
+	gint oldtype;
+
+	if (!pacer || cairo_region_is_empty(region))
+		return;
+
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	cairo_region_union(pacer->damage, region);
+	remmina_frame_pacer_schedule(pacer);
+	remmina_frame_pacer_unlock(pacer, oldtype);
+}
+
+void remmina_frame_pacer_frame(RemminaFramePacer *pacer)
+{
+	TRACE_CALL("remmina_frame_pacer_frame");
+	gint oldtype;
+
+	if (!pacer)
+		return;
+
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	pacer->frames++;
+	remmina_frame_pacer_unlock(pacer, oldtype);
+}
+
+void remmina_frame_pacer_paint_time(RemminaFramePacer *pacer, gint64 usec)
+{
+	TRACE_CALL("remmina_frame_pacer_paint_time");
+	if (!pacer)
+		return;
+
+	/* Painting happens on the main thread, like the ticks reading it */
+	pacer->paint_time = (pacer->paint_time * 7 + usec) / 8;
+}
+
@@ -0,0 +1,71 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINAFRAMEPACER_H__
+#define __REMMINAFRAMEPACER_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/* Presentation scheduler tied to the GdkFrameClock of a widget.
+ *
+ * Damage reported by the protocol is accumulated and handed to the plugin
+ * once per display refresh, so the widget is invalidated and painted at
+ * most at the refresh rate. When painting takes longer than a refresh
+ * interval, the following refresh cycles are skipped. Protocol frames
+ * merged into a single presentation are reported as dropped. */
+
+typedef struct _RemminaFramePacer RemminaFramePacer;
+
+/* Called on the main thread with the damage to invalidate and the number
+ * of protocol frames dropped since the previous presentation */
+typedef void (*RemminaFramePacerFunc)(gpointer data, cairo_region_t *damage, gint dropped);
+
+RemminaFramePacer* remmina_frame_pacer_new(GtkWidget *widget, RemminaFramePacerFunc func, gpointer data);
+void remmina_frame_pacer_free(RemminaFramePacer *pacer);
+
+/* The following functions may be called from any thread, and accept a NULL pacer */
+void remmina_frame_pacer_damage(RemminaFramePacer *pacer, gint x, gint y, gint w, gint h);
+void remmina_frame_pacer_damage_region(RemminaFramePacer *pacer, const cairo_region_t *region);
+/* Marks the end of a protocol frame */
+void remmina_frame_pacer_frame(RemminaFramePacer *pacer);
+/* Reports how long the widget took to paint, in microseconds */
+void remmina_frame_pacer_paint_time(RemminaFramePacer *pacer, gint64 usec);
+
+G_END_DECLS
+
+#endif /* __REMMINAFRAMEPACER_H__ */
+
@@ -0,0 +1,233 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nx_parser.h"
+#include "remmina/remmina_trace_calls.h"
+
+enum
+{
+	REMMINA_NX_PARSER_LIST_NONE,
+	/* After status 127, waiting for the "----" header underline */
+	REMMINA_NX_PARSER_LIST_HEADER,
+	REMMINA_NX_PARSER_LIST_ROWS
+};
+
+struct _RemminaNXParser
+{
+	const RemminaNXParserCallbacks *callbacks;
+	gpointer data;
+
+	/* Current unterminated line */
+	GString *line;
+	gint list_state;
+};
+
+RemminaNXParser* remmina_nx_parser_new(const RemminaNXParserCallbacks *callbacks, gpointer data)
+{
+	TRACE_CALL("remmina_nx_parser_new");
+	RemminaNXParser *parser;
+
+	parser = g_new0(RemminaNXParser, 1);
+	parser->callbacks = callbacks;
+	parser->data = data;
+	parser->line = g_string_sized_new(256);
+	return parser;
+}
+
+void remmina_nx_parser_free(RemminaNXParser *parser)
+{
+	TRACE_CALL("remmina_nx_parser_free");
+	g_string_free(parser->line, TRUE);
+	g_free(parser);
+}
+
+void remmina_nx_parser_end_session_list(RemminaNXParser *parser)
+{
+	TRACE_CALL("remmina_nx_parser_end_session_list");
+	parser->list_state = REMMINA_NX_PARSER_LIST_NONE;
+}
+
+/* Parse "NX> nnn " at the start of a line. Returns the length of the
+ * prefix, or 0 when the line does not start with a status code */
+static gsize remmina_nx_parser_status(const gchar *line, gsize len, gint *status)
+{
+	TRACE_CALL("remmina_nx_parser_status");
+	gsize i;
+
+	if (len < 6 || strncmp(line, "NX> ", 4) != 0)
+		return 0;
+	*status = 0;
+	for (i = 4; i < len && g_ascii_isdigit(line[i]); i++)
+		*status = *status * 10 + (line[i] - '0');
+	if (i == 4 || i >= len || line[i] != ' ')
+		return 0;
+	return i + 1;
+}
+
+/* "display type id options depth screen status name", the name may
+ * contain spaces */
+static void remmina_nx_parser_session(RemminaNXParser *parser, gchar *line)
+{
+	TRACE_CALL("remmina_nx_parser_session");
+	RemminaNXParserSession session = { NULL };
+	gchar *p1, *p2;
+	gint i;
+
+	p1 = line;
+	while (*p1 == ' ')
+		p1++;
+	if (*p1 == '\0')
+		return;
+
+	p1 = line;
+	for (i = 0; i < 7; i++)
+	{
+		p2 = strchr(p1, ' ');
+		if (!p2)
+			break;
+		*p2++ = '\0';
+		switch (i)
+		{
+			case 0:
+				session.display = p1;
+				break;
+			case 1:
+				session.type = p1;
+				break;
+			case 2:
+				session.id = p1;
+				break;
+			case 6:
+				session.status = p1;
+				break;
+			default:
+				break;
+		}
+		while (*p2 == ' ')
+			p2++;
+		p1 = p2;
+	}
+	if (i == 7 && *p1)
+	{
+		p2 = p1 + strlen(p1) - 1;
+		while (*p2 == ' ' && p2 > p1)
+			*p2-- = '\0';
+		session.name = p1;
+	}
+
+	if (parser->callbacks->session)
+		parser->callbacks->session(&session, parser->data);
+}
+
+static void remmina_nx_parser_line(RemminaNXParser *parser)
+{
+	TRACE_CALL("remmina_nx_parser_line");
+	GString *line = parser->line;
+	const gchar *value = NULL;
+	gchar *ptr;
+	gint status = -1;
+
+	if (line->len > 0 && line->str[line->len - 1] == '\r')
+		g_string_truncate(line, line->len - 1);
+
+	if (remmina_nx_parser_status(line->str, line->len, &status))
+	{
+		parser->list_state = (status == 127 ? REMMINA_NX_PARSER_LIST_HEADER : REMMINA_NX_PARSER_LIST_NONE);
+		ptr = strchr(line->str, ':');
+		if (ptr && ptr[1])
+			value = ptr + 2;
+	}
+
+	if (parser->callbacks->line)
+		parser->callbacks->line(line->str, status, value, parser->data);
+
+	if (status >= 0)
+		return;
+	if (parser->list_state == REMMINA_NX_PARSER_LIST_HEADER && strncmp(line->str, "----", 4) == 0)
+		parser->list_state = REMMINA_NX_PARSER_LIST_ROWS;
+	else if (parser->list_state == REMMINA_NX_PARSER_LIST_ROWS)
+		remmina_nx_parser_session(parser, line->str);
+}
+
+/* The server waits for input after a status code with no line terminator */
+static void remmina_nx_parser_prompt(RemminaNXParser *parser)
+{
+	TRACE_CALL("remmina_nx_parser_prompt");
+	gchar *prompt;
+	gsize len;
+	gint status;
+
+	len = remmina_nx_parser_status(parser->line->str, parser->line->len, &status);
+	/* Only the codes asking for input: any other line split right after
+	 * its code, such as 700 with the session id, must not lose its value */
+	if (!len || (status != 101 && status != 102 && status != 105))
+		return;
+
+	parser->list_state = REMMINA_NX_PARSER_LIST_NONE;
+	if (parser->callbacks->prompt)
+	{
+		prompt = g_strndup(parser->line->str, len);
+		parser->callbacks->prompt(prompt, status, parser->data);
+		g_free(prompt);
+	}
+	/* Whatever follows is the echo of our answer */
+	g_string_erase(parser->line, 0, len);
+}
+
+void remmina_nx_parser_feed(RemminaNXParser *parser, const gchar *buf, gsize len)
+{
+	TRACE_CALL("remmina_nx_parser_feed");
+	const gchar *nl;
+
+	while (len > 0)
+	{
+		nl = memchr(buf, '\n', len);
+		if (!nl)
+		{
+			g_string_append_len(parser->line, buf, len);
+			break;
+		}
+		g_string_append_len(parser->line, buf, nl - buf);
+		remmina_nx_parser_line(parser);
+		g_string_truncate(parser->line, 0);
+		len -= nl - buf + 1;
+		buf = nl + 1;
+	}
+	remmina_nx_parser_prompt(parser);
+}
+
@@ -0,0 +1,78 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINANXPARSER_H__
+#define __REMMINANXPARSER_H__
+
+G_BEGIN_DECLS
+
+/* Streaming parser for the NX server output. Bytes are consumed as they
+ * arrive: each byte is scanned once, and only the current unterminated
+ * line is kept. It has no dependency on the SSH session, so it can be
+ * driven from captured transcripts. */
+typedef struct _RemminaNXParser RemminaNXParser;
+
+/* A row of the session list sent after status 127 */
+typedef struct _RemminaNXParserSession
+{
+	const gchar *display;
+	const gchar *type;
+	const gchar *id;
+	const gchar *status;
+	const gchar *name;
+} RemminaNXParserSession;
+
+typedef struct _RemminaNXParserCallbacks
+{
+	/* A complete line. status is the NX status code of the line, or -1.
+	 * value is the text after "NX> nnn xxx: ", or NULL */
+	void (*line)(const gchar *line, gint status, const gchar *value, gpointer data);
+	/* A status code asking for input (101 user, 102 password, 105 command)
+	 * at the end of the output, with no line terminator, such as "NX> 105 " */
+	void (*prompt)(const gchar *prompt, gint status, gpointer data);
+	void (*session)(const RemminaNXParserSession *session, gpointer data);
+} RemminaNXParserCallbacks;
+
+RemminaNXParser* remmina_nx_parser_new(const RemminaNXParserCallbacks *callbacks, gpointer data);
+void remmina_nx_parser_free(RemminaNXParser *parser);
+
+void remmina_nx_parser_feed(RemminaNXParser *parser, const gchar *buf, gsize len);
+/* Stop reporting session list rows until the next status 127 */
+void remmina_nx_parser_end_session_list(RemminaNXParser *parser);
+
+G_END_DECLS
+
+#endif  /* __REMMINANXPARSER_H__  */
+
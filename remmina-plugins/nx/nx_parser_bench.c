@@ -0,0 +1,181 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Transcript benchmark for the NX response parser.
+ *
+ * Feeds a raw capture of the NX server output (the text the NX shell
+ * sends over the SSH channel) to the parser, first in one piece and then
+ * split at random points, and reports the parsing throughput. The events
+ * seen with random splits must match the ones seen in one piece, which
+ * makes it usable as a fuzzer of the chunk boundaries. */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nx_parser.h"
+#include "common/remmina_bench.h"
+#include "remmina/remmina_trace_calls.h"
+
+typedef struct _RemminaNXParserBench
+{
+	guint lines;
+	guint prompts;
+	guint sessions;
+	/* Running hash of the events, to compare the runs */
+	guint32 hash;
+} RemminaNXParserBench;
+
+static void remmina_nx_parser_bench_hash(RemminaNXParserBench *bench, const gchar *str)
+{
+	TRACE_CALL("remmina_nx_parser_bench_hash");
+	while (str && *str)
+		bench->hash = (bench->hash ^ (guchar) *str++) * 16777619;
+	bench->hash = (bench->hash ^ 0xff) * 16777619;
+}
+
+static void remmina_nx_parser_bench_on_line(const gchar *line, gint status, const gchar *value, gpointer data)
+{
+	TRACE_CALL("remmina_nx_parser_bench_on_line");
+	RemminaNXParserBench *bench = (RemminaNXParserBench*) data;
+
+	bench->lines++;
+	bench->hash = (bench->hash ^ (guint32) status) * 16777619;
+	remmina_nx_parser_bench_hash(bench, line);
+}
+
+static void remmina_nx_parser_bench_on_prompt(const gchar *prompt, gint status, gpointer data)
+{
+	TRACE_CALL("remmina_nx_parser_bench_on_prompt");
+	RemminaNXParserBench *bench = (RemminaNXParserBench*) data;
+
+	bench->prompts++;
+	remmina_nx_parser_bench_hash(bench, prompt);
+}
+
+static void remmina_nx_parser_bench_on_session(const RemminaNXParserSession *session, gpointer data)
+{
+	TRACE_CALL("remmina_nx_parser_bench_on_session");
+	RemminaNXParserBench *bench = (RemminaNXParserBench*) data;
+
+	bench->sessions++;
+	remmina_nx_parser_bench_hash(bench, session->display);
+	remmina_nx_parser_bench_hash(bench, session->id);
+	remmina_nx_parser_bench_hash(bench, session->name);
+}
+
+static const RemminaNXParserCallbacks remmina_nx_parser_bench_callbacks =
+{
+	remmina_nx_parser_bench_on_line,
+	remmina_nx_parser_bench_on_prompt,
+	remmina_nx_parser_bench_on_session
+};
+
+/* Feed the transcript, split in chunks of up to max_chunk bytes (0 for a
+ * single piece) */
+static void remmina_nx_parser_bench_run(RemminaNXParserBench *bench, const gchar *data, gsize len,
+		gsize max_chunk, GRand *rand)
+{
+	TRACE_CALL("remmina_nx_parser_bench_run");
+	RemminaNXParser *parser;
+	gsize n;
+
+	memset(bench, 0, sizeof(RemminaNXParserBench));
+	bench->hash = 2166136261U;
+	parser = remmina_nx_parser_new(&remmina_nx_parser_bench_callbacks, bench);
+	while (len > 0)
+	{
+		n = (max_chunk ? MIN(len, (gsize) g_rand_int_range(rand, 1, max_chunk + 1)) : len);
+		remmina_nx_parser_feed(parser, data, n);
+		data += n;
+		len -= n;
+	}
+	remmina_nx_parser_free(parser);
+}
+
+int main(int argc, char **argv)
+{
+	TRACE_CALL("main");
+	RemminaNXParserBench reference, bench;
+	RemminaBenchResult result;
+	GRand *rand;
+	gchar *data;
+	gsize len;
+	gint iterations, i;
+	gint failures = 0;
+	gint split_prompts = 0;
+
+	if (argc < 2)
+	{
+		g_printerr("Usage: %s <transcript> [iterations]\n", argv[0]);
+		return 1;
+	}
+	if (!g_file_get_contents(argv[1], &data, &len, NULL))
+	{
+		g_printerr("Unable to read %s\n", argv[1]);
+		return 1;
+	}
+	iterations = (argc > 2 ? atoi(argv[2]) : 1000);
+	rand = g_rand_new_with_seed(1);
+
+	remmina_nx_parser_bench_run(&reference, data, len, 0, NULL);
+
+	remmina_bench_start(&result);
+	for (i = 0; i < iterations; i++)
+	{
+		/* From byte by byte to full SSH packets */
+		remmina_nx_parser_bench_run(&bench, data, len, (i % 2 ? 32768 : 1 + i % 64), rand);
+		/* A 101, 102 or 105 line split right after its code is taken for a
+		 * prompt, as it would be from the server: such runs are only counted */
+		if (bench.prompts != reference.prompts)
+			split_prompts++;
+		else if (bench.lines != reference.lines || bench.sessions != reference.sessions
+				|| bench.hash != reference.hash)
+			failures++;
+		result.frames++;
+	}
+	remmina_bench_stop(&result);
+
+	remmina_bench_report(argv[1], &result);
+	g_print("lines        %u\n", reference.lines);
+	g_print("sessions     %u\n", reference.sessions);
+	g_print("throughput   %.1f MB/s\n", result.wall > 0 ? (gdouble) len * result.frames / result.wall : 0);
+	g_print("split codes  %d\n", split_prompts);
+	g_print("mismatches   %d\n", failures);
+
+	g_rand_free(rand);
+	g_free(data);
+	return (failures ? 1 : 0);
+}
+
@@ -0,0 +1,428 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <libssh/libssh.h>
+#include <libssh/callbacks.h>
+#include "nx_relay.h"
+#include "remmina/remmina_trace_calls.h"
+
+/* Bounds of the ring buffers, which follow the initial channel window */
+#define REMMINA_NX_RELAY_BUFFER_MIN (32 * 1024)
+#define REMMINA_NX_RELAY_BUFFER_MAX (2 * 1024 * 1024)
+
+typedef struct _RemminaNXRelayBuffer
+{
+	gchar *data;
+	gsize size;
+	gsize head;
+	gsize len;
+} RemminaNXRelayBuffer;
+
+struct _RemminaNXRelay
+{
+	ssh_session session;
+	ssh_channel channel;
+	struct ssh_channel_callbacks_struct callbacks;
+	ssh_event event;
+
+	gint sock;
+	/* Events the socket is currently registered for */
+	short sock_events;
+
+	/* Local socket to channel */
+	RemminaNXRelayBuffer up;
+	/* Channel to local socket */
+	RemminaNXRelayBuffer down;
+
+	gboolean sock_eof;
+	gboolean channel_eof;
+	gboolean error;
+
+	/* Written by remmina_nx_relay_stop() to wake up the poll */
+	gint wakeup[2];
+	volatile gint stopped;
+};
+
+static void remmina_nx_relay_buffer_init(RemminaNXRelayBuffer *buffer, gsize size)
+{
+	TRACE_CALL("remmina_nx_relay_buffer_init");
+	buffer->data = g_malloc(size);
+	buffer->size = size;
+	buffer->head = 0;
+	buffer->len = 0;
+}
+
+/* Contiguous bytes available for reading */
+static gsize remmina_nx_relay_buffer_peek(RemminaNXRelayBuffer *buffer, gchar **ptr)
+{
+	TRACE_CALL("remmina_nx_relay_buffer_peek");
+	*ptr = buffer->data + buffer->head;
+	return MIN(buffer->len, buffer->size - buffer->head);
+}
+
+static void remmina_nx_relay_buffer_consume(RemminaNXRelayBuffer *buffer, gsize len)
+{
+	TRACE_CALL("remmina_nx_relay_buffer_consume");
+	buffer->len -= len;
+	/* Rewind when empty, so that later reads stay contiguous */
+	buffer->head = (buffer->len ? (buffer->head + len) % buffer->size : 0);
+}
+
+/* Contiguous free space available for writing */
+static gsize remmina_nx_relay_buffer_reserve(RemminaNXRelayBuffer *buffer, gchar **ptr)
+{
+	TRACE_CALL("remmina_nx_relay_buffer_reserve");
+	gsize tail;
+
+	tail = (buffer->head + buffer->len) % buffer->size;
+	*ptr = buffer->data + tail;
+	if (tail < buffer->head)
+		return buffer->head - tail;
+	return MIN(buffer->size - buffer->len, buffer->size - tail);
+}
+
+static gsize remmina_nx_relay_buffer_append(RemminaNXRelayBuffer *buffer, const gchar *data, gsize len)
+{
+	TRACE_CALL("remmina_nx_relay_buffer_append");
+	gchar *ptr;
+	gsize done = 0;
+	gsize n;
+
+	while (done < len && (n = remmina_nx_relay_buffer_reserve(buffer, &ptr)) > 0)
+	{
+		n = MIN(n, len - done);
+		memcpy(ptr, data + done, n);
+		buffer->len += n;
+		done += n;
+	}
+	return done;
+}
+
+static int remmina_nx_relay_on_channel_data(ssh_session session, ssh_channel channel, void *data, uint32_t len,
+		int is_stderr, void *userdata)
+{
+	TRACE_CALL("remmina_nx_relay_on_channel_data");
+	RemminaNXRelay *relay = (RemminaNXRelay*) userdata;
+
+	/* FreeNX may send diagnostics on stderr, they are dropped */
+	if (is_stderr)
+		return len;
+	/* Whatever does not fit is kept by libssh, and the channel window
+	 * is not grown until it is read */
+	return remmina_nx_relay_buffer_append(&relay->down, (const gchar*) data, len);
+}
+
+static void remmina_nx_relay_on_channel_eof(ssh_session session, ssh_channel channel, void *userdata)
+{
+	TRACE_CALL("remmina_nx_relay_on_channel_eof");
+	RemminaNXRelay *relay = (RemminaNXRelay*) userdata;
+
+	relay->channel_eof = TRUE;
+}
+
+static int remmina_nx_relay_on_wakeup(socket_t fd, int revents, void *userdata)
+{
+	TRACE_CALL("remmina_nx_relay_on_wakeup");
+	gchar buf[16];
+
+	while (read(fd, buf, sizeof(buf)) > 0);
+	return 0;
+}
+
+static void remmina_nx_relay_read_socket(RemminaNXRelay *relay)
+{
+	TRACE_CALL("remmina_nx_relay_read_socket");
+	gchar *ptr;
+	gsize len;
+	ssize_t n;
+
+	while ((len = remmina_nx_relay_buffer_reserve(&relay->up, &ptr)) > 0)
+	{
+		n = read(relay->sock, ptr, len);
+		if (n > 0)
+		{
+			relay->up.len += n;
+			continue;
+		}
+		if (n == 0)
+			relay->sock_eof = TRUE;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			relay->error = TRUE;
+		break;
+	}
+}
+
+static void remmina_nx_relay_write_socket(RemminaNXRelay *relay)
+{
+	TRACE_CALL("remmina_nx_relay_write_socket");
+	gchar *ptr;
+	gsize len;
+	ssize_t n;
+
+	while ((len = remmina_nx_relay_buffer_peek(&relay->down, &ptr)) > 0)
+	{
+		n = write(relay->sock, ptr, len);
+		if (n > 0)
+		{
+			remmina_nx_relay_buffer_consume(&relay->down, n);
+			continue;
+		}
+		if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			relay->error = TRUE;
+		break;
+	}
+}
+
+static int remmina_nx_relay_on_socket(socket_t fd, int revents, void *userdata)
+{
+	TRACE_CALL("remmina_nx_relay_on_socket");
+	RemminaNXRelay *relay = (RemminaNXRelay*) userdata;
+
+	if (revents & POLLOUT)
+		remmina_nx_relay_write_socket(relay);
+	if (revents & (POLLIN | POLLHUP))
+		remmina_nx_relay_read_socket(relay);
+	if (revents & (POLLERR | POLLNVAL))
+		relay->error = TRUE;
+	return 0;
+}
+
+/* Move data which does not need the socket or the session to be ready */
+static void remmina_nx_relay_pump(RemminaNXRelay *relay)
+{
+	TRACE_CALL("remmina_nx_relay_pump");
+	gchar *ptr;
+	gsize len;
+	uint32_t window;
+	gint n;
+
+	/* Local socket to channel, within the remote window: the rest waits
+	 * for a window adjust message, which wakes up the poll */
+	while ((len = remmina_nx_relay_buffer_peek(&relay->up, &ptr)) > 0)
+	{
+		window = ssh_channel_window_size(relay->channel);
+		if (window == 0)
+			break;
+		n = ssh_channel_write(relay->channel, ptr, MIN(len, window));
+		if (n == SSH_ERROR)
+		{
+			relay->error = TRUE;
+			return;
+		}
+		if (n == 0)
+			break;
+		remmina_nx_relay_buffer_consume(&relay->up, n);
+	}
+
+	/* Data libssh kept when the down buffer was full */
+	while ((len = remmina_nx_relay_buffer_reserve(&relay->down, &ptr)) > 0
+			&& ssh_channel_poll(relay->channel, 0) > 0)
+	{
+		n = ssh_channel_read_nonblocking(relay->channel, ptr, len, 0);
+		if (n == SSH_ERROR)
+		{
+			relay->error = TRUE;
+			return;
+		}
+		if (n <= 0)
+			break;
+		relay->down.len += n;
+	}
+
+	remmina_nx_relay_write_socket(relay);
+}
+
+/* Only poll the socket for what the buffers can take */
+static void remmina_nx_relay_update_events(RemminaNXRelay *relay)
+{
+	TRACE_CALL("remmina_nx_relay_update_events");
+	short events = 0;
+
+	if (!relay->sock_eof && relay->up.len < relay->up.size)
+		events |= POLLIN;
+	if (relay->down.len > 0)
+		events |= POLLOUT;
+	if (events == relay->sock_events)
+		return;
+
+	if (relay->sock_events)
+		ssh_event_remove_fd(relay->event, relay->sock);
+	if (events)
+		ssh_event_add_fd(relay->event, relay->sock, events, remmina_nx_relay_on_socket, relay);
+	relay->sock_events = events;
+}
+
+RemminaNXRelay* remmina_nx_relay_new(ssh_session session, ssh_channel channel)
+{
+	TRACE_CALL("remmina_nx_relay_new");
+	RemminaNXRelay *relay;
+	gsize size;
+
+	relay = g_new0(RemminaNXRelay, 1);
+	relay->session = session;
+	relay->channel = channel;
+	relay->sock = -1;
+
+	if (pipe(relay->wakeup) != 0)
+	{
+		g_free(relay);
+		return NULL;
+	}
+	fcntl(relay->wakeup[0], F_SETFL, fcntl(relay->wakeup[0], F_GETFL) | O_NONBLOCK);
+	fcntl(relay->wakeup[1], F_SETFL, fcntl(relay->wakeup[1], F_GETFL) | O_NONBLOCK);
+
+	size = CLAMP(ssh_channel_window_size(channel), REMMINA_NX_RELAY_BUFFER_MIN, REMMINA_NX_RELAY_BUFFER_MAX);
+	remmina_nx_relay_buffer_init(&relay->up, size);
+	remmina_nx_relay_buffer_init(&relay->down, size);
+
+	return relay;
+}
+
+void remmina_nx_relay_free(RemminaNXRelay *relay)
+{
+	TRACE_CALL("remmina_nx_relay_free");
+	close(relay->wakeup[0]);
+	close(relay->wakeup[1]);
+	g_free(relay->up.data);
+	g_free(relay->down.data);
+	g_free(relay);
+}
+
+void remmina_nx_relay_stop(RemminaNXRelay *relay)
+{
+	TRACE_CALL("remmina_nx_relay_stop");
+	g_atomic_int_set(&relay->stopped, 1);
+	if (write(relay->wakeup[1], "", 1) < 0)
+	{
+		/* The pipe is full, the relay is being woken up anyway */
+	}
+}
+
+gint remmina_nx_relay_accept(RemminaNXRelay *relay, gint server_sock)
+{
+	TRACE_CALL("remmina_nx_relay_accept");
+	struct pollfd fds[2];
+
+	fds[0].fd = server_sock;
+	fds[0].events = POLLIN;
+	fds[1].fd = relay->wakeup[0];
+	fds[1].events = POLLIN;
+
+	while (!g_atomic_int_get(&relay->stopped))
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (fds[0].revents & POLLIN)
+			return accept(server_sock, NULL, NULL);
+		if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+			return -1;
+	}
+	return -1;
+}
+
+gboolean remmina_nx_relay_run(RemminaNXRelay *relay, gint sock)
+{
+	TRACE_CALL("remmina_nx_relay_run");
+	gint flags;
+
+	relay->sock = sock;
+	relay->sock_events = 0;
+	flags = fcntl(sock, F_GETFL);
+	fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+	ssh_callbacks_init(&relay->callbacks);
+	relay->callbacks.userdata = relay;
+	relay->callbacks.channel_data_function = remmina_nx_relay_on_channel_data;
+	relay->callbacks.channel_eof_function = remmina_nx_relay_on_channel_eof;
+	ssh_set_channel_callbacks(relay->channel, &relay->callbacks);
+	ssh_set_blocking(relay->session, 0);
+
+	relay->event = ssh_event_new();
+	ssh_event_add_session(relay->event, relay->session);
+	ssh_event_add_fd(relay->event, relay->wakeup[0], POLLIN, remmina_nx_relay_on_wakeup, relay);
+
+	/* Anything received while the session was still in use for the NX
+	 * handshake is already buffered by libssh */
+	remmina_nx_relay_pump(relay);
+
+	while (!g_atomic_int_get(&relay->stopped) && !relay->error)
+	{
+		/* Closing handshake: forward the EOF once the pending data has
+		 * been delivered, in each direction */
+		if (relay->sock_eof && relay->up.len == 0)
+		{
+			ssh_channel_send_eof(relay->channel);
+			break;
+		}
+		if ((relay->channel_eof || ssh_channel_is_eof(relay->channel)) && relay->down.len == 0
+				&& ssh_channel_poll(relay->channel, 0) <= 0)
+		{
+			break;
+		}
+
+		remmina_nx_relay_update_events(relay);
+		if (ssh_event_dopoll(relay->event, -1) == SSH_ERROR)
+		{
+			relay->error = TRUE;
+			break;
+		}
+		remmina_nx_relay_pump(relay);
+	}
+
+	if (relay->sock_events)
+		ssh_event_remove_fd(relay->event, relay->sock);
+	ssh_event_remove_fd(relay->event, relay->wakeup[0]);
+	ssh_event_remove_session(relay->event, relay->session);
+	ssh_event_free(relay->event);
+	relay->event = NULL;
+	relay->sock_events = 0;
+
+	ssh_set_blocking(relay->session, 1);
+	fcntl(sock, F_SETFL, flags);
+	relay->sock = -1;
+
+	return !relay->error;
+}
+
@@ -0,0 +1,65 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINANXRELAY_H__
+#define __REMMINANXRELAY_H__
+
+#include <libssh/libssh.h>
+
+G_BEGIN_DECLS
+
+/* Relay between a local socket and an SSH channel, driven by the libssh
+ * event loop. Each direction goes through a ring buffer sized to the
+ * channel window: when one is full, the relay stops reading from its
+ * source instead of blocking on writes. */
+typedef struct _RemminaNXRelay RemminaNXRelay;
+
+RemminaNXRelay* remmina_nx_relay_new(ssh_session session, ssh_channel channel);
+void remmina_nx_relay_free(RemminaNXRelay *relay);
+
+/* Wait for a connection on a listening socket. Returns -1 on error or
+ * when the relay has been stopped */
+gint remmina_nx_relay_accept(RemminaNXRelay *relay, gint server_sock);
+/* Relay data until one side closes, an error occurs or the relay is
+ * stopped. The socket is left open. Returns FALSE on error */
+gboolean remmina_nx_relay_run(RemminaNXRelay *relay, gint sock);
+/* Make remmina_nx_relay_accept() or remmina_nx_relay_run() return as soon
+ * as possible. Can be called from any thread */
+void remmina_nx_relay_stop(RemminaNXRelay *relay);
+
+G_END_DECLS
+
+#endif  /* __REMMINANXRELAY_H__  */
+
@@ -0,0 +1,267 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Loopback benchmark for the NX tunnel relay.
+ *
+ * Connects to an SSH server (localhost by default, authenticating with
+ * the user's keys or agent), forwards a channel to an echo server run by
+ * the benchmark itself, and relays a local socket through it as the NX
+ * tunnel does. Messages are sent one at a time and waited for, giving
+ * the round trip latency distribution and the relayed throughput.
+ *
+ * REMMINA_BENCH_SSH_HOST, REMMINA_BENCH_SSH_PORT and REMMINA_BENCH_SSH_USER
+ * select the SSH server. */
+
+#include <glib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <libssh/libssh.h>
+#include "nx_relay.h"
+#include "common/remmina_bench.h"
+#include "remmina/remmina_trace_calls.h"
+
+typedef struct _RemminaNXBench
+{
+	RemminaNXRelay *relay;
+	gint relay_sock;
+	gint echo_sock;
+} RemminaNXBench;
+
+static gboolean remmina_nx_bench_write_all(gint fd, const gchar *buf, gsize len)
+{
+	TRACE_CALL("remmina_nx_bench_write_all");
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+		buf += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+static gboolean remmina_nx_bench_read_all(gint fd, gchar *buf, gsize len)
+{
+	TRACE_CALL("remmina_nx_bench_read_all");
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = read(fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+		buf += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+static gpointer remmina_nx_bench_echo(gpointer data)
+{
+	TRACE_CALL("remmina_nx_bench_echo");
+	RemminaNXBench *bench = (RemminaNXBench*) data;
+	gchar buf[65536];
+	ssize_t n;
+	gint sock;
+
+	sock = accept(bench->echo_sock, NULL, NULL);
+	if (sock < 0)
+		return NULL;
+	while ((n = read(sock, buf, sizeof(buf))) > 0)
+	{
+		if (!remmina_nx_bench_write_all(sock, buf, n))
+			break;
+	}
+	close(sock);
+	return NULL;
+}
+
+static gpointer remmina_nx_bench_relay(gpointer data)
+{
+	TRACE_CALL("remmina_nx_bench_relay");
+	RemminaNXBench *bench = (RemminaNXBench*) data;
+
+	if (!remmina_nx_relay_run(bench->relay, bench->relay_sock))
+		g_printerr("Relay error\n");
+	return NULL;
+}
+
+static gint remmina_nx_bench_compare(gconstpointer a, gconstpointer b)
+{
+	TRACE_CALL("remmina_nx_bench_compare");
+	gint64 x = *(const gint64*) a;
+	gint64 y = *(const gint64*) b;
+
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+	TRACE_CALL("main");
+	RemminaNXBench bench;
+	RemminaBenchResult result;
+	const gchar *host, *user, *port;
+	ssh_session session;
+	ssh_channel channel;
+	struct sockaddr_in sin;
+	socklen_t sinlen = sizeof(sin);
+	pthread_t echo_thread, relay_thread;
+	gint sv[2];
+	gint size, count, i;
+	gint64 *rtt;
+	gint64 t;
+	gchar *out, *in;
+	gchar *name;
+
+	size = (argc > 1 ? atoi(argv[1]) : 4096);
+	count = (argc > 2 ? atoi(argv[2]) : 10000);
+	if (size <= 0 || count <= 0)
+	{
+		g_printerr("Usage: %s [message size] [message count]\n", argv[0]);
+		return 1;
+	}
+
+	/* Echo server on an ephemeral loopback port */
+	bench.echo_sock = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (bench.echo_sock < 0 || bind(bench.echo_sock, (struct sockaddr*) &sin, sizeof(sin))
+			|| listen(bench.echo_sock, 1) || getsockname(bench.echo_sock, (struct sockaddr*) &sin, &sinlen))
+	{
+		g_printerr("Failed to start the echo server\n");
+		return 1;
+	}
+	pthread_create(&echo_thread, NULL, remmina_nx_bench_echo, &bench);
+
+	host = g_getenv("REMMINA_BENCH_SSH_HOST");
+	port = g_getenv("REMMINA_BENCH_SSH_PORT");
+	user = g_getenv("REMMINA_BENCH_SSH_USER");
+
+	session = ssh_new();
+	ssh_options_set(session, SSH_OPTIONS_HOST, host ? host : "localhost");
+	if (port)
+		ssh_options_set(session, SSH_OPTIONS_PORT_STR, port);
+	if (user)
+		ssh_options_set(session, SSH_OPTIONS_USER, user);
+	if (ssh_connect(session) != SSH_OK || ssh_userauth_publickey_auto(session, NULL, NULL) != SSH_AUTH_SUCCESS)
+	{
+		g_printerr("SSH connection failed: %s\n", ssh_get_error(session));
+		return 1;
+	}
+
+	channel = ssh_channel_new(session);
+	if (ssh_channel_open_forward(channel, "127.0.0.1", ntohs(sin.sin_port), "127.0.0.1", 0) != SSH_OK)
+	{
+		g_printerr("Failed to open the forwarded channel: %s\n", ssh_get_error(session));
+		return 1;
+	}
+
+	/* The other end of the pair plays nxproxy */
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return 1;
+	bench.relay = remmina_nx_relay_new(session, channel);
+	bench.relay_sock = sv[0];
+	if (!bench.relay)
+		return 1;
+	pthread_create(&relay_thread, NULL, remmina_nx_bench_relay, &bench);
+
+	out = g_malloc(size);
+	in = g_malloc(size);
+	for (i = 0; i < size; i++)
+		out[i] = (gchar) g_random_int();
+	rtt = g_new(gint64, count);
+
+	remmina_bench_start(&result);
+	for (i = 0; i < count; i++)
+	{
+		t = g_get_monotonic_time();
+		if (!remmina_nx_bench_write_all(sv[1], out, size) || !remmina_nx_bench_read_all(sv[1], in, size))
+		{
+			g_printerr("Relay closed after %d messages\n", i);
+			break;
+		}
+		rtt[i] = g_get_monotonic_time() - t;
+		result.frames++;
+	}
+	remmina_bench_stop(&result);
+
+	if (result.frames > 0 && memcmp(in, out, size) != 0)
+		g_printerr("Echoed data does not match\n");
+
+	name = g_strdup_printf("ssh://%s echo, %d byte messages", host ? host : "localhost", size);
+	remmina_bench_report(name, &result);
+	g_free(name);
+	if (result.frames > 0)
+	{
+		qsort(rtt, result.frames, sizeof(gint64), remmina_nx_bench_compare);
+		g_print("rtt p50      %" G_GINT64_FORMAT " us\n", rtt[result.frames / 2]);
+		g_print("rtt p99      %" G_GINT64_FORMAT " us\n", rtt[result.frames * 99 / 100]);
+		g_print("rtt max      %" G_GINT64_FORMAT " us\n", rtt[result.frames - 1]);
+		g_print("throughput   %.1f MB/s\n", result.wall > 0 ? 2.0 * size * result.frames / result.wall : 0);
+	}
+
+	/* Shutdown handshake, as remmina_nx_session_free() does */
+	remmina_nx_relay_stop(bench.relay);
+	pthread_join(relay_thread, NULL);
+	close(sv[1]);
+	close(sv[0]);
+	ssh_channel_close(channel);
+	ssh_channel_free(channel);
+	remmina_nx_relay_free(bench.relay);
+	pthread_join(echo_thread, NULL);
+	close(bench.echo_sock);
+	ssh_disconnect(session);
+	ssh_free(session);
+
+	g_free(rtt);
+	g_free(out);
+	g_free(in);
+	return 0;
+}
+
@@ -39,6 +39,8 @@
 #include <glib/gstdio.h>
 #include <libssh/libssh.h>
 #include "nx_session.h"
+#include "nx_relay.h"
+#include "nx_parser.h"
 
 /* Some missing stuff in libssh */
 #define REMMINA_SSH_TYPE_DSS 1
@@ -102,15 +104,16 @@ struct _RemminaNXSession
 
 	/* Tunnel related members */
 	pthread_t thread;
-	gboolean running;
+	RemminaNXRelay *relay;
 	gint server_sock;
 
 	/* NX related members */
 	GHashTable *session_parameters;
 
-	GString *response;
-	gint response_pos;
+	RemminaNXParser *parser;
 	gint status;
+	/* Status code the server is waiting at, see remmina_nx_session_on_prompt() */
+	gint prompt_status;
 	gint encryption;
 	gint localport;
 
@@ -121,12 +124,15 @@ struct _RemminaNXSession
 
 	gboolean allow_start;
 	GtkListStore *session_list;
-	gint session_list_state;
+	/* Rows parsed from the last chunk, added to session_list at once */
+	GPtrArray *session_rows;
 
 	GPid proxy_pid;
 	guint proxy_watch_source;
 };
 
+static const RemminaNXParserCallbacks remmina_nx_session_parser_callbacks;
+
 RemminaNXSession*
 remmina_nx_session_new(void)
 {
@@ -136,8 +142,10 @@ remmina_nx_session_new(void)
 	nx = g_new0(RemminaNXSession, 1);
 
 	nx->session_parameters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
-	nx->response = g_string_new(NULL);
+	nx->parser = remmina_nx_parser_new(&remmina_nx_session_parser_callbacks, nx);
 	nx->status = -1;
+	nx->prompt_status = -1;
+	nx->session_rows = g_ptr_array_new_with_free_func((GDestroyNotify) g_strfreev);
 	nx->encryption = 1;
 	nx->server_sock = -1;
 
@@ -163,8 +171,7 @@ void remmina_nx_session_free(RemminaNXSession *nx)
 	thread = nx->thread;
 	if (thread)
 	{
-		nx->running = FALSE;
-		pthread_cancel(thread);
+		remmina_nx_relay_stop(nx->relay);
 		pthread_join(thread, NULL);
 		nx->thread = 0;
 	}
@@ -173,6 +180,12 @@ void remmina_nx_session_free(RemminaNXSession *nx)
 		ssh_channel_close(nx->channel);
 		ssh_channel_free(nx->channel);
 	}
+	/* After the channel, which keeps a pointer to the relay callbacks */
+	if (nx->relay)
+	{
+		remmina_nx_relay_free(nx->relay);
+		nx->relay = NULL;
+	}
 	if (nx->server_sock >= 0)
 	{
 		close(nx->server_sock);
@@ -182,7 +195,8 @@ void remmina_nx_session_free(RemminaNXSession *nx)
 	g_free(nx->server);
 	g_free(nx->error);
 	g_hash_table_destroy(nx->session_parameters);
-	g_string_free(nx->response, TRUE);
+	remmina_nx_parser_free(nx->parser);
+	g_ptr_array_free(nx->session_rows, TRUE);
 	g_free(nx->version);
 	g_free(nx->session_id);
 	g_free(nx->proxy_cookie);
@@ -263,12 +277,31 @@ void remmina_nx_session_set_log_callback(RemminaNXSession *nx, RemminaNXLogCallb
 	nx->log_callback = log_callback;
 }
 
+static void remmina_nx_session_flush_session_rows(RemminaNXSession *nx)
+{
+	TRACE_CALL("remmina_nx_session_flush_session_rows");
+	gchar **row;
+	guint i;
+
+	for (i = 0; i < nx->session_rows->len; i++)
+	{
+		row = (gchar**) g_ptr_array_index(nx->session_rows, i);
+		gtk_list_store_insert_with_values(nx->session_list, NULL, -1,
+				REMMINA_NX_SESSION_COLUMN_DISPLAY, row[REMMINA_NX_SESSION_COLUMN_DISPLAY],
+				REMMINA_NX_SESSION_COLUMN_TYPE, row[REMMINA_NX_SESSION_COLUMN_TYPE],
+				REMMINA_NX_SESSION_COLUMN_ID, row[REMMINA_NX_SESSION_COLUMN_ID],
+				REMMINA_NX_SESSION_COLUMN_STATUS, row[REMMINA_NX_SESSION_COLUMN_STATUS],
+				REMMINA_NX_SESSION_COLUMN_NAME, row[REMMINA_NX_SESSION_COLUMN_NAME], -1);
+	}
+	g_ptr_array_set_size(nx->session_rows, 0);
+}
+
 static gboolean remmina_nx_session_get_response(RemminaNXSession *nx)
 {
 	TRACE_CALL("remmina_nx_session_get_response");
 	struct timeval timeout;
 	ssh_channel ch[2];
-	ssh_buffer buffer;
+	gchar buffer[4096];
 	gint len;
 	gint is_stderr;
 
@@ -294,88 +327,51 @@ static gboolean remmina_nx_session_get_response(RemminaNXSession *nx)
 	if (is_stderr > 1)
 		return FALSE;
 
-	buffer = buffer_new();
-	len = channel_read_buffer(nx->channel, buffer, len, is_stderr);
-	if (len <= 0)
-	{
-		remmina_nx_session_set_application_error(nx, "Channel closed.");
-		return FALSE;
-	}
-	if (len > 0)
+	/* Everything already received, the parser only keeps the last unterminated line */
+	while (len > 0)
 	{
-		g_string_append_len(nx->response, (const gchar*) buffer_get(buffer), len);
+		len = ssh_channel_read_nonblocking(nx->channel, buffer, sizeof(buffer), is_stderr);
+		if (len < 0)
+		{
+			remmina_nx_session_set_application_error(nx, "Channel closed.");
+			return FALSE;
+		}
+		remmina_nx_parser_feed(nx->parser, buffer, len);
 	}
 
-	buffer_free(buffer);
+	if (nx->session_rows->len > 0)
+		remmina_nx_session_flush_session_rows(nx);
 	return TRUE;
 }
 
-static void remmina_nx_session_parse_session_list_line(RemminaNXSession *nx, const gchar *line)
+static void remmina_nx_session_on_session(const RemminaNXParserSession *session, gpointer data)
 {
-	TRACE_CALL("remmina_nx_session_parse_session_list_line");
-	gchar *p1, *p2;
-	gchar *val;
-	gint i;
-	GtkTreeIter iter;
+	TRACE_CALL("remmina_nx_session_on_session");
+	RemminaNXSession *nx = (RemminaNXSession*) data;
+	gchar **row;
 
-	p1 = (char*) line;
-	while (*p1 == ' ')
-		p1++;
-	if (*p1 == '\0')
+	if (!nx->session_list)
 		return;
 
-	gtk_list_store_append(nx->session_list, &iter);
-
-	p1 = (char*) line;
-	for (i = 0; i < 7; i++)
-	{
-		p2 = strchr(p1, ' ');
-		if (!p2)
-			return;
-		val = g_strndup(p1, (gint)(p2 - p1));
-		switch (i)
-		{
-			case 0:
-				gtk_list_store_set(nx->session_list, &iter, REMMINA_NX_SESSION_COLUMN_DISPLAY, val, -1);
-				break;
-			case 1:
-				gtk_list_store_set(nx->session_list, &iter, REMMINA_NX_SESSION_COLUMN_TYPE, val, -1);
-				break;
-			case 2:
-				gtk_list_store_set(nx->session_list, &iter, REMMINA_NX_SESSION_COLUMN_ID, val, -1);
-				break;
-			case 6:
-				gtk_list_store_set(nx->session_list, &iter, REMMINA_NX_SESSION_COLUMN_STATUS, val, -1);
-				break;
-			default:
-				break;
-		}
-		g_free(val);
-
-		while (*p2 == ' ')
-			p2++;
-		p1 = p2;
-	}
-	/* The last name column might contains space so it's not in the above loop. We simply rtrim it here. */
-	i = strlen(p1);
-	if (i < 1)
-		return;
-	p2 = p1 + i - 1;
-	while (*p2 == ' ' && p2 > p1)
-		p2--;
-	val = g_strndup(p1, (gint)(p2 - p1 + 1));
-	gtk_list_store_set(nx->session_list, &iter, REMMINA_NX_SESSION_COLUMN_NAME, val, -1);
-	g_free(val);
+	row = g_new0(gchar*, REMMINA_NX_SESSION_N_COLUMNS + 1);
+	/* g_strfreev() stops at the first NULL, missing columns are empty */
+	row[REMMINA_NX_SESSION_COLUMN_DISPLAY] = g_strdup(session->display ? session->display : "");
+	row[REMMINA_NX_SESSION_COLUMN_TYPE] = g_strdup(session->type ? session->type : "");
+	row[REMMINA_NX_SESSION_COLUMN_ID] = g_strdup(session->id ? session->id : "");
+	row[REMMINA_NX_SESSION_COLUMN_STATUS] = g_strdup(session->status ? session->status : "");
+	row[REMMINA_NX_SESSION_COLUMN_NAME] = g_strdup(session->name ? session->name : "");
+	g_ptr_array_add(nx->session_rows, row);
 }
 
-static gint remmina_nx_session_parse_line(RemminaNXSession *nx, const gchar *line, gchar **valueptr)
+static void remmina_nx_session_on_line(const gchar *line, gint status, const gchar *value, gpointer data)
 {
-	TRACE_CALL("remmina_nx_session_parse_line");
+	TRACE_CALL("remmina_nx_session_on_line");
+	RemminaNXSession *nx = (RemminaNXSession*) data;
 	gchar *s;
 	gchar *ptr;
-	gint status;
 
-	*valueptr = NULL;
+	if (nx->log_callback)
+		nx->log_callback("[NX] %s\n", line);
 
 	/* Get the server version from the initial line */
 	if (!nx->version)
@@ -399,129 +395,71 @@ static gint remmina_nx_session_parse_line(RemminaNXSession *nx, const gchar *lin
 				*ptr = '\0';
 		}
 		g_free(s);
-		return nx->status;
+		return;
 	}
 
-	if (sscanf(line, "NX> %i ", &status) < 1)
+	if (status < 0)
+		return;
+
+	if (status == 500)
 	{
-		if (nx->session_list_state && nx->session_list)
+		/* 500: Last operation failed. Should be ignored. */
+	}
+	else
+		if (status >= 400 && status <= 599)
+		{
+			remmina_nx_session_set_application_error(nx, "%s", line);
+		}
+		else
 		{
-			if (nx->session_list_state == 1 && strncmp(line, "----", 4) == 0)
+			switch (status)
 			{
-				nx->session_list_state = 2;
+				case 700:
+					g_free(nx->session_id);
+					nx->session_id = g_strdup(value);
+					break;
+				case 705:
+					nx->session_display = (value ? atoi(value) : 0);
+					break;
+				case 701:
+					g_free(nx->proxy_cookie);
+					nx->proxy_cookie = g_strdup(value);
+					break;
+				case 148: /* Server capacity not reached for user xxx */
+					nx->allow_start = TRUE;
+					break;
 			}
-			else
-				if (nx->session_list_state == 2)
-				{
-					remmina_nx_session_parse_session_list_line(nx, line);
-				}
-			return -1;
 		}
-		return nx->status;
-	}
 
-	nx->session_list_state = 0;
 	nx->status = status;
-	ptr = strchr(line, ':');
-	if (!ptr)
-		return status;
-	*valueptr = ptr + 2;
-	return status;
 }
 
-static gchar*
-remmina_nx_session_get_line(RemminaNXSession *nx)
+static void remmina_nx_session_on_prompt(const gchar *prompt, gint status, gpointer data)
 {
-	TRACE_CALL("remmina_nx_session_get_line");
-	gchar *line;
-	gchar *pos, *ptr;
-	gint len;
-	gint l;
-
-	if (nx->response_pos >= nx->response->len)
-		return NULL;
-
-	pos = nx->response->str + nx->response_pos;
-	if ((ptr = strchr(pos, '\n')) == NULL)
-		return NULL;
-
-	len = ((gint)(ptr - pos)) + 1;
-	line = g_strndup(pos, len - 1);
-
-	l = strlen(line);
-	if (l > 0 && line[l - 1] == '\r')
-	{
-		line[l - 1] = '\0';
-	}
-
-	nx->response_pos += len;
+	TRACE_CALL("remmina_nx_session_on_prompt");
+	RemminaNXSession *nx = (RemminaNXSession*) data;
 
-	return line;
+	if (nx->log_callback)
+		nx->log_callback("[NX] %s\n", prompt);
+	nx->prompt_status = status;
 }
 
+static const RemminaNXParserCallbacks remmina_nx_session_parser_callbacks =
+{
+	remmina_nx_session_on_line,
+	remmina_nx_session_on_prompt,
+	remmina_nx_session_on_session
+};
+
+/* Status reached since the last call: the prompt the server waits at, or
+ * the last status line. -1 when nothing new has been received */
 static gint remmina_nx_session_parse_response(RemminaNXSession *nx)
 {
 	TRACE_CALL("remmina_nx_session_parse_response");
-	gchar *line;
-	gchar *pos, *p;
-	gint status = -1;
-
-	if (nx->response_pos >= nx->response->len)
-		return -1;
-
-	while ((line = remmina_nx_session_get_line(nx)) != NULL)
-	{
-		if (nx->log_callback)
-			nx->log_callback("[NX] %s\n", line);
-
-		status = remmina_nx_session_parse_line(nx, line, &p);
-		if (status == 500)
-		{
-			/* 500: Last operation failed. Should be ignored. */
-		}
-		else
-			if (status >= 400 && status <= 599)
-			{
-				remmina_nx_session_set_application_error(nx, "%s", line);
-			}
-			else
-			{
-				switch (status)
-				{
-					case 127: /* Session list */
-						nx->session_list_state = 1;
-						break;
-					case 148: /* Server capacity not reached for user xxx */
-						nx->session_list_state = 0;
-						nx->allow_start = TRUE;
-						break;
-					case 700:
-						nx->session_id = g_strdup(p);
-						break;
-					case 705:
-						nx->session_display = atoi(p);
-						break;
-					case 701:
-						nx->proxy_cookie = g_strdup(p);
-						break;
-				}
-			}
-		g_free(line);
-
-		nx->status = status;
-	}
+	gint status;
 
-	pos = nx->response->str + nx->response_pos;
-	if (sscanf(pos, "NX> %i ", &status) < 1)
-	{
-		status = nx->status;
-	}
-	else
-	{
-		if (nx->log_callback)
-			nx->log_callback("[NX] %s\n", pos);
-		nx->response_pos += 8;
-	}
+	status = (nx->prompt_status >= 0 ? nx->prompt_status : nx->status);
+	nx->prompt_status = -1;
 	nx->status = -1;
 	return status;
 }
@@ -538,7 +476,7 @@ static gint remmina_nx_session_expect_status2(RemminaNXSession *nx, gint status,
 		if (!remmina_nx_session_get_response(nx))
 			return -1;
 	}
-	nx->session_list_state = 0;
+	remmina_nx_parser_end_session_list(nx->parser);
 	if (remmina_nx_session_has_error(nx))
 		return -1;
 	return response;
@@ -829,120 +767,21 @@ static gpointer remmina_nx_session_tunnel_main_thread(gpointer data)
 {
 	TRACE_CALL("remmina_nx_session_tunnel_main_thread");
 	RemminaNXSession *nx = (RemminaNXSession*) data;
-	gchar *ptr;
-	ssize_t len = 0, lenw = 0;
-	fd_set set;
-	struct timeval timeout;
-	ssh_channel channels[2];
-	ssh_channel channels_out[2];
 	gint sock;
-	gint ret;
-	gchar buffer[10240];
-	gchar socketbuffer[10240];
-	gchar *socketbuffer_ptr = NULL;
-	gint socketbuffer_len = 0;
-
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
 
 	/* Accept a local connection */
-	sock = accept(nx->server_sock, NULL, NULL);
+	sock = remmina_nx_relay_accept(nx->relay, nx->server_sock);
+	close(nx->server_sock);
+	nx->server_sock = -1;
 	if (sock < 0)
 	{
 		remmina_nx_session_set_application_error(nx, "Failed to accept local socket");
-		nx->thread = 0;
 		return NULL;
 	}
-	close(nx->server_sock);
-	nx->server_sock = -1;
-
-	channels[0] = nx->channel;
-	channels[1] = NULL;
 
 	/* Start the tunnel data transmittion */
-	while (nx->running)
-	{
-		timeout.tv_sec = 1;
-		timeout.tv_usec = 0;
-
-		FD_ZERO(&set);
-		FD_SET(sock, &set);
-
-		ret = ssh_select(channels, channels_out, sock + 1, &set, &timeout);
-		if (!nx->running)
-			break;
-		if (ret == SSH_EINTR)
-			continue;
-		if (ret == -1)
-			break;
-
-		if (FD_ISSET(sock, &set))
-		{
-			len = read(sock, buffer, sizeof(buffer));
-			if (len == 0)
-				nx->running = FALSE;
-			else
-				if (len > 0)
-				{
-					for (ptr = buffer, lenw = 0; len > 0; len -= lenw, ptr += lenw)
-					{
-						ssh_set_fd_towrite(nx->session);
-						lenw = channel_write(channels[0], (char*) ptr, len);
-						if (lenw <= 0)
-						{
-							nx->running = FALSE;
-							break;
-						}
-					}
-				}
-		}
-
-		if (!nx->running)
-			break;
-
-		if (channels_out[0] && socketbuffer_len <= 0)
-		{
-			len = channel_read_nonblocking(channels_out[0], socketbuffer, sizeof(socketbuffer), 0);
-			if (len == SSH_ERROR || len == SSH_EOF)
-			{
-				nx->running = FALSE;
-				break;
-			}
-			else
-				if (len > 0)
-				{
-					socketbuffer_ptr = socketbuffer;
-					socketbuffer_len = len;
-				}
-				else
-				{
-					/* Clean up the stderr buffer in case FreeNX send something there */
-					len = channel_read_nonblocking(channels_out[0], buffer, sizeof(buffer), 1);
-				}
-		}
-
-		if (nx->running && socketbuffer_len > 0)
-		{
-			for (lenw = 0; socketbuffer_len > 0; socketbuffer_len -= lenw, socketbuffer_ptr += lenw)
-			{
-				lenw = write(sock, socketbuffer_ptr, socketbuffer_len);
-				if (lenw == -1 && errno == EAGAIN && nx->running)
-				{
-					/* Sometimes we cannot write to a socket (always EAGAIN), probably because it's internal
-					 * buffer is full. We need read the pending bytes from the socket first. so here we simply
-					 * break, leave the buffer there, and continue with other data */
-					break;
-				}
-				if (lenw <= 0)
-				{
-					nx->running = FALSE;
-					break;
-				}
-			}
-		}
-	}
-
-	nx->thread = 0;
+	remmina_nx_relay_run(nx->relay, sock);
+	close(sock);
 
 	return NULL;
 }
@@ -995,8 +834,14 @@ gboolean remmina_nx_session_tunnel_open(RemminaNXSession *nx)
 		return FALSE;
 	}
 
+	nx->relay = remmina_nx_relay_new(nx->session, nx->channel);
+	if (!nx->relay)
+	{
+		remmina_nx_session_set_application_error(nx, "Failed to initialize the tunnel.");
+		close(sock);
+		return FALSE;
+	}
 	nx->server_sock = sock;
-	nx->running = TRUE;
 
 	if (pthread_create(&nx->thread, NULL, remmina_nx_session_tunnel_main_thread, nx))
 	{
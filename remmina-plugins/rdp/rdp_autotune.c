@@ -0,0 +1,316 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "rdp_plugin.h"
+#include "rdp_autotune.h"
+#include <gio/gio.h>
+#include <netinet/tcp.h>
+
+#define REMMINA_RDP_AUTOTUNE_PROBES         3
+#define REMMINA_RDP_AUTOTUNE_PROBE_TIMEOUT  2	/* seconds */
+#define REMMINA_RDP_AUTOTUNE_INTERVAL       G_USEC_PER_SEC
+#define REMMINA_RDP_AUTOTUNE_SUSTAIN        5	/* intervals */
+
+/* Round trip time limits of the link classes, in microseconds */
+#define REMMINA_RDP_AUTOTUNE_LAN_RTT        3000
+#define REMMINA_RDP_AUTOTUNE_BROADBAND_RTT  30000
+
+/* Payload rates, in bytes per second, below which a saturated link
+ * is considered slow */
+#define REMMINA_RDP_AUTOTUNE_WAN_RATE       (256 * 1024)
+#define REMMINA_RDP_AUTOTUNE_BROADBAND_RATE (4 * 1024 * 1024)
+
+static const gchar* remmina_rdp_autotune_link_name(RemminaRdpLink link)
+{
+	TRACE_CALL("remmina_rdp_autotune_link_name");
+	switch (link)
+	{
+		case REMMINA_RDP_LINK_LAN:
+			return "LAN";
+		case REMMINA_RDP_LINK_BROADBAND:
+			return "broadband";
+		case REMMINA_RDP_LINK_WAN:
+			return "WAN";
+		default:
+			return "unknown";
+	}
+}
+
+static RemminaRdpLink remmina_rdp_autotune_classify(gint64 rtt)
+{
+	TRACE_CALL("remmina_rdp_autotune_classify");
+	if (rtt < 0)
+		return REMMINA_RDP_LINK_UNKNOWN;
+	if (rtt <= REMMINA_RDP_AUTOTUNE_LAN_RTT)
+		return REMMINA_RDP_LINK_LAN;
+	if (rtt <= REMMINA_RDP_AUTOTUNE_BROADBAND_RTT)
+		return REMMINA_RDP_LINK_BROADBAND;
+	return REMMINA_RDP_LINK_WAN;
+}
+
+/* Time a few TCP handshakes with the server and keep the best one, the
+ * first connection also pays for the name resolution. Returns -1 when the
+ * server cannot be reached. */
+static gint64 remmina_rdp_autotune_probe(const gchar* host, gint port)
+{
+	TRACE_CALL("remmina_rdp_autotune_probe");
+	GSocketClient* client;
+	GSocketConnection* connection;
+	gint64 start, rtt, best;
+	gint i;
+
+	best = -1;
+	client = g_socket_client_new();
+	g_socket_client_set_timeout(client, REMMINA_RDP_AUTOTUNE_PROBE_TIMEOUT);
+
+	for (i = 0; i < REMMINA_RDP_AUTOTUNE_PROBES; i++)
+	{
+		start = g_get_monotonic_time();
+		connection = g_socket_client_connect_to_host(client, host, port, NULL, NULL);
+		if (!connection)
+			break;
+		rtt = g_get_monotonic_time() - start;
+		g_object_unref(connection);
+
+		if (best < 0 || rtt < best)
+			best = rtt;
+	}
+
+	g_object_unref(client);
+
+	return best;
+}
+
+/* Smoothed RTT the kernel measured on the RDP transport socket, the other
+ * descriptors (event pipe, channels) are not TCP sockets and are skipped */
+static gint64 remmina_rdp_autotune_socket_rtt(void** rfds, int rcount)
+{
+	TRACE_CALL("remmina_rdp_autotune_socket_rtt");
+#ifdef TCP_INFO
+	struct tcp_info info;
+	socklen_t len;
+	int i;
+
+	for (i = 0; i < rcount; i++)
+	{
+		len = sizeof(info);
+		if (getsockopt(GPOINTER_TO_INT(rfds[i]), IPPROTO_TCP, TCP_INFO, &info, &len) == 0 && info.tcpi_rtt > 0)
+			return info.tcpi_rtt;
+	}
+#endif
+	return -1;
+}
+
+/* Measure the link before connecting. Through an SSH tunnel the RDP socket
+ * only reaches localhost, so the SSH server is probed instead and the
+ * session samples are disabled. The class learned during the previous
+ * session is kept when it is slower than what the probe found, as long as
+ * this session samples the link too: otherwise nothing could ever raise it
+ * again, and the probe alone decides. */
+void remmina_rdp_autotune_init(rfContext* rfi, RemminaFile* remminafile, const gchar* host, gint port)
+{
+	TRACE_CALL("remmina_rdp_autotune_init");
+	const gchar* ssh_server;
+	gchar* probe_host;
+	gint probe_port;
+	gint64 rtt;
+	RemminaRdpLink link;
+	RemminaRdpLink learned;
+
+	rfi->autotune = TRUE;
+	rfi->autotune_session = TRUE;
+
+	if (remmina_plugin_service->file_get_int(remminafile, "ssh_enabled", FALSE))
+	{
+		ssh_server = remmina_plugin_service->file_get_string(remminafile, "ssh_server");
+		if (!ssh_server || !ssh_server[0])
+			ssh_server = remmina_plugin_service->file_get_string(remminafile, "server");
+		remmina_plugin_service->get_server_port(ssh_server, 22, &probe_host, &probe_port);
+		rfi->autotune_session = FALSE;
+	}
+	else
+	{
+		probe_host = g_strdup(host);
+		probe_port = port;
+	}
+
+	/* GIO takes locks, do not get cancelled in the middle of it */
+	CANCEL_DEFER
+	rtt = probe_host ? remmina_rdp_autotune_probe(probe_host, probe_port) : -1;
+	CANCEL_ASYNC
+	g_free(probe_host);
+
+	link = remmina_rdp_autotune_classify(rtt);
+	if (rfi->autotune_session)
+	{
+		learned = remmina_plugin_service->file_get_int(remminafile, "rdp_auto_link", REMMINA_RDP_LINK_UNKNOWN);
+		if (learned > link && learned <= REMMINA_RDP_LINK_WAN)
+			link = learned;
+	}
+
+	rfi->autotune_link = link;
+	rfi->autotune_pending = link;
+	rfi->autotune_count = 0;
+	rfi->autotune_rtt_min = rtt;
+
+	remmina_plugin_service->log_printf("[RDP] automatic quality: handshake %" G_GINT64_FORMAT " us, %s profile\n",
+		rtt, remmina_rdp_autotune_link_name(link));
+}
+
+/* Colour depth, codec and performance flags of the selected profile */
+void remmina_rdp_autotune_apply(rfContext* rfi)
+{
+	TRACE_CALL("remmina_rdp_autotune_apply");
+	switch (rfi->autotune_link)
+	{
+		case REMMINA_RDP_LINK_LAN:
+			rfi->settings->ColorDepth = 32;
+			rfi->settings->RemoteFxCodec = True;
+			rfi->settings->PerformanceFlags = DEFAULT_QUALITY_9;
+			break;
+
+		case REMMINA_RDP_LINK_WAN:
+			rfi->settings->ColorDepth = 16;
+			rfi->settings->RemoteFxCodec = False;
+			rfi->settings->PerformanceFlags = DEFAULT_QUALITY_0;
+			break;
+
+		case REMMINA_RDP_LINK_BROADBAND:
+		default:
+			rfi->settings->ColorDepth = 24;
+			rfi->settings->RemoteFxCodec = False;
+			rfi->settings->PerformanceFlags = DEFAULT_QUALITY_2;
+			break;
+	}
+}
+
+static void remmina_rdp_autotune_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
+{
+	TRACE_CALL("remmina_rdp_autotune_surface_bits");
+	rfContext* rfi = (rfContext*) context;
+
+	rfi->autotune_bytes += cmd->bitmapDataLength;
+	rfi->autotune_surface_bits(context, cmd);
+}
+
+static void remmina_rdp_autotune_bitmap_update(rdpContext* context, BITMAP_UPDATE* bitmap)
+{
+	TRACE_CALL("remmina_rdp_autotune_bitmap_update");
+	rfContext* rfi = (rfContext*) context;
+	UINT32 i;
+
+	for (i = 0; i < bitmap->number; i++)
+		rfi->autotune_bytes += bitmap->rectangles[i].bitmapLength;
+	rfi->autotune_bitmap_update(context, bitmap);
+}
+
+/* Chain the update callbacks carrying the bulk of the screen data, to
+ * know how many compressed bytes the server is sending */
+void remmina_rdp_autotune_start(rfContext* rfi)
+{
+	TRACE_CALL("remmina_rdp_autotune_start");
+	rdpUpdate* update = rfi->instance->update;
+
+	if (!rfi->autotune || !rfi->autotune_session)
+		return;
+
+	rfi->autotune_surface_bits = update->SurfaceBits;
+	update->SurfaceBits = remmina_rdp_autotune_surface_bits;
+	rfi->autotune_bitmap_update = update->BitmapUpdate;
+	update->BitmapUpdate = remmina_rdp_autotune_bitmap_update;
+
+	rfi->autotune_bytes = 0;
+	rfi->autotune_time = g_get_monotonic_time();
+}
+
+/* Called by the RDP thread after each wakeup. Once per interval, classify
+ * the link again from the lowest RTT seen so far, and from the payload
+ * rate when the smoothed RTT shows the link is queueing. The performance
+ * flags and the colour depth are negotiated when connecting, so a sustained
+ * change is remembered in the profile and used from the next connection. */
+void remmina_rdp_autotune_sample(rfContext* rfi, void** rfds, int rcount)
+{
+	TRACE_CALL("remmina_rdp_autotune_sample");
+	gint64 now, rtt, rate;
+	RemminaRdpLink link;
+
+	if (!rfi->autotune || !rfi->autotune_session)
+		return;
+
+	now = g_get_monotonic_time();
+	if (now - rfi->autotune_time < REMMINA_RDP_AUTOTUNE_INTERVAL)
+		return;
+
+	rate = rfi->autotune_bytes * G_USEC_PER_SEC / (now - rfi->autotune_time);
+	rfi->autotune_bytes = 0;
+	rfi->autotune_time = now;
+
+	rtt = remmina_rdp_autotune_socket_rtt(rfds, rcount);
+	if (rtt < 0)
+		return;
+	if (rfi->autotune_rtt_min < 0 || rtt < rfi->autotune_rtt_min)
+		rfi->autotune_rtt_min = rtt;
+
+	link = remmina_rdp_autotune_classify(rfi->autotune_rtt_min);
+	if (rate > 0 && rtt > 2 * rfi->autotune_rtt_min + 10000)
+	{
+		if (rate < REMMINA_RDP_AUTOTUNE_WAN_RATE)
+			link = REMMINA_RDP_LINK_WAN;
+		else if (rate < REMMINA_RDP_AUTOTUNE_BROADBAND_RATE && link < REMMINA_RDP_LINK_BROADBAND)
+			link = REMMINA_RDP_LINK_BROADBAND;
+	}
+
+	if (link == rfi->autotune_link)
+	{
+		rfi->autotune_pending = link;
+		rfi->autotune_count = 0;
+		return;
+	}
+
+	if (link != rfi->autotune_pending)
+	{
+		rfi->autotune_pending = link;
+		rfi->autotune_count = 0;
+	}
+
+	if (++rfi->autotune_count < REMMINA_RDP_AUTOTUNE_SUSTAIN)
+		return;
+
+	remmina_plugin_service->log_printf("[RDP] automatic quality: link changed from %s to %s (rtt %" G_GINT64_FORMAT
+		" us, %" G_GINT64_FORMAT " bytes/s), applied on next connection\n",
+		remmina_rdp_autotune_link_name(rfi->autotune_link), remmina_rdp_autotune_link_name(link), rtt, rate);
+	rfi->autotune_link = link;
+	rfi->autotune_count = 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Headless replay benchmark for the RDP plugin.
+ *
+ * Replays the surface bits commands recorded with REMMINA_CAPTURE_DIR
+ * through the libfreerdp GDI and the plugin's own per-frame path, one
+ * paint cycle per recorded frame: rf_begin_paint()/rf_end_paint(), the UI
+ * object queued by rf_queue_ui(), remmina_rdp_event_queue_ui() draining it
+ * on the main loop and the frame pacer coalescing the damage. Reports
+ * frames per second, CPU time and heap allocations per frame.
+ *
+ * There is no window: the pacer is ticked every refresh interval on the
+ * clock of the capture instead of by a frame clock, and a presentation
+ * only counts the frame where the plugin would invalidate the drawing
+ * area. The cairo painting itself is not measured.
+ *
+ * Only surface bits are recorded, so the numbers are representative of
+ * RemoteFX and NSCodec sessions. They are decoded by the libfreerdp GDI,
+ * as in the plugin: rf_gdi_surface_bits() in rdp_gdi.c is not exercised,
+ * nothing registers the rdp_gdi.c update callbacks.
+ *
+ * The plugin and pacer sources are included directly so their static
+ * functions can be driven as they are, like vnc_bench.c does. */
+
+#include "rdp_plugin.c"
+#include "common/remmina_frame_pacer.c"
+#include "common/remmina_bench.h"
+
+/* Refresh interval the pacer is ticked at, in microseconds */
+#define REMMINA_RDP_BENCH_REFRESH 16667
+
+typedef struct _RemminaRdpBench
+{
+	gboolean main_thread;
+	guint64 frames;
+	guint64 damage;
+	guint64 dropped;
+	guint64 presented;
+	gint64 ui_queue_max;
+} RemminaRdpBench;
+
+static RemminaRdpBench remmina_rdp_bench;
+
+/* Minimal plugin service: only what the per-frame path calls. The
+ * statistics the plugin reports are what the benchmark prints */
+static gboolean remmina_rdp_bench_is_main_thread(void)
+{
+	TRACE_CALL("remmina_rdp_bench_is_main_thread");
+	return remmina_rdp_bench.main_thread;
+}
+
+static void remmina_rdp_bench_stats_count(RemminaProtocolWidget* gp, RemminaProtocolStat stat, gint64 delta)
+{
+	TRACE_CALL("remmina_rdp_bench_stats_count");
+	switch (stat)
+	{
+		case REMMINA_PROTOCOL_STAT_FRAMES:
+			remmina_rdp_bench.frames += delta;
+			break;
+
+		case REMMINA_PROTOCOL_STAT_DAMAGE_PIXELS:
+			remmina_rdp_bench.damage += delta;
+			break;
+
+		case REMMINA_PROTOCOL_STAT_DROPPED_FRAMES:
+			remmina_rdp_bench.dropped += delta;
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void remmina_rdp_bench_stats_gauge(RemminaProtocolWidget* gp, RemminaProtocolStat stat, gint64 value)
+{
+	TRACE_CALL("remmina_rdp_bench_stats_gauge");
+	if (stat == REMMINA_PROTOCOL_STAT_UI_QUEUE_DEPTH)
+		remmina_rdp_bench.ui_queue_max = MAX(remmina_rdp_bench.ui_queue_max, value);
+}
+
+static void remmina_rdp_bench_stats_sample(RemminaProtocolWidget* gp, RemminaProtocolStat stat, gint64 usec)
+{
+	TRACE_CALL("remmina_rdp_bench_stats_sample");
+}
+
+static RemminaPluginService remmina_rdp_bench_service =
+{
+	.is_main_thread = remmina_rdp_bench_is_main_thread,
+	.protocol_plugin_stats_count = remmina_rdp_bench_stats_count,
+	.protocol_plugin_stats_gauge = remmina_rdp_bench_stats_gauge,
+	.protocol_plugin_stats_sample = remmina_rdp_bench_stats_sample
+};
+
+/* Stands in for remmina_rdp_event_update_damage(): same statistics,
+ * but there is no drawing area to invalidate */
+static void remmina_rdp_bench_present(gpointer data, cairo_region_t* damage, gint dropped)
+{
+	TRACE_CALL("remmina_rdp_bench_present");
+	RemminaProtocolWidget* gp = (RemminaProtocolWidget*) data;
+
+	if (dropped)
+		remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_DROPPED_FRAMES, dropped);
+	remmina_rdp_bench.presented++;
+}
+
+/* What remmina_frame_pacer_tick() does at a refresh. Nothing is painted,
+ * so there is never a refresh to skip */
+static void remmina_rdp_bench_tick(RemminaFramePacer* pacer)
+{
+	TRACE_CALL("remmina_rdp_bench_tick");
+	gboolean empty;
+	gint oldtype;
+
+	remmina_frame_pacer_lock(pacer, &oldtype);
+	empty = cairo_region_is_empty(pacer->damage);
+	remmina_frame_pacer_unlock(pacer, oldtype);
+
+	if (!empty)
+		remmina_frame_pacer_present(pacer);
+}
+
+/* The main thread side: run the rf_queue_ui() handler, then the refresh
+ * due at this point of the capture, if any */
+static void remmina_rdp_bench_main_loop(RemminaFramePacer* pacer, gint64 timestamp, gint64* next_tick)
+{
+	TRACE_CALL("remmina_rdp_bench_main_loop");
+	remmina_rdp_bench.main_thread = TRUE;
+
+	while (g_main_context_iteration(NULL, FALSE));
+
+	if (timestamp >= *next_tick)
+	{
+		remmina_rdp_bench_tick(pacer);
+		*next_tick += ((timestamp - *next_tick) / REMMINA_RDP_BENCH_REFRESH + 1) * REMMINA_RDP_BENCH_REFRESH;
+	}
+
+	remmina_rdp_bench.main_thread = FALSE;
+}
+
+int main(int argc, char** argv)
+{
+	TRACE_CALL("main");
+	RemminaCapture* capture;
+	RemminaCaptureRecordType type;
+	RemminaBenchResult result;
+	RemminaProtocolWidget* gp;
+	SURFACE_BITS_COMMAND cmd;
+	freerdp* instance;
+	rfContext* rfi;
+	const guchar* p;
+	gint64 timestamp = 0;
+	gint64 next_tick = 0;
+	guint32 len;
+	UINT32 flags;
+
+	if (argc != 2)
+	{
+		g_printerr("Usage: %s <capture.rmcap>\n", argv[0]);
+		return 1;
+	}
+
+	capture = remmina_capture_open_read(argv[1]);
+	if (!capture || !remmina_capture_read(capture, &type, &timestamp, &p, &len)
+			|| type != REMMINA_CAPTURE_RECORD_HEADER || len < 20)
+	{
+		g_printerr("%s is not an RDP capture\n", argv[1]);
+		return 1;
+	}
+
+	remmina_plugin_service = &remmina_rdp_bench_service;
+
+	/* Same context as remmina_rdp_init(). Any GObject can carry the plugin
+	 * data, the per-frame path never touches the widget */
+	gp = (RemminaProtocolWidget*) g_object_new(G_TYPE_OBJECT, NULL);
+	instance = freerdp_new();
+	instance->ContextSize = sizeof(rfContext);
+	freerdp_context_new(instance);
+	rfi = (rfContext*) instance->context;
+	g_object_set_data(G_OBJECT(gp), "plugin-data", rfi);
+	rfi->protocol_widget = gp;
+	rfi->instance = instance;
+	rfi->settings = instance->settings;
+	pthread_mutex_init(&rfi->mutex, NULL);
+	rfi->ui_queue = g_async_queue_new();
+
+	/* The ticks are driven by remmina_rdp_bench_main_loop(), as if the tick
+	 * callback stayed installed for the whole replay, so the pacer never
+	 * tries to install one on a widget which does not exist */
+	rfi->pacer = remmina_frame_pacer_new((GtkWidget*) gp, remmina_rdp_bench_present, gp);
+	rfi->pacer->scheduled = TRUE;
+
+	rfi->settings->DesktopWidth = remmina_capture_get_uint32(p);
+	rfi->settings->DesktopHeight = remmina_capture_get_uint32(p + 4);
+	rfi->settings->ColorDepth = remmina_capture_get_uint32(p + 8);
+	rfi->bpp = remmina_capture_get_uint32(p + 12);
+	rfi->settings->RemoteFxCodec = remmina_capture_get_uint32(p + 16);
+
+	/* Same GDI setup as remmina_rdp_post_connect() */
+	flags = CLRCONV_ALPHA | (rfi->bpp == 32 ? CLRBUF_32BPP : CLRBUF_16BPP);
+	gdi_init(instance, flags, NULL);
+	instance->update->BeginPaint = rf_begin_paint;
+	instance->update->EndPaint = rf_end_paint;
+
+	remmina_bench_start(&result);
+
+	instance->update->BeginPaint(instance->context);
+	while (remmina_capture_read(capture, &type, &timestamp, &p, &len))
+	{
+		switch (type)
+		{
+			case REMMINA_CAPTURE_RECORD_SURFACE_BITS:
+				if (len < 36)
+					break;
+				memset(&cmd, 0, sizeof(cmd));
+				cmd.cmdType = remmina_capture_get_uint32(p);
+				cmd.destLeft = remmina_capture_get_uint32(p + 4);
+				cmd.destTop = remmina_capture_get_uint32(p + 8);
+				cmd.destRight = remmina_capture_get_uint32(p + 12);
+				cmd.destBottom = remmina_capture_get_uint32(p + 16);
+				cmd.bpp = remmina_capture_get_uint32(p + 20);
+				cmd.codecID = remmina_capture_get_uint32(p + 24);
+				cmd.width = remmina_capture_get_uint32(p + 28);
+				cmd.height = remmina_capture_get_uint32(p + 32);
+				cmd.bitmapDataLength = len - 36;
+				cmd.bitmapData = (BYTE*) p + 36;
+				instance->update->SurfaceBits(instance->context, &cmd);
+				break;
+
+			case REMMINA_CAPTURE_RECORD_FRAME:
+				instance->update->EndPaint(instance->context);
+				remmina_rdp_bench_main_loop(rfi->pacer, timestamp, &next_tick);
+				instance->update->BeginPaint(instance->context);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	/* Whatever is still pending goes out at the next refresh */
+	remmina_rdp_bench_main_loop(rfi->pacer, MAX(timestamp, next_tick), &next_tick);
+
+	remmina_bench_stop(&result);
+	result.frames = remmina_rdp_bench.frames;
+
+	g_print("desktop      %dx%d, %d bpp\n", rfi->settings->DesktopWidth, rfi->settings->DesktopHeight,
+			rfi->settings->ColorDepth);
+	remmina_bench_report(argv[1], &result);
+	g_print("damage/frame %.0f pixels\n", result.frames ? (gdouble) remmina_rdp_bench.damage / result.frames : 0);
+	g_print("presented    %" G_GUINT64_FORMAT "\n", remmina_rdp_bench.presented);
+	g_print("dropped      %" G_GUINT64_FORMAT "\n", remmina_rdp_bench.dropped);
+	g_print("ui queue max %" G_GINT64_FORMAT "\n", remmina_rdp_bench.ui_queue_max);
+
+	remmina_frame_pacer_free(rfi->pacer);
+	rfi->pacer = NULL;
+	rf_object_free_list(gp);
+	g_async_queue_unref(rfi->ui_queue);
+	rfi->ui_queue = NULL;
+	pthread_mutex_destroy(&rfi->mutex);
+	gdi_free(instance);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+	g_object_unref(gp);
+	remmina_capture_close(capture);
+	return 0;
+}
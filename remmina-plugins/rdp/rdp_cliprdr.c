@@ -318,7 +318,7 @@ static int remmina_rdp_cliprdr_monitor_ready(CliprdrClientContext* context, CLIP
 
 	gp = clipboard->rfi->protocol_widget;
 
-	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	ui = rf_object_new(gp);
 	ui->type = REMMINA_RDP_UI_CLIPBOARD;
 	ui->clipboard.clipboard = clipboard;
 	ui->clipboard.type = REMMINA_RDP_UI_CLIPBOARD_MONITORREADY;
@@ -393,7 +393,7 @@ static int remmina_rdp_cliprdr_server_format_list(CliprdrClientContext* context,
 		}
 	}
 
-	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	ui = rf_object_new(gp);
 	ui->type = REMMINA_RDP_UI_CLIPBOARD;
 	ui->clipboard.clipboard = clipboard;
 	ui->clipboard.type = REMMINA_RDP_UI_CLIPBOARD_SET_DATA;
@@ -421,7 +421,7 @@ static int remmina_rdp_cliprdr_server_format_data_request(CliprdrClientContext*
 	clipboard = (rfClipboard*)context->custom;
 	gp = clipboard->rfi->protocol_widget;
 
-	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	ui = rf_object_new(gp);
 	ui->type = REMMINA_RDP_UI_CLIPBOARD;
 	ui->clipboard.clipboard = clipboard;
 	ui->clipboard.type = REMMINA_RDP_UI_CLIPBOARD_GET_DATA;
@@ -553,7 +553,7 @@ static int remmina_rdp_cliprdr_server_format_data_response(CliprdrClientContext*
 		// Clipboard data arrived from server when we are not busywaiting.
 		// Just put it on the local clipboard
 
-		ui = g_new0(RemminaPluginRdpUiObject, 1);
+		ui = rf_object_new(gp);
 		ui->type = REMMINA_RDP_UI_CLIPBOARD;
 		ui->clipboard.clipboard = clipboard;
 		ui->clipboard.type = REMMINA_RDP_UI_CLIPBOARD_SET_CONTENT;
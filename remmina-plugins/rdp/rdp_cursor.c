@@ -0,0 +1,183 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "rdp_plugin.h"
+#include "rdp_cursor.h"
+#include <freerdp/codec/color.h>
+#include <string.h>
+
+/* Cursors no session uses any more are kept for when they come back,
+ * the least recently released ones are destroyed first */
+#define REMMINA_RDP_CURSOR_UNUSED_MAX 64
+
+struct remmina_rdp_cursor
+{
+	/* Display, size, hotspot, bpp and mask data of the pointer */
+	GBytes* key;
+	GdkCursor* cursor;
+	gint refcount;
+	/* Link in remmina_rdp_cursor_unused while refcount is 0 */
+	GList* unused_link;
+};
+
+static GHashTable* remmina_rdp_cursor_table = NULL;
+static GQueue remmina_rdp_cursor_unused = G_QUEUE_INIT;
+static GdkCursor* remmina_rdp_cursor_blank = NULL;
+
+static void remmina_rdp_cursor_free(RemminaRdpCursor* cursor)
+{
+	TRACE_CALL("remmina_rdp_cursor_free");
+	g_bytes_unref(cursor->key);
+	g_object_unref(cursor->cursor);
+	g_free(cursor);
+}
+
+static GBytes* remmina_rdp_cursor_key(GdkDisplay* display, rdpPointer* pointer)
+{
+	TRACE_CALL("remmina_rdp_cursor_key");
+	GByteArray* key;
+	struct
+	{
+		GdkDisplay* display;
+		UINT32 width;
+		UINT32 height;
+		UINT32 xPos;
+		UINT32 yPos;
+		UINT32 xorBpp;
+		UINT32 lengthXorMask;
+	} header;
+
+	memset(&header, 0, sizeof(header));
+	header.display = display;
+	header.width = pointer->width;
+	header.height = pointer->height;
+	header.xPos = pointer->xPos;
+	header.yPos = pointer->yPos;
+	header.xorBpp = pointer->xorBpp;
+	header.lengthXorMask = pointer->lengthXorMask;
+
+	key = g_byte_array_sized_new(sizeof(header) + pointer->lengthXorMask + pointer->lengthAndMask);
+	g_byte_array_append(key, (guint8*) &header, sizeof(header));
+	g_byte_array_append(key, pointer->xorMaskData, pointer->lengthXorMask);
+	g_byte_array_append(key, pointer->andMaskData, pointer->lengthAndMask);
+	return g_byte_array_free_to_bytes(key);
+}
+
+static GdkCursor* remmina_rdp_cursor_create(GdkDisplay* display, rdpPointer* pointer, HCLRCONV clrconv)
+{
+	TRACE_CALL("remmina_rdp_cursor_create");
+	GdkCursor* cursor;
+	GdkPixbuf* pixbuf;
+	cairo_surface_t* surface;
+	UINT8* data;
+
+	data = g_malloc(pointer->width * pointer->height * 4);
+	freerdp_alpha_cursor_convert(data, pointer->xorMaskData, pointer->andMaskData, pointer->width, pointer->height, pointer->xorBpp, clrconv);
+	surface = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32, pointer->width, pointer->height, cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, pointer->width));
+	pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0, pointer->width, pointer->height);
+	cairo_surface_destroy(surface);
+	g_free(data);
+
+	cursor = gdk_cursor_new_from_pixbuf(display, pixbuf, pointer->xPos, pointer->yPos);
+	g_object_unref(pixbuf);
+	return cursor;
+}
+
+/* Return the cursor of a pointer shape with a new reference, building it
+ * only when no session has seen the same shape recently */
+RemminaRdpCursor* remmina_rdp_cursor_get(GdkDisplay* display, rdpPointer* pointer, HCLRCONV clrconv)
+{
+	TRACE_CALL("remmina_rdp_cursor_get");
+	RemminaRdpCursor* cursor;
+	GBytes* key;
+
+	if (!remmina_rdp_cursor_table)
+		remmina_rdp_cursor_table = g_hash_table_new(g_bytes_hash, g_bytes_equal);
+
+	key = remmina_rdp_cursor_key(display, pointer);
+	cursor = (RemminaRdpCursor*) g_hash_table_lookup(remmina_rdp_cursor_table, key);
+	if (cursor)
+	{
+		g_bytes_unref(key);
+		if (cursor->unused_link)
+		{
+			g_queue_delete_link(&remmina_rdp_cursor_unused, cursor->unused_link);
+			cursor->unused_link = NULL;
+		}
+		cursor->refcount++;
+		return cursor;
+	}
+
+	cursor = g_new0(RemminaRdpCursor, 1);
+	cursor->key = key;
+	cursor->cursor = remmina_rdp_cursor_create(display, pointer, clrconv);
+	cursor->refcount = 1;
+	g_hash_table_insert(remmina_rdp_cursor_table, key, cursor);
+	return cursor;
+}
+
+GdkCursor* remmina_rdp_cursor_get_cursor(RemminaRdpCursor* cursor)
+{
+	TRACE_CALL("remmina_rdp_cursor_get_cursor");
+	return cursor->cursor;
+}
+
+void remmina_rdp_cursor_release(RemminaRdpCursor* cursor)
+{
+	TRACE_CALL("remmina_rdp_cursor_release");
+	RemminaRdpCursor* oldest;
+
+	if (--cursor->refcount > 0)
+		return;
+
+	g_queue_push_head(&remmina_rdp_cursor_unused, cursor);
+	cursor->unused_link = g_queue_peek_head_link(&remmina_rdp_cursor_unused);
+
+	while (g_queue_get_length(&remmina_rdp_cursor_unused) > REMMINA_RDP_CURSOR_UNUSED_MAX)
+	{
+		oldest = (RemminaRdpCursor*) g_queue_pop_tail(&remmina_rdp_cursor_unused);
+		g_hash_table_remove(remmina_rdp_cursor_table, oldest->key);
+		remmina_rdp_cursor_free(oldest);
+	}
+}
+
+/* Sessions all run on the default display */
+GdkCursor* remmina_rdp_cursor_get_blank(GdkDisplay* display)
+{
+	TRACE_CALL("remmina_rdp_cursor_get_blank");
+	if (!remmina_rdp_cursor_blank)
+		remmina_rdp_cursor_blank = gdk_cursor_new_for_display(display, GDK_BLANK_CURSOR);
+	return remmina_rdp_cursor_blank;
+}
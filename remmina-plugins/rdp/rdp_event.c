@@ -39,6 +39,7 @@
 #include "rdp_event.h"
 #include "rdp_gdi.h"
 #include "rdp_cliprdr.h"
+#include "rdp_cursor.h"
 #include <gdk/gdkkeysyms.h>
 #include <cairo/cairo-xlib.h>
 #include <freerdp/locale/keyboard.h>
@@ -91,8 +92,15 @@ static void remmina_rdp_event_event_push(RemminaProtocolWidget* gp, const Remmin
 
 	if (rfi->event_queue)
 	{
-		event = g_memdup(e, sizeof(RemminaPluginRdpEvent));
+		event = rf_event_new(gp);
+		*event = *e;
+		event->next_free = NULL;
+		event->timestamp = g_get_monotonic_time();
 		g_async_queue_push(rfi->event_queue, event);
+		if (e->type != REMMINA_RDP_EVENT_TYPE_SUPPRESS_OUTPUT)
+			remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_INPUT_EVENTS, 1);
+		remmina_plugin_service->protocol_plugin_stats_gauge(gp, REMMINA_PROTOCOL_STAT_EVENT_QUEUE_DEPTH,
+				g_async_queue_length(rfi->event_queue));
 
 		if (write(rfi->event_pipe[1], "\0", 1))
 		{
@@ -188,21 +196,35 @@ static void remmina_rdp_event_scale_area(RemminaProtocolWidget* gp, gint* x, gin
 	*h = sh;
 }
 
-void remmina_rdp_event_update_region(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
+/* Invalidate the damage accumulated by the frame pacer since the last refresh */
+static void remmina_rdp_event_update_damage(gpointer data, cairo_region_t* damage, gint dropped)
 {
-	TRACE_CALL("remmina_rdp_event_update_region");
+	TRACE_CALL("remmina_rdp_event_update_damage");
+	RemminaProtocolWidget* gp = (RemminaProtocolWidget*) data;
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
-	gint x, y, w, h;
+	cairo_region_t* scaled;
+	cairo_rectangle_int_t rect;
+	gint i, n;
 
-	x = ui->region.x;
-	y = ui->region.y;
-	w = ui->region.width;
-	h = ui->region.height;
+	if (dropped)
+		remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_DROPPED_FRAMES, dropped);
 
-	if (remmina_plugin_service->protocol_plugin_get_scale(gp))
-		remmina_rdp_event_scale_area(gp, &x, &y, &w, &h);
+	if (!remmina_plugin_service->protocol_plugin_get_scale(gp))
+	{
+		gtk_widget_queue_draw_region(rfi->drawing_area, damage);
+		return;
+	}
 
-	gtk_widget_queue_draw_area(rfi->drawing_area, x, y, w, h);
+	scaled = cairo_region_create();
+	n = cairo_region_num_rectangles(damage);
+	for (i = 0; i < n; i++)
+	{
+		cairo_region_get_rectangle(damage, i, &rect);
+		remmina_rdp_event_scale_area(gp, &rect.x, &rect.y, &rect.width, &rect.height);
+		cairo_region_union_rectangle(scaled, &rect);
+	}
+	gtk_widget_queue_draw_region(rfi->drawing_area, scaled);
+	cairo_region_destroy(scaled);
 }
 
 void remmina_rdp_event_update_rect(RemminaProtocolWidget* gp, gint x, gint y, gint w, gint h)
@@ -269,6 +291,7 @@ static gboolean remmina_rdp_event_on_draw(GtkWidget* widget, cairo_t* context, R
 {
 	TRACE_CALL("remmina_rdp_event_on_draw");
 	gboolean scale;
+	gint64 start;
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
 
 	if (!rfi) return FALSE;
@@ -276,6 +299,8 @@ static gboolean remmina_rdp_event_on_draw(GtkWidget* widget, cairo_t* context, R
 	if (!rfi->surface)
 		return FALSE;
 
+	start = g_get_monotonic_time();
+
 	scale = remmina_plugin_service->protocol_plugin_get_scale(gp);
 
 	if (scale)
@@ -286,6 +311,10 @@ static gboolean remmina_rdp_event_on_draw(GtkWidget* widget, cairo_t* context, R
 	cairo_set_operator (context, CAIRO_OPERATOR_SOURCE);	// Ignore alpha channel from FreeRDP
 	cairo_paint(context);
 
+	start = g_get_monotonic_time() - start;
+	remmina_plugin_service->protocol_plugin_stats_sample(gp, REMMINA_PROTOCOL_STAT_PAINT_TIME, start);
+	remmina_frame_pacer_paint_time(rfi->pacer, start);
+
 	return TRUE;
 }
 
@@ -511,7 +540,7 @@ gboolean remmina_rdp_event_on_clipboard(GtkClipboard *gtkClipboard, GdkEvent *ev
 	clipboard = &(rfi->clipboard);
 
 	if ( clipboard->sync ) {
-		ui = g_new0(RemminaPluginRdpUiObject, 1);
+		ui = rf_object_new(gp);
 		ui->type = REMMINA_RDP_UI_CLIPBOARD;
 		ui->clipboard.clipboard = clipboard;
 		ui->clipboard.type = REMMINA_RDP_UI_CLIPBOARD_FORMATLIST;
@@ -533,6 +562,7 @@ void remmina_rdp_event_init(RemminaProtocolWidget* gp)
 
 	rfi->drawing_area = gtk_drawing_area_new();
 	gtk_widget_show(rfi->drawing_area);
+	rfi->pacer = remmina_frame_pacer_new(rfi->drawing_area, remmina_rdp_event_update_damage, gp);
 	gtk_container_add(GTK_CONTAINER(gp), rfi->drawing_area);
 
 	gtk_widget_add_events(rfi->drawing_area, GDK_POINTER_MOTION_MASK | GDK_BUTTON_PRESS_MASK
@@ -619,8 +649,15 @@ void remmina_rdp_event_uninit(RemminaProtocolWidget* gp)
 	}
 	while ((ui =(RemminaPluginRdpUiObject*) g_async_queue_try_pop(rfi->ui_queue)) != NULL)
 	{
-		rf_object_free(gp, ui);
+		/* A sync object belongs to its waiter */
+		if (ui->sync)
+			rf_completion_signal(ui->sync_completion);
+		else
+			rf_object_free(gp, ui);
 	}
+	rf_object_free_list(gp);
+	remmina_frame_pacer_free(rfi->pacer);
+	rfi->pacer = NULL;
 	if (rfi->surface)
 	{
 		cairo_surface_destroy(rfi->surface);
@@ -688,23 +725,18 @@ static void remmina_rdp_event_connected(RemminaProtocolWidget* gp, RemminaPlugin
 static void remmina_rdp_event_create_cursor(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
 {
 	TRACE_CALL("remmina_rdp_event_create_cursor");
-	GdkPixbuf* pixbuf;
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
-	rdpPointer* pointer = (rdpPointer*)ui->cursor.pointer;
-	cairo_surface_t* surface;
-	UINT8* data = malloc(pointer->width * pointer->height * 4);
-
-	freerdp_alpha_cursor_convert(data, pointer->xorMaskData, pointer->andMaskData, pointer->width, pointer->height, pointer->xorBpp, rfi->clrconv);
-	surface = cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32, pointer->width, pointer->height, cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, pointer->width));
-	pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0, pointer->width, pointer->height);
-	cairo_surface_destroy(surface);
-	((rfPointer*)ui->cursor.pointer)->cursor = gdk_cursor_new_from_pixbuf(rfi->display, pixbuf, pointer->xPos, pointer->yPos);
+	rfPointer* pointer = ui->cursor.pointer;
+
+	pointer->cache_entry = remmina_rdp_cursor_get(rfi->display, &pointer->pointer, rfi->clrconv);
+	pointer->cursor = remmina_rdp_cursor_get_cursor(pointer->cache_entry);
 }
 
 static void remmina_rdp_event_free_cursor(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
 {
 	TRACE_CALL("remmina_rdp_event_free_cursor");
-	g_object_unref(ui->cursor.pointer->cursor);
+	remmina_rdp_cursor_release(ui->cursor.pointer->cache_entry);
+	ui->cursor.pointer->cache_entry = NULL;
 	ui->cursor.pointer->cursor = NULL;
 }
 
@@ -728,7 +760,7 @@ static void remmina_rdp_event_cursor(RemminaProtocolWidget* gp, RemminaPluginRdp
 			break;
 
 		case REMMINA_RDP_POINTER_NULL:
-			gdk_window_set_cursor(gtk_widget_get_window(rfi->drawing_area), gdk_cursor_new(GDK_BLANK_CURSOR));
+			gdk_window_set_cursor(gtk_widget_get_window(rfi->drawing_area), remmina_rdp_cursor_get_blank(rfi->display));
 			break;
 
 		case REMMINA_RDP_POINTER_DEFAULT:
@@ -756,23 +788,41 @@ static void remmina_rdp_event_process_event(RemminaProtocolWidget* gp, RemminaPl
 }
 
 
+/* Time the UI queue may hold the main loop before yielding, in microseconds */
+#define REMMINA_RDP_UI_QUEUE_BUDGET 8000
+
 gboolean remmina_rdp_event_queue_ui(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL("remmina_rdp_event_queue_ui");
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
 	RemminaPluginRdpUiObject* ui;
+	gint64 deadline;
+	gboolean pending = TRUE;
 
-	LOCK_BUFFER(FALSE);
-	ui = (RemminaPluginRdpUiObject*) g_async_queue_try_pop(rfi->ui_queue);
+	/* Drain everything queued so far in a single dispatch. Region updates
+	 * go to the frame pacer, which invalidates them at the next refresh */
+	deadline = g_get_monotonic_time() + REMMINA_RDP_UI_QUEUE_BUDGET;
 
-	if (ui)
+	while (pending)
 	{
+		LOCK_BUFFER(FALSE)
+		ui = (RemminaPluginRdpUiObject*) g_async_queue_try_pop(rfi->ui_queue);
+		if (!ui)
+		{
+			rfi->ui_handler = 0;
+			pending = FALSE;
+		}
 		UNLOCK_BUFFER(FALSE)
+
+		if (!ui)
+			break;
+
 		if ( !rfi->thread_cancelled ) {
 			switch (ui->type)
 			{
 				case REMMINA_RDP_UI_UPDATE_REGION:
-					remmina_rdp_event_update_region(gp, ui);
+					remmina_frame_pacer_damage(rfi->pacer, ui->region.x, ui->region.y,
+							ui->region.width, ui->region.height);
 					break;
 
 				case REMMINA_RDP_UI_CONNECTED:
@@ -798,21 +848,30 @@ gboolean remmina_rdp_event_queue_ui(RemminaProtocolWidget* gp)
 
 		// Should we signal the subthread to unlock ?
 		if (ui->sync) {
-			pthread_mutex_unlock(&ui->sync_wait_mutex);
+			rf_completion_signal(ui->sync_completion);
 			/* Freeing ui, when in sync mode, must be done by the just
 			 * unlocked rf_queue_ui() */
 		} else {
 			rf_object_free(gp, ui);
 		}
 
-		return TRUE;
-	}
-	else
-	{
-		rfi->ui_handler = 0;
-		UNLOCK_BUFFER(FALSE)
-		return FALSE;
+		/* Out of time: leave the rest to the next main loop iteration */
+		if (g_get_monotonic_time() >= deadline)
+			break;
 	}
+
+	return pending;
+}
+
+/* Ask the RDP thread to stop or resume the screen updates from the server */
+void remmina_rdp_event_suppress_output(RemminaProtocolWidget* gp, gboolean suppress)
+{
+	TRACE_CALL("remmina_rdp_event_suppress_output");
+	RemminaPluginRdpEvent rdp_event = { 0 };
+
+	rdp_event.type = REMMINA_RDP_EVENT_TYPE_SUPPRESS_OUTPUT;
+	rdp_event.suppress_output.allow = suppress ? FALSE : TRUE;
+	remmina_rdp_event_event_push(gp, &rdp_event);
 }
 
 void remmina_rdp_event_unfocus(RemminaProtocolWidget* gp)
@@ -42,6 +42,7 @@ void remmina_rdp_event_uninit(RemminaProtocolWidget* gp);
 void remmina_rdp_event_update_scale(RemminaProtocolWidget* gp);
 gboolean remmina_rdp_event_queue_ui(RemminaProtocolWidget* gp);
 void remmina_rdp_event_unfocus(RemminaProtocolWidget* gp);
+void remmina_rdp_event_suppress_output(RemminaProtocolWidget* gp, gboolean suppress);
 void remmina_rdp_event_update_rect(RemminaProtocolWidget* gp, gint x, gint y, gint w, gint h);
 
 G_END_DECLS
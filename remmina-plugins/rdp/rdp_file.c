@@ -58,153 +58,165 @@ gboolean remmina_rdp_file_import_test(const gchar* from_file)
 	return FALSE;
 }
 
-static void remmina_rdp_file_import_field(RemminaFile* remminafile, const gchar* key, const gchar* value)
+typedef enum
 {
-	TRACE_CALL("remmina_rdp_file_import_field");
-	if (g_strcmp0(key, "desktopwidth") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "resolution_width", value);
-	}
-	else if (g_strcmp0(key, "desktopheight") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "resolution_height", value);
-	}
-	else if (g_strcmp0(key, "session bpp") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "colordepth", value);
-	}
-	else if (g_strcmp0(key, "keyboardhook") == 0)
-	{
-		remmina_plugin_service->file_set_int(remminafile, "keyboard_grab", (atoi (value) == 1));
-	}
-	else if (g_strcmp0(key, "full address") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "server", value);
-	}
-	else if (g_strcmp0(key, "audiomode") == 0)
-	{
-		switch (atoi(value))
-		{
-			case 0:
-				remmina_plugin_service->file_set_string(remminafile, "sound", "local");
-				break;
-			case 1:
-				remmina_plugin_service->file_set_string(remminafile, "sound", "remote");
-				break;
-		}
-	}
-	else if (g_strcmp0(key, "redirectprinters") == 0)
-	{
-		remmina_plugin_service->file_set_int(remminafile, "shareprinter", (atoi (value) == 1));
-	}
-	else if (g_strcmp0(key, "redirectsmartcard") == 0)
-	{
-		remmina_plugin_service->file_set_int(remminafile, "sharesmartcard", (atoi (value) == 1));
-	}
-	else if (g_strcmp0(key, "redirectclipboard") == 0)
-	{
-		remmina_plugin_service->file_set_int(remminafile, "disableclipboard", (atoi (value) != 1));
-	}
-	else if (g_strcmp0(key, "alternate shell") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "exec", value);
-	}
-	else if (g_strcmp0(key, "shell working directory") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "execpath", value);
-	}
+	REMMINA_RDP_FILE_FIELD_STRING,
+	REMMINA_RDP_FILE_FIELD_BOOL,
+	REMMINA_RDP_FILE_FIELD_NOT_BOOL,
+	REMMINA_RDP_FILE_FIELD_SOUND
+} RemminaRdpFileFieldType;
+
+typedef struct _RemminaRdpFileField
+{
+	const gchar* key;
+	const gchar* setting;
+	RemminaRdpFileFieldType type;
+} RemminaRdpFileField;
+
+/* Imported keys, at the slot given by remmina_rdp_file_field_hash(). The hash
+ * has no collision between these keys, so a lookup is one compare.
+ * Check it again when adding a key */
+#define REMMINA_RDP_FILE_FIELD_SLOTS 18
+static const RemminaRdpFileField remmina_rdp_file_fields[REMMINA_RDP_FILE_FIELD_SLOTS] =
+{
+	[0] = { "keyboardhook", "keyboard_grab", REMMINA_RDP_FILE_FIELD_BOOL },
+	[1] = { "password", "password", REMMINA_RDP_FILE_FIELD_STRING },
+	[2] = { "redirectprinters", "shareprinter", REMMINA_RDP_FILE_FIELD_BOOL },
+	[4] = { "full address", "server", REMMINA_RDP_FILE_FIELD_STRING },
+	[5] = { "alternate shell", "exec", REMMINA_RDP_FILE_FIELD_STRING },
+	[6] = { "redirectsmartcard", "sharesmartcard", REMMINA_RDP_FILE_FIELD_BOOL },
+	[7] = { "shell working directory", "execpath", REMMINA_RDP_FILE_FIELD_STRING },
+	[8] = { "redirectclipboard", "disableclipboard", REMMINA_RDP_FILE_FIELD_NOT_BOOL },
 	/* tsclient fields, import only */
-	else if (g_strcmp0(key, "client hostname") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "clientname", value);
-	}
-	else if (g_strcmp0(key, "domain") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "domain", value);
-	}
-	else if (g_strcmp0(key, "username") == 0)
-	{
-		remmina_plugin_service->file_set_string(remminafile, "username", value);
-	}
-	else if (g_strcmp0(key, "password") == 0)
+	[10] = { "username", "username", REMMINA_RDP_FILE_FIELD_STRING },
+	[11] = { "client hostname", "clientname", REMMINA_RDP_FILE_FIELD_STRING },
+	[12] = { "audiomode", "sound", REMMINA_RDP_FILE_FIELD_SOUND },
+	[13] = { "domain", "domain", REMMINA_RDP_FILE_FIELD_STRING },
+	[14] = { "session bpp", "colordepth", REMMINA_RDP_FILE_FIELD_STRING },
+	[16] = { "desktopwidth", "resolution_width", REMMINA_RDP_FILE_FIELD_STRING },
+	[17] = { "desktopheight", "resolution_height", REMMINA_RDP_FILE_FIELD_STRING }
+};
+
+static guint remmina_rdp_file_field_hash(const gchar* key, gsize len)
+{
+	TRACE_CALL("remmina_rdp_file_field_hash");
+	return ((guchar) key[len / 2] + len) % REMMINA_RDP_FILE_FIELD_SLOTS;
+}
+
+static void remmina_rdp_file_import_field(RemminaFile* remminafile, const gchar* key, gsize len, const gchar* value)
+{
+	TRACE_CALL("remmina_rdp_file_import_field");
+	const RemminaRdpFileField* field;
+
+	if (len == 0)
+		return;
+
+	field = &remmina_rdp_file_fields[remmina_rdp_file_field_hash(key, len)];
+	if (!field->key || strcmp(field->key, key) != 0)
+		return;
+
+	switch (field->type)
 	{
-		remmina_plugin_service->file_set_string(remminafile, "password", value);
+		case REMMINA_RDP_FILE_FIELD_STRING:
+			remmina_plugin_service->file_set_string(remminafile, field->setting, value);
+			break;
+		case REMMINA_RDP_FILE_FIELD_BOOL:
+			remmina_plugin_service->file_set_int(remminafile, field->setting, (atoi (value) == 1));
+			break;
+		case REMMINA_RDP_FILE_FIELD_NOT_BOOL:
+			remmina_plugin_service->file_set_int(remminafile, field->setting, (atoi (value) != 1));
+			break;
+		case REMMINA_RDP_FILE_FIELD_SOUND:
+			switch (atoi(value))
+			{
+				case 0:
+					remmina_plugin_service->file_set_string(remminafile, field->setting, "local");
+					break;
+				case 1:
+					remmina_plugin_service->file_set_string(remminafile, field->setting, "remote");
+					break;
+			}
+			break;
 	}
 }
 
-static RemminaFile* remmina_rdp_file_import_channel(GIOChannel* channel)
+/* Parses the whole content of a .rdp file, which is modified in place */
+static RemminaFile* remmina_rdp_file_import_data(gchar* data, gsize len)
 {
-	TRACE_CALL("remmina_rdp_file_import_channel");
+	TRACE_CALL("remmina_rdp_file_import_data");
 	gchar* p;
-	const gchar* enc;
-	gchar* line = NULL;
+	gchar* line;
+	gchar* next;
+	gchar* end;
+	gchar* text;
+	gsize text_len;
+	gsize key_len;
+	const gchar* enc = NULL;
 	GError* error = NULL;
-	gsize bytes_read = 0;
 	RemminaFile* remminafile;
-	guchar magic[2] = { 0 };
 
-	if (g_io_channel_set_encoding(channel, NULL, &error) != G_IO_STATUS_NORMAL)
-	{
-		g_print("g_io_channel_set_encoding: %s\n", error->message);
-		return NULL;
-	}
-
-	/* Try to detect the UTF-16 encoding */
-	if (g_io_channel_read_chars(channel, (gchar*) magic, 2, &bytes_read, &error) != G_IO_STATUS_NORMAL)
-	{
-		g_print("g_io_channel_read_chars: %s\n", error->message);
-		return NULL;
-	}
-
-	if (magic[0] == 0xFF && magic[1] == 0xFE)
-	{
+	/* Detect the UTF-16 encoding, then transcode the whole file at once */
+	if (len >= 2 && (guchar) data[0] == 0xFF && (guchar) data[1] == 0xFE)
 		enc = "UTF-16LE";
-	}
-	else if (magic[0] == 0xFE && magic[1] == 0xFF)
-	{
+	else if (len >= 2 && (guchar) data[0] == 0xFE && (guchar) data[1] == 0xFF)
 		enc = "UTF-16BE";
-	}
-	else
+	else if (!g_utf8_validate(data, len, NULL))
+		/* Not UTF-8: saved with the ANSI code page of a western Windows */
+		enc = "WINDOWS-1252";
+
+	if (enc)
 	{
-		enc = "UTF-8";
-		if (g_io_channel_seek_position(channel, 0, G_SEEK_SET, &error) != G_IO_STATUS_NORMAL)
+		p = (enc[0] == 'U' ? data + 2 : data);
+		text = g_convert(p, len - (p - data), "UTF-8", enc, NULL, &text_len, &error);
+		if (text == NULL)
 		{
-			g_print("g_io_channel_seek: failed\n");
+			g_print("g_convert: %s\n", error->message);
+			g_error_free(error);
 			return NULL;
 		}
 	}
-
-	if (g_io_channel_set_encoding(channel, enc, &error) != G_IO_STATUS_NORMAL)
+	else
 	{
-		g_print("g_io_channel_set_encoding: %s\n", error->message);
-		return NULL;
+		text = data;
+		text_len = len;
+		/* UTF-8 BOM */
+		if (text_len >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0)
+		{
+			text += 3;
+			text_len -= 3;
+		}
 	}
 
 	remminafile = remmina_plugin_service->file_new();
 
-	while (g_io_channel_read_line(channel, &line, NULL, &bytes_read, &error) == G_IO_STATUS_NORMAL)
+	end = text + text_len;
+	for (line = text; line < end; line = next)
 	{
-		if (line == NULL)
-			break;
-
-		line[bytes_read] = '\0';
+		p = memchr(line, '\n', end - line);
+		next = (p ? p + 1 : end);
+		if (!p)
+			p = end;
+		if (p > line && p[-1] == '\r')
+			p--;
+		/* Both g_file_get_contents() and g_convert() terminate the buffer,
+		 * so a last line without end of line is terminated too */
+		*p = '\0';
+
+		/* key:type:value */
 		p = strchr(line, ':');
-
 		if (p)
 		{
 			*p++ = '\0';
-			p = strchr (p, ':');
-
+			key_len = p - line - 1;
+			p = strchr(p, ':');
 			if (p)
-			{
-				p++;
-				remmina_rdp_file_import_field(remminafile, line, p);
-			}
+				remmina_rdp_file_import_field(remminafile, line, key_len, p + 1);
 		}
-
-		g_free(line);
 	}
 
+	if (enc)
+		g_free(text);
+
 	if (remmina_plugin_service->file_get_int(remminafile, "resolution_width", 0) > 0 &&
 		remmina_plugin_service->file_get_int(remminafile, "resolution_height", 0) > 0)
 	{
@@ -222,23 +234,24 @@ static RemminaFile* remmina_rdp_file_import_channel(GIOChannel* channel)
 	return remminafile;
 }
 
+/* May be called from several threads at once, for bulk imports */
 RemminaFile* remmina_rdp_file_import(const gchar* from_file)
 {
 	TRACE_CALL("remmina_rdp_file_import");
-	GIOChannel* channel;
+	gchar* data;
+	gsize len;
 	GError* error = NULL;
 	RemminaFile* remminafile;
 
-	channel = g_io_channel_new_file(from_file, "r", &error);
-
-	if (channel == NULL)
+	if (!g_file_get_contents(from_file, &data, &len, &error))
 	{
 		g_print("Failed to import %s: %s\n", from_file, error->message);
+		g_error_free(error);
 		return NULL;
 	}
 
-	remminafile = remmina_rdp_file_import_channel(channel);
-	g_io_channel_shutdown(channel, TRUE, &error);
+	remminafile = remmina_rdp_file_import_data(data, len);
+	g_free(data);
 
 	return remminafile;
 }
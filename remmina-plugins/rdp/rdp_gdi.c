@@ -61,7 +61,7 @@ static void rf_desktop_resize(rdpContext* context)
 
 	UNLOCK_BUFFER(TRUE)
 
-	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	ui = rf_object_new(gp);
 	ui->sync = TRUE;	// Wait for completion too
 	ui->type = REMMINA_RDP_UI_EVENT;
 	ui->event.type = REMMINA_RDP_UI_EVENT_UPDATE_SCALE;
@@ -148,7 +148,7 @@ static void rf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surfa
 		message = rfx_process_message(rfi->rfx_context, surface_bits_command->bitmapData,
 				surface_bits_command->bitmapDataLength);
 
-		ui = g_new0(RemminaPluginRdpUiObject, 1);
+		ui = rf_object_new(rfi->protocol_widget);
 		ui->type = REMMINA_RDP_UI_RFX;
 		ui->rfx.left = surface_bits_command->destLeft;
 		ui->rfx.top = surface_bits_command->destTop;
@@ -163,7 +163,7 @@ static void rf_gdi_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* surfa
 		freerdp_image_flip(surface_bits_command->bitmapData, bitmap,
 				surface_bits_command->width, surface_bits_command->height, 32);
 
-		ui = g_new0(RemminaPluginRdpUiObject, 1);
+		ui = rf_object_new(rfi->protocol_widget);
 		ui->type = REMMINA_RDP_UI_NOCODEC;
 		ui->nocodec.left = surface_bits_command->destLeft;
 		ui->nocodec.top = surface_bits_command->destTop;
@@ -0,0 +1,272 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Benchmark of the .rdp file import.
+ *
+ *   remmina-rdp-import-bench [files] [threads]
+ *
+ * Generates a corpus of .rdp files in a temporary directory, written by
+ * the plugin's own export, half of them in UTF-16LE with a BOM as mstsc
+ * saves them. The corpus is then imported once by a single thread, and
+ * once by a pool of threads as bulk imports do, reporting files per
+ * second and heap allocations per file. Every imported server name is
+ * checked. The corpus is removed at the end.
+ *
+ * The plugin source is included so the import runs unchanged, on top of
+ * a minimal plugin service keeping the settings in a hash table. */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "rdp_file.c"
+#include "common/remmina_bench.h"
+
+RemminaPluginService* remmina_plugin_service = NULL;
+
+struct _RemminaFile
+{
+	GHashTable *settings;
+};
+
+static RemminaFile* remmina_rdp_import_bench_file_new(void)
+{
+	TRACE_CALL("remmina_rdp_import_bench_file_new");
+	RemminaFile *remminafile;
+
+	remminafile = g_new0(RemminaFile, 1);
+	remminafile->settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	return remminafile;
+}
+
+static void remmina_rdp_import_bench_file_free(RemminaFile *remminafile)
+{
+	TRACE_CALL("remmina_rdp_import_bench_file_free");
+	g_hash_table_destroy(remminafile->settings);
+	g_free(remminafile);
+}
+
+static void remmina_rdp_import_bench_set_string(RemminaFile *remminafile, const gchar *setting, const gchar *value)
+{
+	TRACE_CALL("remmina_rdp_import_bench_set_string");
+	g_hash_table_insert(remminafile->settings, g_strdup(setting), g_strdup(value));
+}
+
+static const gchar* remmina_rdp_import_bench_get_string(RemminaFile *remminafile, const gchar *setting)
+{
+	TRACE_CALL("remmina_rdp_import_bench_get_string");
+	return (const gchar*) g_hash_table_lookup(remminafile->settings, setting);
+}
+
+static void remmina_rdp_import_bench_set_int(RemminaFile *remminafile, const gchar *setting, gint value)
+{
+	TRACE_CALL("remmina_rdp_import_bench_set_int");
+	g_hash_table_insert(remminafile->settings, g_strdup(setting), g_strdup_printf("%i", value));
+}
+
+static gint remmina_rdp_import_bench_get_int(RemminaFile *remminafile, const gchar *setting, gint default_value)
+{
+	TRACE_CALL("remmina_rdp_import_bench_get_int");
+	const gchar *value;
+
+	value = g_hash_table_lookup(remminafile->settings, setting);
+	return (value ? atoi(value) : default_value);
+}
+
+static RemminaPluginService remmina_rdp_import_bench_service =
+{
+	.file_new = remmina_rdp_import_bench_file_new,
+	.file_set_string = remmina_rdp_import_bench_set_string,
+	.file_get_string = remmina_rdp_import_bench_get_string,
+	.file_set_int = remmina_rdp_import_bench_set_int,
+	.file_get_int = remmina_rdp_import_bench_get_int
+};
+
+typedef struct _RemminaRdpImportBench
+{
+	gchar **paths;
+	guint count;
+	volatile gint next;
+	volatile gint errors;
+} RemminaRdpImportBench;
+
+static gboolean remmina_rdp_import_bench_check(guint i, RemminaFile *remminafile)
+{
+	TRACE_CALL("remmina_rdp_import_bench_check");
+	gchar server[32];
+	gboolean ok;
+
+	if (!remminafile)
+		return FALSE;
+	g_snprintf(server, sizeof(server), "host-%05u.example.com", i);
+	ok = (g_strcmp0(remmina_rdp_import_bench_get_string(remminafile, "server"), server) == 0 &&
+		g_strcmp0(remmina_rdp_import_bench_get_string(remminafile, "resolution"), "1920x1080") == 0);
+	remmina_rdp_import_bench_file_free(remminafile);
+	return ok;
+}
+
+static gboolean remmina_rdp_import_bench_generate(RemminaRdpImportBench *bench, const gchar *dir)
+{
+	TRACE_CALL("remmina_rdp_import_bench_generate");
+	RemminaFile *remminafile;
+	gchar *content, *utf16;
+	gsize len, utf16_len;
+	FILE *fp;
+	gchar *s;
+	guint i;
+
+	remminafile = remmina_rdp_import_bench_file_new();
+	remmina_rdp_import_bench_set_string(remminafile, "resolution", "1920x1080");
+	remmina_rdp_import_bench_set_string(remminafile, "sound", "local");
+	remmina_rdp_import_bench_set_int(remminafile, "colordepth", 32);
+
+	for (i = 0; i < bench->count; i++)
+	{
+		s = g_strdup_printf("host-%05u.example.com", i);
+		remmina_rdp_import_bench_set_string(remminafile, "server", s);
+		g_free(s);
+		bench->paths[i] = g_strdup_printf("%s/host-%05u.rdp", dir, i);
+
+		fp = g_fopen(bench->paths[i], "w");
+		if (fp == NULL)
+			return FALSE;
+		remmina_rdp_file_export_channel(remminafile, fp);
+		fprintf(fp, "username:s:user%05u\r\ndomain:s:EXAMPLE\r\n", i);
+		fclose(fp);
+
+		if (i % 2)
+			continue;
+		/* Every other file in UTF-16LE with a BOM, as mstsc writes them */
+		if (!g_file_get_contents(bench->paths[i], &content, &len, NULL))
+			return FALSE;
+		utf16 = g_convert(content, len, "UTF-16LE", "UTF-8", NULL, &utf16_len, NULL);
+		g_free(content);
+		if (utf16 == NULL)
+			return FALSE;
+		content = g_malloc(utf16_len + 2);
+		content[0] = (gchar) 0xFF;
+		content[1] = (gchar) 0xFE;
+		memcpy(content + 2, utf16, utf16_len);
+		g_free(utf16);
+		if (!g_file_set_contents(bench->paths[i], content, utf16_len + 2, NULL))
+			return FALSE;
+		g_free(content);
+	}
+
+	remmina_rdp_import_bench_file_free(remminafile);
+	return TRUE;
+}
+
+static void* remmina_rdp_import_bench_thread(void *data)
+{
+	TRACE_CALL("remmina_rdp_import_bench_thread");
+	RemminaRdpImportBench *bench = (RemminaRdpImportBench*) data;
+	guint i;
+
+	while ((i = g_atomic_int_add(&bench->next, 1)) < bench->count)
+	{
+		if (!remmina_rdp_import_bench_check(i, remmina_rdp_file_import(bench->paths[i])))
+			g_atomic_int_inc(&bench->errors);
+	}
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	TRACE_CALL("main");
+	RemminaRdpImportBench bench;
+	RemminaBenchResult result;
+	pthread_t *threads;
+	gchar dir[] = "/tmp/remmina-rdp-import-XXXXXX";
+	gint64 t;
+	guint i, nthreads;
+
+	bench.count = (argc > 1 ? atoi(argv[1]) : 10000);
+	nthreads = (argc > 2 ? atoi(argv[2]) : (guint) sysconf(_SC_NPROCESSORS_ONLN));
+	if (bench.count == 0 || nthreads == 0)
+	{
+		g_printerr("Usage: %s [files] [threads]\n", argv[0]);
+		return 1;
+	}
+	bench.paths = g_new0(gchar*, bench.count + 1);
+	bench.errors = 0;
+	remmina_plugin_service = &remmina_rdp_import_bench_service;
+
+	if (!mkdtemp(dir))
+	{
+		g_printerr("Failed to create a temporary directory\n");
+		return 1;
+	}
+	t = g_get_monotonic_time();
+	if (!remmina_rdp_import_bench_generate(&bench, dir))
+	{
+		g_printerr("Failed to write the corpus in %s\n", dir);
+		return 1;
+	}
+	g_print("files        %u\n", bench.count);
+	g_print("generated in %.3f s\n", (g_get_monotonic_time() - t) / 1000000.0);
+
+	remmina_bench_start(&result);
+	for (i = 0; i < bench.count; i++)
+	{
+		if (!remmina_rdp_import_bench_check(i, remmina_rdp_file_import(bench.paths[i])))
+			bench.errors++;
+	}
+	remmina_bench_stop(&result);
+	g_print("serial       %.0f files/s\n", result.wall > 0 ? bench.count * 1000000.0 / result.wall : 0);
+	g_print("cpu/file     %.1f us\n", (gdouble) result.cpu / bench.count);
+#ifdef __GLIBC__
+	g_print("allocs/file  %.1f\n", (gdouble) result.allocs / bench.count);
+#endif
+
+	threads = g_new0(pthread_t, nthreads);
+	bench.next = 0;
+	t = g_get_monotonic_time();
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&threads[i], NULL, remmina_rdp_import_bench_thread, &bench);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	t = g_get_monotonic_time() - t;
+	g_print("threads      %u\n", nthreads);
+	g_print("parallel     %.0f files/s\n", t > 0 ? bench.count * 1000000.0 / t : 0);
+	g_print("errors       %d\n", bench.errors);
+
+	for (i = 0; i < bench.count; i++)
+		g_unlink(bench.paths[i]);
+	g_rmdir(dir);
+	g_strfreev(bench.paths);
+	g_free(threads);
+
+	return (bench.errors ? 1 : 0);
+}
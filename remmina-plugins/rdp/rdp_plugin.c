@@ -41,9 +41,11 @@
 #include "rdp_settings.h"
 #include "rdp_cliprdr.h"
 #include "rdp_channels.h"
+#include "rdp_autotune.h"
 
 #include <errno.h>
 #include <pthread.h>
+#include <string.h>
 #include <cairo/cairo-xlib.h>
 #include <freerdp/freerdp.h>
 #include <freerdp/constants.h>
@@ -57,6 +59,7 @@
 #define REMMINA_RDP_FEATURE_SCALE                2
 #define REMMINA_RDP_FEATURE_UNFOCUS              3
 #define REMMINA_RDP_FEATURE_TOOL_SENDCTRLALTDEL  4
+#define REMMINA_RDP_FEATURE_VISIBILITY           5
 
 RemminaPluginService* remmina_plugin_service = NULL;
 static char remmina_rdp_plugin_default_drive_name[]="RemminaDisk";
@@ -73,6 +76,28 @@ void rf_get_fds(RemminaProtocolWidget* gp, void** rfds, int* rcount)
 	}
 }
 
+/* Send a Suppress Output PDU for the whole desktop. When the output is
+ * allowed again, also ask for a full refresh with a Refresh Rect PDU */
+static void rf_suppress_output(rfContext* rfi, gboolean allow)
+{
+	TRACE_CALL("rf_suppress_output");
+	rdpUpdate* update = rfi->instance->update;
+	RECTANGLE_16 area;
+
+	if (!rfi->connected)
+		return;
+
+	area.left = 0;
+	area.top = 0;
+	area.right = rfi->settings->DesktopWidth - 1;
+	area.bottom = rfi->settings->DesktopHeight - 1;
+
+	if (update->SuppressOutput)
+		update->SuppressOutput((rdpContext*) rfi, allow ? 1 : 0, &area);
+	if (allow && update->RefreshRect)
+		update->RefreshRect((rdpContext*) rfi, 1, &area);
+}
+
 BOOL rf_check_fds(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL("rf_check_fds");
@@ -101,9 +126,16 @@ BOOL rf_check_fds(RemminaProtocolWidget* gp)
 				input->MouseEvent(input, event->mouse_event.flags,
 						event->mouse_event.x, event->mouse_event.y);
 				break;
+
+			case REMMINA_RDP_EVENT_TYPE_SUPPRESS_OUTPUT:
+				rf_suppress_output(rfi, event->suppress_output.allow);
+				rf_event_free(gp, event);
+				continue;
 		}
 
-		g_free(event);
+		remmina_plugin_service->protocol_plugin_stats_sample(gp, REMMINA_PROTOCOL_STAT_INPUT_LATENCY,
+				g_get_monotonic_time() - event->timestamp);
+		rf_event_free(gp, event);
 	}
 
 	if (read(rfi->event_pipe[0], buf, sizeof (buf)))
@@ -113,37 +145,142 @@ BOOL rf_check_fds(RemminaProtocolWidget* gp)
 	return True;
 }
 
+/* Completion of synchronous UI calls. Every thread waiting for the main
+ * thread owns one, created on its first sync call and reused afterwards.
+ * The UI object holds a reference, so a cancelled waiter never leaves the
+ * main thread signalling freed memory */
+struct remmina_plugin_rdp_completion
+{
+	gint refcount;
+	gboolean done;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+static void rf_completion_unref(RemminaPluginRdpCompletion* completion)
+{
+	TRACE_CALL("rf_completion_unref");
+	if (!g_atomic_int_dec_and_test(&completion->refcount))
+		return;
+	pthread_mutex_destroy(&completion->mutex);
+	pthread_cond_destroy(&completion->cond);
+	g_free(completion);
+}
+
+static GPrivate rf_completion_key = G_PRIVATE_INIT((GDestroyNotify) rf_completion_unref);
+
+static RemminaPluginRdpCompletion* rf_completion_get(void)
+{
+	TRACE_CALL("rf_completion_get");
+	RemminaPluginRdpCompletion* completion;
+
+	completion = (RemminaPluginRdpCompletion*) g_private_get(&rf_completion_key);
+	if (!completion)
+	{
+		completion = g_new0(RemminaPluginRdpCompletion, 1);
+		completion->refcount = 1;
+		pthread_mutex_init(&completion->mutex, NULL);
+		pthread_cond_init(&completion->cond, NULL);
+		g_private_set(&rf_completion_key, completion);
+	}
+	completion->done = FALSE;
+	g_atomic_int_inc(&completion->refcount);
+	return completion;
+}
+
+static void rf_completion_cleanup(void* data)
+{
+	TRACE_CALL("rf_completion_cleanup");
+	RemminaPluginRdpCompletion* completion = (RemminaPluginRdpCompletion*) data;
+
+	pthread_mutex_unlock(&completion->mutex);
+}
+
+static void rf_completion_wait(RemminaPluginRdpCompletion* completion)
+{
+	TRACE_CALL("rf_completion_wait");
+
+	/* pthread_cond_wait() stays a cancellation point */
+	CANCEL_DEFER
+	pthread_mutex_lock(&completion->mutex);
+	pthread_cleanup_push(rf_completion_cleanup, completion);
+	while (!completion->done)
+		pthread_cond_wait(&completion->cond, &completion->mutex);
+	pthread_cleanup_pop(1);
+	CANCEL_ASYNC
+}
+
+void rf_completion_signal(RemminaPluginRdpCompletion* completion)
+{
+	TRACE_CALL("rf_completion_signal");
+
+	pthread_mutex_lock(&completion->mutex);
+	completion->done = TRUE;
+	pthread_cond_signal(&completion->cond);
+	pthread_mutex_unlock(&completion->mutex);
+	rf_completion_unref(completion);
+}
+
 void rf_queue_ui(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui)
 {
 	TRACE_CALL("rf_queue_ui");
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
-	gboolean ui_sync_save;
+	RemminaPluginRdpCompletion* completion = NULL;
 
-	ui_sync_save = ui->sync;
-
-	if (ui_sync_save) {
-		pthread_mutex_init(&ui->sync_wait_mutex,NULL);
-		pthread_mutex_lock(&ui->sync_wait_mutex);
+	if (ui->sync)
+	{
+		completion = rf_completion_get();
+		ui->sync_completion = completion;
 	}
 
 	LOCK_BUFFER(TRUE)
 	g_async_queue_push(rfi->ui_queue, ui);
+	remmina_plugin_service->protocol_plugin_stats_gauge(gp, REMMINA_PROTOCOL_STAT_UI_QUEUE_DEPTH,
+			g_async_queue_length(rfi->ui_queue));
 	if (!rfi->ui_handler)
 		rfi->ui_handler = IDLE_ADD((GSourceFunc) remmina_rdp_event_queue_ui, gp);
 	UNLOCK_BUFFER(TRUE)
 
-	if (ui_sync_save) {
+	if (completion)
+	{
 		/* Wait for main thread function completion before returning */
-		pthread_mutex_lock(&ui->sync_wait_mutex);
-		pthread_mutex_unlock(&ui->sync_wait_mutex);
+		rf_completion_wait(completion);
 		rf_object_free(gp, ui);
 	}
 }
 
+/* UI objects are created for every paint, keep a few of them around
+ * instead of going through the allocator each time */
+#define RF_OBJECT_FREE_LIST_MAX 64
+
+RemminaPluginRdpUiObject* rf_object_new(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL("rf_object_new");
+	rfContext* rfi = GET_PLUGIN_DATA(gp);
+	RemminaPluginRdpUiObject* obj;
+	gboolean worker = !remmina_plugin_service->is_main_thread();
+
+	LOCK_BUFFER(worker)
+	obj = rfi->ui_free_list;
+	if (obj)
+	{
+		rfi->ui_free_list = obj->next_free;
+		rfi->ui_free_count--;
+	}
+	UNLOCK_BUFFER(worker)
+
+	if (!obj)
+		return g_new0(RemminaPluginRdpUiObject, 1);
+
+	memset(obj, 0, sizeof(RemminaPluginRdpUiObject));
+	return obj;
+}
+
 void rf_object_free(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* obj)
 {
 	TRACE_CALL("rf_object_free");
 	rfContext* rfi = GET_PLUGIN_DATA(gp);
+	gboolean worker = !remmina_plugin_service->is_main_thread();
 
 	switch (obj->type)
 	{
@@ -159,9 +296,141 @@ void rf_object_free(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* obj)
 			break;
 	}
 
+	LOCK_BUFFER(worker)
+	if (rfi->ui_free_count < RF_OBJECT_FREE_LIST_MAX)
+	{
+		obj->next_free = rfi->ui_free_list;
+		rfi->ui_free_list = obj;
+		rfi->ui_free_count++;
+		obj = NULL;
+	}
+	UNLOCK_BUFFER(worker)
+
 	g_free(obj);
 }
 
+void rf_object_free_list(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL("rf_object_free_list");
+	rfContext* rfi = GET_PLUGIN_DATA(gp);
+	RemminaPluginRdpUiObject* obj;
+	RemminaPluginRdpEvent* event;
+
+	while ((obj = rfi->ui_free_list) != NULL)
+	{
+		rfi->ui_free_list = obj->next_free;
+		g_free(obj);
+	}
+	rfi->ui_free_count = 0;
+
+	while ((event = rfi->event_free_list) != NULL)
+	{
+		rfi->event_free_list = event->next_free;
+		g_free(event);
+	}
+	rfi->event_free_count = 0;
+}
+
+/* Input events are recycled the same way, they are queued by the main
+ * thread and released by the RDP thread once sent */
+RemminaPluginRdpEvent* rf_event_new(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL("rf_event_new");
+	rfContext* rfi = GET_PLUGIN_DATA(gp);
+	RemminaPluginRdpEvent* event;
+	gboolean worker = !remmina_plugin_service->is_main_thread();
+
+	LOCK_BUFFER(worker)
+	event = rfi->event_free_list;
+	if (event)
+	{
+		rfi->event_free_list = event->next_free;
+		rfi->event_free_count--;
+	}
+	UNLOCK_BUFFER(worker)
+
+	if (!event)
+		return g_new0(RemminaPluginRdpEvent, 1);
+
+	memset(event, 0, sizeof(RemminaPluginRdpEvent));
+	return event;
+}
+
+void rf_event_free(RemminaProtocolWidget* gp, RemminaPluginRdpEvent* event)
+{
+	TRACE_CALL("rf_event_free");
+	rfContext* rfi = GET_PLUGIN_DATA(gp);
+	gboolean worker = !remmina_plugin_service->is_main_thread();
+
+	LOCK_BUFFER(worker)
+	if (rfi->event_free_count < RF_OBJECT_FREE_LIST_MAX)
+	{
+		event->next_free = rfi->event_free_list;
+		rfi->event_free_list = event;
+		rfi->event_free_count++;
+		event = NULL;
+	}
+	UNLOCK_BUFFER(worker)
+
+	g_free(event);
+}
+
+/* Serialize a surface bits command, all fields as big endian 32 bit integers */
+static void rf_capture_surface_bits(rdpContext* context, SURFACE_BITS_COMMAND* cmd)
+{
+	TRACE_CALL("rf_capture_surface_bits");
+	rfContext* rfi = (rfContext*) context;
+	GByteArray* record;
+
+	record = g_byte_array_sized_new(36 + cmd->bitmapDataLength);
+	remmina_capture_put_uint32(record, cmd->cmdType);
+	remmina_capture_put_uint32(record, cmd->destLeft);
+	remmina_capture_put_uint32(record, cmd->destTop);
+	remmina_capture_put_uint32(record, cmd->destRight);
+	remmina_capture_put_uint32(record, cmd->destBottom);
+	remmina_capture_put_uint32(record, cmd->bpp);
+	remmina_capture_put_uint32(record, cmd->codecID);
+	remmina_capture_put_uint32(record, cmd->width);
+	remmina_capture_put_uint32(record, cmd->height);
+	g_byte_array_append(record, cmd->bitmapData, cmd->bitmapDataLength);
+	remmina_capture_write(rfi->capture, REMMINA_CAPTURE_RECORD_SURFACE_BITS, record->data, record->len);
+	g_byte_array_free(record, TRUE);
+
+	rfi->capture_surface_bits(context, cmd);
+}
+
+/* With REMMINA_CAPTURE_DIR set, record the decrypted surface bits commands.
+ * The transport is TLS encrypted, so unlike VNC the raw byte stream
+ * would be useless for a replay. */
+static void rf_capture_start(rfContext* rfi)
+{
+	TRACE_CALL("rf_capture_start");
+	GByteArray* header;
+	GError* error = NULL;
+
+	rfi->capture = remmina_capture_open_write("rdp", &error);
+	if (error)
+	{
+		remmina_plugin_service->log_printf("[RDP] %s\n", error->message);
+		g_error_free(error);
+	}
+	if (!rfi->capture)
+		return;
+	remmina_plugin_service->log_printf("[RDP] Capturing session to %s\n", remmina_capture_get_filename(rfi->capture));
+
+	header = g_byte_array_new();
+	remmina_capture_put_uint32(header, rfi->settings->DesktopWidth);
+	remmina_capture_put_uint32(header, rfi->settings->DesktopHeight);
+	remmina_capture_put_uint32(header, rfi->settings->ColorDepth);
+	remmina_capture_put_uint32(header, rfi->bpp);
+	remmina_capture_put_uint32(header, rfi->settings->RemoteFxCodec);
+	remmina_capture_write(rfi->capture, REMMINA_CAPTURE_RECORD_HEADER, header->data, header->len);
+	g_byte_array_free(header, TRUE);
+
+	rfi->capture_surface_bits = rfi->instance->update->SurfaceBits;
+	rfi->instance->update->SurfaceBits = rf_capture_surface_bits;
+}
+
 void rf_begin_paint(rdpContext* context)
 {
 	TRACE_CALL("rf_begin_paint");
@@ -184,6 +453,9 @@ void rf_end_paint(rdpContext* context)
 	rfi = (rfContext*) context;
 	gp = rfi->protocol_widget;
 
+	if (rfi->capture)
+		remmina_capture_write(rfi->capture, REMMINA_CAPTURE_RECORD_FRAME, NULL, 0);
+
 	if (gdi->primary->hdc->hwnd->invalid->null)
 		return;
 
@@ -192,7 +464,11 @@ void rf_end_paint(rdpContext* context)
 	w = gdi->primary->hdc->hwnd->invalid->w;
 	h = gdi->primary->hdc->hwnd->invalid->h;
 
-	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_FRAMES, 1);
+	remmina_frame_pacer_frame(rfi->pacer);
+	remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_DAMAGE_PIXELS, (gint64) w * h);
+
+	ui = rf_object_new(rfi->protocol_widget);
 	ui->type = REMMINA_RDP_UI_UPDATE_REGION;
 	ui->region.x = x;
 	ui->region.y = y;
@@ -221,7 +497,7 @@ static void rf_desktop_resize(rdpContext* context)
 
 	/* Call to remmina_rdp_event_update_scale(gp) on the main UI thread */
 
-	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	ui = rf_object_new(gp);
 	ui->sync = TRUE;	// Wait for completion too
 	ui->type = REMMINA_RDP_UI_EVENT;
 	ui->event.type = REMMINA_RDP_UI_EVENT_UPDATE_SCALE;
@@ -346,30 +622,29 @@ static BOOL remmina_rdp_post_connect(freerdp* instance)
 	rfi->hdc->hwnd->cinvalid = (HGDI_RGN) malloc(sizeof(GDI_RGN) * rfi->hdc->hwnd->count);
 	rfi->hdc->hwnd->ninvalid = 0;
 
+	/* gdi_init() already created the glyph, brush, bitmap, offscreen and
+	 * palette caches and registered their callbacks. Registering them again
+	 * would chain the cache orders to themselves */
 	pointer_cache_register_callbacks(instance->update);
 
-/*
-	if (rfi->sw_gdi != TRUE)
-	{
-		glyph_cache_register_callbacks(instance->update);
-		brush_cache_register_callbacks(instance->update);
-		bitmap_cache_register_callbacks(instance->update);
-		offscreen_cache_register_callbacks(instance->update);
-		palette_cache_register_callbacks(instance->update);
-	}
-*/
-
 	instance->update->BeginPaint = rf_begin_paint;
 	instance->update->EndPaint = rf_end_paint;
 	instance->update->DesktopResize = rf_desktop_resize;
 
+	rf_capture_start(rfi);
+	remmina_rdp_autotune_start(rfi);
+
 	remmina_rdp_clipboard_init(rfi);
 	freerdp_channels_post_connect(instance->context->channels, instance);
 	rfi->connected = True;
 
+	/* The session may have been opened in a background tab */
+	if (!remmina_plugin_service->protocol_plugin_is_visible(gp))
+		rf_suppress_output(rfi, FALSE);
+
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "connect");
 
-	ui = g_new0(RemminaPluginRdpUiObject, 1);
+	ui = rf_object_new(gp);
 	ui->type = REMMINA_RDP_UI_CONNECTED;
 	rf_queue_ui(gp, ui);
 
@@ -482,6 +757,7 @@ static void remmina_rdp_main_loop(RemminaProtocolWidget* gp)
 	int rcount;
 	int wcount;
 	int max_fds;
+	gint64 start;
 	void *rfds[32];
 	void *wfds[32];
 	fd_set rfds_set;
@@ -509,6 +785,7 @@ static void remmina_rdp_main_loop(RemminaProtocolWidget* gp)
 			break;
 		}
 		rf_get_fds(gp, rfds, &rcount);
+		remmina_rdp_autotune_sample(rfi, rfds, rcount);
 
 		max_fds = 0;
 		FD_ZERO(&rfds_set);
@@ -552,11 +829,14 @@ static void remmina_rdp_main_loop(RemminaProtocolWidget* gp)
 			}
 		}
 
-		/* check the libfreerdp fds */
+		/* check the libfreerdp fds, this is where updates are decoded */
+		start = g_get_monotonic_time();
 		if (!freerdp_check_fds(rfi->instance))
 		{
 			break;
 		}
+		remmina_plugin_service->protocol_plugin_stats_sample(gp, REMMINA_PROTOCOL_STAT_DECODE_TIME,
+				g_get_monotonic_time() - start);
 		/* check channel fds */
 		if (!freerdp_channels_check_fds(channels, rfi->instance))
 		{
@@ -670,6 +950,9 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget* gp)
 		g_free(hostport);
 	}
 
+	if (remmina_plugin_service->file_get_int(remminafile, "quality", DEFAULT_QUALITY_0) == REMMINA_RDP_QUALITY_AUTO)
+		remmina_rdp_autotune_init(rfi, remminafile, host, port);
+
 	if (cert_host != host) g_free(cert_host);
 	g_free(host);
 	g_free(s);
@@ -731,7 +1014,11 @@ static gboolean remmina_rdp_main(RemminaProtocolWidget* gp)
 	value = remmina_plugin_service->pref_get_value(s);
 	g_free(s);
 
-	if (value && value[0])
+	if (rfi->autotune)
+	{
+		remmina_rdp_autotune_apply(rfi);
+	}
+	else if (value && value[0])
 	{
 		rfi->settings->PerformanceFlags = strtoul(value, NULL, 16);
 	}
@@ -1019,6 +1306,12 @@ static gboolean remmina_rdp_close_connection(RemminaProtocolWidget* gp)
 
 	pthread_mutex_destroy(&rfi->mutex);
 
+	/* Remember the measured link for the next automatic quality connection.
+	 * Only sessions sampling the link learn it, not the ones through SSH */
+	if (rfi->autotune && rfi->autotune_session && rfi->autotune_link != REMMINA_RDP_LINK_UNKNOWN)
+		remmina_plugin_service->file_set_int(remmina_plugin_service->protocol_plugin_get_file(gp),
+			"rdp_auto_link", rfi->autotune_link);
+
 	remmina_rdp_event_uninit(gp);
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "disconnect");
 
@@ -1034,6 +1327,12 @@ static gboolean remmina_rdp_close_connection(RemminaProtocolWidget* gp)
 
 	remmina_rdp_clipboard_free(rfi);
 
+	if (rfi->capture)
+	{
+		remmina_capture_close(rfi->capture);
+		rfi->capture = NULL;
+	}
+
 	if (rfi->rfx_context)
 	{
 		rfx_context_free(rfi->rfx_context);
@@ -1093,6 +1392,10 @@ static void remmina_rdp_call_feature(RemminaProtocolWidget* gp, const RemminaPro
 			remmina_rdp_send_ctrlaltdel(gp);
 			break;
 
+		case REMMINA_RDP_FEATURE_VISIBILITY:
+			remmina_rdp_event_suppress_output(gp, !remmina_plugin_service->protocol_plugin_is_visible(gp));
+			break;
+
 		default:
 			break;
 	}
@@ -1117,6 +1420,7 @@ static gpointer quality_list[] =
 	"1", N_("Medium"),
 	"2", N_("Good"),
 	"9", N_("Best (slowest)"),
+	"-1", N_("Automatic"),
 	NULL
 };
 
@@ -1196,6 +1500,7 @@ static const RemminaProtocolFeature remmina_rdp_features[] =
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_SCALE, REMMINA_RDP_FEATURE_SCALE, NULL, NULL, NULL },
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_TOOL, REMMINA_RDP_FEATURE_TOOL_SENDCTRLALTDEL, N_("Send Ctrl+Alt+Delete"), NULL, NULL },
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_UNFOCUS, REMMINA_RDP_FEATURE_UNFOCUS, NULL, NULL, NULL },
+	{ REMMINA_PROTOCOL_FEATURE_TYPE_VISIBILITY, REMMINA_RDP_FEATURE_VISIBILITY, NULL, NULL, NULL },
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_END, 0, NULL, NULL, NULL }
 };
 
@@ -1232,7 +1537,8 @@ static RemminaFilePlugin remmina_rdpf =
 	remmina_rdp_file_import,                      // Import function
 	remmina_rdp_file_export_test,                 // Test export function
 	remmina_rdp_file_export,                      // Export function
-	NULL
+	NULL,                                         // Export hints
+	TRUE                                          // Import is thread safe
 };
 
 /* Preferences plugin definition and features */
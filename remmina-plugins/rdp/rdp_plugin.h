@@ -37,6 +37,8 @@
 #define __REMMINA_RDP_H__
 
 #include "common/remmina_plugin.h"
+#include "common/remmina_capture.h"
+#include "common/remmina_frame_pacer.h"
 #include <freerdp/freerdp.h>
 #include <freerdp/channels/channels.h>
 #include <freerdp/codec/color.h>
@@ -50,6 +52,7 @@
 #include <winpr/clipboard.h>
 
 typedef struct rf_context rfContext;
+typedef struct remmina_plugin_rdp_completion RemminaPluginRdpCompletion;
 
 #define LOCK_BUFFER(t)	  	if (t) {CANCEL_DEFER} pthread_mutex_lock(&rfi->mutex);
 #define UNLOCK_BUFFER(t)	pthread_mutex_unlock(&rfi->mutex); if (t) {CANCEL_ASYNC}
@@ -61,6 +64,9 @@ typedef struct rf_context rfContext;
 #define DEFAULT_QUALITY_2	0x01
 #define DEFAULT_QUALITY_9	0x80
 
+/* "quality" value selecting the profile from the measured link */
+#define REMMINA_RDP_QUALITY_AUTO	-1
+
 extern RemminaPluginService* remmina_plugin_service;
 
 
@@ -90,25 +96,12 @@ typedef struct rf_clipboard rfClipboard;
 struct rf_pointer
 {
 	rdpPointer pointer;
+	/* Owned by the cursor cache entry, see rdp_cursor.c */
 	GdkCursor* cursor;
+	struct remmina_rdp_cursor* cache_entry;
 };
 typedef struct rf_pointer rfPointer;
 
-struct rf_bitmap
-{
-	rdpBitmap bitmap;
-	Pixmap pixmap;
-	cairo_surface_t* surface;
-};
-typedef struct rf_bitmap rfBitmap;
-
-struct rf_glyph
-{
-	rdpGlyph glyph;
-	Pixmap pixmap;
-};
-typedef struct rf_glyph rfGlyph;
-
 struct rf_context
 {
 	rdpContext _p;
@@ -163,6 +156,12 @@ struct rf_context
 
 	GAsyncQueue* ui_queue;
 	guint ui_handler;
+	RemminaFramePacer* pacer;
+	/* Recycled UI objects and input events, protected by rfi->mutex */
+	struct remmina_plugin_rdp_ui_object* ui_free_list;
+	gint ui_free_count;
+	struct remmina_plugin_rdp_event* event_free_list;
+	gint event_free_count;
 
 
 
@@ -171,17 +170,37 @@ struct rf_context
 	gint event_pipe[2];
 
 	rfClipboard clipboard;
+
+	/* Protocol capture, the original SurfaceBits callback is chained */
+	RemminaCapture* capture;
+	pSurfaceBits capture_surface_bits;
+
+	/* Automatic quality, see rdp_autotune.c */
+	gboolean autotune;
+	gboolean autotune_session;
+	gint autotune_link;
+	gint autotune_pending;
+	gint autotune_count;
+	gint64 autotune_rtt_min;
+	gint64 autotune_time;
+	gint64 autotune_bytes;
+	pSurfaceBits autotune_surface_bits;
+	pBitmapUpdate autotune_bitmap_update;
 };
 
 typedef enum
 {
 	REMMINA_RDP_EVENT_TYPE_SCANCODE,
-	REMMINA_RDP_EVENT_TYPE_MOUSE
+	REMMINA_RDP_EVENT_TYPE_MOUSE,
+	REMMINA_RDP_EVENT_TYPE_SUPPRESS_OUTPUT
 } RemminaPluginRdpEventType;
 
 struct remmina_plugin_rdp_event
 {
 	RemminaPluginRdpEventType type;
+	gint64 timestamp;
+	/* Link in the free list while the event is not in use */
+	struct remmina_plugin_rdp_event* next_free;
 	union
 	{
 		struct
@@ -196,6 +215,10 @@ struct remmina_plugin_rdp_event
 			UINT16 x;
 			UINT16 y;
 		} mouse_event;
+		struct
+		{
+			BOOL allow;
+		} suppress_output;
 	};
 };
 typedef struct remmina_plugin_rdp_event RemminaPluginRdpEvent;
@@ -238,7 +261,10 @@ struct remmina_plugin_rdp_ui_object
 {
 	RemminaPluginRdpUiType type;
 	gboolean sync;
-	pthread_mutex_t sync_wait_mutex;
+	/* Signalled by the main thread once a sync object is processed */
+	RemminaPluginRdpCompletion* sync_completion;
+	/* Link in the free list while the object is not in use */
+	struct remmina_plugin_rdp_ui_object* next_free;
 	union
 	{
 		struct
@@ -287,7 +313,12 @@ void rf_uninit(RemminaProtocolWidget* gp);
 void rf_get_fds(RemminaProtocolWidget* gp, void** rfds, int* rcount);
 BOOL rf_check_fds(RemminaProtocolWidget* gp);
 void rf_queue_ui(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* ui);
+RemminaPluginRdpUiObject* rf_object_new(RemminaProtocolWidget* gp);
 void rf_object_free(RemminaProtocolWidget* gp, RemminaPluginRdpUiObject* obj);
+void rf_object_free_list(RemminaProtocolWidget* gp);
+RemminaPluginRdpEvent* rf_event_new(RemminaProtocolWidget* gp);
+void rf_event_free(RemminaProtocolWidget* gp, RemminaPluginRdpEvent* event);
+void rf_completion_signal(RemminaPluginRdpCompletion* completion);
 
 #endif
 
@@ -0,0 +1,319 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Headless replay benchmark for the VNC plugin.
+ *
+ * Feeds a capture recorded with REMMINA_CAPTURE_DIR through libvncclient
+ * and the plugin's own framebuffer update path, without any window or
+ * network connection, and reports frames per second, CPU time and heap
+ * allocations per frame.
+ *
+ * The plugin source is included directly so the static decode functions
+ * can be driven as they are, instead of duplicating them here. */
+
+#include "vnc_plugin.c"
+#include "common/remmina_bench.h"
+
+typedef struct _RemminaVncBench
+{
+	gint width;
+	gint height;
+	rfbPixelFormat format;
+	RemminaCapture *capture;
+	gint fd;
+} RemminaVncBench;
+
+static RemminaVncBench remmina_vnc_bench;
+
+/* Minimal plugin service: only what the update path calls */
+static gint remmina_vnc_bench_get_width(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL("remmina_vnc_bench_get_width");
+	return remmina_vnc_bench.width;
+}
+
+static void remmina_vnc_bench_set_width(RemminaProtocolWidget *gp, gint width)
+{
+	TRACE_CALL("remmina_vnc_bench_set_width");
+	remmina_vnc_bench.width = width;
+}
+
+static gint remmina_vnc_bench_get_height(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL("remmina_vnc_bench_get_height");
+	return remmina_vnc_bench.height;
+}
+
+static void remmina_vnc_bench_set_height(RemminaProtocolWidget *gp, gint height)
+{
+	TRACE_CALL("remmina_vnc_bench_set_height");
+	remmina_vnc_bench.height = height;
+}
+
+static gboolean remmina_vnc_bench_get_scale(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL("remmina_vnc_bench_get_scale");
+	return FALSE;
+}
+
+static void remmina_vnc_bench_stats(RemminaProtocolWidget *gp, RemminaProtocolStat stat, gint64 value)
+{
+	TRACE_CALL("remmina_vnc_bench_stats");
+}
+
+static RemminaPluginService remmina_vnc_bench_service =
+{
+	.protocol_plugin_get_width = remmina_vnc_bench_get_width,
+	.protocol_plugin_set_width = remmina_vnc_bench_set_width,
+	.protocol_plugin_get_height = remmina_vnc_bench_get_height,
+	.protocol_plugin_set_height = remmina_vnc_bench_set_height,
+	.protocol_plugin_get_scale = remmina_vnc_bench_get_scale,
+	.protocol_plugin_stats_count = remmina_vnc_bench_stats,
+	.protocol_plugin_stats_gauge = remmina_vnc_bench_stats,
+	.protocol_plugin_stats_sample = remmina_vnc_bench_stats
+};
+
+/* Same buffers as remmina_plugin_vnc_rfb_allocfb(), without the widgets */
+static rfbBool remmina_vnc_bench_allocfb(rfbClient *cl)
+{
+	TRACE_CALL("remmina_vnc_bench_allocfb");
+	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+
+	if (gpdata->surface)
+		cairo_surface_destroy(gpdata->surface);
+	g_free(gpdata->vnc_buffer);
+	gpdata->surface = NULL;
+	gpdata->vnc_buffer = NULL;
+	if (!remmina_plugin_vnc_alloc_surface(cl, &gpdata->surface, &gpdata->vnc_buffer))
+		return FALSE;
+	cl->frameBuffer = (gpdata->vnc_buffer ? gpdata->vnc_buffer : cairo_image_surface_get_data(gpdata->surface));
+	remmina_vnc_bench_set_width(gp, cl->width);
+	remmina_vnc_bench_set_height(gp, cl->height);
+	return TRUE;
+}
+
+/* Write to the client socket, throwing away whatever the client sends
+ * meanwhile so it never blocks on a full socket buffer */
+static gboolean remmina_vnc_bench_send(gint fd, const guchar *buf, gsize len)
+{
+	TRACE_CALL("remmina_vnc_bench_send");
+	struct pollfd pfd;
+	guchar discard[4096];
+	gssize n;
+
+	while (len > 0)
+	{
+		pfd.fd = fd;
+		pfd.events = POLLIN | POLLOUT;
+		if (poll(&pfd, 1, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		if (pfd.revents & POLLIN)
+		{
+			if (read(fd, discard, sizeof(discard)) <= 0)
+				return FALSE;
+		}
+		if (pfd.revents & POLLOUT)
+		{
+			n = write(fd, buf, len);
+			if (n <= 0)
+				return FALSE;
+			buf += n;
+			len -= n;
+		}
+		if (pfd.revents & (POLLERR | POLLHUP))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Plays the server side: a security-less RFB 3.8 handshake announcing the
+ * captured framebuffer, then every recorded server chunk as fast as possible */
+static gpointer remmina_vnc_bench_feed(gpointer data)
+{
+	TRACE_CALL("remmina_vnc_bench_feed");
+	RemminaVncBench *bench = (RemminaVncBench*) data;
+	RemminaCaptureRecordType type;
+	GByteArray *init;
+	const guchar *payload;
+	gint64 timestamp;
+	guint32 len;
+	static const guchar security[] = { 1, rfbNoAuth, 0, 0, 0, 0 };
+
+	init = g_byte_array_new();
+	g_byte_array_append(init, (const guint8*) "RFB 003.008\n", 12);
+	g_byte_array_append(init, security, sizeof(security));
+	remmina_capture_put_uint16(init, bench->width);
+	remmina_capture_put_uint16(init, bench->height);
+	g_byte_array_append(init, &bench->format.bitsPerPixel, 1);
+	g_byte_array_append(init, &bench->format.depth, 1);
+	g_byte_array_append(init, &bench->format.bigEndian, 1);
+	g_byte_array_append(init, &bench->format.trueColour, 1);
+	remmina_capture_put_uint16(init, bench->format.redMax);
+	remmina_capture_put_uint16(init, bench->format.greenMax);
+	remmina_capture_put_uint16(init, bench->format.blueMax);
+	g_byte_array_append(init, &bench->format.redShift, 1);
+	g_byte_array_append(init, &bench->format.greenShift, 1);
+	g_byte_array_append(init, &bench->format.blueShift, 1);
+	g_byte_array_append(init, (const guint8*) "\0\0\0", 3);
+	remmina_capture_put_uint32(init, 6);
+	g_byte_array_append(init, (const guint8*) "replay", 6);
+
+	if (remmina_vnc_bench_send(bench->fd, init->data, init->len))
+	{
+		while (remmina_capture_read(bench->capture, &type, &timestamp, &payload, &len))
+		{
+			if (type == REMMINA_CAPTURE_RECORD_DATA && !remmina_vnc_bench_send(bench->fd, payload, len))
+				break;
+		}
+	}
+	g_byte_array_free(init, TRUE);
+
+	/* End of capture, the client sees the server going away */
+	close(bench->fd);
+	return NULL;
+}
+
+static gboolean remmina_vnc_bench_read_header(RemminaVncBench *bench)
+{
+	TRACE_CALL("remmina_vnc_bench_read_header");
+	RemminaCaptureRecordType type;
+	const guchar *p;
+	gint64 timestamp;
+	guint32 len;
+
+	if (!remmina_capture_read(bench->capture, &type, &timestamp, &p, &len)
+			|| type != REMMINA_CAPTURE_RECORD_HEADER || len < 17)
+		return FALSE;
+
+	bench->width = remmina_capture_get_uint16(p);
+	bench->height = remmina_capture_get_uint16(p + 2);
+	bench->format.bitsPerPixel = p[4];
+	bench->format.depth = p[5];
+	bench->format.bigEndian = p[6];
+	bench->format.trueColour = p[7];
+	bench->format.redMax = remmina_capture_get_uint16(p + 8);
+	bench->format.greenMax = remmina_capture_get_uint16(p + 10);
+	bench->format.blueMax = remmina_capture_get_uint16(p + 12);
+	bench->format.redShift = p[14];
+	bench->format.greenShift = p[15];
+	bench->format.blueShift = p[16];
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	TRACE_CALL("main");
+	RemminaProtocolWidget *gp;
+	RemminaPluginVncData *gpdata;
+	rfbClient *cl;
+	pthread_t feeder;
+	gint sv[2];
+	RemminaBenchResult result;
+
+	if (argc != 2)
+	{
+		g_printerr("Usage: %s <capture.rmcap>\n", argv[0]);
+		return 1;
+	}
+
+	remmina_vnc_bench.capture = remmina_capture_open_read(argv[1]);
+	if (!remmina_vnc_bench.capture || !remmina_vnc_bench_read_header(&remmina_vnc_bench))
+	{
+		g_printerr("%s is not a VNC capture\n", argv[1]);
+		return 1;
+	}
+
+	remmina_plugin_service = &remmina_vnc_bench_service;
+	rfbClientLog = remmina_plugin_vnc_rfb_output;
+	rfbClientErr = remmina_plugin_vnc_rfb_output;
+
+	/* Any GObject can carry the plugin data, the update path never touches the widget */
+	gp = (RemminaProtocolWidget*) g_object_new(G_TYPE_OBJECT, NULL);
+	gpdata = g_new0(RemminaPluginVncData, 1);
+	g_object_set_data_full(G_OBJECT(gp), "plugin-data", gpdata, g_free);
+	pthread_mutex_init(&gpdata->buffer_mutex, NULL);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return 1;
+	remmina_vnc_bench.fd = sv[1];
+
+	cl = rfbGetClient(8, 3, 4);
+	cl->MallocFrameBuffer = remmina_vnc_bench_allocfb;
+	cl->canHandleNewFBSize = TRUE;
+	cl->GotFrameBufferUpdate = remmina_plugin_vnc_rfb_updatefb;
+	cl->format = remmina_vnc_bench.format;
+	rfbClientSetClientData(cl, NULL, gp);
+	/* Like an incoming connection: the socket is already there */
+	cl->listenSpecified = TRUE;
+	cl->sock = sv[0];
+	SetNonBlocking(cl->sock);
+
+	pthread_create(&feeder, NULL, remmina_vnc_bench_feed, &remmina_vnc_bench);
+
+	if (!rfbInitClient(cl, NULL, NULL))
+	{
+		g_printerr("Replay handshake failed\n");
+		return 1;
+	}
+
+	remmina_bench_start(&result);
+
+	while (WaitForMessage(cl, 1000000) > 0 && HandleRFBServerMessage(cl))
+	{
+		if (gpdata->frame_damaged)
+		{
+			gpdata->frame_damaged = FALSE;
+			result.frames++;
+		}
+	}
+
+	remmina_bench_stop(&result);
+	pthread_join(feeder, NULL);
+
+	g_print("framebuffer  %dx%d, %d bpp\n", remmina_vnc_bench.width, remmina_vnc_bench.height,
+			remmina_vnc_bench.format.bitsPerPixel);
+	remmina_bench_report(argv[1], &result);
+
+	rfbClientCleanup(cl);
+	remmina_capture_close(remmina_vnc_bench.capture);
+	g_object_unref(gp);
+	return 0;
+}
+
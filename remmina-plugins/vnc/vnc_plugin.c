@@ -34,6 +34,9 @@
  */
 
 #include "common/remmina_plugin.h"
+#include "common/remmina_capture.h"
+#include "common/remmina_frame_pacer.h"
+#include <poll.h>
 
 #define REMMINA_PLUGIN_VNC_FEATURE_PREF_QUALITY            1
 #define REMMINA_PLUGIN_VNC_FEATURE_PREF_VIEWONLY           2
@@ -43,9 +46,36 @@
 #define REMMINA_PLUGIN_VNC_FEATURE_SCALE                   6
 #define REMMINA_PLUGIN_VNC_FEATURE_UNFOCUS                 7
 #define REMMINA_PLUGIN_VNC_FEATURE_TOOL_SENDCTRLALTDEL     8
+#define REMMINA_PLUGIN_VNC_FEATURE_VISIBILITY              9
 
 #define GET_PLUGIN_DATA(gp) (RemminaPluginVncData*) g_object_get_data(G_OBJECT(gp), "plugin-data")
 
+/* "quality" value letting remmina_plugin_vnc_autoquality_sample() pick the encodings */
+#define REMMINA_PLUGIN_VNC_QUALITY_AUTO -1
+
+/* Server data buffered by the I/O relay before it stops reading the socket */
+#define REMMINA_PLUGIN_VNC_IO_QUEUE_MAX (16 * 1024 * 1024)
+
+/* Cursor shapes kept per session */
+#define REMMINA_PLUGIN_VNC_CURSOR_CACHE_MAX 64
+
+/* A cursor shape sent by the server. The VNC thread converts new shapes to
+ * a pixbuf, the main thread turns it into a GdkCursor when first set */
+typedef struct _RemminaPluginVncCursor
+{
+	guint64 hash;
+	gint width;
+	gint height;
+	gint xhot;
+	gint yhot;
+	gint bytes_per_pixel;
+	/* Source pixels followed by the mask, to rule out hash collisions */
+	guchar *shape;
+	gsize shape_len;
+	GdkPixbuf *pixbuf;
+	GdkCursor *cursor;
+} RemminaPluginVncCursor;
+
 typedef struct _RemminaPluginVncData
 {
 	/* Whether the user requests to connect/disconnect */
@@ -58,22 +88,23 @@ typedef struct _RemminaPluginVncData
 	gboolean auth_first;
 
 	GtkWidget *drawing_area;
+	/* The desktop as cairo RGB24. libvncclient decodes straight into it
+	 * when the pixel format allows, otherwise into vnc_buffer */
+	cairo_surface_t *surface;
 	guchar *vnc_buffer;
-	GdkPixbuf *rgb_buffer;
 
-	GdkPixbuf *scale_buffer;
+	/* Size of drawing_area, to map pointer events when scaling */
 	gint scale_width;
 	gint scale_height;
-	guint scale_handler;
 
-	gint queuedraw_x, queuedraw_y, queuedraw_w, queuedraw_h;
-	guint queuedraw_handler;
+	RemminaFramePacer *pacer;
 
 	gulong clipboard_handler;
 	GTimeVal clipboard_timer;
 
-	GdkPixbuf *queuecursor_pixbuf;
-	gint queuecursor_x, queuecursor_y;
+	/* Most recently used first, protected by buffer_mutex */
+	GQueue *cursor_cache;
+	RemminaPluginVncCursor *queuecursor;
 	guint queuecursor_handler;
 
 	gpointer client;
@@ -89,6 +120,46 @@ typedef struct _RemminaPluginVncData
 	pthread_t thread;
 	pthread_mutex_t buffer_mutex;
 
+	/* Set by the framebuffer update callback, used to count frames */
+	gboolean frame_damaged;
+
+	/* Automatic quality, only used by the VNC thread */
+	gboolean autoquality;
+	gint autoquality_level;
+	gint autoquality_vote;
+	gint autoquality_static;
+	gboolean autoquality_lossy;
+	gint64 autoquality_window;
+	gint64 autoquality_busy;
+	gint64 autoquality_pixels;
+	gint autoquality_frames;
+
+	/* Pipelined update requests and continuous updates, VNC thread only */
+	gboolean pipeline;
+	gboolean pipeline_saturated;
+	gint pipeline_extra;
+	gint64 pipeline_last;
+	gint64 pipeline_window;
+	gint64 pipeline_busy;
+	gboolean fence_supported;
+	gboolean cu_supported;
+	gboolean cu_enabled;
+
+	/* Socket I/O relay and protocol capture, see remmina_plugin_vnc_io_start() */
+	RemminaCapture *capture;
+	gboolean io_running;
+	pthread_t io_thread;
+	gint io_sock;
+	gint io_pair;
+
+	/* Pixel conversion worker, see remmina_plugin_vnc_convert_worker() */
+	gboolean convert_running;
+	gboolean convert_quit;
+	pthread_t convert_thread;
+	pthread_mutex_t convert_mutex;
+	pthread_cond_t convert_cond;
+	cairo_region_t *convert_region;
+
 } RemminaPluginVncData;
 
 static RemminaPluginService *remmina_plugin_service = NULL;
@@ -109,12 +180,15 @@ enum
 	REMMINA_PLUGIN_VNC_EVENT_CUTTEXT,
 	REMMINA_PLUGIN_VNC_EVENT_CHAT_OPEN,
 	REMMINA_PLUGIN_VNC_EVENT_CHAT_SEND,
-	REMMINA_PLUGIN_VNC_EVENT_CHAT_CLOSE
+	REMMINA_PLUGIN_VNC_EVENT_CHAT_CLOSE,
+	REMMINA_PLUGIN_VNC_EVENT_VISIBILITY,
+	REMMINA_PLUGIN_VNC_EVENT_QUALITY
 };
 
 typedef struct _RemminaPluginVncEvent
 {
 	gint event_type;
+	gint64 timestamp;
 	union
 	{
 		struct
@@ -132,6 +206,14 @@ typedef struct _RemminaPluginVncEvent
 		{
 			gchar *text;
 		} text;
+		struct
+		{
+			gboolean visible;
+		} visibility;
+		struct
+		{
+			gint quality;
+		} quality;
 	} event_data;
 } RemminaPluginVncEvent;
 
@@ -141,7 +223,7 @@ typedef struct _RemminaPluginVncEvent
 static void remmina_plugin_vnc_update_scale(RemminaProtocolWidget *gp, gboolean scale);
 
 struct onMainThread_cb_data {
-	enum { FUNC_GTK_WIDGET_QUEUE_DRAW_AREA, FUNC_UPDATE_SCALE } func;
+	enum { FUNC_UPDATE_SCALE } func;
 
 	GtkWidget *widget;
 	gint x, y, width, height;
@@ -159,9 +241,6 @@ static gboolean onMainThread_cb(struct onMainThread_cb_data *d)
 	TRACE_CALL("onMainThread_cb");
 	if ( !d->cancelled ) {
 		switch( d->func ) {
-			case FUNC_GTK_WIDGET_QUEUE_DRAW_AREA:
-				gtk_widget_queue_draw_area( d->widget, d->x, d->y, d->width, d->height );
-				break;
 			case FUNC_UPDATE_SCALE:
 				remmina_plugin_vnc_update_scale( d->gp, d->scale );
 				break;
@@ -198,19 +277,6 @@ static void onMainThread_schedule_callback_and_wait( struct onMainThread_cb_data
 	pthread_mutex_destroy( &d->mu );
 }
 
-static void onMainThread_gtk_widget_queue_draw_area(GtkWidget *widget, gint x, gint y, gint width, gint height )
-{
-	TRACE_CALL("onMainThread_gtk_widget_queue_draw_area");
-	struct onMainThread_cb_data *d;
-	d = (struct onMainThread_cb_data *)g_malloc( sizeof(struct onMainThread_cb_data) );
-	d->func = FUNC_GTK_WIDGET_QUEUE_DRAW_AREA;
-	d->widget = widget;
-	d->x = x; d->y = y; d->width = width; d->height = height;
-	onMainThread_schedule_callback_and_wait( d );
-	g_free(d);
-}
-
-
 /* --------------------------------------- */
 
 
@@ -223,6 +289,7 @@ static void remmina_plugin_vnc_event_push(RemminaProtocolWidget *gp, gint event_
 
 	event = g_new(RemminaPluginVncEvent, 1);
 	event->event_type = event_type;
+	event->timestamp = g_get_monotonic_time();
 	switch (event_type)
 	{
 		case REMMINA_PLUGIN_VNC_EVENT_KEY:
@@ -238,10 +305,20 @@ static void remmina_plugin_vnc_event_push(RemminaProtocolWidget *gp, gint event_
 		case REMMINA_PLUGIN_VNC_EVENT_CHAT_SEND:
 			event->event_data.text.text = g_strdup((char*) p1);
 			break;
+		case REMMINA_PLUGIN_VNC_EVENT_VISIBILITY:
+			event->event_data.visibility.visible = GPOINTER_TO_INT(p1);
+			break;
+		case REMMINA_PLUGIN_VNC_EVENT_QUALITY:
+			event->event_data.quality.quality = GPOINTER_TO_INT(p1);
+			break;
 		default:
 			break;
 	}
 	g_queue_push_tail(gpdata->vnc_event_queue, event);
+	if (event_type != REMMINA_PLUGIN_VNC_EVENT_VISIBILITY && event_type != REMMINA_PLUGIN_VNC_EVENT_QUALITY)
+		remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_INPUT_EVENTS, 1);
+	remmina_plugin_service->protocol_plugin_stats_gauge(gp, REMMINA_PROTOCOL_STAT_EVENT_QUEUE_DEPTH,
+			g_queue_get_length(gpdata->vnc_event_queue));
 	if (write(gpdata->vnc_event_pipe[1], "\0", 1))
 	{
 		/* Ignore */
@@ -275,6 +352,7 @@ static void remmina_plugin_vnc_event_free_all(RemminaProtocolWidget *gp)
 	}
 }
 
+/* Expand a damaged area of the desktop to the scaled drawing area */
 static void remmina_plugin_vnc_scale_area(RemminaProtocolWidget *gp, gint *x, gint *y, gint *w, gint *h)
 {
 	TRACE_CALL("remmina_plugin_vnc_scale_area");
@@ -282,18 +360,13 @@ static void remmina_plugin_vnc_scale_area(RemminaProtocolWidget *gp, gint *x, gi
 	gint sx, sy, sw, sh;
 	gint width, height;
 
-	if (gpdata->rgb_buffer == NULL || gpdata->scale_buffer == NULL)
-		return;
-
 	width = remmina_plugin_service->protocol_plugin_get_width(gp);
 	height = remmina_plugin_service->protocol_plugin_get_height(gp);
 
+	if (width < 1 || height < 1 || gpdata->scale_width < 1 || gpdata->scale_height < 1)
+		return;
 	if (gpdata->scale_width == width && gpdata->scale_height == height)
-	{
-		/* Same size, just copy the pixels */
-		gdk_pixbuf_copy_area(gpdata->rgb_buffer, *x, *y, *w, *h, gpdata->scale_buffer, *x, *y);
 		return;
-	}
 
 	/* We have to extend the scaled region 2 scaled pixels, to avoid gaps */
 	sx = MIN(MAX(0, (*x) * gpdata->scale_width / width - gpdata->scale_width / width - 2), gpdata->scale_width - 1);
@@ -301,100 +374,12 @@ static void remmina_plugin_vnc_scale_area(RemminaProtocolWidget *gp, gint *x, gi
 	sw = MIN(gpdata->scale_width - sx, (*w) * gpdata->scale_width / width + gpdata->scale_width / width + 4);
 	sh = MIN(gpdata->scale_height - sy, (*h) * gpdata->scale_height / height + gpdata->scale_height / height + 4);
 
-	gdk_pixbuf_scale(gpdata->rgb_buffer, gpdata->scale_buffer, sx, sy, sw, sh, 0, 0,
-			(double) gpdata->scale_width / (double) width, (double) gpdata->scale_height / (double) height,
-			remmina_plugin_service->pref_get_scale_quality());
-
 	*x = sx;
 	*y = sy;
 	*w = sw;
 	*h = sh;
 }
 
-static gboolean remmina_plugin_vnc_update_scale_buffer(RemminaProtocolWidget *gp, gboolean in_thread)
-{
-	TRACE_CALL("remmina_plugin_vnc_update_scale_buffer");
-	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	RemminaFile *remminafile;
-	gint width, height;
-	gint gpwidth, gpheight;
-	gboolean scale;
-	gint x, y, w, h;
-	GdkPixbuf *pixbuf;
-	GtkAllocation a;
-
-	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
-
-	if (gpdata->running)
-	{
-		gtk_widget_get_allocation(GTK_WIDGET(gp), &a);
-		width = a.width;
-		height = a.height;
-		scale = remmina_plugin_service->protocol_plugin_get_scale(gp);
-		if (scale)
-		{
-			if (width > 1 && height > 1)
-			{
-				LOCK_BUFFER (in_thread)
-
-				if (gpdata->scale_buffer)
-				{
-					g_object_unref(gpdata->scale_buffer);
-				}
-				gpwidth = remmina_plugin_service->protocol_plugin_get_width(gp);
-				gpheight = remmina_plugin_service->protocol_plugin_get_height(gp);
-				gpdata->scale_width = width;
-				gpdata->scale_height = height;
-
-				pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, gpdata->scale_width,
-						gpdata->scale_height);
-				gpdata->scale_buffer = pixbuf;
-
-				x = 0;
-				y = 0;
-				w = gpwidth;
-				h = gpheight;
-				remmina_plugin_vnc_scale_area(gp, &x, &y, &w, &h);
-
-UNLOCK_BUFFER			(in_thread)
-		}
-	}
-	else
-	{
-		LOCK_BUFFER (in_thread)
-
-		if (gpdata->scale_buffer)
-		{
-			g_object_unref (gpdata->scale_buffer);
-			gpdata->scale_buffer = NULL;
-		}
-		gpdata->scale_width = 0;
-		gpdata->scale_height = 0;
-
-		UNLOCK_BUFFER (in_thread)
-	}
-		if (width > 1 && height > 1)
-		{
-			if (in_thread)
-			{
-				onMainThread_gtk_widget_queue_draw_area(GTK_WIDGET(gp), 0, 0, width, height);
-			}
-			else
-			{
-				gtk_widget_queue_draw_area(GTK_WIDGET(gp), 0, 0, width, height);
-			}
-		}
-	}
-	gpdata->scale_handler = 0;
-	return FALSE;
-}
-
-static gboolean remmina_plugin_vnc_update_scale_buffer_main(RemminaProtocolWidget *gp)
-{
-	TRACE_CALL("remmina_plugin_vnc_update_scale_buffer_main");
-	return remmina_plugin_vnc_update_scale_buffer(gp, FALSE);
-}
-
 static void remmina_plugin_vnc_update_scale(RemminaProtocolWidget *gp, gboolean scale)
 {
 	TRACE_CALL("remmina_plugin_vnc_update_scale");
@@ -430,49 +415,64 @@ static void remmina_plugin_vnc_update_scale(RemminaProtocolWidget *gp, gboolean
 		/* In non scaled mode, the plugins forces dimensions of drawing area */
 		gtk_widget_set_size_request (GTK_WIDGET (gpdata->drawing_area), width, height);
 	}
+	gtk_widget_queue_draw(gpdata->drawing_area);
 
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "update-align");
 }
 
+static void remmina_plugin_vnc_cursor_free(RemminaPluginVncCursor *cursor)
+{
+	TRACE_CALL("remmina_plugin_vnc_cursor_free");
+	if (cursor->pixbuf)
+		g_object_unref(cursor->pixbuf);
+	if (cursor->cursor)
+		g_object_unref(cursor->cursor);
+	g_free(cursor->shape);
+	g_free(cursor);
+}
+
 gboolean remmina_plugin_vnc_setcursor(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL("remmina_plugin_vnc_setcursor");
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	GdkCursor *cur;
+	RemminaPluginVncCursor *cursor;
 
 	LOCK_BUFFER (FALSE)
 	gpdata->queuecursor_handler = 0;
 
-	if (gpdata->queuecursor_pixbuf)
+	cursor = gpdata->queuecursor;
+	if (cursor)
 	{
-		cur = gdk_cursor_new_from_pixbuf(gdk_display_get_default(), gpdata->queuecursor_pixbuf, gpdata->queuecursor_x,
-				gpdata->queuecursor_y);
-		gdk_window_set_cursor(gtk_widget_get_window(gpdata->drawing_area), cur);
-		g_object_unref(cur);
-		g_object_unref(gpdata->queuecursor_pixbuf);
-		gpdata->queuecursor_pixbuf = NULL;
+		if (!cursor->cursor)
+		{
+			cursor->cursor = gdk_cursor_new_from_pixbuf(gdk_display_get_default(), cursor->pixbuf, cursor->xhot,
+					cursor->yhot);
+			g_object_unref(cursor->pixbuf);
+			cursor->pixbuf = NULL;
+		}
+		gdk_window_set_cursor(gtk_widget_get_window(gpdata->drawing_area), cursor->cursor);
+		gpdata->queuecursor = NULL;
 	}
 	else
 	{
 		gdk_window_set_cursor(gtk_widget_get_window(gpdata->drawing_area), NULL);
 	}
+
+	/* Cursors are only released by the main thread. The queued shape is
+	 * always the most recent, so it is never evicted */
+	while (g_queue_get_length(gpdata->cursor_cache) > REMMINA_PLUGIN_VNC_CURSOR_CACHE_MAX)
+		remmina_plugin_vnc_cursor_free((RemminaPluginVncCursor*) g_queue_pop_tail(gpdata->cursor_cache));
 	UNLOCK_BUFFER (FALSE)
 
 	return FALSE;
 }
 
-static void remmina_plugin_vnc_queuecursor(RemminaProtocolWidget *gp, GdkPixbuf *pixbuf, gint x, gint y)
+static void remmina_plugin_vnc_queuecursor(RemminaProtocolWidget *gp, RemminaPluginVncCursor *cursor)
 {
 	TRACE_CALL("remmina_plugin_vnc_queuecursor");
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
 
-	if (gpdata->queuecursor_pixbuf)
-	{
-		g_object_unref(gpdata->queuecursor_pixbuf);
-	}
-	gpdata->queuecursor_pixbuf = pixbuf;
-	gpdata->queuecursor_x = x;
-	gpdata->queuecursor_y = y;
+	gpdata->queuecursor = cursor;
 	if (!gpdata->queuecursor_handler)
 	{
 		gpdata->queuecursor_handler = IDLE_ADD((GSourceFunc) remmina_plugin_vnc_setcursor, gp);
@@ -491,6 +491,197 @@ typedef struct _RemminaKeyVal
 static const uint32_t remmina_plugin_vnc_no_encrypt_auth_types[] =
 {	rfbNoAuth, rfbVncAuth, rfbMSLogon, 0};
 
+/* ContinuousUpdates and Fence extensions, as defined by TigerVNC. They are
+ * unknown to libvncclient, so their pseudo-encodings and server messages go
+ * through a client protocol extension. */
+#define REMMINA_PLUGIN_VNC_ENCODING_FENCE               -312
+#define REMMINA_PLUGIN_VNC_ENCODING_CONTINUOUS_UPDATES  -313
+#define REMMINA_PLUGIN_VNC_MSG_CONTINUOUS_UPDATES       150
+#define REMMINA_PLUGIN_VNC_MSG_FENCE                    248
+#define REMMINA_PLUGIN_VNC_FENCE_BLOCK_BEFORE           0x00000001
+#define REMMINA_PLUGIN_VNC_FENCE_BLOCK_AFTER            0x00000002
+#define REMMINA_PLUGIN_VNC_FENCE_REQUEST                0x80000000
+#define REMMINA_PLUGIN_VNC_FENCE_MAX_PAYLOAD            64
+
+/* Without continuous updates, up to REMMINA_PLUGIN_VNC_PIPELINE_DEPTH extra
+ * incremental requests are kept outstanding, at most one per interval, so
+ * the server does not wait a round trip for the next request after each
+ * update. Both modes stop while the VNC thread is saturated. */
+#define REMMINA_PLUGIN_VNC_PIPELINE_DEPTH       2
+#define REMMINA_PLUGIN_VNC_PIPELINE_INTERVAL    (G_USEC_PER_SEC / 60)
+#define REMMINA_PLUGIN_VNC_PIPELINE_WINDOW      (G_USEC_PER_SEC / 2)
+#define REMMINA_PLUGIN_VNC_PIPELINE_SATURATED   75	/* percent busy */
+#define REMMINA_PLUGIN_VNC_PIPELINE_RECOVERED   50	/* percent busy */
+
+static void remmina_plugin_vnc_put_uint16(guchar *buf, guint16 value)
+{
+	TRACE_CALL("remmina_plugin_vnc_put_uint16");
+	buf[0] = value >> 8;
+	buf[1] = value & 0xff;
+}
+
+static void remmina_plugin_vnc_put_uint32(guchar *buf, guint32 value)
+{
+	TRACE_CALL("remmina_plugin_vnc_put_uint32");
+	buf[0] = value >> 24;
+	buf[1] = (value >> 16) & 0xff;
+	buf[2] = (value >> 8) & 0xff;
+	buf[3] = value & 0xff;
+}
+
+static void remmina_plugin_vnc_continuous_updates(rfbClient *cl, gboolean enable)
+{
+	TRACE_CALL("remmina_plugin_vnc_continuous_updates");
+	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+	guchar msg[10];
+
+	msg[0] = REMMINA_PLUGIN_VNC_MSG_CONTINUOUS_UPDATES;
+	msg[1] = enable ? 1 : 0;
+	remmina_plugin_vnc_put_uint16(msg + 2, 0);
+	remmina_plugin_vnc_put_uint16(msg + 4, 0);
+	remmina_plugin_vnc_put_uint16(msg + 6, cl->width);
+	remmina_plugin_vnc_put_uint16(msg + 8, cl->height);
+	if (WriteToRFBServer(cl, (char*) msg, sizeof(msg)))
+		gpdata->cu_enabled = enable;
+}
+
+/* Answer the server's fence requests with the flags we honour. Messages are
+ * handled in order on a single thread, so both blocking flags are met by
+ * answering right away. */
+static rfbBool remmina_plugin_vnc_handle_fence(rfbClient *cl)
+{
+	TRACE_CALL("remmina_plugin_vnc_handle_fence");
+	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+	guchar header[8];
+	guchar msg[9 + REMMINA_PLUGIN_VNC_FENCE_MAX_PAYLOAD];
+	guint32 flags;
+	guint8 len;
+
+	if (!ReadFromRFBServer(cl, (char*) header, sizeof(header)))
+		return FALSE;
+	flags = ((guint32) header[3] << 24) | (header[4] << 16) | (header[5] << 8) | header[6];
+	len = header[7];
+	if (len > REMMINA_PLUGIN_VNC_FENCE_MAX_PAYLOAD)
+		return FALSE;
+	if (len && !ReadFromRFBServer(cl, (char*) msg + 9, len))
+		return FALSE;
+
+	gpdata->fence_supported = TRUE;
+	if (!(flags & REMMINA_PLUGIN_VNC_FENCE_REQUEST))
+		return TRUE;
+
+	msg[0] = REMMINA_PLUGIN_VNC_MSG_FENCE;
+	msg[1] = msg[2] = msg[3] = 0;
+	remmina_plugin_vnc_put_uint32(msg + 4, flags & (REMMINA_PLUGIN_VNC_FENCE_BLOCK_BEFORE | REMMINA_PLUGIN_VNC_FENCE_BLOCK_AFTER));
+	msg[8] = len;
+	return WriteToRFBServer(cl, (char*) msg, 9 + len);
+}
+
+static rfbBool remmina_plugin_vnc_handle_message(rfbClient *cl, rfbServerToClientMsg *message)
+{
+	TRACE_CALL("remmina_plugin_vnc_handle_message");
+	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+
+	switch (message->type)
+	{
+		case REMMINA_PLUGIN_VNC_MSG_CONTINUOUS_UPDATES:
+			/* EndOfContinuousUpdates: sent once to announce the support,
+			 * then to confirm each time they are disabled */
+			gpdata->cu_supported = TRUE;
+			gpdata->cu_enabled = FALSE;
+			return TRUE;
+		case REMMINA_PLUGIN_VNC_MSG_FENCE:
+			return remmina_plugin_vnc_handle_fence(cl);
+		default:
+			return FALSE;
+	}
+}
+
+static int remmina_plugin_vnc_extension_encodings[] =
+{ REMMINA_PLUGIN_VNC_ENCODING_FENCE, REMMINA_PLUGIN_VNC_ENCODING_CONTINUOUS_UPDATES, 0 };
+
+static rfbClientProtocolExtension remmina_plugin_vnc_extension =
+{ remmina_plugin_vnc_extension_encodings, NULL, remmina_plugin_vnc_handle_message, NULL };
+
+/* Called by the VNC thread after each loop, with the time spent on a server
+ * message and whether it was a framebuffer update */
+static void remmina_plugin_vnc_pipeline_run(RemminaProtocolWidget *gp, rfbClient *cl, gint64 busy, gboolean update)
+{
+	TRACE_CALL("remmina_plugin_vnc_pipeline_run");
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+	gint64 now, elapsed;
+	gint load;
+	gboolean visible;
+
+	if (!gpdata->pipeline)
+		return;
+
+	now = g_get_monotonic_time();
+	if (update && gpdata->pipeline_extra > 0)
+		gpdata->pipeline_extra--;
+
+	gpdata->pipeline_busy += busy;
+	elapsed = now - gpdata->pipeline_window;
+	if (elapsed >= REMMINA_PLUGIN_VNC_PIPELINE_WINDOW)
+	{
+		load = (gint) (gpdata->pipeline_busy * 100 / elapsed);
+		if (load >= REMMINA_PLUGIN_VNC_PIPELINE_SATURATED)
+			gpdata->pipeline_saturated = TRUE;
+		else if (load <= REMMINA_PLUGIN_VNC_PIPELINE_RECOVERED)
+			gpdata->pipeline_saturated = FALSE;
+		gpdata->pipeline_window = now;
+		gpdata->pipeline_busy = 0;
+	}
+
+	visible = remmina_plugin_service->protocol_plugin_is_visible(gp);
+
+	/* The server only accepts continuous updates from clients which
+	 * answered its fences */
+	if (gpdata->cu_supported && gpdata->fence_supported)
+	{
+		if (gpdata->cu_enabled != (visible && !gpdata->pipeline_saturated))
+			remmina_plugin_vnc_continuous_updates(cl, !gpdata->cu_enabled);
+		return;
+	}
+
+	if (!visible || gpdata->pipeline_saturated)
+		return;
+	if (gpdata->pipeline_extra < REMMINA_PLUGIN_VNC_PIPELINE_DEPTH
+			&& now - gpdata->pipeline_last >= REMMINA_PLUGIN_VNC_PIPELINE_INTERVAL)
+	{
+		if (SendIncrementalFramebufferUpdateRequest(cl))
+			gpdata->pipeline_extra++;
+		gpdata->pipeline_last = now;
+	}
+}
+
+/* libvncclient asks for an incremental update of cl->updateRect after each
+ * framebuffer update. While the session is hidden, shrink it to a single
+ * pixel, then ask for the whole framebuffer when it is shown again.
+ * Continuous updates are switched by remmina_plugin_vnc_pipeline_run(). */
+static void remmina_plugin_vnc_set_visible(rfbClient *cl, gboolean visible)
+{
+	TRACE_CALL("remmina_plugin_vnc_set_visible");
+	cl->updateRect.x = 0;
+	cl->updateRect.y = 0;
+	if (visible)
+	{
+		cl->updateRect.w = cl->width;
+		cl->updateRect.h = cl->height;
+		SendFramebufferUpdateRequest(cl, 0, 0, cl->width, cl->height, FALSE);
+	}
+	else
+	{
+		cl->updateRect.w = 1;
+		cl->updateRect.h = 1;
+	}
+}
+
+static void remmina_plugin_vnc_update_quality(rfbClient *cl, gint quality);
+
 static void remmina_plugin_vnc_process_vnc_event(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL("remmina_plugin_vnc_process_vnc_event");
@@ -526,7 +717,18 @@ static void remmina_plugin_vnc_process_vnc_event(RemminaProtocolWidget *gp)
 					TextChatClose(cl);
 					TextChatFinish(cl);
 					break;
+				case REMMINA_PLUGIN_VNC_EVENT_VISIBILITY:
+					remmina_plugin_vnc_set_visible(cl, event->event_data.visibility.visible);
+					remmina_plugin_vnc_event_free(event);
+					continue;
+				case REMMINA_PLUGIN_VNC_EVENT_QUALITY:
+					remmina_plugin_vnc_update_quality(cl, event->event_data.quality.quality);
+					SetFormatAndEncodings(cl);
+					remmina_plugin_vnc_event_free(event);
+					continue;
 			}
+			remmina_plugin_service->protocol_plugin_stats_sample(gp, REMMINA_PROTOCOL_STAT_INPUT_LATENCY,
+					g_get_monotonic_time() - event->timestamp);
 		}
 		remmina_plugin_vnc_event_free(event);
 	}
@@ -543,11 +745,70 @@ typedef struct _RemminaPluginVncCuttextParam
 	gint textlen;
 } RemminaPluginVncCuttextParam;
 
+/* Encodings of the automatic quality, from lossless and cheap to decode
+ * down to lossy and small. A negative JPEG quality means lossless. */
+typedef struct _RemminaPluginVncQualityStep
+{
+	const gchar *encodings;
+	gint compress;
+	gint jpeg;
+} RemminaPluginVncQualityStep;
+
+static const RemminaPluginVncQualityStep remmina_plugin_vnc_quality_steps[] =
+{
+	{ "copyrect hextile raw", 0, -1 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 1, -1 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 6, -1 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 3, 7 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 6, 5 },
+	{ "tight zrle ultra copyrect hextile zlib corre rre raw", 9, 2 }
+};
+
+#define REMMINA_PLUGIN_VNC_QUALITY_STEPS     G_N_ELEMENTS(remmina_plugin_vnc_quality_steps)
+#define REMMINA_PLUGIN_VNC_QUALITY_LOSSLESS  3	/* Steps without JPEG */
+#define REMMINA_PLUGIN_VNC_QUALITY_START     2
+
+/* Length of a measurement window, and the share of it spent reading and
+ * decoding updates above which the link or the decoder is saturated */
+#define REMMINA_PLUGIN_VNC_AUTOQUALITY_WINDOW    (G_USEC_PER_SEC / 2)
+#define REMMINA_PLUGIN_VNC_AUTOQUALITY_BUSY      50	/* percent */
+#define REMMINA_PLUGIN_VNC_AUTOQUALITY_IDLE      15	/* percent */
+#define REMMINA_PLUGIN_VNC_AUTOQUALITY_VOTES     2	/* windows */
+
+static void remmina_plugin_vnc_autoquality_apply(rfbClient *cl, gint level)
+{
+	TRACE_CALL("remmina_plugin_vnc_autoquality_apply");
+	const RemminaPluginVncQualityStep *step = &remmina_plugin_vnc_quality_steps[level];
+
+	cl->appData.useBGR233 = 0;
+	cl->appData.encodingsString = step->encodings;
+	cl->appData.compressLevel = step->compress;
+	cl->appData.enableJPEG = (step->jpeg >= 0);
+	cl->appData.qualityLevel = (step->jpeg >= 0 ? step->jpeg : 9);
+}
+
 static void remmina_plugin_vnc_update_quality(rfbClient *cl, gint quality)
 {
 	TRACE_CALL("remmina_plugin_vnc_update_quality");
+	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+
+	gpdata->autoquality = (quality == REMMINA_PLUGIN_VNC_QUALITY_AUTO);
+	cl->appData.enableJPEG = TRUE;
+
 	switch (quality)
 	{
+		case REMMINA_PLUGIN_VNC_QUALITY_AUTO:
+			gpdata->autoquality_level = REMMINA_PLUGIN_VNC_QUALITY_START;
+			gpdata->autoquality_vote = 0;
+			gpdata->autoquality_static = 0;
+			gpdata->autoquality_lossy = FALSE;
+			gpdata->autoquality_window = g_get_monotonic_time();
+			gpdata->autoquality_busy = 0;
+			gpdata->autoquality_pixels = 0;
+			gpdata->autoquality_frames = 0;
+			remmina_plugin_vnc_autoquality_apply(cl, gpdata->autoquality_level);
+			break;
 		case 9:
 			cl->appData.useBGR233 = 0;
 			cl->appData.encodingsString = "copyrect hextile raw";
@@ -576,6 +837,93 @@ static void remmina_plugin_vnc_update_quality(rfbClient *cl, gint quality)
 	}
 }
 
+/* Called by the VNC thread after each server message with the time spent
+ * reading and decoding it. libvncclient does not count the bytes it reads,
+ * but the time HandleRFBServerMessage() spends on a message includes
+ * waiting for the rest of it on the socket, so the busy share of a window
+ * covers both a slow link and a slow decoder.
+ * - Saturated windows step towards smaller, lossy encodings.
+ * - Windows with updates and time to spare step back towards cheaper,
+ *   lossless ones, but never to lossless while the screen is in motion.
+ * - Once the screen has been static for a second after lossy updates, switch
+ *   to lossless and ask for the whole screen again to sharpen it. */
+static void remmina_plugin_vnc_autoquality_sample(RemminaProtocolWidget *gp, rfbClient *cl, gint64 busy)
+{
+	TRACE_CALL("remmina_plugin_vnc_autoquality_sample");
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+	gint64 now, elapsed, area;
+	gint level, load;
+	gboolean motion;
+
+	if (!gpdata->autoquality)
+		return;
+
+	gpdata->autoquality_busy += busy;
+	now = g_get_monotonic_time();
+	elapsed = now - gpdata->autoquality_window;
+	if (elapsed < REMMINA_PLUGIN_VNC_AUTOQUALITY_WINDOW)
+		return;
+
+	load = (gint) (gpdata->autoquality_busy * 100 / elapsed);
+	area = (gint64) cl->width * cl->height;
+	/* Several frames touching a tenth of the screen within half a second */
+	motion = (gpdata->autoquality_frames >= 3 && gpdata->autoquality_pixels * 10 >= area);
+	level = gpdata->autoquality_level;
+
+	if (gpdata->autoquality_pixels == 0)
+	{
+		gpdata->autoquality_vote = 0;
+		if (++gpdata->autoquality_static >= 2 && gpdata->autoquality_lossy)
+		{
+			gpdata->autoquality_lossy = FALSE;
+			level = MIN(level, REMMINA_PLUGIN_VNC_QUALITY_LOSSLESS - 1);
+			if (remmina_plugin_service->protocol_plugin_is_visible(gp))
+				SendFramebufferUpdateRequest(cl, 0, 0, cl->width, cl->height, FALSE);
+		}
+	}
+	else
+	{
+		gpdata->autoquality_static = 0;
+		if (load >= REMMINA_PLUGIN_VNC_AUTOQUALITY_BUSY)
+			gpdata->autoquality_vote = MAX(gpdata->autoquality_vote, 0) + 1;
+		else if (load <= REMMINA_PLUGIN_VNC_AUTOQUALITY_IDLE)
+			gpdata->autoquality_vote = MIN(gpdata->autoquality_vote, 0) - 1;
+		else
+			gpdata->autoquality_vote = 0;
+
+		if (gpdata->autoquality_vote >= REMMINA_PLUGIN_VNC_AUTOQUALITY_VOTES)
+		{
+			/* Motion on a saturated link goes straight to JPEG */
+			if (motion && level < REMMINA_PLUGIN_VNC_QUALITY_LOSSLESS)
+				level = REMMINA_PLUGIN_VNC_QUALITY_LOSSLESS;
+			else
+				level = MIN(level + 1, (gint) REMMINA_PLUGIN_VNC_QUALITY_STEPS - 1);
+			gpdata->autoquality_vote = 0;
+		}
+		else if (gpdata->autoquality_vote <= -REMMINA_PLUGIN_VNC_AUTOQUALITY_VOTES)
+		{
+			if (level > 0 && !(motion && level == REMMINA_PLUGIN_VNC_QUALITY_LOSSLESS))
+				level--;
+			gpdata->autoquality_vote = 0;
+		}
+	}
+
+	if (level >= REMMINA_PLUGIN_VNC_QUALITY_LOSSLESS)
+		gpdata->autoquality_lossy = TRUE;
+
+	if (level != gpdata->autoquality_level)
+	{
+		gpdata->autoquality_level = level;
+		remmina_plugin_vnc_autoquality_apply(cl, level);
+		SetFormatAndEncodings(cl);
+	}
+
+	gpdata->autoquality_window = now;
+	gpdata->autoquality_busy = 0;
+	gpdata->autoquality_pixels = 0;
+	gpdata->autoquality_frames = 0;
+}
+
 static void remmina_plugin_vnc_update_colordepth(rfbClient *cl, gint colordepth)
 {
 	TRACE_CALL("remmina_plugin_vnc_update_colordepth");
@@ -625,50 +973,96 @@ static void remmina_plugin_vnc_update_colordepth(rfbClient *cl, gint colordepth)
 	}
 }
 
+/* Called by the frame pacer once per display refresh */
+static void remmina_plugin_vnc_queue_draw_area_real(gpointer data, cairo_region_t *damage, gint dropped)
+{
+	TRACE_CALL("remmina_plugin_vnc_queue_draw_area_real");
+	RemminaProtocolWidget *gp = (RemminaProtocolWidget*) data;
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+
+	if (dropped)
+		remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_DROPPED_FRAMES, dropped);
+
+	if (GTK_IS_WIDGET(gp) && gpdata->connected)
+		gtk_widget_queue_draw_region(GTK_WIDGET(gp), damage);
+}
+
+static void remmina_plugin_vnc_queue_draw_area(RemminaProtocolWidget *gp, gint x, gint y, gint w, gint h)
+{
+	TRACE_CALL("remmina_plugin_vnc_queue_draw_area");
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+
+	if (remmina_plugin_service->protocol_plugin_get_scale(gp))
+		remmina_plugin_vnc_scale_area(gp, &x, &y, &w, &h);
+
+	remmina_frame_pacer_damage(gpdata->pacer, x, y, w, h);
+}
+
+/* Create the surface for a desktop of the client size. When the negotiated
+ * pixel format is already the one of cairo RGB24 the surface is the
+ * libvncclient framebuffer, otherwise *vnc_buffer gets a framebuffer to be
+ * converted by remmina_plugin_vnc_convert_area() */
+static gboolean remmina_plugin_vnc_alloc_surface(rfbClient *cl, cairo_surface_t **surface, guchar **vnc_buffer)
+{
+	TRACE_CALL("remmina_plugin_vnc_alloc_surface");
+	cairo_surface_t *new_surface;
+	gboolean native;
+
+	new_surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, cl->width, cl->height);
+	if (cairo_surface_status(new_surface) != CAIRO_STATUS_SUCCESS)
+	{
+		cairo_surface_destroy(new_surface);
+		return FALSE;
+	}
+
+	native = (cl->format.bitsPerPixel == 32 && cl->format.redMax == 0xff && cl->format.greenMax == 0xff
+			&& cl->format.blueMax == 0xff && cl->format.redShift == 16 && cl->format.greenShift == 8
+			&& cl->format.blueShift == 0 && (cl->format.bigEndian != 0) == (G_BYTE_ORDER == G_BIG_ENDIAN)
+			&& cairo_image_surface_get_stride(new_surface) == cl->width * 4);
+
+	*surface = new_surface;
+	*vnc_buffer = native ? NULL : (guchar*) g_malloc(cl->width * cl->height * (cl->format.bitsPerPixel / 8));
+	return TRUE;
+}
+
 static rfbBool remmina_plugin_vnc_rfb_allocfb(rfbClient *cl)
 {
 	TRACE_CALL("remmina_plugin_vnc_rfb_allocfb");
 	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	gint width, height, depth, size;
+	gint width, height;
 	gboolean scale;
-	GdkPixbuf *new_pixbuf, *old_pixbuf;
+	cairo_surface_t *new_surface, *old_surface;
+	guchar *new_buffer, *old_buffer;
 
 	width = cl->width;
 	height = cl->height;
-	depth = cl->format.bitsPerPixel;
-	size = width * height * (depth / 8);
 
-	/* Putting gdk_pixbuf_new inside a gdk_thread_enter/leave pair could cause dead-lock! */
-	new_pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
-	if (new_pixbuf == NULL)
+	if (!remmina_plugin_vnc_alloc_surface(cl, &new_surface, &new_buffer))
 		return FALSE;
-	gdk_pixbuf_fill(new_pixbuf, 0);
-	old_pixbuf = gpdata->rgb_buffer;
 
 	LOCK_BUFFER (TRUE)
 
 	remmina_plugin_service->protocol_plugin_set_width(gp, cl->width);
 	remmina_plugin_service->protocol_plugin_set_height(gp, cl->height);
 
-	gpdata->rgb_buffer = new_pixbuf;
-
-	if (gpdata->vnc_buffer)
-		g_free(gpdata->vnc_buffer);
-	gpdata->vnc_buffer = (guchar*) g_malloc(size);
-	cl->frameBuffer = gpdata->vnc_buffer;
+	old_surface = gpdata->surface;
+	old_buffer = gpdata->vnc_buffer;
+	gpdata->surface = new_surface;
+	gpdata->vnc_buffer = new_buffer;
+	cl->frameBuffer = (new_buffer ? new_buffer : cairo_image_surface_get_data(new_surface));
 
 	UNLOCK_BUFFER (TRUE)
 
-	if (old_pixbuf)
-		g_object_unref(old_pixbuf);
+	if (old_surface)
+		cairo_surface_destroy(old_surface);
+	g_free(old_buffer);
 
 	scale = remmina_plugin_service->protocol_plugin_get_scale(gp);
 
 	remmina_plugin_vnc_update_scale( gp, scale);
 
-	if (gpdata->scale_handler == 0)
-		remmina_plugin_vnc_update_scale_buffer(gp, TRUE);
+	remmina_plugin_vnc_queue_draw_area(gp, 0, 0, width, height);
 
 	/* Notify window of change so that scroll border can be hidden or shown if needed */
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "desktop-resize");
@@ -676,145 +1070,248 @@ static rfbBool remmina_plugin_vnc_rfb_allocfb(rfbClient *cl)
 	/* Refresh the client's updateRect - bug in xvncclient */
 	cl->updateRect.w = width;
 	cl->updateRect.h = height;
+	if (!remmina_plugin_service->protocol_plugin_is_visible(gp))
+		remmina_plugin_vnc_set_visible(cl, FALSE);
+	else if (gpdata->cu_enabled)
+		remmina_plugin_vnc_continuous_updates(cl, TRUE);
 
 	return TRUE;
 }
 
-static gint remmina_plugin_vnc_bits(gint n)
+/* Convert a cursor shape to a RGBA pixbuf, pixels outside of the mask are
+ * fully transparent */
+static void remmina_plugin_vnc_rfb_fill_cursor(rfbClient* cl, guchar *dest, gint dest_rowstride, guchar *src,
+		guchar *mask, gint w, gint h)
 {
-	TRACE_CALL("remmina_plugin_vnc_bits");
-	gint b = 0;
-	while (n)
-	{
-		b++;
-		n >>= 1;
+	TRACE_CALL("remmina_plugin_vnc_rfb_fill_cursor");
+	guchar rt[256], gt[256], bt[256];
+	guchar *destptr;
+	guint32 pixel;
+	gint bytesPerPixel;
+	gint rs, gs, bs, rm, gm, bm;
+	gint ix, iy;
+	gint i;
+
+	bytesPerPixel = cl->format.bitsPerPixel / 8;
+	rm = MAX(1, MIN(cl->format.redMax, 0xff));
+	gm = MAX(1, MIN(cl->format.greenMax, 0xff));
+	bm = MAX(1, MIN(cl->format.blueMax, 0xff));
+	rs = cl->format.redShift;
+	gs = cl->format.greenShift;
+	bs = cl->format.blueShift;
+
+	for (i = 0; i <= rm; i++)
+		rt[i] = (i * 0xff + rm / 2) / rm;
+	for (i = 0; i <= gm; i++)
+		gt[i] = (i * 0xff + gm / 2) / gm;
+	for (i = 0; i <= bm; i++)
+		bt[i] = (i * 0xff + bm / 2) / bm;
+
+	for (iy = 0; iy < h; iy++)
+	{
+		destptr = dest + iy * dest_rowstride;
+		for (ix = 0; ix < w; ix++)
+		{
+			pixel = 0;
+			if (cl->format.bigEndian)
+				for (i = 0; i < bytesPerPixel; i++)
+					pixel = (pixel << 8) | (*src++);
+			else
+				for (i = 0; i < bytesPerPixel; i++)
+					pixel += (*src++) << (8 * i);
+			if (*mask++)
+			{
+				destptr[0] = rt[(pixel >> rs) & rm];
+				destptr[1] = gt[(pixel >> gs) & gm];
+				destptr[2] = bt[(pixel >> bs) & bm];
+				destptr[3] = 0xff;
+			}
+			else
+			{
+				destptr[0] = destptr[1] = destptr[2] = destptr[3] = 0;
+			}
+			destptr += 4;
+		}
 	}
-	return b ? b : 1;
 }
 
-static gboolean remmina_plugin_vnc_queue_draw_area_real(RemminaProtocolWidget *gp)
+/* Convert pixels of the client format to cairo RGB24, with a lookup table
+ * per channel */
+static void remmina_plugin_vnc_rfb_fill_surface(rfbClient* cl, guchar *dest, gint dest_rowstride, guchar *src,
+		gint src_rowstride, gint w, gint h)
 {
-	TRACE_CALL("remmina_plugin_vnc_queue_draw_area_real");
+	TRACE_CALL("remmina_plugin_vnc_rfb_fill_surface");
+	guint32 rt[256], gt[256], bt[256];
+	guint32 *destptr;
+	guchar *srcptr;
+	guint32 pixel;
+	gint bytesPerPixel;
+	gint rs, gs, bs, rm, gm, bm;
+	gint ix, iy;
+	gint i;
+
+	bytesPerPixel = cl->format.bitsPerPixel / 8;
+	rm = MAX(1, MIN(cl->format.redMax, 0xff));
+	gm = MAX(1, MIN(cl->format.greenMax, 0xff));
+	bm = MAX(1, MIN(cl->format.blueMax, 0xff));
+	rs = cl->format.redShift;
+	gs = cl->format.greenShift;
+	bs = cl->format.blueShift;
+
+	for (i = 0; i <= rm; i++)
+		rt[i] = (guint32) ((i * 0xff + rm / 2) / rm) << 16;
+	for (i = 0; i <= gm; i++)
+		gt[i] = (guint32) ((i * 0xff + gm / 2) / gm) << 8;
+	for (i = 0; i <= bm; i++)
+		bt[i] = (guint32) ((i * 0xff + bm / 2) / bm);
+
+	for (iy = 0; iy < h; iy++)
+	{
+		destptr = (guint32*) (dest + iy * dest_rowstride);
+		srcptr = src + iy * src_rowstride;
+		for (ix = 0; ix < w; ix++)
+		{
+			pixel = 0;
+			if (cl->format.bigEndian)
+				for (i = 0; i < bytesPerPixel; i++)
+					pixel = (pixel << 8) | (*srcptr++);
+			else
+				for (i = 0; i < bytesPerPixel; i++)
+					pixel += (*srcptr++) << (8 * i);
+			*destptr++ = rt[(pixel >> rs) & rm] | gt[(pixel >> gs) & gm] | bt[(pixel >> bs) & bm];
+		}
+	}
+}
+
+/* Convert a decoded area to the surface if needed, then invalidate it */
+static void remmina_plugin_vnc_convert_area(RemminaProtocolWidget *gp, rfbClient *cl, gint x, gint y, gint w, gint h)
+{
+	TRACE_CALL("remmina_plugin_vnc_convert_area");
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	gint x, y, w, h;
+	gint bytesPerPixel;
+	gint rowstride;
+	gint width;
+	gint height;
+	gboolean in_thread;
 
-	if (GTK_IS_WIDGET(gp) && gpdata->connected)
+	/* Called by the converter worker, which is never cancelled, or by the VNC
+	 * thread, which runs with asynchronous cancellation: it must not be
+	 * cancelled holding the lock. Native formats skip the worker even when
+	 * it is running, so ask which thread this is */
+	in_thread = !(gpdata->convert_running && pthread_equal(pthread_self(), gpdata->convert_thread));
+
+	LOCK_BUFFER (in_thread)
+
+	/* Areas queued before a desktop resize may fall outside of it */
+	width = remmina_plugin_service->protocol_plugin_get_width(gp);
+	height = remmina_plugin_service->protocol_plugin_get_height(gp);
+	w = MIN(w, width - x);
+	h = MIN(h, height - y);
+	if (w < 1 || h < 1 || gpdata->surface == NULL)
 	{
-		LOCK_BUFFER (FALSE)
-		x = gpdata->queuedraw_x;
-		y = gpdata->queuedraw_y;
-		w = gpdata->queuedraw_w;
-		h = gpdata->queuedraw_h;
-		gpdata->queuedraw_handler = 0;
-		UNLOCK_BUFFER (FALSE)
+		UNLOCK_BUFFER (in_thread)
+		return;
+	}
 
-		gtk_widget_queue_draw_area(GTK_WIDGET(gp), x, y, w, h);
+	if (gpdata->vnc_buffer)
+	{
+		bytesPerPixel = cl->format.bitsPerPixel / 8;
+		rowstride = cairo_image_surface_get_stride(gpdata->surface);
+		cairo_surface_flush(gpdata->surface);
+		remmina_plugin_vnc_rfb_fill_surface(cl, cairo_image_surface_get_data(gpdata->surface) + y * rowstride + x * 4,
+				rowstride, gpdata->vnc_buffer + ((y * width + x) * bytesPerPixel), width * bytesPerPixel, w, h);
 	}
-	return FALSE;
+	cairo_surface_mark_dirty_rectangle(gpdata->surface, x, y, w, h);
+
+	UNLOCK_BUFFER (in_thread)
+
+	remmina_plugin_vnc_queue_draw_area(gp, x, y, w, h);
 }
 
-static void remmina_plugin_vnc_queue_draw_area(RemminaProtocolWidget *gp, gint x, gint y, gint w, gint h)
+/* Second stage of the VNC pipeline: the VNC thread reads and decodes server
+ * messages into vnc_buffer, this worker converts the damaged areas to the
+ * surface, so slow conversions do not hold back the socket reads. Native
+ * formats are decoded straight into the surface and never get here. An area
+ * decoded again while the worker reads it is queued again by its own update
+ * callback, so a torn read never stays on screen. */
+static gpointer remmina_plugin_vnc_convert_worker(gpointer data)
 {
-	TRACE_CALL("remmina_plugin_vnc_queue_draw_area");
+	TRACE_CALL("remmina_plugin_vnc_convert_worker");
+	RemminaProtocolWidget *gp = (RemminaProtocolWidget*) data;
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	gint nx2, ny2, ox2, oy2;
+	cairo_region_t *region;
+	cairo_rectangle_int_t rect;
+	gint i, n;
 
-	LOCK_BUFFER (TRUE)
-	if (gpdata->queuedraw_handler)
-	{
-		nx2 = x + w;
-		ny2 = y + h;
-		ox2 = gpdata->queuedraw_x + gpdata->queuedraw_w;
-		oy2 = gpdata->queuedraw_y + gpdata->queuedraw_h;
-		gpdata->queuedraw_x = MIN(gpdata->queuedraw_x, x);
-		gpdata->queuedraw_y = MIN(gpdata->queuedraw_y, y);
-		gpdata->queuedraw_w = MAX(ox2, nx2) - gpdata->queuedraw_x;
-		gpdata->queuedraw_h = MAX(oy2, ny2) - gpdata->queuedraw_y;
-	}
-	else
+	pthread_mutex_lock(&gpdata->convert_mutex);
+	while (!gpdata->convert_quit)
 	{
-		gpdata->queuedraw_x = x;
-		gpdata->queuedraw_y = y;
-		gpdata->queuedraw_w = w;
-		gpdata->queuedraw_h = h;
-		gpdata->queuedraw_handler = IDLE_ADD((GSourceFunc) remmina_plugin_vnc_queue_draw_area_real, gp);
+		if (cairo_region_is_empty(gpdata->convert_region))
+		{
+			pthread_cond_wait(&gpdata->convert_cond, &gpdata->convert_mutex);
+			continue;
+		}
+		region = gpdata->convert_region;
+		gpdata->convert_region = cairo_region_create();
+		pthread_mutex_unlock(&gpdata->convert_mutex);
+
+		n = cairo_region_num_rectangles(region);
+		for (i = 0; i < n; i++)
+		{
+			cairo_region_get_rectangle(region, i, &rect);
+			remmina_plugin_vnc_convert_area(gp, (rfbClient*) gpdata->client, rect.x, rect.y, rect.width, rect.height);
+		}
+		cairo_region_destroy(region);
+
+		pthread_mutex_lock(&gpdata->convert_mutex);
 	}
-UNLOCK_BUFFER (TRUE)
+	pthread_mutex_unlock(&gpdata->convert_mutex);
+
+	return NULL;
 }
 
-static void remmina_plugin_vnc_rfb_fill_buffer(rfbClient* cl, guchar *dest, gint dest_rowstride, guchar *src,
-		gint src_rowstride, guchar *mask, gint w, gint h)
+static void remmina_plugin_vnc_convert_start(RemminaProtocolWidget *gp)
 {
-	TRACE_CALL("remmina_plugin_vnc_rfb_fill_buffer");
-	guchar *destptr, *srcptr;
-	gint bytesPerPixel;
-	guint32 pixel;
-	gint ix, iy;
-	gint i;
-	guchar c;
-	gint rs, gs, bs, rm, gm, bm, rl, gl, bl, rr, gr, br;
-	gint r;
+	TRACE_CALL("remmina_plugin_vnc_convert_start");
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
 
-	bytesPerPixel = cl->format.bitsPerPixel / 8;
-	switch (cl->format.bitsPerPixel)
+	gpdata->convert_quit = FALSE;
+	gpdata->convert_region = cairo_region_create();
+	pthread_mutex_init(&gpdata->convert_mutex, NULL);
+	pthread_cond_init(&gpdata->convert_cond, NULL);
+
+	if (pthread_create(&gpdata->convert_thread, NULL, remmina_plugin_vnc_convert_worker, gp) == 0)
 	{
-		case 32:
-			/* The following codes fill in the Alpha channel swap red/green value */
-			for (iy = 0; iy < h; iy++)
-			{
-				destptr = dest + iy * dest_rowstride;
-				srcptr = src + iy * src_rowstride;
-				for (ix = 0; ix < w; ix++)
-				{
-					*destptr++ = *(srcptr + 2);
-					*destptr++ = *(srcptr + 1);
-					*destptr++ = *srcptr;
-					if (mask)
-						*destptr++ = (*mask++) ? 0xff : 0x00;
-					srcptr += 4;
-				}
-			}
-			break;
-		default:
-			rm = cl->format.redMax;
-			gm = cl->format.greenMax;
-			bm = cl->format.blueMax;
-			rr = remmina_plugin_vnc_bits(rm);
-			gr = remmina_plugin_vnc_bits(gm);
-			br = remmina_plugin_vnc_bits(bm);
-			rl = 8 - rr;
-			gl = 8 - gr;
-			bl = 8 - br;
-			rs = cl->format.redShift;
-			gs = cl->format.greenShift;
-			bs = cl->format.blueShift;
-			for (iy = 0; iy < h; iy++)
-			{
-				destptr = dest + iy * dest_rowstride;
-				srcptr = src + iy * src_rowstride;
-				for (ix = 0; ix < w; ix++)
-				{
-					pixel = 0;
-					for (i = 0; i < bytesPerPixel; i++)
-						pixel += (*srcptr++) << (8 * i);
-					c = (guchar)((pixel >> rs) & rm) << rl;
-					for (r = rr; r < 8; r *= 2)
-						c |= c >> r;
-					*destptr++ = c;
-					c = (guchar)((pixel >> gs) & gm) << gl;
-					for (r = gr; r < 8; r *= 2)
-						c |= c >> r;
-					*destptr++ = c;
-					c = (guchar)((pixel >> bs) & bm) << bl;
-					for (r = br; r < 8; r *= 2)
-						c |= c >> r;
-					*destptr++ = c;
-					if (mask)
-						*destptr++ = (*mask++) ? 0xff : 0x00;
-				}
-			}
-			break;
+		gpdata->convert_running = TRUE;
+		return;
 	}
+
+	/* Convert on the VNC thread as before */
+	cairo_region_destroy(gpdata->convert_region);
+	gpdata->convert_region = NULL;
+	pthread_mutex_destroy(&gpdata->convert_mutex);
+	pthread_cond_destroy(&gpdata->convert_cond);
+}
+
+static void remmina_plugin_vnc_convert_stop(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL("remmina_plugin_vnc_convert_stop");
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+
+	if (!gpdata->convert_running)
+		return;
+
+	pthread_mutex_lock(&gpdata->convert_mutex);
+	gpdata->convert_quit = TRUE;
+	pthread_cond_signal(&gpdata->convert_cond);
+	pthread_mutex_unlock(&gpdata->convert_mutex);
+	pthread_join(gpdata->convert_thread, NULL);
+	gpdata->convert_running = FALSE;
+
+	cairo_region_destroy(gpdata->convert_region);
+	gpdata->convert_region = NULL;
+	pthread_mutex_destroy(&gpdata->convert_mutex);
+	pthread_cond_destroy(&gpdata->convert_cond);
 }
 
 static void remmina_plugin_vnc_rfb_updatefb(rfbClient* cl, int x, int y, int w, int h)
@@ -822,30 +1319,29 @@ static void remmina_plugin_vnc_rfb_updatefb(rfbClient* cl, int x, int y, int w,
 	TRACE_CALL("remmina_plugin_vnc_rfb_updatefb");
 	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	gint bytesPerPixel;
-	gint rowstride;
-	gint width;
+	cairo_rectangle_int_t rect;
 
-	LOCK_BUFFER (TRUE)
+	gpdata->frame_damaged = TRUE;
+	gpdata->autoquality_pixels += (gint64) w * h;
+	remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_DAMAGE_PIXELS, (gint64) w * h);
 
-	if (w >= 1 || h >= 1)
-	{
-		width = remmina_plugin_service->protocol_plugin_get_width(gp);
-		bytesPerPixel = cl->format.bitsPerPixel / 8;
-		rowstride = gdk_pixbuf_get_rowstride(gpdata->rgb_buffer);
-		remmina_plugin_vnc_rfb_fill_buffer(cl, gdk_pixbuf_get_pixels(gpdata->rgb_buffer) + y * rowstride + x * 3,
-				rowstride, gpdata->vnc_buffer + ((y * width + x) * bytesPerPixel), width * bytesPerPixel, NULL,
-				w, h);
-	}
-
-	if (remmina_plugin_service->protocol_plugin_get_scale(gp))
+	if (!gpdata->convert_running || gpdata->vnc_buffer == NULL)
 	{
-		remmina_plugin_vnc_scale_area(gp, &x, &y, &w, &h);
+		remmina_plugin_vnc_convert_area(gp, cl, x, y, w, h);
+		return;
 	}
 
-	UNLOCK_BUFFER (TRUE)
+	rect.x = x;
+	rect.y = y;
+	rect.width = w;
+	rect.height = h;
 
-	remmina_plugin_vnc_queue_draw_area(gp, x, y, w, h);
+	CANCEL_DEFER
+	pthread_mutex_lock(&gpdata->convert_mutex);
+	cairo_region_union_rectangle(gpdata->convert_region, &rect);
+	pthread_cond_signal(&gpdata->convert_cond);
+	pthread_mutex_unlock(&gpdata->convert_mutex);
+	CANCEL_ASYNC
 }
 
 static gboolean remmina_plugin_vnc_queue_cuttext(RemminaPluginVncCuttextParam *param)
@@ -1012,29 +1508,89 @@ remmina_plugin_vnc_rfb_credential (rfbClient *cl, int credentialType)
 	return cred;
 }
 
+/* FNV-1a, over the bytes libvncclient already holds */
+static guint64 remmina_plugin_vnc_cursor_hash(guint64 hash, const guchar *data, gsize len)
+{
+	TRACE_CALL("remmina_plugin_vnc_cursor_hash");
+	gsize i;
+
+	for (i = 0; i < len; i++)
+	{
+		hash ^= data[i];
+		hash *= G_GUINT64_CONSTANT(0x100000001b3);
+	}
+	return hash;
+}
+
+static gboolean remmina_plugin_vnc_cursor_match(RemminaPluginVncCursor *cursor, guint64 hash, rfbClient *cl,
+		int xhot, int yhot, int width, int height, int bytesPerPixel)
+{
+	TRACE_CALL("remmina_plugin_vnc_cursor_match");
+	gsize source_len = (gsize) width * height * bytesPerPixel;
+
+	return cursor->hash == hash && cursor->width == width && cursor->height == height && cursor->xhot == xhot
+			&& cursor->yhot == yhot && cursor->bytes_per_pixel == bytesPerPixel
+			&& memcmp(cursor->shape, cl->rcSource, source_len) == 0
+			&& memcmp(cursor->shape + source_len, cl->rcMask, (gsize) width * height) == 0;
+}
+
 static void remmina_plugin_vnc_rfb_cursor_shape(rfbClient *cl, int xhot, int yhot, int width, int height, int bytesPerPixel)
 {
 	TRACE_CALL("remmina_plugin_vnc_rfb_cursor_shape");
 	RemminaProtocolWidget *gp = rfbClientGetClientData(cl, NULL);
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	guchar *pixbuf_data;
-	GdkPixbuf *pixbuf;
+	RemminaPluginVncCursor *cursor = NULL;
+	gsize source_len;
+	guint64 hash;
+	GList *l;
 
 	if (!gtk_widget_get_window(GTK_WIDGET(gp)))
 		return;
 
-	if (width && height)
+	if (!width || !height)
+		return;
+
+	source_len = (gsize) width * height * bytesPerPixel;
+	hash = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+	hash = remmina_plugin_vnc_cursor_hash(hash, cl->rcSource, source_len);
+	hash = remmina_plugin_vnc_cursor_hash(hash, cl->rcMask, (gsize) width * height);
+
+	LOCK_BUFFER (TRUE)
+
+	for (l = g_queue_peek_head_link(gpdata->cursor_cache); l; l = l->next)
 	{
-		pixbuf_data = g_malloc(width * height * 4);
-		remmina_plugin_vnc_rfb_fill_buffer(cl, pixbuf_data, width * 4, cl->rcSource,
-				width * cl->format.bitsPerPixel / 8, cl->rcMask, width, height);
-		pixbuf = gdk_pixbuf_new_from_data(pixbuf_data, GDK_COLORSPACE_RGB, TRUE, 8, width, height, width * 4,
-				(GdkPixbufDestroyNotify) g_free, NULL);
+		if (remmina_plugin_vnc_cursor_match((RemminaPluginVncCursor*) l->data, hash, cl, xhot, yhot, width, height,
+				bytesPerPixel))
+		{
+			cursor = (RemminaPluginVncCursor*) l->data;
+			g_queue_unlink(gpdata->cursor_cache, l);
+			g_queue_push_head_link(gpdata->cursor_cache, l);
+			break;
+		}
+	}
 
-		LOCK_BUFFER (TRUE)
-		remmina_plugin_vnc_queuecursor(gp, pixbuf, xhot, yhot);
-UNLOCK_BUFFER	(TRUE)
-}
+	if (!cursor)
+	{
+		cursor = g_new0(RemminaPluginVncCursor, 1);
+		cursor->hash = hash;
+		cursor->width = width;
+		cursor->height = height;
+		cursor->xhot = xhot;
+		cursor->yhot = yhot;
+		cursor->bytes_per_pixel = bytesPerPixel;
+		cursor->shape_len = source_len + (gsize) width * height;
+		cursor->shape = g_malloc(cursor->shape_len);
+		memcpy(cursor->shape, cl->rcSource, source_len);
+		memcpy(cursor->shape + source_len, cl->rcMask, (gsize) width * height);
+		cursor->pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+		remmina_plugin_vnc_rfb_fill_cursor(cl, gdk_pixbuf_get_pixels(cursor->pixbuf),
+				gdk_pixbuf_get_rowstride(cursor->pixbuf), cl->rcSource, cl->rcMask, width, height);
+		g_queue_push_head(gpdata->cursor_cache, cursor);
+	}
+
+	remmina_plugin_vnc_queuecursor(gp, cursor);
+
+	UNLOCK_BUFFER (TRUE)
 }
 
 static void remmina_plugin_vnc_rfb_bell(rfbClient *cl)
@@ -1211,11 +1767,211 @@ static gboolean remmina_plugin_vnc_incoming_connection(RemminaProtocolWidget *gp
 	return TRUE;
 }
 
+/* Send as much of the queue as the socket takes without blocking. Returns
+ * FALSE only on a real error: a full socket is tried again on POLLOUT */
+static gboolean remmina_plugin_vnc_io_flush(gint fd, GByteArray *queue, gsize *offset)
+{
+	TRACE_CALL("remmina_plugin_vnc_io_flush");
+	gssize n;
+
+	while (queue->len > *offset)
+	{
+		/* MSG_NOSIGNAL: a peer gone away is an error, not a SIGPIPE */
+		n = send(fd, queue->data + *offset, queue->len - *offset, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (n <= 0)
+			return FALSE;
+		*offset += n;
+	}
+	if (*offset == queue->len)
+	{
+		g_byte_array_set_size(queue, 0);
+		*offset = 0;
+	}
+	else if (*offset >= queue->len / 2)
+	{
+		g_byte_array_remove_range(queue, 0, *offset);
+		*offset = 0;
+	}
+	return TRUE;
+}
+
+/* First stage of the VNC pipeline: read everything the server sends as soon
+ * as it arrives and queue it for libvncclient, so the TCP window stays open
+ * while the VNC thread is busy decoding. The queue is bounded, when it is
+ * full the server socket is left alone until libvncclient catches up.
+ * What the client sends is queued the same way, so a server slow to read
+ * never blocks the relay: libvncclient is then left alone instead. */
+static gpointer remmina_plugin_vnc_io_relay(gpointer data)
+{
+	TRACE_CALL("remmina_plugin_vnc_io_relay");
+	RemminaProtocolWidget *gp = (RemminaProtocolWidget*) data;
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+	struct pollfd fds[2];
+	guchar buf[65536];
+	GByteArray *queue;
+	GByteArray *out;
+	gsize offset;
+	gsize out_offset;
+	gboolean eof;
+	gboolean can_read;
+	gboolean can_write;
+	gssize n;
+
+	queue = g_byte_array_new();
+	out = g_byte_array_new();
+	offset = 0;
+	out_offset = 0;
+	eof = FALSE;
+
+	for (;;)
+	{
+		can_read = !eof && queue->len < REMMINA_PLUGIN_VNC_IO_QUEUE_MAX;
+		can_write = out->len < REMMINA_PLUGIN_VNC_IO_QUEUE_MAX;
+		fds[0].fd = (can_read || out->len > out_offset) ? gpdata->io_sock : -1;
+		fds[0].events = (can_read ? POLLIN : 0) | (out->len > out_offset ? POLLOUT : 0);
+		fds[1].fd = gpdata->io_pair;
+		fds[1].events = (can_write ? POLLIN : 0) | (queue->len > offset ? POLLOUT : 0);
+
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[0].revents & POLLOUT || (!can_read && fds[0].revents & (POLLHUP | POLLERR)))
+		{
+			if (!remmina_plugin_vnc_io_flush(gpdata->io_sock, out, &out_offset))
+				break;
+		}
+		if (can_read && fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+		{
+			n = read(gpdata->io_sock, buf, sizeof(buf));
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				continue;
+			if (n <= 0)
+			{
+				/* Hand over what is left before closing */
+				eof = TRUE;
+			}
+			else
+			{
+				if (gpdata->capture)
+					remmina_capture_write(gpdata->capture, REMMINA_CAPTURE_RECORD_DATA, buf, n);
+				remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_BYTES_IN, n);
+				g_byte_array_append(queue, buf, n);
+			}
+		}
+		if (fds[1].revents & POLLOUT)
+		{
+			if (!remmina_plugin_vnc_io_flush(gpdata->io_pair, queue, &offset))
+				break;
+		}
+		if (fds[1].revents & (POLLIN | POLLHUP | POLLERR))
+		{
+			n = read(gpdata->io_pair, buf, sizeof(buf));
+			if (n < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			if (n <= 0)
+				break;
+			remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_BYTES_OUT, n);
+			g_byte_array_append(out, buf, n);
+			/* Most of the time the socket takes it right away */
+			if (!remmina_plugin_vnc_io_flush(gpdata->io_sock, out, &out_offset))
+				break;
+		}
+		if (eof && queue->len == offset)
+			break;
+	}
+
+	g_byte_array_free(queue, TRUE);
+	g_byte_array_free(out, TRUE);
+
+	/* Closing our end of the pair makes libvncclient see the disconnection */
+	close(gpdata->io_pair);
+	close(gpdata->io_sock);
+	return NULL;
+}
+
+/* Put the I/O relay thread between libvncclient and the server socket.
+ * When REMMINA_CAPTURE_DIR is set, it also records everything the server
+ * sends after the handshake. The capture header holds what a replay needs
+ * to rebuild the handshake: framebuffer size and the pixel format we asked
+ * for. */
+static void remmina_plugin_vnc_io_start(RemminaProtocolWidget *gp, rfbClient *cl)
+{
+	TRACE_CALL("remmina_plugin_vnc_io_start");
+	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
+	GByteArray *header;
+	GError *error = NULL;
+	gint sv[2];
+
+	/* TLS sessions are bound to the original socket */
+	if (cl->tlsSession)
+		return;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return;
+	/* The relay must never block writing to libvncclient */
+	fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL, 0) | O_NONBLOCK);
+
+	gpdata->capture = remmina_capture_open_write("vnc", &error);
+	if (error)
+	{
+		remmina_plugin_service->log_printf("[VNC] %s\n", error->message);
+		g_error_free(error);
+	}
+	if (gpdata->capture)
+	{
+		remmina_plugin_service->log_printf("[VNC] Capturing session to %s\n",
+				remmina_capture_get_filename(gpdata->capture));
+		header = g_byte_array_new();
+		remmina_capture_put_uint16(header, cl->width);
+		remmina_capture_put_uint16(header, cl->height);
+		g_byte_array_append(header, &cl->format.bitsPerPixel, 1);
+		g_byte_array_append(header, &cl->format.depth, 1);
+		g_byte_array_append(header, &cl->format.bigEndian, 1);
+		g_byte_array_append(header, &cl->format.trueColour, 1);
+		remmina_capture_put_uint16(header, cl->format.redMax);
+		remmina_capture_put_uint16(header, cl->format.greenMax);
+		remmina_capture_put_uint16(header, cl->format.blueMax);
+		g_byte_array_append(header, &cl->format.redShift, 1);
+		g_byte_array_append(header, &cl->format.greenShift, 1);
+		g_byte_array_append(header, &cl->format.blueShift, 1);
+		remmina_capture_write(gpdata->capture, REMMINA_CAPTURE_RECORD_HEADER, header->data, header->len);
+		g_byte_array_free(header, TRUE);
+	}
+
+	gpdata->io_sock = cl->sock;
+	gpdata->io_pair = sv[1];
+	cl->sock = sv[0];
+
+	if (pthread_create(&gpdata->io_thread, NULL, remmina_plugin_vnc_io_relay, gp))
+	{
+		/* Keep talking to the server directly */
+		cl->sock = gpdata->io_sock;
+		close(sv[0]);
+		close(sv[1]);
+		if (gpdata->capture)
+		{
+			remmina_capture_close(gpdata->capture);
+			gpdata->capture = NULL;
+		}
+		return;
+	}
+	gpdata->io_running = TRUE;
+}
+
 static gboolean remmina_plugin_vnc_main_loop(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL("remmina_plugin_vnc_main_loop");
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
 	gint ret;
+	gint64 start;
+	gboolean update;
 	rfbClient *cl;
 	fd_set fds;
 	struct timeval timeout;
@@ -1228,8 +1984,15 @@ static gboolean remmina_plugin_vnc_main_loop(RemminaProtocolWidget *gp)
 
 	cl = (rfbClient*) gpdata->client;
 
-	timeout.tv_sec = 10;
-	timeout.tv_usec = 0;
+	/* The automatic quality also needs to see the windows without updates,
+	 * pipelined requests are sent on time even when nothing arrives */
+	timeout.tv_sec = gpdata->autoquality ? 0 : 10;
+	timeout.tv_usec = gpdata->autoquality ? REMMINA_PLUGIN_VNC_AUTOQUALITY_WINDOW : 0;
+	if (gpdata->pipeline && !gpdata->cu_enabled && gpdata->pipeline_extra < REMMINA_PLUGIN_VNC_PIPELINE_DEPTH)
+	{
+		timeout.tv_sec = 0;
+		timeout.tv_usec = REMMINA_PLUGIN_VNC_PIPELINE_INTERVAL;
+	}
 	FD_ZERO(&fds);
 	FD_SET(cl->sock, &fds);
 	FD_SET(gpdata->vnc_event_pipe[0], &fds);
@@ -1238,15 +2001,40 @@ static gboolean remmina_plugin_vnc_main_loop(RemminaProtocolWidget *gp)
 	/* Sometimes it returns <0 when opening a modal dialog in other window. Absolutely weird */
 	/* So we continue looping anyway */
 	if (ret <= 0)
+	{
+		if (ret == 0)
+		{
+			remmina_plugin_vnc_autoquality_sample(gp, cl, 0);
+			remmina_plugin_vnc_pipeline_run(gp, cl, 0, FALSE);
+		}
 		return TRUE;
+	}
 
 	if (FD_ISSET(gpdata->vnc_event_pipe[0], &fds))
 	{
 		remmina_plugin_vnc_process_vnc_event(gp);
+		if (!FD_ISSET(cl->sock, &fds))
+			remmina_plugin_vnc_pipeline_run(gp, cl, 0, FALSE);
 	}
 	if (FD_ISSET(cl->sock, &fds))
 	{
+		start = g_get_monotonic_time();
 		ret = HandleRFBServerMessage(cl);
+		start = g_get_monotonic_time() - start;
+		remmina_plugin_service->protocol_plugin_stats_sample(gp, REMMINA_PROTOCOL_STAT_DECODE_TIME, start);
+		update = gpdata->frame_damaged;
+		if (gpdata->frame_damaged)
+		{
+			gpdata->frame_damaged = FALSE;
+			gpdata->autoquality_frames++;
+			remmina_plugin_service->protocol_plugin_stats_count(gp, REMMINA_PROTOCOL_STAT_FRAMES, 1);
+			remmina_frame_pacer_frame(gpdata->pacer);
+		}
+		if (ret)
+		{
+			remmina_plugin_vnc_autoquality_sample(gp, cl, start);
+			remmina_plugin_vnc_pipeline_run(gp, cl, start, update);
+		}
 		if (!ret)
 		{
 			gpdata->running = FALSE;
@@ -1347,6 +2135,14 @@ static gboolean remmina_plugin_vnc_main(RemminaProtocolWidget *gp)
 				remmina_plugin_service->file_get_int(remminafile, "showcursor", FALSE) ? FALSE : TRUE);
 
 		remmina_plugin_vnc_update_quality(cl, remmina_plugin_service->file_get_int(remminafile, "quality", 0));
+		gpdata->pipeline = !remmina_plugin_service->file_get_int(remminafile, "disablepipeline", FALSE);
+		gpdata->pipeline_saturated = FALSE;
+		gpdata->pipeline_extra = 0;
+		gpdata->pipeline_window = g_get_monotonic_time();
+		gpdata->pipeline_busy = 0;
+		gpdata->fence_supported = FALSE;
+		gpdata->cu_supported = FALSE;
+		gpdata->cu_enabled = FALSE;
 		remmina_plugin_vnc_update_colordepth(cl, remmina_plugin_service->file_get_int(remminafile, "colordepth", 8));
 		SetFormatAndEncodings(cl);
 
@@ -1407,6 +2203,9 @@ static gboolean remmina_plugin_vnc_main(RemminaProtocolWidget *gp)
 
 	remmina_plugin_service->protocol_plugin_init_save_cred(gp);
 
+	remmina_plugin_vnc_io_start(gp, cl);
+	remmina_plugin_vnc_convert_start(gp);
+
 	gpdata->client = cl;
 
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "connect");
@@ -1766,6 +2565,9 @@ static gboolean remmina_plugin_vnc_close_connection_timeout(RemminaProtocolWidge
 	if (gpdata->running)
 		return TRUE;
 
+	/* The conversion worker uses the frame pacer and the client */
+	remmina_plugin_vnc_convert_stop(gp);
+
 	/* unregister the clipboard monitor */
 	if (gpdata->clipboard_handler)
 	{
@@ -1778,21 +2580,14 @@ static gboolean remmina_plugin_vnc_close_connection_timeout(RemminaProtocolWidge
 		g_source_remove(gpdata->queuecursor_handler);
 		gpdata->queuecursor_handler = 0;
 	}
-	if (gpdata->queuecursor_pixbuf)
-	{
-		g_object_unref(gpdata->queuecursor_pixbuf);
-		gpdata->queuecursor_pixbuf = NULL;
-	}
+	gpdata->queuecursor = NULL;
+	g_queue_free_full(gpdata->cursor_cache, (GDestroyNotify) remmina_plugin_vnc_cursor_free);
+	gpdata->cursor_cache = NULL;
 
-	if (gpdata->queuedraw_handler)
-	{
-		g_source_remove(gpdata->queuedraw_handler);
-		gpdata->queuedraw_handler = 0;
-	}
-	if (gpdata->scale_handler)
+	if (gpdata->pacer)
 	{
-		g_source_remove(gpdata->scale_handler);
-		gpdata->scale_handler = 0;
+		remmina_frame_pacer_free(gpdata->pacer);
+		gpdata->pacer = NULL;
 	}
 	if (gpdata->listen_sock >= 0)
 	{
@@ -1803,21 +2598,27 @@ static gboolean remmina_plugin_vnc_close_connection_timeout(RemminaProtocolWidge
 		rfbClientCleanup((rfbClient*) gpdata->client);
 		gpdata->client = NULL;
 	}
-	if (gpdata->rgb_buffer)
+	if (gpdata->io_running)
 	{
-		g_object_unref(gpdata->rgb_buffer);
-		gpdata->rgb_buffer = NULL;
+		/* The relay thread exits as soon as libvncclient closed its socket */
+		pthread_join(gpdata->io_thread, NULL);
+		gpdata->io_running = FALSE;
+	}
+	if (gpdata->capture)
+	{
+		remmina_capture_close(gpdata->capture);
+		gpdata->capture = NULL;
+	}
+	if (gpdata->surface)
+	{
+		cairo_surface_destroy(gpdata->surface);
+		gpdata->surface = NULL;
 	}
 	if (gpdata->vnc_buffer)
 	{
 		g_free(gpdata->vnc_buffer);
 		gpdata->vnc_buffer = NULL;
 	}
-	if (gpdata->scale_buffer)
-	{
-		g_object_unref(gpdata->scale_buffer);
-		gpdata->scale_buffer = NULL;
-	}
 	g_ptr_array_free(gpdata->pressed_keys, TRUE);
 	remmina_plugin_vnc_event_free_all(gp);
 	g_queue_free(gpdata->vnc_event_queue);
@@ -1881,9 +2682,9 @@ static void remmina_plugin_vnc_call_feature(RemminaProtocolWidget *gp, const Rem
 	switch (feature->id)
 	{
 		case REMMINA_PLUGIN_VNC_FEATURE_PREF_QUALITY:
-			remmina_plugin_vnc_update_quality((rfbClient*) (gpdata->client),
-					remmina_plugin_service->file_get_int(remminafile, "quality", 0));
-			SetFormatAndEncodings((rfbClient*) (gpdata->client));
+			/* Applied by the VNC thread, which also owns the automatic quality */
+			remmina_plugin_vnc_event_push(gp, REMMINA_PLUGIN_VNC_EVENT_QUALITY,
+					GINT_TO_POINTER(remmina_plugin_service->file_get_int(remminafile, "quality", 0)), NULL, NULL);
 			break;
 		case REMMINA_PLUGIN_VNC_FEATURE_PREF_VIEWONLY:
 			break;
@@ -1908,35 +2709,71 @@ static void remmina_plugin_vnc_call_feature(RemminaProtocolWidget *gp, const Rem
 		case REMMINA_PLUGIN_VNC_FEATURE_TOOL_SENDCTRLALTDEL:
 			remmina_plugin_vnc_send_ctrlaltdel(gp);
 			break;
+		case REMMINA_PLUGIN_VNC_FEATURE_VISIBILITY:
+			remmina_plugin_vnc_event_push(gp, REMMINA_PLUGIN_VNC_EVENT_VISIBILITY,
+					GINT_TO_POINTER(remmina_plugin_service->protocol_plugin_is_visible(gp)), NULL, NULL);
+			break;
 		default:
 			break;
 	}
 }
 
 
+static cairo_filter_t remmina_plugin_vnc_scale_filter(void)
+{
+	TRACE_CALL("remmina_plugin_vnc_scale_filter");
+	switch (remmina_plugin_service->pref_get_scale_quality())
+	{
+		case GDK_INTERP_NEAREST:
+			return CAIRO_FILTER_FAST;
+		case GDK_INTERP_TILES:
+			return CAIRO_FILTER_GOOD;
+		case GDK_INTERP_BILINEAR:
+			return CAIRO_FILTER_BILINEAR;
+		default:
+			return CAIRO_FILTER_BEST;
+	}
+}
+
 static gboolean remmina_plugin_vnc_on_draw(GtkWidget *widget, cairo_t *context, RemminaProtocolWidget *gp)
 {
 	TRACE_CALL("remmina_plugin_vnc_on_draw");
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
-	GdkPixbuf *buffer;
 	gboolean scale;
+	gint width, height;
+	gint64 start;
+
+	start = g_get_monotonic_time();
 
 	LOCK_BUFFER (FALSE)
 
-	scale = remmina_plugin_service->protocol_plugin_get_scale(gp);
-	/* widget == gpdata->drawing_area */
-	buffer = (scale ? gpdata->scale_buffer : gpdata->rgb_buffer);
-	if (!buffer)
+	if (!gpdata->surface)
 	{
 		UNLOCK_BUFFER (FALSE)
 		return FALSE;
 	}
-	cairo_rectangle(context, 0, 0, gtk_widget_get_allocated_width(widget), gtk_widget_get_allocated_height(widget));
 
-	gdk_cairo_set_source_pixbuf(context, buffer, 0, 0);
-	cairo_fill(context);
+	/* widget == gpdata->drawing_area, scaling is done while painting */
+	scale = remmina_plugin_service->protocol_plugin_get_scale(gp);
+	width = remmina_plugin_service->protocol_plugin_get_width(gp);
+	height = remmina_plugin_service->protocol_plugin_get_height(gp);
+	if (scale && width > 0 && height > 0)
+	{
+		cairo_scale(context, (double) gtk_widget_get_allocated_width(widget) / width,
+				(double) gtk_widget_get_allocated_height(widget) / height);
+	}
+
+	cairo_set_source_surface(context, gpdata->surface, 0, 0);
+	if (scale)
+		cairo_pattern_set_filter(cairo_get_source(context), remmina_plugin_vnc_scale_filter());
+	cairo_set_operator(context, CAIRO_OPERATOR_SOURCE);
+	cairo_paint(context);
 
 	UNLOCK_BUFFER (FALSE)
+
+	start = g_get_monotonic_time() - start;
+	remmina_plugin_service->protocol_plugin_stats_sample(gp, REMMINA_PROTOCOL_STAT_PAINT_TIME, start);
+	remmina_frame_pacer_paint_time(gpdata->pacer, start);
 	return TRUE;
 }
 
@@ -1945,10 +2782,10 @@ static gboolean remmina_plugin_vnc_on_configure(GtkWidget *widget, GdkEventConfi
 	TRACE_CALL("remmina_plugin_vnc_on_configure");
 	RemminaPluginVncData *gpdata = GET_PLUGIN_DATA(gp);
 
-	/* We do a delayed reallocating to improve performance */
-	if (gpdata->scale_handler)
-		g_source_remove(gpdata->scale_handler);
-	gpdata->scale_handler = g_timeout_add(300, (GSourceFunc) remmina_plugin_vnc_update_scale_buffer_main, gp);
+	gpdata->scale_width = event->width;
+	gpdata->scale_height = event->height;
+	if (remmina_plugin_service->protocol_plugin_get_scale(gp))
+		gtk_widget_queue_draw(widget);
 	return FALSE;
 }
 
@@ -1975,11 +2812,14 @@ static void remmina_plugin_vnc_init(RemminaProtocolWidget *gp)
 	g_signal_connect(G_OBJECT(gpdata->drawing_area), "draw", G_CALLBACK(remmina_plugin_vnc_on_draw), gp);
 	g_signal_connect(G_OBJECT(gpdata->drawing_area), "configure_event", G_CALLBACK(remmina_plugin_vnc_on_configure), gp);
 
+	gpdata->pacer = remmina_frame_pacer_new(gpdata->drawing_area, remmina_plugin_vnc_queue_draw_area_real, gp);
+
 	gpdata->auth_first = TRUE;
 	g_get_current_time(&gpdata->clipboard_timer);
 	gpdata->listen_sock = -1;
 	gpdata->pressed_keys = g_ptr_array_new();
 	gpdata->vnc_event_queue = g_queue_new();
+	gpdata->cursor_cache = g_queue_new();
 	if (pipe(gpdata->vnc_event_pipe))
 	{
 		g_print("Error creating pipes.\n");
@@ -2010,6 +2850,7 @@ static gpointer quality_list[] =
 	"1", N_("Medium"),
 	"2", N_("Good"),
 	"9", N_("Best (slowest)"),
+	"-1", N_("Automatic"),
 	NULL
 };
 
@@ -2070,6 +2911,7 @@ static const RemminaProtocolSetting remmina_plugin_vnc_advanced_settings[] =
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "disableclipboard", N_("Disable clipboard sync"), TRUE, NULL, NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "disableencryption", N_("Disable encryption"), FALSE, NULL, NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "disableserverinput", N_("Disable server input"), TRUE, NULL, NULL },
+	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "disablepipeline", N_("Disable pipelined updates"), FALSE, NULL, NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK, "disablepasswordstoring", N_("Disable password storing"), FALSE, NULL, NULL },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_END, NULL, NULL, FALSE, NULL, NULL }
 };
@@ -2086,6 +2928,7 @@ static const RemminaProtocolFeature remmina_plugin_vnc_features[] =
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_TOOL, REMMINA_PLUGIN_VNC_FEATURE_TOOL_SENDCTRLALTDEL, N_("Send Ctrl+Alt+Delete"), NULL, NULL },
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_SCALE, REMMINA_PLUGIN_VNC_FEATURE_SCALE, NULL, NULL, NULL },
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_UNFOCUS, REMMINA_PLUGIN_VNC_FEATURE_UNFOCUS, NULL, NULL, NULL },
+	{ REMMINA_PROTOCOL_FEATURE_TYPE_VISIBILITY, REMMINA_PLUGIN_VNC_FEATURE_VISIBILITY, NULL, NULL, NULL },
 	{ REMMINA_PROTOCOL_FEATURE_TYPE_END, 0, NULL, NULL, NULL }
 };
 
@@ -2140,6 +2983,8 @@ remmina_plugin_entry(RemminaPluginService *service)
 	bindtextdomain(GETTEXT_PACKAGE, REMMINA_LOCALEDIR);
 	bind_textdomain_codeset(GETTEXT_PACKAGE, "UTF-8");
 
+	rfbClientRegisterExtension(&remmina_plugin_vnc_extension);
+
 	if (!service->register_plugin((RemminaPlugin *) &remmina_plugin_vnc))
 	{
 		return FALSE;
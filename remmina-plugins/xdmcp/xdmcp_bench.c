@@ -0,0 +1,314 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Launch latency benchmark for the nested X servers of the XDMCP plugin.
+ *
+ * Run it inside a throwaway X server, for instance
+ *   Xvfb :50 & DISPLAY=:50 remmina-xdmcp-bench 20 [host]
+ * Each run reserves a display number and starts Xephyr inside a GtkSocket,
+ * as the plugin does, and reports the time from the spawn until
+ *   plug     the Xephyr window is embedded in the socket
+ *   server   the nested server accepts clients
+ *   greeter  a window is mapped on it, when host is given for -query
+ * The time to take an idle server from the pool is measured too.
+ * The servers are started with -ac, so the benchmark can connect to them. */
+
+#include "common/remmina_plugin.h"
+#include <gtk/gtkx.h>
+#include <X11/Xlib.h>
+#include "xdmcp_display.h"
+#include "xdmcp_pool.h"
+
+/* Give up on a run after 30 seconds */
+#define REMMINA_XDMCP_BENCH_TIMEOUT (30 * G_USEC_PER_SEC)
+
+typedef struct _RemminaXdmcpBench
+{
+	GtkWidget *window;
+	GtkWidget *socket;
+	gboolean ready;
+} RemminaXdmcpBench;
+
+static void remmina_xdmcp_bench_on_plug_added(GtkSocket *socket, RemminaXdmcpBench *bench)
+{
+	TRACE_CALL("remmina_xdmcp_bench_on_plug_added");
+	bench->ready = TRUE;
+}
+
+static void remmina_xdmcp_bench_iterate(void)
+{
+	TRACE_CALL("remmina_xdmcp_bench_iterate");
+	while (gtk_events_pending())
+		gtk_main_iteration();
+	g_usleep(1000);
+}
+
+/* Connect to the nested server, and look for a viewable top level window
+ * when greeter is set */
+static gboolean remmina_xdmcp_bench_probe(gint display, gboolean greeter)
+{
+	TRACE_CALL("remmina_xdmcp_bench_probe");
+	Display *dpy;
+	Window root, parent, *children;
+	XWindowAttributes attr;
+	unsigned int n, i;
+	gboolean found;
+	gchar *name;
+
+	name = g_strdup_printf(":%i", display);
+	dpy = XOpenDisplay(name);
+	g_free(name);
+	if (!dpy)
+		return FALSE;
+
+	found = !greeter;
+	if (greeter && XQueryTree(dpy, DefaultRootWindow(dpy), &root, &parent, &children, &n))
+	{
+		for (i = 0; i < n && !found; i++)
+		{
+			if (XGetWindowAttributes(dpy, children[i], &attr) && attr.map_state == IsViewable)
+				found = TRUE;
+		}
+		if (children)
+			XFree(children);
+	}
+	XCloseDisplay(dpy);
+
+	return found;
+}
+
+static gint remmina_xdmcp_bench_compare(gconstpointer a, gconstpointer b)
+{
+	TRACE_CALL("remmina_xdmcp_bench_compare");
+	gint64 x = *(const gint64*) a;
+	gint64 y = *(const gint64*) b;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+static void remmina_xdmcp_bench_report(const gchar *name, GArray *times)
+{
+	TRACE_CALL("remmina_xdmcp_bench_report");
+	if (times->len == 0)
+	{
+		g_print("%-12s n/a\n", name);
+		return;
+	}
+	g_array_sort(times, remmina_xdmcp_bench_compare);
+	g_print("%-12s p50 %.1f ms  max %.1f ms  (%u runs)\n", name,
+			g_array_index(times, gint64, times->len / 2) / 1000.0,
+			g_array_index(times, gint64, times->len - 1) / 1000.0, times->len);
+}
+
+static void remmina_xdmcp_bench_window_new(RemminaXdmcpBench *bench)
+{
+	TRACE_CALL("remmina_xdmcp_bench_window_new");
+	bench->ready = FALSE;
+	bench->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size(GTK_WINDOW(bench->window), 640, 480);
+	bench->socket = gtk_socket_new();
+	g_signal_connect(G_OBJECT(bench->socket), "plug-added", G_CALLBACK(remmina_xdmcp_bench_on_plug_added), bench);
+	gtk_container_add(GTK_CONTAINER(bench->window), bench->socket);
+	gtk_widget_show_all(bench->window);
+	gtk_widget_realize(bench->socket);
+}
+
+/* One cold start: spawn, then wait for each stage in turn */
+static void remmina_xdmcp_bench_run(gchar **args, gboolean greeter, GArray *reserve_times, GArray *plug_times,
+		GArray *server_times, GArray *greeter_times)
+{
+	TRACE_CALL("remmina_xdmcp_bench_run");
+	RemminaXdmcpBench bench;
+	GError *error = NULL;
+	gint64 begin;
+	gint64 t;
+	gint display;
+	GPid pid;
+
+	remmina_xdmcp_bench_window_new(&bench);
+
+	begin = g_get_monotonic_time();
+	display = remmina_xdmcp_display_reserve();
+	t = g_get_monotonic_time() - begin;
+	if (display == 0)
+	{
+		g_printerr("No free display number\n");
+		gtk_widget_destroy(bench.window);
+		return;
+	}
+	g_array_append_val(reserve_times, t);
+
+	begin = g_get_monotonic_time();
+	if (!remmina_xdmcp_display_spawn(display, gtk_socket_get_id(GTK_SOCKET(bench.socket)), args, &pid, &error))
+	{
+		g_printerr("Unable to start Xephyr: %s\n", error->message);
+		g_error_free(error);
+		remmina_xdmcp_display_release(display);
+		gtk_widget_destroy(bench.window);
+		return;
+	}
+
+	while (!bench.ready && g_get_monotonic_time() - begin < REMMINA_XDMCP_BENCH_TIMEOUT)
+		remmina_xdmcp_bench_iterate();
+	if (bench.ready)
+	{
+		t = g_get_monotonic_time() - begin;
+		g_array_append_val(plug_times, t);
+	}
+
+	while (g_get_monotonic_time() - begin < REMMINA_XDMCP_BENCH_TIMEOUT)
+	{
+		if (remmina_xdmcp_bench_probe(display, FALSE))
+		{
+			t = g_get_monotonic_time() - begin;
+			g_array_append_val(server_times, t);
+			break;
+		}
+		remmina_xdmcp_bench_iterate();
+	}
+
+	while (greeter && g_get_monotonic_time() - begin < REMMINA_XDMCP_BENCH_TIMEOUT)
+	{
+		if (remmina_xdmcp_bench_probe(display, TRUE))
+		{
+			t = g_get_monotonic_time() - begin;
+			g_array_append_val(greeter_times, t);
+			break;
+		}
+		g_usleep(10000);
+		remmina_xdmcp_bench_iterate();
+	}
+
+	kill(pid, SIGTERM);
+	g_spawn_close_pid(pid);
+	remmina_xdmcp_display_release(display);
+	gtk_widget_destroy(bench.window);
+	remmina_xdmcp_bench_iterate();
+}
+
+/* Prespawn a server, wait until the pool can hand it out, then time the
+ * take into a session window */
+static void remmina_xdmcp_bench_run_pool(gchar **args, GArray *take_times)
+{
+	TRACE_CALL("remmina_xdmcp_bench_run_pool");
+	RemminaXdmcpBench bench;
+	GtkWidget *socket = NULL;
+	gint64 begin;
+	gint64 t;
+	gint display;
+	GPid pid;
+
+	remmina_xdmcp_bench_window_new(&bench);
+	remmina_xdmcp_pool_fill(args);
+
+	begin = g_get_monotonic_time();
+	while (g_get_monotonic_time() - begin < REMMINA_XDMCP_BENCH_TIMEOUT)
+	{
+		t = g_get_monotonic_time();
+		socket = remmina_xdmcp_pool_take(args, bench.socket, &display, &pid);
+		t = g_get_monotonic_time() - t;
+		if (socket)
+			break;
+		remmina_xdmcp_bench_iterate();
+	}
+
+	if (socket)
+	{
+		g_array_append_val(take_times, t);
+		kill(pid, SIGTERM);
+		g_spawn_close_pid(pid);
+		remmina_xdmcp_display_release(display);
+	}
+	gtk_widget_destroy(bench.window);
+	remmina_xdmcp_bench_iterate();
+}
+
+int main(int argc, char **argv)
+{
+	TRACE_CALL("main");
+	GArray *reserve_times, *plug_times, *server_times, *greeter_times, *take_times;
+	GPtrArray *args;
+	gint runs, i;
+
+	gtk_init(&argc, &argv);
+	if (argc < 2)
+	{
+		g_printerr("Usage: %s <runs> [host]\n", argv[0]);
+		return 1;
+	}
+	runs = atoi(argv[1]);
+
+	args = g_ptr_array_new();
+	g_ptr_array_add(args, "-screen");
+	g_ptr_array_add(args, "640x480x24");
+	g_ptr_array_add(args, "-nolisten");
+	g_ptr_array_add(args, "tcp");
+	g_ptr_array_add(args, "-ac");
+	if (argc > 2)
+	{
+		g_ptr_array_add(args, "-query");
+		g_ptr_array_add(args, argv[2]);
+	}
+	g_ptr_array_add(args, NULL);
+
+	reserve_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+	plug_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+	server_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+	greeter_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+	take_times = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+	for (i = 0; i < runs; i++)
+		remmina_xdmcp_bench_run((gchar**) args->pdata, argc > 2, reserve_times, plug_times, server_times,
+				greeter_times);
+
+	remmina_xdmcp_pool_set_size(1);
+	for (i = 0; i < runs; i++)
+		remmina_xdmcp_bench_run_pool((gchar**) args->pdata, take_times);
+	remmina_xdmcp_pool_shutdown();
+
+	remmina_xdmcp_bench_report("reserve", reserve_times);
+	remmina_xdmcp_bench_report("plug", plug_times);
+	remmina_xdmcp_bench_report("server", server_times);
+	remmina_xdmcp_bench_report("greeter", greeter_times);
+	remmina_xdmcp_bench_report("pool take", take_times);
+
+	g_array_free(reserve_times, TRUE);
+	g_array_free(plug_times, TRUE);
+	g_array_free(server_times, TRUE);
+	g_array_free(greeter_times, TRUE);
+	g_array_free(take_times, TRUE);
+	g_ptr_array_free(args, TRUE);
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "common/remmina_plugin.h"
+#include <stdio.h>
+#include "xdmcp_display.h"
+
+/* The X server lock files and unix sockets, see X_UNIX_SOCKET */
+#define X_LOCK_DIR "/tmp"
+#define X_LOCK_FORMAT ".X%d-lock%c"
+#define X_UNIX_SOCKET_DIR "/tmp/.X11-unix"
+#define X_UNIX_SOCKET_FORMAT "X%d%c"
+
+G_LOCK_DEFINE_STATIC(remmina_xdmcp_display);
+static gboolean remmina_xdmcp_display_reserved[MAX_X_DISPLAY_NUMBER];
+
+/* Mark the displays with an entry in dir. A trailing character after the
+ * name means it is some other file, such as X0-lock.tmp */
+static void remmina_xdmcp_display_scan(const gchar *dir, const gchar *format, gboolean *used)
+{
+	TRACE_CALL("remmina_xdmcp_display_scan");
+	GDir *gdir;
+	const gchar *name;
+	gint display;
+	gchar c;
+
+	gdir = g_dir_open(dir, 0, NULL);
+	if (!gdir)
+		return;
+	while ((name = g_dir_read_name(gdir)) != NULL)
+	{
+		if (sscanf(name, format, &display, &c) == 1 && display > 0 && display < MAX_X_DISPLAY_NUMBER)
+			used[display] = TRUE;
+	}
+	g_dir_close(gdir);
+}
+
+gint remmina_xdmcp_display_reserve(void)
+{
+	TRACE_CALL("remmina_xdmcp_display_reserve");
+	gboolean used[MAX_X_DISPLAY_NUMBER];
+	gint display = 0;
+	gint i;
+
+	/* A server may run with only its lock file (abstract sockets) or only
+	 * its socket (stale lock removed), so both are checked */
+	memset(used, 0, sizeof(used));
+	remmina_xdmcp_display_scan(X_LOCK_DIR, X_LOCK_FORMAT, used);
+	remmina_xdmcp_display_scan(X_UNIX_SOCKET_DIR, X_UNIX_SOCKET_FORMAT, used);
+
+	G_LOCK(remmina_xdmcp_display);
+	for (i = 1; i < MAX_X_DISPLAY_NUMBER; i++)
+	{
+		if (!used[i] && !remmina_xdmcp_display_reserved[i])
+		{
+			remmina_xdmcp_display_reserved[i] = TRUE;
+			display = i;
+			break;
+		}
+	}
+	G_UNLOCK(remmina_xdmcp_display);
+
+	return display;
+}
+
+void remmina_xdmcp_display_release(gint display)
+{
+	TRACE_CALL("remmina_xdmcp_display_release");
+	if (display <= 0 || display >= MAX_X_DISPLAY_NUMBER)
+		return;
+	G_LOCK(remmina_xdmcp_display);
+	remmina_xdmcp_display_reserved[display] = FALSE;
+	G_UNLOCK(remmina_xdmcp_display);
+}
+
+gboolean remmina_xdmcp_display_spawn(gint display, gint parent, gchar **args, GPid *pid, GError **error)
+{
+	TRACE_CALL("remmina_xdmcp_display_spawn");
+	GPtrArray *argv;
+	gboolean ret;
+	gint i;
+
+	argv = g_ptr_array_new_with_free_func(g_free);
+	g_ptr_array_add(argv, g_strdup("Xephyr"));
+	g_ptr_array_add(argv, g_strdup_printf(":%i", display));
+	g_ptr_array_add(argv, g_strdup("-parent"));
+	g_ptr_array_add(argv, g_strdup_printf("%i", parent));
+	for (i = 0; args && args[i]; i++)
+		g_ptr_array_add(argv, g_strdup(args[i]));
+	g_ptr_array_add(argv, NULL);
+
+	ret = g_spawn_async(NULL, (gchar**) argv->pdata, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, pid, error);
+	g_ptr_array_free(argv, TRUE);
+
+	return ret;
+}
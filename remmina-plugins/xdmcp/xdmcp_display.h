@@ -0,0 +1,57 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINAXDMCPDISPLAY_H__
+#define __REMMINAXDMCPDISPLAY_H__
+
+G_BEGIN_DECLS
+
+/* Local X display numbers for the nested Xephyr servers.
+ * Numbers handed out by this process stay reserved until released, so two
+ * sessions starting at the same time never get the same number, even
+ * before their servers have created the lock file and the socket. */
+
+/* The lowest display number free both here and on the system, 0 if none */
+gint remmina_xdmcp_display_reserve(void);
+void remmina_xdmcp_display_release(gint display);
+
+/* Start Xephyr on a reserved display, inside the X window parent.
+ * args are the other command line options, NULL terminated */
+gboolean remmina_xdmcp_display_spawn(gint display, gint parent, gchar **args, GPid *pid, GError **error);
+
+G_END_DECLS
+
+#endif  /* __REMMINAXDMCPDISPLAY_H__  */
+
@@ -37,8 +37,8 @@
 #if GTK_VERSION == 3
 #  include <gtk/gtkx.h>
 #endif
-
-INCLUDE_GET_AVAILABLE_XDISPLAY
+#include "xdmcp_display.h"
+#include "xdmcp_pool.h"
 
 #define REMMINA_PLUGIN_XDMCP_FEATURE_TOOL_SENDCTRLALTDEL 1
 
@@ -75,34 +75,15 @@ static void remmina_plugin_xdmcp_on_plug_removed(GtkSocket *socket, RemminaProto
 	remmina_plugin_service->protocol_plugin_close_connection(gp);
 }
 
-static gboolean remmina_plugin_xdmcp_start_xephyr(RemminaProtocolWidget *gp)
+/* The Xephyr options for remminafile, other than the display and the parent window */
+static gchar** remmina_plugin_xdmcp_get_xephyr_args(RemminaFile *remminafile)
 {
-	TRACE_CALL("remmina_plugin_xdmcp_start_xephyr");
-	RemminaPluginXdmcpData *gpdata = GET_PLUGIN_DATA(gp);
-	RemminaFile *remminafile;
-	gchar *argv[50];
-	gint argc;
+	TRACE_CALL("remmina_plugin_xdmcp_get_xephyr_args");
+	GPtrArray *args;
 	gchar *host;
 	gint i;
-	GError *error = NULL;
-	gboolean ret;
 
-	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
-
-	gpdata->display = remmina_get_available_xdisplay();
-	if (gpdata->display == 0)
-	{
-		remmina_plugin_service->protocol_plugin_set_error(gp, "Run out of available local X display number.");
-		return FALSE;
-	}
-
-	argc = 0;
-	argv[argc++] = g_strdup("Xephyr");
-
-	argv[argc++] = g_strdup_printf(":%i", gpdata->display);
-
-	argv[argc++] = g_strdup("-parent");
-	argv[argc++] = g_strdup_printf("%i", gpdata->socket_id);
+	args = g_ptr_array_new();
 
 	/* All Xephyr version between 1.5.0 and 1.6.4 will break when -screen argument is specified with -parent.
 	 * It's not possible to support color depth if you have those Xephyr version. Please see this bug
@@ -112,24 +93,24 @@ static gboolean remmina_plugin_xdmcp_start_xephyr(RemminaProtocolWidget *gp)
 	i = remmina_plugin_service->file_get_int(remminafile, "colordepth", 8);
 	if (i >= 8)
 	{
-		argv[argc++] = g_strdup("-screen");
-		argv[argc++] = g_strdup_printf("%ix%ix%i",
+		g_ptr_array_add(args, g_strdup("-screen"));
+		g_ptr_array_add(args, g_strdup_printf("%ix%ix%i",
 				remmina_plugin_service->file_get_int(remminafile, "resolution_width", 640),
-				remmina_plugin_service->file_get_int(remminafile, "resolution_height", 480), i);
+				remmina_plugin_service->file_get_int(remminafile, "resolution_height", 480), i));
 	}
 
 	if (i == 2)
 	{
-		argv[argc++] = g_strdup("-grayscale");
+		g_ptr_array_add(args, g_strdup("-grayscale"));
 	}
 
 	if (remmina_plugin_service->file_get_int(remminafile, "showcursor", FALSE))
 	{
-		argv[argc++] = g_strdup("-host-cursor");
+		g_ptr_array_add(args, g_strdup("-host-cursor"));
 	}
 	if (remmina_plugin_service->file_get_int(remminafile, "once", FALSE))
 	{
-		argv[argc++] = g_strdup("-once");
+		g_ptr_array_add(args, g_strdup("-once"));
 	}
 
 	if (!remmina_plugin_service->file_get_int(remminafile, "ssh_enabled", FALSE))
@@ -137,42 +118,112 @@ static gboolean remmina_plugin_xdmcp_start_xephyr(RemminaProtocolWidget *gp)
 		remmina_plugin_service->get_server_port(remmina_plugin_service->file_get_string(remminafile, "server"), 0,
 				&host, &i);
 
-		argv[argc++] = g_strdup("-query");
-		argv[argc++] = host;
+		g_ptr_array_add(args, g_strdup("-query"));
+		g_ptr_array_add(args, host);
 
 		if (i)
 		{
-			argv[argc++] = g_strdup("-port");
-			argv[argc++] = g_strdup_printf("%i", i);
+			g_ptr_array_add(args, g_strdup("-port"));
+			g_ptr_array_add(args, g_strdup_printf("%i", i));
 		}
 	}
 	else
 	{
 		/* When the connection is through an SSH tunnel, it connects back to local unix socket,
 		 * so for security we can disable tcp listening */
-		argv[argc++] = g_strdup("-nolisten");
-		argv[argc++] = g_strdup("tcp");
+		g_ptr_array_add(args, g_strdup("-nolisten"));
+		g_ptr_array_add(args, g_strdup("tcp"));
 
 		/* FIXME: It's better to get the magic cookie back from xqproxy, then call xauth,
 		 * instead of disable access control */
-		argv[argc++] = g_strdup("-ac");
+		g_ptr_array_add(args, g_strdup("-ac"));
 	}
 
-	argv[argc++] = NULL;
+	g_ptr_array_add(args, NULL);
+	return (gchar**) g_ptr_array_free(args, FALSE);
+}
 
-	ret = g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, &gpdata->pid, &error);
-	for (i = 0; i < argc; i++)
-		g_free(argv[i]);
+static gboolean remmina_plugin_xdmcp_start_xephyr(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL("remmina_plugin_xdmcp_start_xephyr");
+	RemminaPluginXdmcpData *gpdata = GET_PLUGIN_DATA(gp);
+	RemminaFile *remminafile;
+	gchar **args;
+	GError *error = NULL;
+	gboolean ret;
+
+	/* Already running, taken from the pool */
+	if (gpdata->pid)
+		return TRUE;
+
+	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
+
+	gpdata->display = remmina_xdmcp_display_reserve();
+	if (gpdata->display == 0)
+	{
+		remmina_plugin_service->protocol_plugin_set_error(gp, "Run out of available local X display number.");
+		return FALSE;
+	}
+
+	args = remmina_plugin_xdmcp_get_xephyr_args(remminafile);
+	ret = remmina_xdmcp_display_spawn(gpdata->display, gpdata->socket_id, args, &gpdata->pid, &error);
+	g_strfreev(args);
 
 	if (!ret)
 	{
 		remmina_plugin_service->protocol_plugin_set_error(gp, "%s", error->message);
+		g_error_free(error);
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
+static gboolean remmina_plugin_xdmcp_fill_pool(gchar **args)
+{
+	TRACE_CALL("remmina_plugin_xdmcp_fill_pool");
+	remmina_xdmcp_pool_fill(args);
+	return FALSE;
+}
+
+/* With the xdmcp_prespawn preference set, take an idle Xephyr from the pool
+ * and start another one like it once the session is on its way.
+ * Only for SSH sessions: xqproxy does the XDMCP query later, while a direct
+ * session needs a server started with -query for its host */
+static void remmina_plugin_xdmcp_use_pool(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL("remmina_plugin_xdmcp_use_pool");
+	RemminaPluginXdmcpData *gpdata = GET_PLUGIN_DATA(gp);
+	GtkWidget *socket;
+	gchar **args;
+	gchar *value;
+	gint size;
+
+	value = remmina_plugin_service->pref_get_value("xdmcp_prespawn");
+	size = (value ? atoi(value) : 0);
+	g_free(value);
+	remmina_xdmcp_pool_set_size(size);
+	if (size <= 0)
+		return;
+
+	args = remmina_plugin_xdmcp_get_xephyr_args(remmina_plugin_service->protocol_plugin_get_file(gp));
+
+	socket = remmina_xdmcp_pool_take(args, gpdata->socket, &gpdata->display, &gpdata->pid);
+	if (socket)
+	{
+		gpdata->socket = socket;
+		gpdata->socket_id = gtk_socket_get_id(GTK_SOCKET(socket));
+		remmina_plugin_service->protocol_plugin_register_hostkey(gp, gpdata->socket);
+		g_signal_connect(G_OBJECT(gpdata->socket), "plug-removed", G_CALLBACK(remmina_plugin_xdmcp_on_plug_removed), gp);
+		/* Its plug-added is gone already */
+		gpdata->ready = TRUE;
+		remmina_plugin_service->protocol_plugin_emit_signal(gp, "connect");
+	}
+
+	gdk_threads_add_idle_full(G_PRIORITY_LOW, (GSourceFunc) remmina_plugin_xdmcp_fill_pool, args,
+			(GDestroyNotify) g_strfreev);
+}
+
 static gboolean remmina_plugin_xdmcp_tunnel_init_callback(RemminaProtocolWidget *gp, gint remotedisplay, const gchar *server,
 		gint port)
 {
@@ -282,6 +333,8 @@ static gboolean remmina_plugin_xdmcp_open_connection(RemminaProtocolWidget *gp)
 
 	if (remmina_plugin_service->file_get_int (remminafile, "ssh_enabled", FALSE))
 	{
+		remmina_plugin_xdmcp_use_pool(gp);
+
 		if (pthread_create (&gpdata->thread, NULL, remmina_plugin_xdmcp_main_thread, gp))
 		{
 			remmina_plugin_service->protocol_plugin_set_error (gp,
@@ -318,6 +371,8 @@ static gboolean remmina_plugin_xdmcp_close_connection(RemminaProtocolWidget *gp)
 		g_spawn_close_pid(gpdata->pid);
 		gpdata->pid = 0;
 	}
+	remmina_xdmcp_display_release(gpdata->display);
+	gpdata->display = 0;
 
 	remmina_plugin_service->protocol_plugin_emit_signal(gp, "disconnect");
 
@@ -431,6 +486,8 @@ remmina_plugin_entry(RemminaPluginService *service)
 		return FALSE;
 	}
 
+	atexit(remmina_xdmcp_pool_shutdown);
+
 	return TRUE;
 }
 
@@ -0,0 +1,187 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "common/remmina_plugin.h"
+#if GTK_VERSION == 3
+#  include <gtk/gtkx.h>
+#endif
+#include "xdmcp_display.h"
+#include "xdmcp_pool.h"
+
+typedef struct _RemminaXdmcpPoolServer
+{
+	/* The command line options, joined */
+	gchar *key;
+	GtkWidget *window;
+	GtkWidget *socket;
+	gint display;
+	GPid pid;
+	gboolean ready;
+} RemminaXdmcpPoolServer;
+
+/* Only used from the main thread */
+static GList *remmina_xdmcp_pool = NULL;
+static gint remmina_xdmcp_pool_size = 0;
+
+static void remmina_xdmcp_pool_server_free(RemminaXdmcpPoolServer *server)
+{
+	TRACE_CALL("remmina_xdmcp_pool_server_free");
+	remmina_xdmcp_pool = g_list_remove(remmina_xdmcp_pool, server);
+	g_free(server->key);
+	g_free(server);
+}
+
+static void remmina_xdmcp_pool_on_plug_added(GtkSocket *socket, RemminaXdmcpPoolServer *server)
+{
+	TRACE_CALL("remmina_xdmcp_pool_on_plug_added");
+	server->ready = TRUE;
+}
+
+/* The server went away while idle */
+static gboolean remmina_xdmcp_pool_on_plug_removed(GtkSocket *socket, RemminaXdmcpPoolServer *server)
+{
+	TRACE_CALL("remmina_xdmcp_pool_on_plug_removed");
+	if (server->pid)
+	{
+		kill(server->pid, SIGTERM);
+		g_spawn_close_pid(server->pid);
+	}
+	remmina_xdmcp_display_release(server->display);
+	gtk_widget_destroy(server->window);
+	remmina_xdmcp_pool_server_free(server);
+	return TRUE;
+}
+
+void remmina_xdmcp_pool_set_size(gint size)
+{
+	TRACE_CALL("remmina_xdmcp_pool_set_size");
+	remmina_xdmcp_pool_size = MAX(size, 0);
+}
+
+GtkWidget* remmina_xdmcp_pool_take(gchar **args, GtkWidget *placeholder, gint *display, GPid *pid)
+{
+	TRACE_CALL("remmina_xdmcp_pool_take");
+	RemminaXdmcpPoolServer *server;
+	GtkWidget *parent;
+	GtkWidget *socket;
+	GList *l;
+	gchar *key;
+
+	/* The X window of the socket only survives the move when both sides
+	 * are realized, otherwise Xephyr would lose its parent */
+	parent = gtk_widget_get_parent(placeholder);
+	if (!remmina_xdmcp_pool || !parent || !gtk_widget_get_realized(parent))
+		return NULL;
+
+	key = g_strjoinv(" ", args);
+	server = NULL;
+	for (l = remmina_xdmcp_pool; l; l = l->next)
+	{
+		if (((RemminaXdmcpPoolServer*) l->data)->ready && g_strcmp0(((RemminaXdmcpPoolServer*) l->data)->key, key) == 0)
+		{
+			server = (RemminaXdmcpPoolServer*) l->data;
+			break;
+		}
+	}
+	g_free(key);
+	if (!server)
+		return NULL;
+
+	socket = server->socket;
+	g_signal_handlers_disconnect_by_data(socket, server);
+	gtk_widget_destroy(placeholder);
+	gtk_widget_reparent(socket, parent);
+	gtk_widget_destroy(server->window);
+
+	*display = server->display;
+	*pid = server->pid;
+	remmina_xdmcp_pool_server_free(server);
+
+	return socket;
+}
+
+void remmina_xdmcp_pool_fill(gchar **args)
+{
+	TRACE_CALL("remmina_xdmcp_pool_fill");
+	RemminaXdmcpPoolServer *server;
+	GError *error = NULL;
+
+	if ((gint) g_list_length(remmina_xdmcp_pool) >= remmina_xdmcp_pool_size)
+		return;
+
+	server = g_new0(RemminaXdmcpPoolServer, 1);
+	server->display = remmina_xdmcp_display_reserve();
+	if (server->display == 0)
+	{
+		g_free(server);
+		return;
+	}
+
+	server->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	server->socket = gtk_socket_new();
+	gtk_widget_show(server->socket);
+	gtk_container_add(GTK_CONTAINER(server->window), server->socket);
+	/* Realized but never shown */
+	gtk_widget_realize(server->socket);
+
+	if (!remmina_xdmcp_display_spawn(server->display, gtk_socket_get_id(GTK_SOCKET(server->socket)), args,
+			&server->pid, &error))
+	{
+		g_print("Unable to prespawn Xephyr: %s\n", error->message);
+		g_error_free(error);
+		remmina_xdmcp_display_release(server->display);
+		gtk_widget_destroy(server->window);
+		g_free(server);
+		return;
+	}
+
+	server->key = g_strjoinv(" ", args);
+	g_signal_connect(G_OBJECT(server->socket), "plug-added", G_CALLBACK(remmina_xdmcp_pool_on_plug_added), server);
+	g_signal_connect(G_OBJECT(server->socket), "plug-removed", G_CALLBACK(remmina_xdmcp_pool_on_plug_removed), server);
+	remmina_xdmcp_pool = g_list_append(remmina_xdmcp_pool, server);
+}
+
+void remmina_xdmcp_pool_shutdown(void)
+{
+	TRACE_CALL("remmina_xdmcp_pool_shutdown");
+	GList *l;
+
+	/* GTK may be gone already, only the processes are handled */
+	for (l = remmina_xdmcp_pool; l; l = l->next)
+	{
+		if (((RemminaXdmcpPoolServer*) l->data)->pid)
+			kill(((RemminaXdmcpPoolServer*) l->data)->pid, SIGTERM);
+	}
+}
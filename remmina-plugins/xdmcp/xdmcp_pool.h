@@ -0,0 +1,62 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2010 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINAXDMCPPOOL_H__
+#define __REMMINAXDMCPPOOL_H__
+
+G_BEGIN_DECLS
+
+/* Idle Xephyr servers started in advance, each one embedded in a GtkSocket
+ * of a hidden window. A session taking one only has to move the socket
+ * into its own widget, instead of waiting for a new X server.
+ * Servers are matched on their command line options, so only servers
+ * which are not bound to a host (no -query) can be pooled. */
+
+/* Maximum number of idle servers, 0 (the default) disables the pool */
+void remmina_xdmcp_pool_set_size(gint size);
+
+/* Replace placeholder, an empty socket, with the socket of an idle server
+ * started with args, and return it. NULL if there is none ready, or the
+ * parent of placeholder is not realized */
+GtkWidget* remmina_xdmcp_pool_take(gchar **args, GtkWidget *placeholder, gint *display, GPid *pid);
+/* Start a server with args, if the pool has room */
+void remmina_xdmcp_pool_fill(gchar **args);
+/* Terminate the idle servers, at exit */
+void remmina_xdmcp_pool_shutdown(void);
+
+G_END_DECLS
+
+#endif  /* __REMMINAXDMCPPOOL_H__  */
+
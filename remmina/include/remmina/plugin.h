@@ -106,6 +106,8 @@ typedef struct _RemminaFilePlugin
     gboolean (* export_test_func) (RemminaFile *file);
     gboolean (* export_func) (RemminaFile *file, const gchar *to_file);
     const gchar *export_hints;
+    /* import_func may run in several threads at once, for bulk imports */
+    gboolean import_thread_safe;
 } RemminaFilePlugin;
 
 typedef struct _RemminaToolPlugin
@@ -220,6 +222,19 @@ typedef struct _RemminaPluginService
     void         (* get_server_port)                      (const gchar *server, gint defaultport, gchar **host, gint *port);  
     gboolean     (* is_main_thread)                       (void);
 
+    void         (* protocol_plugin_stats_count)          (RemminaProtocolWidget *gp, RemminaProtocolStat stat, gint64 delta);
+    void         (* protocol_plugin_stats_gauge)          (RemminaProtocolWidget *gp, RemminaProtocolStat stat, gint64 value);
+    void         (* protocol_plugin_stats_sample)         (RemminaProtocolWidget *gp, RemminaProtocolStat stat, gint64 usec);
+    gboolean     (* protocol_plugin_is_visible)           (RemminaProtocolWidget *gp);
+
+    RemminaSSHExecBatch* (* protocol_plugin_ssh_exec_batch_new) (RemminaProtocolWidget *gp);
+    RemminaSSHExec* (* ssh_exec_batch_add)                (RemminaSSHExecBatch *batch, RemminaSSHExecOutputFunc output_func, gpointer data, const gchar *fmt, ...);
+    gboolean     (* ssh_exec_batch_run)                   (RemminaSSHExecBatch *batch);
+    gboolean     (* ssh_exec_batch_start)                 (RemminaSSHExecBatch *batch, RemminaSSHExecBatchFunc done_func, gpointer data);
+    gboolean     (* ssh_exec_batch_wait)                  (RemminaSSHExecBatch *batch);
+    void         (* ssh_exec_batch_free)                  (RemminaSSHExecBatch *batch);
+    gint         (* ssh_exec_get_status)                  (RemminaSSHExec *exec);
+
 } RemminaPluginService;
 
 /* "Prototype" of the plugin entry function */
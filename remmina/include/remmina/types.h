@@ -46,7 +46,9 @@ typedef enum
     REMMINA_PROTOCOL_FEATURE_TYPE_PREF,
     REMMINA_PROTOCOL_FEATURE_TYPE_TOOL,
     REMMINA_PROTOCOL_FEATURE_TYPE_UNFOCUS,
-    REMMINA_PROTOCOL_FEATURE_TYPE_SCALE
+    REMMINA_PROTOCOL_FEATURE_TYPE_SCALE,
+    /* Called when the session becomes visible or hidden, see protocol_plugin_is_visible */
+    REMMINA_PROTOCOL_FEATURE_TYPE_VISIBILITY
 } RemminaProtocolFeatureType;
 
 #define REMMINA_PROTOCOL_FEATURE_PREF_RADIO 1
@@ -67,6 +69,15 @@ typedef gpointer RemminaTunnelInitFunc;
 typedef gboolean (*RemminaXPortTunnelInitFunc) (RemminaProtocolWidget *gp,
     gint remotedisplay, const gchar *server, gint port);
 
+/* Remote commands run over parallel channels of an SSH session */
+typedef struct _RemminaSSHExec RemminaSSHExec;
+typedef struct _RemminaSSHExecBatch RemminaSSHExecBatch;
+/* Output of a command, as it arrives. Called from the thread running the batch */
+typedef void (*RemminaSSHExecOutputFunc) (RemminaSSHExec *exec, const gchar *data, gsize len,
+    gboolean is_stderr, gpointer user_data);
+/* Every command of the batch is over */
+typedef void (*RemminaSSHExecBatchFunc) (RemminaSSHExecBatch *batch, gpointer user_data);
+
 typedef enum
 {
     REMMINA_PROTOCOL_SETTING_TYPE_END,
@@ -110,6 +121,27 @@ typedef enum
     REMMINA_AUTHPWD_TYPE_SSH_PRIVKEY
 } RemminaAuthpwdType;
 
+/* Per-session performance statistics. Counters are accumulated,
+ * gauges keep the last value, timings are histograms in microseconds */
+typedef enum
+{
+    REMMINA_PROTOCOL_STAT_BYTES_IN,
+    REMMINA_PROTOCOL_STAT_BYTES_OUT,
+    REMMINA_PROTOCOL_STAT_FRAMES,
+    REMMINA_PROTOCOL_STAT_DAMAGE_PIXELS,
+    REMMINA_PROTOCOL_STAT_INPUT_EVENTS,
+    REMMINA_PROTOCOL_STAT_DROPPED_FRAMES,
+
+    REMMINA_PROTOCOL_STAT_UI_QUEUE_DEPTH,
+    REMMINA_PROTOCOL_STAT_EVENT_QUEUE_DEPTH,
+
+    REMMINA_PROTOCOL_STAT_DECODE_TIME,
+    REMMINA_PROTOCOL_STAT_PAINT_TIME,
+    REMMINA_PROTOCOL_STAT_INPUT_LATENCY,
+
+    REMMINA_PROTOCOL_STAT_LAST
+} RemminaProtocolStat;
+
 G_END_DECLS
 
 #endif /* __REMMINA_TYPES_H__ */
@@ -41,6 +41,7 @@
 #include "remmina_public.h"
 #include "remmina_main.h"
 #include "remmina_file_manager.h"
+#include "remmina_file_import.h"
 #include "remmina_pref.h"
 #include "remmina_widget_pool.h"
 #include "remmina_plugin_manager.h"
@@ -49,6 +50,7 @@
 #include "remmina_exec.h"
 #include "remmina_icon.h"
 #include "remmina_masterthread_exec.h"
+#include "remmina_startup.h"
 #include "remmina/remmina_trace_calls.h"
 
 #ifdef HAVE_ERRNO_H
@@ -71,6 +73,14 @@ static gboolean remmina_option_quit;
 static gchar *remmina_option_server;
 static gchar *remmina_option_protocol;
 static gchar *remmina_option_icon;
+/* Handled by remmina_startup_init(), only declared for the parser */
+static gchar *remmina_option_startup_trace;
+static gboolean remmina_option_startup_bench;
+static gchar *remmina_option_reencrypt;
+static gchar **remmina_option_import;
+static gboolean remmina_option_import_dry_run;
+/* Set once a command line tool has run, there is no main loop to start then */
+static gboolean remmina_tool_done;
 
 
 static GOptionEntry remmina_options[] =
@@ -86,6 +96,11 @@ static GOptionEntry remmina_options[] =
 	{ "server", 's', 0, G_OPTION_ARG_STRING, &remmina_option_server, "Use default server name", "SERVER" },
 	{ "protocol", 't', 0, G_OPTION_ARG_STRING, &remmina_option_protocol, "Use default protocol", "PROTOCOL" },
 	{ "icon", 'i', 0, G_OPTION_ARG_NONE, &remmina_option_icon, "Start as tray icon", NULL },
+	{ "startup-trace", 0, 0, G_OPTION_ARG_FILENAME, &remmina_option_startup_trace, "Write a startup timeline to FILE", "FILE" },
+	{ "startup-bench", 0, 0, G_OPTION_ARG_NONE, &remmina_option_startup_bench, "Exit once the main window is shown, printing the startup timeline", NULL },
+	{ "reencrypt", 0, 0, G_OPTION_ARG_FILENAME, &remmina_option_reencrypt, "Encrypt again the passwords saved in DIR in an older format, then exit", "DIR" },
+	{ "import", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &remmina_option_import, "Import a file, or all the files in a directory, then exit", "FILE|DIR" },
+	{ "import-dry-run", 0, 0, G_OPTION_ARG_NONE, &remmina_option_import_dry_run, "Only report what --import would do", NULL },
 	{ NULL }
 };
 
@@ -100,6 +115,9 @@ static gint remmina_on_command_line(GApplication *app, GApplicationCommandLine *
 	gboolean parsed;
 	gchar *s;
 	gboolean executed = FALSE;
+	gint count, failed;
+	GSList *paths;
+	RemminaFileImportReport *report;
 
 	remmina_option_about = FALSE;
 	remmina_option_connect = NULL;
@@ -111,6 +129,9 @@ static gint remmina_on_command_line(GApplication *app, GApplicationCommandLine *
 	remmina_option_server = NULL;
 	remmina_option_protocol = NULL;
 	remmina_option_icon = FALSE;
+	remmina_option_reencrypt = NULL;
+	remmina_option_import = NULL;
+	remmina_option_import_dry_run = FALSE;
 
 	argv = g_application_command_line_get_arguments(cmdline, &argc);
 
@@ -132,6 +153,46 @@ static gint remmina_on_command_line(GApplication *app, GApplicationCommandLine *
 		status = 1;
 	}
 
+	if (remmina_option_reencrypt)
+	{
+		count = remmina_file_manager_reencrypt(remmina_option_reencrypt, &failed);
+		if (count < 0)
+		{
+			g_application_command_line_printerr(cmdline, "Cannot read the directory %s\n", remmina_option_reencrypt);
+			status = 1;
+		}
+		else
+		{
+			g_application_command_line_print(cmdline, "%d passwords encrypted again, %d files failed\n", count, failed);
+			if (failed)
+				status = 1;
+		}
+		remmina_tool_done = TRUE;
+		executed = TRUE;
+	}
+	if (remmina_option_import)
+	{
+		paths = NULL;
+		for (count = 0; remmina_option_import[count]; count++)
+			paths = g_slist_append(paths, remmina_option_import[count]);
+		report = remmina_file_import(paths, remmina_option_import_dry_run);
+		g_slist_free(paths);
+		g_strfreev(remmina_option_import);
+		remmina_option_import = NULL;
+
+		if (remmina_option_import_dry_run)
+			g_application_command_line_print(cmdline, "%s", report->profiles->str);
+		if (report->errors->len > 0)
+			g_application_command_line_printerr(cmdline, "Unable to import:\n%s", report->errors->str);
+		g_application_command_line_print(cmdline, "%u files, %u %s, %u failed in %.2f s\n", report->files,
+				report->imported, remmina_option_import_dry_run ? "to import" : "imported", report->failed,
+				report->elapsed / 1000000.0);
+		if (report->failed)
+			status = 1;
+		remmina_file_import_report_free(report);
+		remmina_tool_done = TRUE;
+		executed = TRUE;
+	}
 	if (remmina_option_about)
 	{
 		remmina_exec_command(REMMINA_COMMAND_ABOUT, NULL);
@@ -196,13 +257,27 @@ static gint remmina_on_command_line(GApplication *app, GApplicationCommandLine *
 static void remmina_on_startup(GApplication *app)
 {
 	TRACE_CALL("remmina_on_startup");
+	gint64 t;
+
+	t = remmina_startup_begin();
 	remmina_file_manager_init();
+	remmina_startup_end("init", "remmina_file_manager_init", t);
+	t = remmina_startup_begin();
 	remmina_pref_init();
+	remmina_startup_end("init", "remmina_pref_init", t);
+	t = remmina_startup_begin();
 	remmina_plugin_manager_init();
+	remmina_startup_end("init", "remmina_plugin_manager_init", t);
+	t = remmina_startup_begin();
 	remmina_widget_pool_init();
+	remmina_startup_end("init", "remmina_widget_pool_init", t);
+	t = remmina_startup_begin();
 	remmina_sftp_plugin_register();
 	remmina_ssh_plugin_register();
+	remmina_startup_end("init", "remmina_ssh_plugins_register", t);
+	t = remmina_startup_begin();
 	remmina_icon_init();
+	remmina_startup_end("init", "remmina_icon_init", t);
 
 	g_set_application_name("Remmina");
 	gtk_window_set_default_icon_name("remmina");
@@ -250,8 +325,11 @@ int main(int argc, char* argv[])
 	TRACE_CALL("main");
 	GApplication *app;
 	GApplicationClass *app_class;
+	GApplicationFlags app_flags;
 	int status;
+	gint64 t;
 
+	remmina_startup_init(argc, argv);
 	remmina_masterthread_exec_save_main_thread_id();
 
 	bindtextdomain(GETTEXT_PACKAGE, REMMINA_LOCALEDIR);
@@ -265,9 +343,15 @@ int main(int argc, char* argv[])
 	gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
 #endif
 
+	t = remmina_startup_begin();
 	gtk_init(&argc, &argv);
+	remmina_startup_end("init", "gtk_init", t);
 
-	app = g_application_new("org.Remmina", G_APPLICATION_HANDLES_COMMAND_LINE);
+	/* A benchmark run must not be forwarded to a running instance */
+	app_flags = G_APPLICATION_HANDLES_COMMAND_LINE;
+	if (remmina_startup_is_bench())
+		app_flags |= G_APPLICATION_NON_UNIQUE;
+	app = g_application_new("org.Remmina", app_flags);
 	app_class = G_APPLICATION_CLASS(G_OBJECT_GET_CLASS (app));
 	app_class->local_command_line = remmina_on_local_cmdline;
 	g_signal_connect(app, "startup", G_CALLBACK(remmina_on_startup), NULL);
@@ -276,11 +360,16 @@ int main(int argc, char* argv[])
 
 	status = g_application_run(app, argc, argv);
 
-	if (status == 0 && !g_application_get_is_remote(app))
+	/* A benchmark run may already be done within g_application_run() */
+	if (status == 0 && !g_application_get_is_remote(app)
+			&& !(remmina_startup_is_bench() && remmina_startup_is_finished())
+			&& !remmina_tool_done)
 	{
 		gtk_main();
 	}
 
+	remmina_pref_flush();
+	remmina_file_defaults_free();
 	g_object_unref(app);
 
 	return status;
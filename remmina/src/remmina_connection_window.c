@@ -83,6 +83,7 @@ struct _RemminaConnectionWindowPriv
 	GtkToolItem* toolitem_grab;
 	GtkToolItem* toolitem_preferences;
 	GtkToolItem* toolitem_tools;
+	GtkToolItem* toolitem_stats;
 	GtkWidget* fullscreen_option_button;
 
 	GtkWidget* pin_button;
@@ -91,6 +92,8 @@ struct _RemminaConnectionWindowPriv
 	gboolean sticky;
 
 	gint view_mode;
+
+	gboolean iconified;
 };
 
 typedef struct _RemminaConnectionObject
@@ -111,6 +114,11 @@ typedef struct _RemminaConnectionObject
 	GtkWidget* scrolled_container;
 
 	gboolean connected;
+
+	/* Performance statistics overlay */
+	gboolean show_stats;
+	guint stats_handler;
+	gchar* stats_text;
 } RemminaConnectionObject;
 
 struct _RemminaConnectionHolder
@@ -1059,6 +1067,66 @@ static void remmina_connection_holder_toolbar_disconnect(GtkWidget* widget, Remm
 	remmina_connection_holder_disconnect(cnnhld);
 }
 
+static gboolean remmina_connection_object_stats_timeout(RemminaConnectionObject* cnnobj)
+{
+	TRACE_CALL("remmina_connection_object_stats_timeout");
+	g_free(cnnobj->stats_text);
+	cnnobj->stats_text = remmina_stats_to_text(remmina_protocol_widget_get_stats(REMMINA_PROTOCOL_WIDGET(cnnobj->proto)));
+	gtk_widget_queue_draw(cnnobj->proto);
+	return TRUE;
+}
+
+static void remmina_connection_object_show_stats(RemminaConnectionObject* cnnobj, gboolean show)
+{
+	TRACE_CALL("remmina_connection_object_show_stats");
+	cnnobj->show_stats = show;
+	if (show && !cnnobj->stats_handler)
+	{
+		remmina_connection_object_stats_timeout(cnnobj);
+		cnnobj->stats_handler = g_timeout_add_seconds(1, (GSourceFunc) remmina_connection_object_stats_timeout, cnnobj);
+	}
+	else if (!show && cnnobj->stats_handler)
+	{
+		g_source_remove(cnnobj->stats_handler);
+		cnnobj->stats_handler = 0;
+		gtk_widget_queue_draw(cnnobj->proto);
+	}
+}
+
+/* Drawn after the plugin drawing area, so the text stays on top of the remote desktop */
+static gboolean remmina_connection_object_on_draw_stats(GtkWidget* widget, cairo_t* cr, RemminaConnectionObject* cnnobj)
+{
+	TRACE_CALL("remmina_connection_object_on_draw_stats");
+	PangoLayout* layout;
+	gint width, height;
+
+	if (!cnnobj->show_stats || !cnnobj->stats_text)
+		return FALSE;
+
+	layout = gtk_widget_create_pango_layout(widget, cnnobj->stats_text);
+	pango_layout_get_pixel_size(layout, &width, &height);
+
+	cairo_save(cr);
+	cairo_set_source_rgba(cr, 0, 0, 0, 0.6);
+	cairo_rectangle(cr, 4, 4, width + 8, height + 8);
+	cairo_fill(cr);
+	cairo_set_source_rgb(cr, 1, 1, 1);
+	cairo_move_to(cr, 8, 8);
+	pango_cairo_show_layout(cr, layout);
+	cairo_restore(cr);
+
+	g_object_unref(layout);
+	return FALSE;
+}
+
+static void remmina_connection_holder_toolbar_stats(GtkWidget* widget, RemminaConnectionHolder* cnnhld)
+{
+	TRACE_CALL("remmina_connection_holder_toolbar_stats");
+	DECLARE_CNNOBJ
+
+	remmina_connection_object_show_stats(cnnobj, gtk_toggle_tool_button_get_active(GTK_TOGGLE_TOOL_BUTTON(widget)));
+}
+
 static void remmina_connection_holder_toolbar_grab(GtkWidget* widget, RemminaConnectionHolder* cnnhld)
 {
 	TRACE_CALL("remmina_connection_holder_toolbar_grab");
@@ -1184,6 +1252,14 @@ remmina_connection_holder_create_toolbar(RemminaConnectionHolder* cnnhld, gint m
 	g_signal_connect(G_OBJECT(toolitem), "toggled", G_CALLBACK(remmina_connection_holder_toolbar_tools), cnnhld);
 	priv->toolitem_tools = toolitem;
 
+	toolitem = gtk_toggle_tool_button_new();
+	gtk_tool_button_set_icon_name(GTK_TOOL_BUTTON(toolitem), "utilities-system-monitor");
+	gtk_tool_item_set_tooltip_text(toolitem, _("Show performance statistics"));
+	gtk_toolbar_insert(GTK_TOOLBAR(toolbar), toolitem, -1);
+	gtk_widget_show(GTK_WIDGET(toolitem));
+	g_signal_connect(G_OBJECT(toolitem), "toggled", G_CALLBACK(remmina_connection_holder_toolbar_stats), cnnhld);
+	priv->toolitem_stats = toolitem;
+
 	toolitem = gtk_separator_tool_item_new();
 	gtk_toolbar_insert(GTK_TOOLBAR(toolbar), toolitem, -1);
 	gtk_widget_show(GTK_WIDGET(toolitem));
@@ -1241,6 +1317,9 @@ static void remmina_connection_holder_update_toolbar(RemminaConnectionHolder* cn
 			REMMINA_PROTOCOL_FEATURE_TYPE_TOOL);
 	gtk_widget_set_sensitive(GTK_WIDGET(toolitem), bval);
 
+	toolitem = priv->toolitem_stats;
+	gtk_toggle_tool_button_set_active(GTK_TOGGLE_TOOL_BUTTON(toolitem), cnnobj->show_stats);
+
 	gtk_window_set_title(GTK_WINDOW(cnnhld->cnnwin), remmina_file_get_string(cnnobj->remmina_file, "name"));
 
 	if (priv->floating_toolbar)
@@ -1586,9 +1665,44 @@ static void remmina_connection_window_init(RemminaConnectionWindow* cnnwin)
 	remmina_widget_pool_register(GTK_WIDGET(cnnwin));
 }
 
+/* Only the current tab of a window which is not iconified is visible, the
+ * plugins of the other sessions may stop receiving screen updates */
+static void remmina_connection_holder_update_visibility(RemminaConnectionHolder* cnnhld)
+{
+	TRACE_CALL("remmina_connection_holder_update_visibility");
+	RemminaConnectionWindowPriv* priv;
+	RemminaConnectionObject* cnnobj;
+	GtkWidget* page;
+	gint i, n, current;
+
+	if (!cnnhld->cnnwin || !GTK_IS_WIDGET(cnnhld->cnnwin))
+		return;
+	priv = cnnhld->cnnwin->priv;
+
+	current = gtk_notebook_get_current_page(GTK_NOTEBOOK(priv->notebook));
+	n = gtk_notebook_get_n_pages(GTK_NOTEBOOK(priv->notebook));
+	for (i = 0; i < n; i++)
+	{
+		page = gtk_notebook_get_nth_page(GTK_NOTEBOOK(priv->notebook), i);
+		cnnobj = (RemminaConnectionObject*) g_object_get_data(G_OBJECT(page), "cnnobj");
+		if (!cnnobj || !cnnobj->proto)
+			continue;
+		remmina_protocol_widget_set_visible(REMMINA_PROTOCOL_WIDGET(cnnobj->proto), i == current && !priv->iconified);
+	}
+}
+
 static gboolean remmina_connection_window_state_event(GtkWidget* widget, GdkEventWindowState* event, gpointer user_data)
 {
 	TRACE_CALL("remmina_connection_window_state_event");
+	RemminaConnectionHolder* cnnhld = (RemminaConnectionHolder*) user_data;
+
+	if (event->changed_mask & GDK_WINDOW_STATE_ICONIFIED)
+	{
+		/* The holder may already have moved to another window, or have none */
+		REMMINA_CONNECTION_WINDOW(widget)->priv->iconified = (event->new_window_state & GDK_WINDOW_STATE_ICONIFIED) != 0;
+		if (widget == GTK_WIDGET(cnnhld->cnnwin))
+			remmina_connection_holder_update_visibility(cnnhld);
+	}
 #ifdef ENABLE_MINIMIZE_TO_TRAY
 	GdkScreen* screen;
 
@@ -1841,6 +1955,7 @@ static gboolean remmina_connection_holder_on_switch_page_real(gpointer data)
 
 	if (GTK_IS_WIDGET(cnnhld->cnnwin))
 	{
+		remmina_connection_holder_update_visibility(cnnhld);
 		remmina_connection_holder_update_toolbar(cnnhld);
 		remmina_connection_holder_grab_focus(priv->notebook);
 		if (cnnhld->cnnwin->priv->view_mode != SCROLLED_WINDOW_MODE)
@@ -1876,6 +1991,7 @@ static void remmina_connection_holder_on_page_added(GtkNotebook* notebook, GtkWi
 	else
 	{
 		remmina_connection_holder_update_notebook(cnnhld);
+		remmina_connection_holder_update_visibility(cnnhld);
 	}
 }
 
@@ -2337,6 +2453,8 @@ static void remmina_connection_object_on_disconnect(RemminaProtocolWidget* gp, R
 	GtkWidget* dialog;
 
 	cnnobj->connected = FALSE;
+	remmina_connection_object_show_stats(cnnobj, FALSE);
+	g_free(cnnobj->stats_text);
 
 	if (cnnhld && remmina_pref.save_view_mode)
 	{
@@ -2468,6 +2586,7 @@ remmina_connection_window_open_from_file_full(RemminaFile* remminafile, GCallbac
 			cnnobj);
 	g_signal_connect(G_OBJECT(cnnobj->proto), "update-align", G_CALLBACK(remmina_connection_object_on_update_align),
 			cnnobj);
+	g_signal_connect_after(G_OBJECT(cnnobj->proto), "draw", G_CALLBACK(remmina_connection_object_on_draw_stats), cnnobj);
 
 	/* Create the viewport to make the RemminaProtocolWidget scrollable */
 	cnnobj->viewport = gtk_viewport_new(NULL, NULL);
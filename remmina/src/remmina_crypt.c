@@ -35,6 +35,8 @@
 
 #include "config.h"
 #include <glib.h>
+#include <string.h>
+#include <pthread.h>
 #ifdef HAVE_LIBGCRYPT
 #include <gcrypt.h>
 #endif
@@ -44,70 +46,260 @@
 
 #ifdef HAVE_LIBGCRYPT
 
-static gboolean remmina_crypt_init(gcry_cipher_hd_t *phd)
+/* Values written by this version: REMMINA_CRYPT_V2_PREFIX followed by the base64 of
+ * nonce | ciphertext | tag, AES-256-GCM with a key derived from the secret.
+ * The prefix is not part of the base64 alphabet, so older 3DES-CBC values are
+ * recognized by its absence. They are still decrypted and get rewritten in the
+ * new format the next time the profile is saved. */
+#if GCRYPT_VERSION_NUMBER >= 0x010600
+#define REMMINA_CRYPT_HAVE_GCM
+#endif
+#define REMMINA_CRYPT_V2_PREFIX "$2$"
+#define REMMINA_CRYPT_V2_PREFIX_LEN 3
+#define REMMINA_CRYPT_NONCE_LEN 12
+#define REMMINA_CRYPT_TAG_LEN 16
+
+/* Cipher handles are set up once with the key, then only the IV changes per value.
+ * A handle cannot be used by two threads at once, hence the lock */
+typedef struct _RemminaCrypt
+{
+	gboolean ready;
+	gcry_cipher_hd_t legacy_hd;
+	guchar legacy_iv[8];
+#ifdef REMMINA_CRYPT_HAVE_GCM
+	gcry_cipher_hd_t gcm_hd;
+#endif
+} RemminaCrypt;
+
+static RemminaCrypt remmina_crypt;
+G_LOCK_DEFINE_STATIC(remmina_crypt);
+
+/* Called with the lock held */
+static gboolean remmina_crypt_init(void)
 {
 	TRACE_CALL("remmina_crypt_init");
 	guchar* secret;
 	gcry_error_t err;
 	gsize secret_len;
+#ifdef REMMINA_CRYPT_HAVE_GCM
+	guchar key[32];
+	gchar* s;
+#endif
+
+	if (remmina_crypt.ready)
+		return TRUE;
+
+	if (!remmina_pref.secret)
+		return FALSE;
 
 	secret = g_base64_decode(remmina_pref.secret, &secret_len);
 
 	if (secret_len < 32)
 	{
 		g_print("secret corrupted\n");
+		memset(secret, 0, secret_len);
 		g_free(secret);
 		return FALSE;
 	}
 
-	err = gcry_cipher_open(phd, GCRY_CIPHER_3DES, GCRY_CIPHER_MODE_CBC, 0);
+	err = gcry_cipher_open(&remmina_crypt.legacy_hd, GCRY_CIPHER_3DES, GCRY_CIPHER_MODE_CBC, 0);
 
 	if (err)
 	{
 		g_print("gcry_cipher_open failure: %s\n", gcry_strerror(err));
+		memset(secret, 0, secret_len);
 		g_free(secret);
 		return FALSE;
 	}
 
-	err = gcry_cipher_setkey((*phd), secret, 24);
+	err = gcry_cipher_setkey(remmina_crypt.legacy_hd, secret, 24);
 
 	if (err)
 	{
 		g_print("gcry_cipher_setkey failure: %s\n", gcry_strerror(err));
+		memset(secret, 0, secret_len);
 		g_free(secret);
-		gcry_cipher_close((*phd));
+		gcry_cipher_close(remmina_crypt.legacy_hd);
 		return FALSE;
 	}
 
-	err = gcry_cipher_setiv((*phd), secret + 24, 8);
+	memcpy(remmina_crypt.legacy_iv, secret + 24, 8);
+
+#ifdef REMMINA_CRYPT_HAVE_GCM
+	/* Do not reuse the 3DES key bytes as they are: derive a separate key from the whole secret */
+	s = g_strdup_printf("remmina-crypt-v2:%s", remmina_pref.secret);
+	gcry_md_hash_buffer(GCRY_MD_SHA256, key, s, strlen(s));
+	memset(s, 0, strlen(s));
+	g_free(s);
+
+	err = gcry_cipher_open(&remmina_crypt.gcm_hd, GCRY_CIPHER_AES256, GCRY_CIPHER_MODE_GCM, 0);
+
+	if (!err)
+	{
+		err = gcry_cipher_setkey(remmina_crypt.gcm_hd, key, sizeof(key));
+		if (err)
+			gcry_cipher_close(remmina_crypt.gcm_hd);
+	}
+	/* Wiped on both paths, the handle keeps its own copy */
+	memset(key, 0, sizeof(key));
 
 	if (err)
 	{
-		g_print("gcry_cipher_setiv failure: %s\n", gcry_strerror(err));
+		g_print("gcry_cipher_open failure: %s\n", gcry_strerror(err));
+		memset(secret, 0, secret_len);
 		g_free(secret);
-		gcry_cipher_close((*phd));
+		gcry_cipher_close(remmina_crypt.legacy_hd);
 		return FALSE;
 	}
+#endif
 
+	memset(secret, 0, secret_len);
 	g_free(secret);
 
+	remmina_crypt.ready = TRUE;
+
 	return TRUE;
 }
 
-gchar* remmina_crypt_encrypt(const gchar *str)
+/* Called with the lock held */
+static gboolean remmina_crypt_legacy_run(guchar *buf, gsize buf_len, gboolean encrypt)
 {
-	TRACE_CALL("remmina_crypt_encrypt");
+	TRACE_CALL("remmina_crypt_legacy_run");
+	gcry_error_t err;
+
+	/* CBC keeps chaining across calls: start over from the fixed IV */
+	gcry_cipher_reset(remmina_crypt.legacy_hd);
+	err = gcry_cipher_setiv(remmina_crypt.legacy_hd, remmina_crypt.legacy_iv, 8);
+
+	if (!err)
+	{
+		if (encrypt)
+			err = gcry_cipher_encrypt(remmina_crypt.legacy_hd, buf, buf_len, NULL, 0);
+		else
+			err = gcry_cipher_decrypt(remmina_crypt.legacy_hd, buf, buf_len, NULL, 0);
+	}
+
+	if (err)
+	{
+		g_print("%s failure: %s\n", encrypt ? "gcry_cipher_encrypt" : "gcry_cipher_decrypt", gcry_strerror(err));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+#ifdef REMMINA_CRYPT_HAVE_GCM
+
+static gchar* remmina_crypt_v2_encrypt(const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_v2_encrypt");
 	guchar* buf;
-	gint buf_len;
+	gsize len, buf_len;
+	gchar* b64;
 	gchar* result;
 	gcry_error_t err;
-	gcry_cipher_hd_t hd;
 
-	if (!str || str[0] == '\0')
+	len = strlen(str);
+	buf_len = REMMINA_CRYPT_NONCE_LEN + len + REMMINA_CRYPT_TAG_LEN;
+	buf = (guchar*) g_malloc(buf_len);
+	/* A fresh random nonce for every value, a key/nonce pair must never repeat */
+	gcry_create_nonce(buf, REMMINA_CRYPT_NONCE_LEN);
+	memcpy(buf + REMMINA_CRYPT_NONCE_LEN, str, len);
+
+	G_LOCK(remmina_crypt);
+	if (!remmina_crypt_init())
+	{
+		G_UNLOCK(remmina_crypt);
+		memset(buf, 0, buf_len);
+		g_free(buf);
 		return NULL;
+	}
+	err = gcry_cipher_setiv(remmina_crypt.gcm_hd, buf, REMMINA_CRYPT_NONCE_LEN);
+	if (!err)
+		err = gcry_cipher_authenticate(remmina_crypt.gcm_hd, REMMINA_CRYPT_V2_PREFIX, REMMINA_CRYPT_V2_PREFIX_LEN);
+	if (!err)
+		err = gcry_cipher_encrypt(remmina_crypt.gcm_hd, buf + REMMINA_CRYPT_NONCE_LEN, len, NULL, 0);
+	if (!err)
+		err = gcry_cipher_gettag(remmina_crypt.gcm_hd, buf + REMMINA_CRYPT_NONCE_LEN + len, REMMINA_CRYPT_TAG_LEN);
+	G_UNLOCK(remmina_crypt);
 
-	if (!remmina_crypt_init(&hd))
+	if (err)
+	{
+		g_print("gcry_cipher_encrypt failure: %s\n", gcry_strerror(err));
+		memset(buf, 0, buf_len);
+		g_free(buf);
 		return NULL;
+	}
+
+	b64 = g_base64_encode(buf, buf_len);
+	result = g_strconcat(REMMINA_CRYPT_V2_PREFIX, b64, NULL);
+
+	g_free(b64);
+	g_free(buf);
+
+	return result;
+}
+
+static gchar* remmina_crypt_v2_decrypt(const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_v2_decrypt");
+	guchar* buf;
+	gsize buf_len, len;
+	gchar* result;
+	gcry_error_t err;
+
+	buf = g_base64_decode(str + REMMINA_CRYPT_V2_PREFIX_LEN, &buf_len);
+
+	if (buf_len < REMMINA_CRYPT_NONCE_LEN + REMMINA_CRYPT_TAG_LEN)
+	{
+		g_print("encrypted value corrupted\n");
+		g_free(buf);
+		return NULL;
+	}
+	len = buf_len - REMMINA_CRYPT_NONCE_LEN - REMMINA_CRYPT_TAG_LEN;
+
+	G_LOCK(remmina_crypt);
+	if (!remmina_crypt_init())
+	{
+		G_UNLOCK(remmina_crypt);
+		g_free(buf);
+		return NULL;
+	}
+	err = gcry_cipher_setiv(remmina_crypt.gcm_hd, buf, REMMINA_CRYPT_NONCE_LEN);
+	if (!err)
+		err = gcry_cipher_authenticate(remmina_crypt.gcm_hd, REMMINA_CRYPT_V2_PREFIX, REMMINA_CRYPT_V2_PREFIX_LEN);
+	if (!err)
+		err = gcry_cipher_decrypt(remmina_crypt.gcm_hd, buf + REMMINA_CRYPT_NONCE_LEN, len, NULL, 0);
+	if (!err)
+		err = gcry_cipher_checktag(remmina_crypt.gcm_hd, buf + REMMINA_CRYPT_NONCE_LEN + len, REMMINA_CRYPT_TAG_LEN);
+	G_UNLOCK(remmina_crypt);
+
+	if (err)
+	{
+		/* Also a wrong secret or a tampered value: the tag does not match */
+		g_print("gcry_cipher_decrypt failure: %s\n", gcry_strerror(err));
+		memset(buf, 0, buf_len);
+		g_free(buf);
+		return NULL;
+	}
+
+	result = g_strndup((gchar*) buf + REMMINA_CRYPT_NONCE_LEN, len);
+
+	memset(buf, 0, buf_len);
+	g_free(buf);
+
+	return result;
+}
+
+#else
+
+/* Without GCM support new values keep using the old format */
+static gchar* remmina_crypt_legacy_encrypt(const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_legacy_encrypt");
+	guchar* buf;
+	gint buf_len;
+	gchar* result;
+	gboolean ok;
 
 	buf_len = strlen(str);
 	/* Pack to 64bit block size, and make sure it's always 0-terminated */
@@ -116,58 +308,119 @@ gchar* remmina_crypt_encrypt(const gchar *str)
 	memset(buf, 0, buf_len);
 	memcpy(buf, str, strlen(str));
 
-	err = gcry_cipher_encrypt(hd, buf, buf_len, NULL, 0);
+	G_LOCK(remmina_crypt);
+	ok = remmina_crypt_init() && remmina_crypt_legacy_run(buf, buf_len, TRUE);
+	G_UNLOCK(remmina_crypt);
 
-	if (err)
+	if (!ok)
 	{
-		g_print("gcry_cipher_encrypt failure: %s\n", gcry_strerror(err));
+		memset(buf, 0, buf_len);
 		g_free(buf);
-		gcry_cipher_close(hd);
 		return NULL;
 	}
 
 	result = g_base64_encode(buf, buf_len);
 
 	g_free(buf);
-	gcry_cipher_close(hd);
 
 	return result;
 }
 
-gchar* remmina_crypt_decrypt(const gchar *str)
+#endif
+
+static gchar* remmina_crypt_legacy_decrypt(const gchar *str)
 {
-	TRACE_CALL("remmina_crypt_decrypt");
+	TRACE_CALL("remmina_crypt_legacy_decrypt");
 	guchar* buf;
 	gsize buf_len;
-	gcry_error_t err;
-	gcry_cipher_hd_t hd;
+	gboolean ok;
 
-	if (!str || str[0] == '\0')
-		return NULL;
+	buf = g_base64_decode(str, &buf_len);
 
-	if (!remmina_crypt_init(&hd))
+	if (buf_len == 0 || buf_len % 8)
+	{
+		g_print("encrypted value corrupted\n");
+		g_free(buf);
 		return NULL;
+	}
 
-	buf = g_base64_decode(str, &buf_len);
-
-	err = gcry_cipher_decrypt(hd, buf, buf_len, NULL, 0);
+	G_LOCK(remmina_crypt);
+	ok = remmina_crypt_init() && remmina_crypt_legacy_run(buf, buf_len, FALSE);
+	G_UNLOCK(remmina_crypt);
 
-	if (err)
+	if (!ok)
 	{
-		g_print("gcry_cipher_decrypt failure: %s\n", gcry_strerror(err));
 		g_free(buf);
-		gcry_cipher_close(hd);
 		return NULL;
 	}
 
-	gcry_cipher_close(hd);
-
 	/* Just in case */
 	buf[buf_len - 1] = '\0';
 
 	return (gchar*) buf;
 }
 
+/* Passwords are read by remmina_file_get_secret() from the protocol threads, which
+ * may run with asynchronous cancellation: cancellation is deferred for the whole
+ * call, which holds the remmina_crypt lock and the heap locks */
+gchar* remmina_crypt_encrypt(const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_encrypt");
+	gchar* result;
+	gint oldtype;
+
+	if (!str || str[0] == '\0')
+		return NULL;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+#ifdef REMMINA_CRYPT_HAVE_GCM
+	result = remmina_crypt_v2_encrypt(str);
+#else
+	result = remmina_crypt_legacy_encrypt(str);
+#endif
+	pthread_setcanceltype(oldtype, NULL);
+
+	return result;
+}
+
+gchar* remmina_crypt_decrypt(const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_decrypt");
+	gchar* result;
+	gint oldtype;
+
+	if (!str || str[0] == '\0')
+		return NULL;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+	if (g_str_has_prefix(str, REMMINA_CRYPT_V2_PREFIX))
+	{
+#ifdef REMMINA_CRYPT_HAVE_GCM
+		result = remmina_crypt_v2_decrypt(str);
+#else
+		g_print("encrypted value needs a newer libgcrypt\n");
+		result = NULL;
+#endif
+	}
+	else
+	{
+		result = remmina_crypt_legacy_decrypt(str);
+	}
+	pthread_setcanceltype(oldtype, NULL);
+
+	return result;
+}
+
+gboolean remmina_crypt_is_legacy(const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_is_legacy");
+#ifdef REMMINA_CRYPT_HAVE_GCM
+	return str && str[0] != '\0' && !g_str_has_prefix(str, REMMINA_CRYPT_V2_PREFIX);
+#else
+	return FALSE;
+#endif
+}
+
 #else
 
 gchar* remmina_crypt_encrypt(const gchar *str)
@@ -182,5 +435,11 @@ gchar* remmina_crypt_decrypt(const gchar *str)
 	return NULL;
 }
 
+gboolean remmina_crypt_is_legacy(const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_is_legacy");
+	return FALSE;
+}
+
 #endif
 
@@ -39,6 +39,8 @@ G_BEGIN_DECLS
 
 gchar* remmina_crypt_encrypt(const gchar* str);
 gchar* remmina_crypt_decrypt(const gchar* str);
+/* TRUE if str was encrypted in an older format, and should be encrypted again */
+gboolean remmina_crypt_is_legacy(const gchar* str);
 
 G_END_DECLS
 
@@ -0,0 +1,217 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+/* Benchmark of the encryption of the passwords saved in the profiles.
+ *
+ *   remmina-crypt-bench [secrets] [threads]
+ *
+ * Encrypts and decrypts a set of secrets, as loading and saving that many
+ * profiles does, first with a cipher handle set up for every value as
+ * older versions did, then with remmina_crypt_encrypt/decrypt. Then the
+ * same values are decrypted from several threads at once. Every result is
+ * checked against the original password. */
+
+#include "config.h"
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gcrypt.h>
+#include "remmina_pref.h"
+#include "remmina_crypt.h"
+#include "remmina/remmina_trace_calls.h"
+
+/* remmina_crypt only needs the secret out of the preferences */
+RemminaPref remmina_pref;
+
+typedef struct _RemminaCryptBench
+{
+	gint count;
+	gchar **passwords;
+	gchar **values;
+	gint errors;
+} RemminaCryptBench;
+
+/* The way every value was encrypted before the cipher context was cached */
+static gchar* remmina_crypt_bench_legacy_encrypt(const guchar *secret, const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_bench_legacy_encrypt");
+	gcry_cipher_hd_t hd;
+	guchar *buf;
+	gint buf_len;
+	gchar *result;
+
+	buf_len = strlen(str);
+	buf_len += 8 - buf_len % 8;
+	buf = (guchar*) g_malloc0(buf_len);
+	memcpy(buf, str, strlen(str));
+
+	gcry_cipher_open(&hd, GCRY_CIPHER_3DES, GCRY_CIPHER_MODE_CBC, 0);
+	gcry_cipher_setkey(hd, secret, 24);
+	gcry_cipher_setiv(hd, secret + 24, 8);
+	gcry_cipher_encrypt(hd, buf, buf_len, NULL, 0);
+	gcry_cipher_close(hd);
+
+	result = g_base64_encode(buf, buf_len);
+	g_free(buf);
+	return result;
+}
+
+static gchar* remmina_crypt_bench_legacy_decrypt(const guchar *secret, const gchar *str)
+{
+	TRACE_CALL("remmina_crypt_bench_legacy_decrypt");
+	gcry_cipher_hd_t hd;
+	guchar *buf;
+	gsize buf_len;
+
+	buf = g_base64_decode(str, &buf_len);
+
+	gcry_cipher_open(&hd, GCRY_CIPHER_3DES, GCRY_CIPHER_MODE_CBC, 0);
+	gcry_cipher_setkey(hd, secret, 24);
+	gcry_cipher_setiv(hd, secret + 24, 8);
+	gcry_cipher_decrypt(hd, buf, buf_len, NULL, 0);
+	gcry_cipher_close(hd);
+
+	buf[buf_len - 1] = '\0';
+	return (gchar*) buf;
+}
+
+static void remmina_crypt_bench_check(RemminaCryptBench *bench, gint i, gchar *plain)
+{
+	TRACE_CALL("remmina_crypt_bench_check");
+	if (g_strcmp0(plain, bench->passwords[i]) != 0)
+		g_atomic_int_inc(&bench->errors);
+	g_free(plain);
+}
+
+static void remmina_crypt_bench_report(const gchar *name, gint count, gint64 t)
+{
+	TRACE_CALL("remmina_crypt_bench_report");
+	gint64 elapsed = g_get_monotonic_time() - t;
+
+	g_print("%-22s %8.2f us/value %10.0f values/s\n", name, (gdouble) elapsed / count,
+			elapsed > 0 ? count * 1000000.0 / elapsed : 0);
+}
+
+static gpointer remmina_crypt_bench_thread(gpointer data)
+{
+	TRACE_CALL("remmina_crypt_bench_thread");
+	RemminaCryptBench *bench = (RemminaCryptBench*) data;
+	gint i;
+
+	for (i = 0; i < bench->count; i++)
+		remmina_crypt_bench_check(bench, i, remmina_crypt_decrypt(bench->values[i]));
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	TRACE_CALL("main");
+	RemminaCryptBench bench;
+	guchar secret[32];
+	gchar **legacy;
+	GThread **threads;
+	gint i, nthreads;
+	gint64 t;
+
+	bench.count = (argc > 1 ? atoi(argv[1]) : 5000);
+	nthreads = (argc > 2 ? atoi(argv[2]) : 4);
+	if (bench.count <= 0 || nthreads <= 0)
+	{
+		g_printerr("Usage: %s [secrets] [threads]\n", argv[0]);
+		return 1;
+	}
+	bench.errors = 0;
+
+	gcry_check_version(NULL);
+	gcry_control(GCRYCTL_DISABLE_SECMEM, 0);
+	gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+	gcry_randomize(secret, sizeof(secret), GCRY_STRONG_RANDOM);
+	remmina_pref.secret = g_base64_encode(secret, sizeof(secret));
+
+	bench.passwords = g_new0(gchar*, bench.count + 1);
+	bench.values = g_new0(gchar*, bench.count + 1);
+	legacy = g_new0(gchar*, bench.count + 1);
+	for (i = 0; i < bench.count; i++)
+		bench.passwords[i] = g_strdup_printf("password-%d-%.*s", i, i % 24, "abcdefghijklmnopqrstuvwx");
+
+	g_print("secrets                %d\n", bench.count);
+
+	t = g_get_monotonic_time();
+	for (i = 0; i < bench.count; i++)
+		legacy[i] = remmina_crypt_bench_legacy_encrypt(secret, bench.passwords[i]);
+	remmina_crypt_bench_report("legacy encrypt", bench.count, t);
+
+	t = g_get_monotonic_time();
+	for (i = 0; i < bench.count; i++)
+		remmina_crypt_bench_check(&bench, i, remmina_crypt_bench_legacy_decrypt(secret, legacy[i]));
+	remmina_crypt_bench_report("legacy decrypt", bench.count, t);
+
+	/* Old values read through the cached context, as when loading old profiles */
+	t = g_get_monotonic_time();
+	for (i = 0; i < bench.count; i++)
+		remmina_crypt_bench_check(&bench, i, remmina_crypt_decrypt(legacy[i]));
+	remmina_crypt_bench_report("cached legacy decrypt", bench.count, t);
+
+	t = g_get_monotonic_time();
+	for (i = 0; i < bench.count; i++)
+		bench.values[i] = remmina_crypt_encrypt(bench.passwords[i]);
+	remmina_crypt_bench_report("encrypt", bench.count, t);
+
+	t = g_get_monotonic_time();
+	for (i = 0; i < bench.count; i++)
+		remmina_crypt_bench_check(&bench, i, remmina_crypt_decrypt(bench.values[i]));
+	remmina_crypt_bench_report("decrypt", bench.count, t);
+
+	threads = g_new0(GThread*, nthreads);
+	t = g_get_monotonic_time();
+	for (i = 0; i < nthreads; i++)
+		threads[i] = g_thread_new("crypt-bench", remmina_crypt_bench_thread, &bench);
+	for (i = 0; i < nthreads; i++)
+		g_thread_join(threads[i]);
+	g_print("threads                %d\n", nthreads);
+	remmina_crypt_bench_report("concurrent decrypt", bench.count * nthreads, t);
+
+	g_print("errors                 %d\n", bench.errors);
+
+	g_free(threads);
+	g_strfreev(legacy);
+	g_strfreev(bench.values);
+	g_strfreev(bench.passwords);
+	g_free(remmina_pref.secret);
+
+	return (bench.errors ? 1 : 0);
+}
@@ -75,6 +75,7 @@ const RemminaSetting remmina_system_settings[] =
 { "window_height", REMMINA_SETTING_GROUP_RUNTIME, FALSE },
 { "window_maximize", REMMINA_SETTING_GROUP_RUNTIME, FALSE },
 { "toolbar_opacity", REMMINA_SETTING_GROUP_RUNTIME, FALSE },
+{ "rdp_auto_link", REMMINA_SETTING_GROUP_RUNTIME, FALSE },
 
 { NULL, 0, FALSE } };
 
@@ -109,37 +110,81 @@ remmina_file_new_empty(void)
 	return remminafile;
 }
 
+/* Default settings of new files, from the preference file. They stay parsed as long
+ * as the preferences are unchanged: bulk imports create thousands of files in a row,
+ * from several threads */
+static RemminaFile *remmina_file_defaults = NULL;
+static guint remmina_file_defaults_serial;
+G_LOCK_DEFINE_STATIC(remmina_file_defaults);
+
+/* Last name given by remmina_file_generate_filename() */
+static gint64 remmina_file_last_name = 0;
+G_LOCK_DEFINE_STATIC(remmina_file_last_name);
+
+static RemminaFile* remmina_file_load_keyfile(GKeyFile *gkeyfile, const gchar *filename);
+
 RemminaFile*
 remmina_file_new(void)
 {
 	TRACE_CALL("remmina_file_new");
 	RemminaFile *remminafile;
+	GKeyFile *gkeyfile;
+	guint serial;
 
-	/* Try to load from the preference file for default settings first */
-	remminafile = remmina_file_load(remmina_pref_file);
-
-	if (remminafile)
-	{
-		g_free(remminafile->filename);
-		remminafile->filename = NULL;
-	}
-	else
+	serial = remmina_pref_get_serial();
+	G_LOCK(remmina_file_defaults);
+	if (remmina_file_defaults == NULL || serial != remmina_file_defaults_serial)
 	{
-		remminafile = remmina_file_new_empty();
+		remmina_file_free(remmina_file_defaults);
+		/* The [remmina] group of the preferences holds the default settings */
+		gkeyfile = remmina_pref_get_group("remmina", &remmina_file_defaults_serial);
+		remmina_file_defaults = remmina_file_load_keyfile(gkeyfile, remmina_pref_file);
+		g_key_file_free(gkeyfile);
+		if (remmina_file_defaults == NULL)
+			remmina_file_defaults = remmina_file_new_empty();
 	}
+	remminafile = remmina_file_dup(remmina_file_defaults);
+	G_UNLOCK(remmina_file_defaults);
+
+	g_free(remminafile->filename);
+	remminafile->filename = NULL;
 
 	return remminafile;
 }
 
+void remmina_file_defaults_free(void)
+{
+	TRACE_CALL("remmina_file_defaults_free");
+	G_LOCK(remmina_file_defaults);
+	remmina_file_free(remmina_file_defaults);
+	remmina_file_defaults = NULL;
+	G_UNLOCK(remmina_file_defaults);
+}
+
 void remmina_file_generate_filename(RemminaFile *remminafile)
 {
 	TRACE_CALL("remmina_file_generate_filename");
 	GTimeVal gtime;
+	gint64 name;
 
 	g_free(remminafile->filename);
 	g_get_current_time(&gtime);
-	remminafile->filename = g_strdup_printf("%s/.remmina/%li%03li.remmina", g_get_home_dir(), gtime.tv_sec,
-			gtime.tv_usec / 1000);
+	name = (gint64) gtime.tv_sec * 1000 + gtime.tv_usec / 1000;
+
+	/* The name is the time in ms, files imported in bulk come faster than that */
+	G_LOCK(remmina_file_last_name);
+	if (name <= remmina_file_last_name)
+		name = remmina_file_last_name + 1;
+	while (TRUE)
+	{
+		remminafile->filename = g_strdup_printf("%s/.remmina/%" G_GINT64_FORMAT ".remmina", g_get_home_dir(), name);
+		if (!g_file_test(remminafile->filename, G_FILE_TEST_EXISTS))
+			break;
+		g_free(remminafile->filename);
+		name++;
+	}
+	remmina_file_last_name = name;
+	G_UNLOCK(remmina_file_last_name);
 }
 
 void remmina_file_set_filename(RemminaFile *remminafile, const gchar *filename)
@@ -168,11 +213,10 @@ remmina_file_copy(const gchar *filename)
 	return remminafile;
 }
 
-RemminaFile*
-remmina_file_load(const gchar *filename)
+static RemminaFile*
+remmina_file_load_keyfile(GKeyFile *gkeyfile, const gchar *filename)
 {
-	TRACE_CALL("remmina_file_load");
-	GKeyFile *gkeyfile;
+	TRACE_CALL("remmina_file_load_keyfile");
 	RemminaFile *remminafile;
 	gchar **keys;
 	gchar *key;
@@ -180,11 +224,6 @@ remmina_file_load(const gchar *filename)
 	gchar *s;
 	gboolean encrypted;
 
-	gkeyfile = g_key_file_new();
-
-	if (!g_key_file_load_from_file(gkeyfile, filename, G_KEY_FILE_NONE, NULL))
-		return NULL;
-
 	if (g_key_file_has_key(gkeyfile, "remmina", "name", NULL))
 	{
 		remminafile = remmina_file_new_empty();
@@ -225,6 +264,24 @@ remmina_file_load(const gchar *filename)
 		remminafile = NULL;
 	}
 
+	return remminafile;
+}
+
+RemminaFile*
+remmina_file_load(const gchar *filename)
+{
+	TRACE_CALL("remmina_file_load");
+	GKeyFile *gkeyfile;
+	RemminaFile *remminafile;
+
+	gkeyfile = g_key_file_new();
+
+	if (!g_key_file_load_from_file(gkeyfile, filename, G_KEY_FILE_NONE, NULL))
+	{
+		g_key_file_free(gkeyfile);
+		return NULL;
+	}
+	remminafile = remmina_file_load_keyfile(gkeyfile, filename);
 	g_key_file_free(gkeyfile);
 
 	return remminafile;
@@ -410,6 +467,18 @@ void remmina_file_save_group(RemminaFile *remminafile, RemminaSettingGroup group
 	TRACE_CALL("remmina_file_save_group");
 	GKeyFile *gkeyfile;
 
+	/* Saved as the defaults of new files. The preference file belongs to
+	 * remmina_pref, which would overwrite a direct write with its own copy */
+	if (g_strcmp0(remminafile->filename, remmina_pref_file) == 0)
+	{
+		gkeyfile = g_key_file_new();
+		remmina_file_store_group(remminafile, gkeyfile, group);
+		remmina_pref_set_group("remmina", gkeyfile);
+		remmina_pref_flush();
+		g_key_file_free(gkeyfile);
+		return;
+	}
+
 	if ((gkeyfile = remmina_file_get_keyfile(remminafile)) == NULL)
 		return;
 	remmina_file_store_group(remminafile, gkeyfile, group);
@@ -501,7 +570,7 @@ remmina_file_get_icon_name(RemminaFile *remminafile)
 	TRACE_CALL("remmina_file_get_icon_name");
 	RemminaProtocolPlugin *plugin;
 
-	plugin = (RemminaProtocolPlugin *) remmina_plugin_manager_get_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL,
+	plugin = (RemminaProtocolPlugin *) remmina_plugin_manager_get_plugin_info(REMMINA_PLUGIN_TYPE_PROTOCOL,
 			remmina_file_get_string(remminafile, "protocol"));
 	if (!plugin)
 		return "remmina";
@@ -554,3 +623,67 @@ void remmina_file_unsave_password(RemminaFile *remminafile)
 	remmina_file_set_string(remminafile, "password", NULL);
 	remmina_file_save_group(remminafile, REMMINA_SETTING_GROUP_CREDENTIAL);
 }
+
+gint remmina_file_reencrypt(const gchar *filename)
+{
+	TRACE_CALL("remmina_file_reencrypt");
+	GKeyFile *gkeyfile;
+	gchar **keys;
+	gchar *s, *plain, *value;
+	gchar *content;
+	gsize length = 0;
+	gboolean encrypted;
+	gint i, count = 0;
+
+	/* Work on the key file itself: the values are not decrypted into a RemminaFile, and
+	 * they are not moved to a secret plugin as a regular save would do */
+	gkeyfile = g_key_file_new();
+	if (!g_key_file_load_from_file(gkeyfile, filename, G_KEY_FILE_KEEP_COMMENTS, NULL))
+	{
+		g_key_file_free(gkeyfile);
+		return -1;
+	}
+
+	keys = g_key_file_get_keys(gkeyfile, "remmina", NULL, NULL);
+	for (i = 0; keys && keys[i]; i++)
+	{
+		encrypted = FALSE;
+		remmina_setting_get_group(keys[i], &encrypted);
+		if (!encrypted)
+			continue;
+		s = g_key_file_get_string(gkeyfile, "remmina", keys[i], NULL);
+		if (g_strcmp0(s, ".") != 0 && remmina_crypt_is_legacy(s))
+		{
+			plain = remmina_crypt_decrypt(s);
+			value = remmina_crypt_encrypt(plain);
+			if (value)
+			{
+				g_key_file_set_string(gkeyfile, "remmina", keys[i], value);
+				count++;
+			}
+			else
+			{
+				count = -1;
+			}
+			if (plain)
+				memset(plain, 0, strlen(plain));
+			g_free(plain);
+			g_free(value);
+		}
+		g_free(s);
+		if (count < 0)
+			break;
+	}
+	g_strfreev(keys);
+
+	if (count > 0)
+	{
+		content = g_key_file_to_data(gkeyfile, &length, NULL);
+		if (!g_file_set_contents(filename, content, length, NULL))
+			count = -1;
+		g_free(content);
+	}
+	g_key_file_free(gkeyfile);
+
+	return count;
+}
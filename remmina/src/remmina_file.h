@@ -65,6 +65,8 @@ typedef enum
 
 /* Create a empty .remmina file */
 RemminaFile* remmina_file_new(void);
+/* Free the default settings cached by remmina_file_new(), at exit */
+void remmina_file_defaults_free(void);
 RemminaFile* remmina_file_copy(const gchar *filename);
 void remmina_file_generate_filename(RemminaFile *remminafile);
 void remmina_file_set_filename(RemminaFile *remminafile, const gchar *filename);
@@ -95,6 +97,9 @@ RemminaFile* remmina_file_dup_temp_protocol(RemminaFile *remminafile, const gcha
 void remmina_file_delete(const gchar *filename);
 /* Delete a "password" field and save into .remmina file */
 void remmina_file_unsave_password(RemminaFile *remminafile);
+/* Encrypt again the values of a .remmina file stored in an older format.
+ * Returns the number of values rewritten, or -1 on error */
+gint remmina_file_reencrypt(const gchar *filename);
 
 G_END_DECLS
 
@@ -0,0 +1,370 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <gtk/gtk.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "config.h"
+#include "remmina_public.h"
+#include "remmina_plugin_manager.h"
+#include "remmina_file.h"
+#include "remmina_file_import.h"
+#include "remmina/remmina_trace_calls.h"
+
+/* Profiles written at a time. The workers parse up to two batches ahead of the
+ * writer, which bounds the memory used by parsed files waiting to be written */
+#define REMMINA_FILE_IMPORT_BATCH 256
+#define REMMINA_FILE_IMPORT_MAX_THREADS 8
+/* Time spent writing profiles in each main loop iteration by an asynchronous
+ * import, in microseconds */
+#define REMMINA_FILE_IMPORT_SLICE 20000
+
+typedef struct _RemminaFileImportJob
+{
+	gchar *path;
+	RemminaFilePlugin *plugin;
+	RemminaFile *remminafile;
+	gboolean done;
+	/* The plugin is not thread safe, the writer parses the file itself */
+	gboolean inline_import;
+} RemminaFileImportJob;
+
+typedef struct _RemminaFileImport
+{
+	GPtrArray *jobs;
+	/* Next job to parse, and the first one not allowed yet */
+	guint next;
+	guint limit;
+	pthread_mutex_t mutex;
+	/* Signaled when a job is done or the limit is raised */
+	pthread_cond_t cond;
+	pthread_t threads[REMMINA_FILE_IMPORT_MAX_THREADS];
+	guint nthreads;
+
+	/* Writer side: profiles are always written by the thread which started the import */
+	guint written;
+	gboolean dry_run;
+	gint64 start;
+	RemminaFileImportReport *report;
+	/* Asynchronous import stopped at a job still being parsed: the worker
+	 * finishing a job schedules the writer again */
+	gboolean waiting;
+	RemminaFileImportFunc done_func;
+	gpointer done_data;
+} RemminaFileImport;
+
+static gboolean remmina_file_import_idle(gpointer data);
+
+static void remmina_file_import_add(RemminaFileImport *import, const gchar *path, RemminaFilePlugin *plugin)
+{
+	TRACE_CALL("remmina_file_import_add");
+	RemminaFileImportJob *job;
+
+	job = g_new0(RemminaFileImportJob, 1);
+	job->path = g_strdup(path);
+	job->plugin = plugin;
+	g_ptr_array_add(import->jobs, job);
+}
+
+static void remmina_file_import_collect(RemminaFileImport *import, const gchar *path, gboolean given)
+{
+	TRACE_CALL("remmina_file_import_collect");
+	RemminaFilePlugin *plugin;
+	GDir *dir;
+	const gchar *name;
+	gchar *child;
+
+	if (g_file_test(path, G_FILE_TEST_IS_DIR))
+	{
+		/* Links to directories are only followed when given, to never loop */
+		if (!given && g_file_test(path, G_FILE_TEST_IS_SYMLINK))
+			return;
+		dir = g_dir_open(path, 0, NULL);
+		if (dir == NULL)
+		{
+			remmina_file_import_add(import, path, NULL);
+			return;
+		}
+		while ((name = g_dir_read_name(dir)) != NULL)
+		{
+			child = g_build_filename(path, name, NULL);
+			remmina_file_import_collect(import, child, FALSE);
+			g_free(child);
+		}
+		g_dir_close(dir);
+		return;
+	}
+
+	plugin = remmina_plugin_manager_get_import_file_handler(path);
+	/* Other files found in directories are not ours to import */
+	if (plugin || given)
+		remmina_file_import_add(import, path, plugin);
+}
+
+static void* remmina_file_import_worker(gpointer data)
+{
+	TRACE_CALL("remmina_file_import_worker");
+	RemminaFileImport *import = (RemminaFileImport*) data;
+	RemminaFileImportJob *job;
+
+	pthread_mutex_lock(&import->mutex);
+	while (import->next < import->jobs->len)
+	{
+		if (import->next >= import->limit)
+		{
+			pthread_cond_wait(&import->cond, &import->mutex);
+			continue;
+		}
+		job = (RemminaFileImportJob*) g_ptr_array_index(import->jobs, import->next++);
+		pthread_mutex_unlock(&import->mutex);
+
+		if (job->plugin && job->plugin->import_thread_safe)
+			job->remminafile = job->plugin->import_func(job->path);
+		else
+			job->inline_import = TRUE;
+
+		pthread_mutex_lock(&import->mutex);
+		job->done = TRUE;
+		pthread_cond_broadcast(&import->cond);
+		if (import->waiting)
+		{
+			import->waiting = FALSE;
+			IDLE_ADD(remmina_file_import_idle, import);
+		}
+	}
+	pthread_mutex_unlock(&import->mutex);
+	return NULL;
+}
+
+static void remmina_file_import_write_job(RemminaFileImport *import, RemminaFileImportJob *job)
+{
+	TRACE_CALL("remmina_file_import_write_job");
+	RemminaFileImportReport *report = import->report;
+	const gchar *name;
+
+	if (job->inline_import && job->plugin)
+		job->remminafile = job->plugin->import_func(job->path);
+
+	name = (job->remminafile ? remmina_file_get_string(job->remminafile, "name") : NULL);
+	if (name)
+	{
+		if (!import->dry_run)
+		{
+			remmina_file_generate_filename(job->remminafile);
+			remmina_file_save_all(job->remminafile);
+		}
+		g_string_append_printf(report->profiles, "%s: %s\n", job->path, name);
+		report->imported++;
+	}
+	else
+	{
+		g_string_append(report->errors, job->path);
+		g_string_append_c(report->errors, '\n');
+		report->failed++;
+	}
+
+	remmina_file_free(job->remminafile);
+	job->remminafile = NULL;
+}
+
+static RemminaFileImport* remmina_file_import_start(GSList *paths, gboolean dry_run)
+{
+	TRACE_CALL("remmina_file_import_start");
+	RemminaFileImport *import;
+	RemminaFileImportJob *job;
+	GSList *element;
+	glong cpus;
+	guint nthreads, i;
+
+	import = g_new0(RemminaFileImport, 1);
+	import->dry_run = dry_run;
+	import->start = g_get_monotonic_time();
+	import->report = g_new0(RemminaFileImportReport, 1);
+	import->report->errors = g_string_new(NULL);
+	import->report->profiles = g_string_new(NULL);
+
+	/* Collected here, looking for the plugin of a file may open its module */
+	import->jobs = g_ptr_array_new();
+	for (element = paths; element; element = element->next)
+		remmina_file_import_collect(import, (const gchar*) element->data, TRUE);
+	import->report->files = import->jobs->len;
+
+	import->limit = MIN(2 * REMMINA_FILE_IMPORT_BATCH, import->jobs->len);
+	pthread_mutex_init(&import->mutex, NULL);
+	pthread_cond_init(&import->cond, NULL);
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = CLAMP(cpus, 1, REMMINA_FILE_IMPORT_MAX_THREADS);
+	nthreads = MIN(nthreads, import->jobs->len);
+	for (i = 0; i < nthreads; i++)
+	{
+		if (pthread_create(&import->threads[i], NULL, remmina_file_import_worker, import))
+			break;
+	}
+	import->nthreads = i;
+	/* Without any worker, everything is parsed by the writer */
+	if (import->nthreads == 0)
+	{
+		for (i = 0; i < import->jobs->len; i++)
+		{
+			job = (RemminaFileImportJob*) g_ptr_array_index(import->jobs, i);
+			job->inline_import = job->done = TRUE;
+		}
+	}
+	return import;
+}
+
+/* Write the parsed profiles in order. Returns TRUE once all of them are written.
+ * With wait, it blocks on the jobs still being parsed. Otherwise it returns at
+ * deadline, or at a job still being parsed, with *blocked set. */
+static gboolean remmina_file_import_write(RemminaFileImport *import, gboolean wait, gint64 deadline, gboolean *blocked)
+{
+	TRACE_CALL("remmina_file_import_write");
+	RemminaFileImportJob *job;
+
+	while (import->written < import->jobs->len)
+	{
+		job = (RemminaFileImportJob*) g_ptr_array_index(import->jobs, import->written);
+
+		pthread_mutex_lock(&import->mutex);
+		while (!job->done)
+		{
+			if (!wait)
+			{
+				import->waiting = TRUE;
+				pthread_mutex_unlock(&import->mutex);
+				*blocked = TRUE;
+				return FALSE;
+			}
+			pthread_cond_wait(&import->cond, &import->mutex);
+		}
+		/* Let the workers go on with the batch after next while this one is written */
+		if (import->written % REMMINA_FILE_IMPORT_BATCH == 0)
+		{
+			import->limit = MIN(import->written + 2 * REMMINA_FILE_IMPORT_BATCH, import->jobs->len);
+			pthread_cond_broadcast(&import->cond);
+		}
+		pthread_mutex_unlock(&import->mutex);
+
+		remmina_file_import_write_job(import, job);
+		import->written++;
+
+		if (!wait && g_get_monotonic_time() >= deadline && import->written < import->jobs->len)
+		{
+			*blocked = FALSE;
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static RemminaFileImportReport* remmina_file_import_finish(RemminaFileImport *import)
+{
+	TRACE_CALL("remmina_file_import_finish");
+	RemminaFileImportReport *report;
+	RemminaFileImportJob *job;
+	guint i;
+
+	/* Every job is done, the workers are leaving */
+	for (i = 0; i < import->nthreads; i++)
+		pthread_join(import->threads[i], NULL);
+	pthread_cond_destroy(&import->cond);
+	pthread_mutex_destroy(&import->mutex);
+
+	for (i = 0; i < import->jobs->len; i++)
+	{
+		job = (RemminaFileImportJob*) g_ptr_array_index(import->jobs, i);
+		g_free(job->path);
+		g_free(job);
+	}
+	g_ptr_array_free(import->jobs, TRUE);
+
+	report = import->report;
+	report->elapsed = g_get_monotonic_time() - import->start;
+	g_free(import);
+
+	return report;
+}
+
+/* Writer of an asynchronous import, on the main thread. There is never more
+ * than one source running it: it is rescheduled either by returning TRUE at
+ * the end of a slice, or by the worker completing the job it stopped at. */
+static gboolean remmina_file_import_idle(gpointer data)
+{
+	TRACE_CALL("remmina_file_import_idle");
+	RemminaFileImport *import = (RemminaFileImport*) data;
+	RemminaFileImportFunc done_func;
+	gpointer done_data;
+	gboolean blocked = FALSE;
+
+	if (!remmina_file_import_write(import, FALSE, g_get_monotonic_time() + REMMINA_FILE_IMPORT_SLICE, &blocked))
+		return !blocked;
+
+	done_func = import->done_func;
+	done_data = import->done_data;
+	done_func(remmina_file_import_finish(import), done_data);
+	return FALSE;
+}
+
+RemminaFileImportReport* remmina_file_import(GSList *paths, gboolean dry_run)
+{
+	TRACE_CALL("remmina_file_import");
+	RemminaFileImport *import;
+
+	import = remmina_file_import_start(paths, dry_run);
+	remmina_file_import_write(import, TRUE, 0, NULL);
+	return remmina_file_import_finish(import);
+}
+
+void remmina_file_import_async(GSList *paths, gboolean dry_run, RemminaFileImportFunc done_func, gpointer data)
+{
+	TRACE_CALL("remmina_file_import_async");
+	RemminaFileImport *import;
+
+	import = remmina_file_import_start(paths, dry_run);
+	import->done_func = done_func;
+	import->done_data = data;
+	IDLE_ADD(remmina_file_import_idle, import);
+}
+
+void remmina_file_import_report_free(RemminaFileImportReport *report)
+{
+	TRACE_CALL("remmina_file_import_report_free");
+	if (report == NULL)
+		return;
+	g_string_free(report->errors, TRUE);
+	g_string_free(report->profiles, TRUE);
+	g_free(report);
+}
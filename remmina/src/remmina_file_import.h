@@ -0,0 +1,73 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINAFILEIMPORT_H__
+#define __REMMINAFILEIMPORT_H__
+
+#include "remmina_file.h"
+
+G_BEGIN_DECLS
+
+/* Bulk import of files in other formats, such as .rdp, with the file plugins.
+ * Directories are walked recursively. Files are parsed by a pool of threads,
+ * when the plugin allows it, and the profiles are written by the calling thread,
+ * a batch at a time while the next ones are parsed. */
+typedef struct _RemminaFileImportReport
+{
+	/* Files found with a plugin to import them, plus the paths given without one */
+	guint files;
+	guint imported;
+	guint failed;
+	/* Paths that could not be imported, one per line */
+	GString *errors;
+	/* "path: name" of each profile created, or that would be on a dry run */
+	GString *profiles;
+	/* Wall time in microseconds */
+	gint64 elapsed;
+} RemminaFileImportReport;
+
+/* paths is a list of file or directory names. On a dry run, the files are parsed
+ * but no profile is written */
+RemminaFileImportReport* remmina_file_import(GSList *paths, gboolean dry_run);
+/* Same as remmina_file_import(), without blocking the main loop: the profiles are
+ * written from idle callbacks on the main thread, and done_func receives the
+ * report, to be freed with remmina_file_import_report_free() */
+typedef void (*RemminaFileImportFunc)(RemminaFileImportReport *report, gpointer data);
+void remmina_file_import_async(GSList *paths, gboolean dry_run, RemminaFileImportFunc done_func, gpointer data);
+void remmina_file_import_report_free(RemminaFileImportReport *report);
+
+G_END_DECLS
+
+#endif  /* __REMMINAFILEIMPORT_H__  */
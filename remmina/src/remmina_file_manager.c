@@ -83,6 +83,33 @@ gint remmina_file_manager_iterate(GFunc func, gpointer user_data)
 	return items_count;
 }
 
+gint remmina_file_manager_reencrypt(const gchar *dirname, gint *failed)
+{
+	TRACE_CALL("remmina_file_manager_reencrypt");
+	gchar filename[MAX_PATH_LEN];
+	GDir* dir;
+	const gchar* name;
+	gint n, values_count = 0;
+
+	*failed = 0;
+	dir = g_dir_open(dirname, 0, NULL);
+	if (dir == NULL)
+		return -1;
+	while ((name = g_dir_read_name(dir)) != NULL)
+	{
+		if (!g_str_has_suffix(name, ".remmina"))
+			continue;
+		g_snprintf(filename, MAX_PATH_LEN, "%s/%s", dirname, name);
+		n = remmina_file_reencrypt(filename);
+		if (n < 0)
+			(*failed)++;
+		else
+			values_count += n;
+	}
+	g_dir_close(dir);
+	return values_count;
+}
+
 gchar* remmina_file_manager_get_groups(void)
 {
 	TRACE_CALL("remmina_file_manager_get_groups");
@@ -49,6 +49,9 @@ typedef struct _RemminaGroupData
 void remmina_file_manager_init(void);
 /* Iterate all .remmina connections in the home directory */
 gint remmina_file_manager_iterate(GFunc func, gpointer user_data);
+/* Encrypt again the secrets of all .remmina files in dirname still stored in an older format.
+ * Returns the number of values rewritten, or -1 if the directory cannot be read */
+gint remmina_file_manager_reencrypt(const gchar *dirname, gint *failed);
 /* Get a list of groups */
 gchar* remmina_file_manager_get_groups(void);
 GNode* remmina_file_manager_get_group_tree(void);
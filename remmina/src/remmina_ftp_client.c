@@ -1261,31 +1261,39 @@ remmina_ftp_client_get_waiting_task(RemminaFTPClient *client)
 void remmina_ftp_client_update_task(RemminaFTPClient *client, RemminaFTPTask* task)
 {
 	TRACE_CALL("remmina_ftp_client_update_task");
-	RemminaFTPClientPriv *priv = (RemminaFTPClientPriv*) client->priv;
-	GtkListStore *store = GTK_LIST_STORE(priv->task_list_model);
+	GtkTreeModel *model;
 	GtkTreePath *path;
 	GtkTreeIter iter;
 
 	if ( !remmina_masterthread_exec_is_main_thread() ) {
-		/* Allow the execution of this function from a non main thread */
+		/* Allow the execution of this function from a non main thread.
+		 * Progress updates are frequent: post a snapshot of the task without
+		 * waiting, and let the pending update of the same row be replaced */
 		RemminaMTExecData *d;
+		RemminaFTPTask *snapshot;
+		snapshot = (RemminaFTPTask*)g_malloc0( sizeof(RemminaFTPTask) );
+		snapshot->rowref = task->rowref;
+		snapshot->size = task->size;
+		snapshot->status = task->status;
+		snapshot->donesize = task->donesize;
+		snapshot->tooltip = g_strdup(task->tooltip);
 		d = (RemminaMTExecData*)g_malloc( sizeof(RemminaMTExecData) );
 		d->func = FUNC_FTP_CLIENT_UPDATE_TASK;
 		d->p.ftp_client_update_task.client = client;
-		d->p.ftp_client_update_task.task = task;
-		remmina_masterthread_exec_and_wait(d);
-		g_free(d);
+		d->p.ftp_client_update_task.task = snapshot;
+		remmina_masterthread_exec_post(d, task->rowref);
 		return;
 	}
 
-
-
+	/* The row reference keeps the task list model alive, so the update
+	 * is safe even when the client has gone in the meantime */
+	model = gtk_tree_row_reference_get_model(task->rowref);
 	path = gtk_tree_row_reference_get_path(task->rowref);
 	if (path == NULL)
 		return;
-	gtk_tree_model_get_iter(priv->task_list_model, &iter, path);
+	gtk_tree_model_get_iter(model, &iter, path);
 	gtk_tree_path_free(path);
-	gtk_list_store_set(store, &iter, REMMINA_FTP_TASK_COLUMN_SIZE, task->size, REMMINA_FTP_TASK_COLUMN_STATUS, task->status,
+	gtk_list_store_set(GTK_LIST_STORE(model), &iter, REMMINA_FTP_TASK_COLUMN_SIZE, task->size, REMMINA_FTP_TASK_COLUMN_STATUS, task->status,
 			REMMINA_FTP_TASK_COLUMN_DONESIZE, task->donesize, REMMINA_FTP_TASK_COLUMN_TOOLTIP, task->tooltip, -1);
 }
 
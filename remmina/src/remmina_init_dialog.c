@@ -182,10 +182,9 @@ void remmina_init_dialog_set_status(RemminaInitDialog *dialog, const gchar *stat
 			RemminaMTExecData *d;
 			d = (RemminaMTExecData*)g_malloc( sizeof(RemminaMTExecData) );
 			d->func = FUNC_GTK_LABEL_SET_TEXT;
-			d->p.gtk_label_set_text.label = GTK_LABEL(dialog->status_label);
-			d->p.gtk_label_set_text.str = dialog->status;
-			remmina_masterthread_exec_and_wait(d);
-			g_free(d);
+			d->p.gtk_label_set_text.label = g_object_ref(dialog->status_label);
+			d->p.gtk_label_set_text.str = g_strdup(dialog->status);
+			remmina_masterthread_exec_post(d, dialog->status_label);
 		}
 	}
 }
@@ -211,10 +210,9 @@ void remmina_init_dialog_set_status_temp(RemminaInitDialog *dialog, const gchar
 			RemminaMTExecData *d;
 			d = (RemminaMTExecData*)g_malloc( sizeof(RemminaMTExecData) );
 			d->func = FUNC_GTK_LABEL_SET_TEXT;
-			d->p.gtk_label_set_text.label = GTK_LABEL(dialog->status_label);
-			d->p.gtk_label_set_text.str = s;
-			remmina_masterthread_exec_and_wait(d);
-			g_free(d);
+			d->p.gtk_label_set_text.label = g_object_ref(dialog->status_label);
+			d->p.gtk_label_set_text.str = g_strdup(s);
+			remmina_masterthread_exec_post(d, dialog->status_label);
 		}
 
 		g_free(s);
@@ -41,6 +41,7 @@
 #include "remmina_public.h"
 #include "remmina_file.h"
 #include "remmina_file_manager.h"
+#include "remmina_file_import.h"
 #include "remmina_file_editor.h"
 #include "remmina_connection_window.h"
 #include "remmina_about.h"
@@ -52,6 +53,7 @@
 #include "remmina_icon.h"
 #include "remmina_main.h"
 #include "remmina_external_tools.h"
+#include "remmina_startup.h"
 #include "remmina/remmina_trace_calls.h"
 
 G_DEFINE_TYPE( RemminaMain, remmina_main, GTK_TYPE_WINDOW)
@@ -794,54 +796,48 @@ static void remmina_main_on_action_view_file_mode(GtkRadioAction *action, Remmin
 	previous_action = action;
 }
 
-static void remmina_main_import_file_list(RemminaMain *remminamain, GSList *files)
+static void remmina_main_import_file_list_done(RemminaFileImportReport *report, gpointer data)
 {
-	TRACE_CALL("remmina_main_import_file_list");
+	TRACE_CALL("remmina_main_import_file_list_done");
+	RemminaMain **premminamain = (RemminaMain**) data;
+	RemminaMain *remminamain = *premminamain;
 	GtkWidget *dlg;
-	GSList *element;
-	gchar *path;
-	RemminaFilePlugin *plugin;
-	GString *err;
-	RemminaFile *remminafile = NULL;
-	gboolean imported;
 
-	err = g_string_new(NULL);
-	imported = FALSE;
-	for (element = files; element; element = element->next)
+	/* The window may have been closed during the import */
+	if (remminamain)
 	{
-		path = (gchar*) element->data;
-		plugin = remmina_plugin_manager_get_import_file_handler(path);
-		if (plugin && (remminafile = plugin->import_func(path)) != NULL && remmina_file_get_string(remminafile, "name"))
-		{
-			remmina_file_generate_filename(remminafile);
-			remmina_file_save_all(remminafile);
-			imported = TRUE;
-		}
-		else
-		{
-			g_string_append(err, path);
-			g_string_append_c(err, '\n');
-		}
-		if (remminafile)
+		g_object_remove_weak_pointer(G_OBJECT(remminamain), (gpointer*) premminamain);
+		if (report->errors->len > 0)
 		{
-			remmina_file_free(remminafile);
-			remminafile = NULL;
+			dlg = gtk_message_dialog_new(GTK_WINDOW(remminamain), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+					_("Unable to import:\n%s"), report->errors->str);
+			g_signal_connect(G_OBJECT(dlg), "response", G_CALLBACK(gtk_widget_destroy), NULL);
+			gtk_widget_show(dlg);
 		}
-		g_free(path);
-	}
-	g_slist_free(files);
-	if (err->len > 0)
-	{
-		dlg = gtk_message_dialog_new(GTK_WINDOW(remminamain), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-				_("Unable to import:\n%s"), err->str);
-		g_signal_connect(G_OBJECT(dlg), "response", G_CALLBACK(gtk_widget_destroy), NULL);
-		gtk_widget_show(dlg);
-	}
-	g_string_free(err, TRUE);
-	if (imported)
-	{
+		/* Also replaces the progress message in the status bar */
 		remmina_main_load_files(remminamain, TRUE);
 	}
+	g_free(premminamain);
+	remmina_file_import_report_free(report);
+}
+
+static void remmina_main_import_file_list(RemminaMain *remminamain, GSList *files)
+{
+	TRACE_CALL("remmina_main_import_file_list");
+	RemminaMain **premminamain;
+	guint context_id;
+
+	context_id = gtk_statusbar_get_context_id(remminamain->statusbar_main, "status");
+	gtk_statusbar_pop(remminamain->statusbar_main, context_id);
+	gtk_statusbar_push(remminamain->statusbar_main, context_id, _("Importing..."));
+
+	premminamain = g_new(RemminaMain*, 1);
+	*premminamain = remminamain;
+	g_object_add_weak_pointer(G_OBJECT(remminamain), (gpointer*) premminamain);
+	/* Directories dropped on the window are imported as a whole. Large imports
+	 * take a while: profiles are written in idle time, the window stays usable */
+	remmina_file_import_async(files, FALSE, remmina_main_import_file_list_done, premminamain);
+	g_slist_free_full(files, g_free);
 }
 
 static void remmina_main_action_tools_import_on_response(GtkDialog *dialog, gint response_id, RemminaMain *remminamain)
@@ -1043,7 +1039,7 @@ static gboolean remmina_main_add_tool_plugin(gchar *name, RemminaPlugin *plugin,
 	TRACE_CALL("remmina_main_add_tool_plugin");
 	RemminaMain *remminamain = REMMINA_MAIN(data);
 	GtkWidget *menuitem = gtk_menu_item_new_with_label(plugin->name);
-	GtkAction *action = gtk_action_new(name, plugin->description, NULL, NULL);
+	GtkAction *action = gtk_action_new(name, g_dgettext(plugin->domain, plugin->description), NULL, NULL);
 
 	gtk_widget_show(menuitem);
 	gtk_menu_shell_append(GTK_MENU_SHELL(remminamain->menu_tools), menuitem);
@@ -1054,6 +1050,12 @@ static gboolean remmina_main_add_tool_plugin(gchar *name, RemminaPlugin *plugin,
 	return FALSE;
 }
 
+static gboolean remmina_main_on_map_event(GtkWidget *widget, GdkEvent *event, gpointer user_data)
+{
+	TRACE_CALL("remmina_main_on_map_event");
+	remmina_startup_window_mapped();
+	return FALSE;
+}
 
 static gboolean remmina_main_on_window_state_event(GtkWidget *widget, GdkEventWindowState *event, gpointer user_data)
 {
@@ -1079,6 +1081,8 @@ static gboolean remmina_main_on_window_state_event(GtkWidget *widget, GdkEventWi
 static void remmina_main_init(RemminaMain *remminamain)
 {
 	TRACE_CALL("remmina_main_init");
+	gint64 t;
+
 	/* Initialize template and private data */
 	gtk_widget_init_template(GTK_WIDGET(remminamain));
 	remminamain->priv = g_new0(RemminaMainPriv, 1);
@@ -1087,6 +1091,7 @@ static void remmina_main_init(RemminaMain *remminamain)
 	g_signal_connect(G_OBJECT(remminamain), "delete-event", G_CALLBACK(remmina_main_on_delete_event), NULL);
 	g_signal_connect(G_OBJECT(remminamain), "destroy", G_CALLBACK(remmina_main_destroy), NULL);
 	g_signal_connect(G_OBJECT(remminamain), "window-state-event", G_CALLBACK(remmina_main_on_window_state_event), NULL);
+	g_signal_connect(G_OBJECT(remminamain), "map-event", G_CALLBACK(remmina_main_on_map_event), NULL);
 	gtk_window_set_title(GTK_WINDOW(remminamain), _("Remmina Remote Desktop Client"));
 	gtk_window_set_default_size(GTK_WINDOW(remminamain), remmina_pref.main_width, remmina_pref.main_height);
 	gtk_window_set_position(GTK_WINDOW(remminamain), GTK_WIN_POS_CENTER);
@@ -1120,7 +1125,9 @@ static void remmina_main_init(RemminaMain *remminamain)
 	g_signal_connect(G_OBJECT(remminamain->tree_files_list), "row-activated",
 		G_CALLBACK(remmina_main_file_list_on_row_activated), remminamain);
 	/* Load the files list */
+	t = remmina_startup_begin();
 	remmina_main_load_files(remminamain, FALSE);
+	remmina_startup_end("main", "remmina_main_load_files", t);
 	/* Load the preferences */
 	if (remmina_pref.hide_toolbar)
 	{
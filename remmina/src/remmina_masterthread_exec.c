@@ -45,97 +45,271 @@
 
 static pthread_t gMainThreadID;
 
-static gboolean remmina_masterthread_exec_callback(RemminaMTExecData *d)
-{
+/* Pending calls. Producers push on a lock-free LIFO stack, the main thread
+ * detaches the whole stack at once and runs it in FIFO order, so a single
+ * idle source serves all the calls queued during a main loop iteration */
+static RemminaMTExecData *mt_queue_head = NULL;
+static gint mt_drain_scheduled = FALSE;
 
-	/* This function is called on main GTK Thread via gdk_threads_add_idlde()
-	 * from remmina_masterthread_exec_and_wait() */
+/* Coalescing keys of the posts still in the queue */
+static pthread_mutex_t mt_coalesce_mu = PTHREAD_MUTEX_INITIALIZER;
+static GHashTable *mt_coalesce_table = NULL;
 
-	if (!d->cancelled) {
-		switch(d->func) {
-			case FUNC_INIT_SAVE_CRED:
-				remmina_protocol_widget_init_save_cred(d->p.init_save_creds.gp);
-				break;
-			case FUNC_CHAT_RECEIVE:
-				remmina_protocol_widget_chat_receive(d->p.chat_receive.gp, d->p.chat_receive.text);
-				break;
-			case FUNC_FILE_GET_SECRET:
-				d->p.file_get_secret.retval = remmina_file_get_secret( d->p.file_get_secret.remminafile, d->p.file_get_secret.setting );
-				break;
-			case FUNC_DIALOG_SERVERKEY_CONFIRM:
-				d->p.dialog_serverkey_confirm.retval = remmina_init_dialog_serverkey_confirm( d->p.dialog_serverkey_confirm.dialog,
-					d->p.dialog_serverkey_confirm.serverkey, d->p.dialog_serverkey_confirm.prompt );
-				break;
-			case FUNC_DIALOG_AUTHPWD:
-				d->p.dialog_authpwd.retval = remmina_init_dialog_authpwd(d->p.dialog_authpwd.dialog,
-					d->p.dialog_authpwd.label, d->p.dialog_authpwd.allow_save);
-				break;
-			case FUNC_GTK_LABEL_SET_TEXT:
-				gtk_label_set_text( d->p.gtk_label_set_text.label, d->p.gtk_label_set_text.str );
-				break;
-			case FUNC_DIALOG_AUTHUSERPWD:
-				d->p.dialog_authuserpwd.retval = remmina_init_dialog_authuserpwd( d->p.dialog_authuserpwd.dialog,
-					d->p.dialog_authuserpwd.want_domain, d->p.dialog_authuserpwd.default_username,
-					d->p.dialog_authuserpwd.default_domain, d->p.dialog_authuserpwd.allow_save );
-				break;
-			case FUNC_DIALOG_CERT:
-				d->p.dialog_certificate.retval = remmina_init_dialog_certificate( d->p.dialog_certificate.dialog,
-					d->p.dialog_certificate.subject, d->p.dialog_certificate.issuer, d->p.dialog_certificate.fingerprint );
-				break;
-			case FUNC_DIALOG_CERTCHANGED:
-				d->p.dialog_certchanged.retval = remmina_init_dialog_certificate_changed( d->p.dialog_certchanged.dialog,
-					d->p.dialog_certchanged.subject, d->p.dialog_certchanged.issuer, d->p.dialog_certchanged.new_fingerprint,
-					d->p.dialog_certchanged.old_fingerprint );
-				break;
-			case FUNC_DIALOG_AUTHX509:
-				d->p.dialog_authx509.retval = remmina_init_dialog_authx509( d->p.dialog_authx509.dialog, d->p.dialog_authx509.cacert,
-					d->p.dialog_authx509.cacrl, d->p.dialog_authx509.clientcert, d->p.dialog_authx509.clientkey );
-				break;
-			case FUNC_FTP_CLIENT_UPDATE_TASK:
-				remmina_ftp_client_update_task( d->p.ftp_client_update_task.client, d->p.ftp_client_update_task.task );
-				break;
-			case FUNC_FTP_CLIENT_GET_WAITING_TASK:
-				d->p.ftp_client_get_waiting_task.retval = remmina_ftp_client_get_waiting_task( d->p.ftp_client_get_waiting_task.client );
-				break;
-			case FUNC_SFTP_CLIENT_CONFIRM_RESUME:
+static void remmina_masterthread_exec_run(RemminaMTExecData *d)
+{
+	switch(d->func) {
+		case FUNC_INIT_SAVE_CRED:
+			remmina_protocol_widget_init_save_cred(d->p.init_save_creds.gp);
+			break;
+		case FUNC_CHAT_RECEIVE:
+			remmina_protocol_widget_chat_receive(d->p.chat_receive.gp, d->p.chat_receive.text);
+			break;
+		case FUNC_FILE_GET_SECRET:
+			d->p.file_get_secret.retval = remmina_file_get_secret( d->p.file_get_secret.remminafile, d->p.file_get_secret.setting );
+			break;
+		case FUNC_DIALOG_SERVERKEY_CONFIRM:
+			d->p.dialog_serverkey_confirm.retval = remmina_init_dialog_serverkey_confirm( d->p.dialog_serverkey_confirm.dialog,
+				d->p.dialog_serverkey_confirm.serverkey, d->p.dialog_serverkey_confirm.prompt );
+			break;
+		case FUNC_DIALOG_AUTHPWD:
+			d->p.dialog_authpwd.retval = remmina_init_dialog_authpwd(d->p.dialog_authpwd.dialog,
+				d->p.dialog_authpwd.label, d->p.dialog_authpwd.allow_save);
+			break;
+		case FUNC_GTK_LABEL_SET_TEXT:
+			gtk_label_set_text( d->p.gtk_label_set_text.label, d->p.gtk_label_set_text.str );
+			break;
+		case FUNC_DIALOG_AUTHUSERPWD:
+			d->p.dialog_authuserpwd.retval = remmina_init_dialog_authuserpwd( d->p.dialog_authuserpwd.dialog,
+				d->p.dialog_authuserpwd.want_domain, d->p.dialog_authuserpwd.default_username,
+				d->p.dialog_authuserpwd.default_domain, d->p.dialog_authuserpwd.allow_save );
+			break;
+		case FUNC_DIALOG_CERT:
+			d->p.dialog_certificate.retval = remmina_init_dialog_certificate( d->p.dialog_certificate.dialog,
+				d->p.dialog_certificate.subject, d->p.dialog_certificate.issuer, d->p.dialog_certificate.fingerprint );
+			break;
+		case FUNC_DIALOG_CERTCHANGED:
+			d->p.dialog_certchanged.retval = remmina_init_dialog_certificate_changed( d->p.dialog_certchanged.dialog,
+				d->p.dialog_certchanged.subject, d->p.dialog_certchanged.issuer, d->p.dialog_certchanged.new_fingerprint,
+				d->p.dialog_certchanged.old_fingerprint );
+			break;
+		case FUNC_DIALOG_AUTHX509:
+			d->p.dialog_authx509.retval = remmina_init_dialog_authx509( d->p.dialog_authx509.dialog, d->p.dialog_authx509.cacert,
+				d->p.dialog_authx509.cacrl, d->p.dialog_authx509.clientcert, d->p.dialog_authx509.clientkey );
+			break;
+		case FUNC_FTP_CLIENT_UPDATE_TASK:
+			remmina_ftp_client_update_task( d->p.ftp_client_update_task.client, d->p.ftp_client_update_task.task );
+			break;
+		case FUNC_FTP_CLIENT_GET_WAITING_TASK:
+			d->p.ftp_client_get_waiting_task.retval = remmina_ftp_client_get_waiting_task( d->p.ftp_client_get_waiting_task.client );
+			break;
+		case FUNC_SFTP_CLIENT_CONFIRM_RESUME:
 #ifdef HAVE_LIBSSH
-				d->p.sftp_client_confirm_resume.retval = remmina_sftp_client_confirm_resume( d->p.sftp_client_confirm_resume.client,
-					d->p.sftp_client_confirm_resume.path );
+			d->p.sftp_client_confirm_resume.retval = remmina_sftp_client_confirm_resume( d->p.sftp_client_confirm_resume.client,
+				d->p.sftp_client_confirm_resume.path );
 #endif
-				break;
-			case FUNC_VTE_TERMINAL_SET_ENCODING_AND_PTY:
+			break;
+		case FUNC_VTE_TERMINAL_SET_ENCODING_AND_PTY:
 #if defined (HAVE_LIBSSH) && defined (HAVE_LIBVTE)
-				remmina_plugin_ssh_vte_terminal_set_encoding_and_pty( d->p.vte_terminal_set_encoding_and_pty.terminal,
-					d->p.vte_terminal_set_encoding_and_pty.codeset, d->p.vte_terminal_set_encoding_and_pty.slave );
+			remmina_plugin_ssh_vte_terminal_set_encoding_and_pty( d->p.vte_terminal_set_encoding_and_pty.terminal,
+				d->p.vte_terminal_set_encoding_and_pty.codeset, d->p.vte_terminal_set_encoding_and_pty.slave );
 #endif
-				break;
-		}
+			break;
+	}
+}
+
+static void remmina_masterthread_exec_free_params(RemminaMTExecData *d)
+{
+	/* Release what a fire and forget post owns */
+	switch(d->func) {
+		case FUNC_GTK_LABEL_SET_TEXT:
+			g_object_unref(d->p.gtk_label_set_text.label);
+			g_free((gchar*)d->p.gtk_label_set_text.str);
+			break;
+		case FUNC_CHAT_RECEIVE:
+			g_object_unref(d->p.chat_receive.gp);
+			g_free((gchar*)d->p.chat_receive.text);
+			break;
+		case FUNC_FTP_CLIENT_UPDATE_TASK:
+			remmina_ftp_task_free(d->p.ftp_client_update_task.task);
+			break;
+		case FUNC_VTE_TERMINAL_SET_ENCODING_AND_PTY:
+#ifdef HAVE_LIBVTE
+			g_object_unref(d->p.vte_terminal_set_encoding_and_pty.terminal);
+			g_free((gchar*)d->p.vte_terminal_set_encoding_and_pty.codeset);
+#endif
+			break;
+		default:
+			break;
+	}
+}
+
+static void remmina_masterthread_exec_dispatch(RemminaMTExecData *d)
+{
+	if (d->coalesce_key) {
+		/* From now on a new post with the same key is queued again */
+		pthread_mutex_lock(&mt_coalesce_mu);
+		if (g_hash_table_lookup(mt_coalesce_table, d->coalesce_key) == d)
+			g_hash_table_remove(mt_coalesce_table, d->coalesce_key);
+		pthread_mutex_unlock(&mt_coalesce_mu);
+	}
+
+	if (!d->waited) {
+		remmina_masterthread_exec_run(d);
+		remmina_masterthread_exec_free_params(d);
+		g_free(d);
+		return;
+	}
+
+	pthread_mutex_lock(&d->mu);
+	if (!d->cancelled) {
+		/* Do not hold the mutex while running: dialogs run a nested main loop */
 		pthread_mutex_unlock(&d->mu);
-	} else {
-		/* thread has been cancelled, so we must free d memory here */
+		remmina_masterthread_exec_run(d);
+		pthread_mutex_lock(&d->mu);
+	}
+	if (d->cancelled) {
+		/* The waiting thread has been cancelled, so we must free d memory here */
+		pthread_mutex_unlock(&d->mu);
+		pthread_cond_destroy(&d->cond);
+		pthread_mutex_destroy(&d->mu);
 		g_free(d);
+		return;
+	}
+	d->complete = TRUE;
+	pthread_cond_signal(&d->cond);
+	pthread_mutex_unlock(&d->mu);
+}
+
+static gboolean remmina_masterthread_exec_drain(gpointer data)
+{
+	/* This function is called on main GTK Thread via gdk_threads_add_idle()
+	 * and runs every call queued since its last execution */
+	RemminaMTExecData *head, *d, *next, *fifo;
+
+	/* Reset before detaching, so a producer pushing after this point
+	 * schedules a new drain */
+	g_atomic_int_set(&mt_drain_scheduled, FALSE);
+
+	do {
+		head = g_atomic_pointer_get(&mt_queue_head);
+	} while (!g_atomic_pointer_compare_and_exchange(&mt_queue_head, head, NULL));
+
+	fifo = NULL;
+	for (d = head; d; d = next) {
+		next = d->next;
+		d->next = fifo;
+		fifo = d;
+	}
+
+	for (d = fifo; d; d = next) {
+		next = d->next;
+		remmina_masterthread_exec_dispatch(d);
 	}
+
 	return G_SOURCE_REMOVE;
 }
 
+static void remmina_masterthread_exec_enqueue(RemminaMTExecData *d)
+{
+	RemminaMTExecData *head;
+
+	do {
+		head = g_atomic_pointer_get(&mt_queue_head);
+		d->next = head;
+	} while (!g_atomic_pointer_compare_and_exchange(&mt_queue_head, head, d));
+
+	if (g_atomic_int_compare_and_exchange(&mt_drain_scheduled, FALSE, TRUE))
+		gdk_threads_add_idle(remmina_masterthread_exec_drain, NULL);
+}
+
 static void remmina_masterthread_exec_cleanup_handler(RemminaMTExecData *d)
 {
+	/* Called with d->mu locked when the waiting thread is cancelled */
+	if (d->complete) {
+		/* The main thread is done with d, nobody else will free it */
+		pthread_mutex_unlock(&d->mu);
+		pthread_cond_destroy(&d->cond);
+		pthread_mutex_destroy(&d->mu);
+		g_free(d);
+		return;
+	}
 	d->cancelled = TRUE;
+	pthread_mutex_unlock(&d->mu);
 }
 
-void remmina_masterthread_exec_and_wait(RemminaMTExecData *d)
+void remmina_masterthread_exec_call(RemminaMTExecData *d)
 {
+	gint oldtype;
+
 	d->cancelled = FALSE;
-	pthread_cleanup_push(remmina_masterthread_exec_cleanup_handler, (void *)d);
+	d->complete = FALSE;
+	d->waited = TRUE;
+	d->coalesce_key = NULL;
 	pthread_mutex_init(&d->mu, NULL);
+	pthread_cond_init(&d->cond, NULL);
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+	remmina_masterthread_exec_enqueue(d);
+	pthread_setcanceltype(oldtype, NULL);
+}
+
+void remmina_masterthread_exec_wait(RemminaMTExecData *d)
+{
 	pthread_mutex_lock(&d->mu);
-	gdk_threads_add_idle((GSourceFunc)remmina_masterthread_exec_callback, (gpointer)d);
-	pthread_mutex_lock(&d->mu);
+	pthread_cleanup_push((void (*)(void *))remmina_masterthread_exec_cleanup_handler, (void *)d);
+	while (!d->complete)
+		pthread_cond_wait(&d->cond, &d->mu);
 	pthread_cleanup_pop(0);
 	pthread_mutex_unlock(&d->mu);
+	pthread_cond_destroy(&d->cond);
 	pthread_mutex_destroy(&d->mu);
 }
 
+void remmina_masterthread_exec_and_wait(RemminaMTExecData *d)
+{
+	remmina_masterthread_exec_call(d);
+	remmina_masterthread_exec_wait(d);
+}
+
+void remmina_masterthread_exec_post(RemminaMTExecData *d, gconstpointer coalesce_key)
+{
+	RemminaMTExecData *pending;
+	gint oldtype;
+
+	d->cancelled = FALSE;
+	d->complete = FALSE;
+	d->waited = FALSE;
+	d->coalesce_key = NULL;
+
+	/* Posted from plugin threads running with asynchronous cancellation:
+	 * being cancelled with mt_coalesce_mu held, or with the call half queued,
+	 * would stop every later call to the main thread */
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+
+	if (coalesce_key) {
+		pthread_mutex_lock(&mt_coalesce_mu);
+		if (!mt_coalesce_table)
+			mt_coalesce_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+		pending = g_hash_table_lookup(mt_coalesce_table, coalesce_key);
+		if (pending && pending->func == d->func) {
+			/* Still queued: replace its parameters, keeping its position */
+			remmina_masterthread_exec_free_params(pending);
+			pending->p = d->p;
+			pthread_mutex_unlock(&mt_coalesce_mu);
+			g_free(d);
+			pthread_setcanceltype(oldtype, NULL);
+			return;
+		}
+		if (!pending) {
+			d->coalesce_key = coalesce_key;
+			g_hash_table_insert(mt_coalesce_table, (gpointer)coalesce_key, d);
+		}
+		pthread_mutex_unlock(&mt_coalesce_mu);
+	}
+
+	remmina_masterthread_exec_enqueue(d);
+	pthread_setcanceltype(oldtype, NULL);
+}
+
 void remmina_masterthread_exec_save_main_thread_id() {
 	/* To be called from main thread at startup */
 	gMainThreadID = pthread_self();
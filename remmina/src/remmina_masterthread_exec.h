@@ -134,15 +134,37 @@ typedef struct remmina_masterthread_exec_data {
 #endif
 	} p;
 
-	/* Mutex for thread synchronization */
+	/* Mutex and condition for thread synchronization */
 	pthread_mutex_t mu;
+	pthread_cond_t cond;
 	/* Flag to catch cancellations */
 	gboolean cancelled;
+	/* TRUE when the main thread has executed the call */
+	gboolean complete;
+	/* TRUE when a thread will wait for the result, FALSE for posts */
+	gboolean waited;
+
+	/* Dispatcher queue link and coalescing key */
+	struct remmina_masterthread_exec_data *next;
+	gconstpointer coalesce_key;
 
 } RemminaMTExecData;
 
+/* Execute d on the main thread and wait for its completion */
 void remmina_masterthread_exec_and_wait(RemminaMTExecData *d);
 
+/* Split form of remmina_masterthread_exec_and_wait(): queue d and return
+ * immediately, then collect the result later with remmina_masterthread_exec_wait() */
+void remmina_masterthread_exec_call(RemminaMTExecData *d);
+void remmina_masterthread_exec_wait(RemminaMTExecData *d);
+
+/* Fire and forget, only for functions without a return value. The dispatcher
+ * frees d and takes ownership of its parameters: strings must be newly
+ * allocated, widgets and protocol widgets referenced, and the FTP task a copy.
+ * When coalesce_key is not NULL, a pending post with the same func and key
+ * is replaced by d, so only the latest update is executed */
+void remmina_masterthread_exec_post(RemminaMTExecData *d, gconstpointer coalesce_key);
+
 void remmina_masterthread_exec_save_main_thread_id(void);
 gboolean remmina_masterthread_exec_is_main_thread(void);
 
@@ -36,7 +36,9 @@
 #include "config.h"
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <stdlib.h>
 #include <string.h>
+#include <glib/gstdio.h>
 #include "remmina_public.h"
 #include "remmina_file.h"
 #include "remmina_pref.h"
@@ -47,10 +49,34 @@
 #include "remmina_plugin_manager.h"
 #include "remmina_public.h"
 #include "remmina_masterthread_exec.h"
+#include "remmina_startup.h"
 #include "remmina/remmina_trace_calls.h"
 
 static GPtrArray* remmina_plugin_table = NULL;
 
+/* Plugins by name, one table per plugin type */
+static GHashTable* remmina_plugin_index[REMMINA_PLUGIN_TYPE_SECRET + 1];
+
+/* A plugin module in REMMINA_PLUGINDIR */
+typedef struct _RemminaPluginModule
+{
+	gchar *path;
+	gboolean loaded;
+} RemminaPluginModule;
+
+/* Plugins only known from the manifest, mapped to the module providing
+ * them. They only have their descriptive fields set, and are replaced in
+ * the tables when their module registers the real plugin. */
+static GHashTable* remmina_plugin_stubs = NULL;
+
+/* The manifest caches the plugins registered by each module, keyed by the
+ * module mtime and size, so that modules are only opened when needed.
+ * While a module is opened for the first time, its plugins are recorded in
+ * the remmina_plugin_manifest_group group of the new manifest. */
+#define REMMINA_PLUGIN_MANIFEST_FILE "plugins.manifest"
+static GKeyFile* remmina_plugin_manifest = NULL;
+static const gchar* remmina_plugin_manifest_group = NULL;
+
 /* There can be only one secret plugin loaded */
 static RemminaSecretPlugin *remmina_secret_plugin = NULL;
 
@@ -63,9 +89,69 @@ static gint remmina_plugin_manager_compare_func(RemminaPlugin **a, RemminaPlugin
 	return g_strcmp0((*a)->name, (*b)->name);
 }
 
+static gchar* remmina_plugin_manager_manifest_key(gint i, const gchar *key)
+{
+	TRACE_CALL("remmina_plugin_manager_manifest_key");
+	return g_strdup_printf("plugin%d_%s", i, key);
+}
+
+static void remmina_plugin_manager_manifest_set(gint i, const gchar *key, const gchar *value)
+{
+	TRACE_CALL("remmina_plugin_manager_manifest_set");
+	gchar *k;
+
+	if (!value)
+		return;
+	k = remmina_plugin_manager_manifest_key(i, key);
+	g_key_file_set_string(remmina_plugin_manifest, remmina_plugin_manifest_group, k, value);
+	g_free(k);
+}
+
+static gchar* remmina_plugin_manager_manifest_get(GKeyFile *manifest, const gchar *group, gint i, const gchar *key)
+{
+	TRACE_CALL("remmina_plugin_manager_manifest_get");
+	gchar *k;
+	gchar *value;
+
+	k = remmina_plugin_manager_manifest_key(i, key);
+	value = g_key_file_get_string(manifest, group, k, NULL);
+	g_free(k);
+	return value;
+}
+
+/* Record a plugin registered by the module being scanned */
+static void remmina_plugin_manager_manifest_record(RemminaPlugin *plugin)
+{
+	TRACE_CALL("remmina_plugin_manager_manifest_record");
+	RemminaProtocolPlugin *protocol_plugin;
+	gchar *type;
+	gint i;
+
+	i = g_key_file_get_integer(remmina_plugin_manifest, remmina_plugin_manifest_group, "plugins", NULL);
+
+	type = g_strdup_printf("%d", plugin->type);
+	remmina_plugin_manager_manifest_set(i, "type", type);
+	g_free(type);
+	remmina_plugin_manager_manifest_set(i, "name", plugin->name);
+	remmina_plugin_manager_manifest_set(i, "description", plugin->description);
+	remmina_plugin_manager_manifest_set(i, "domain", plugin->domain);
+	remmina_plugin_manager_manifest_set(i, "version", plugin->version);
+	if (plugin->type == REMMINA_PLUGIN_TYPE_PROTOCOL)
+	{
+		protocol_plugin = (RemminaProtocolPlugin*) plugin;
+		remmina_plugin_manager_manifest_set(i, "icon_name", protocol_plugin->icon_name);
+		remmina_plugin_manager_manifest_set(i, "icon_name_ssh", protocol_plugin->icon_name_ssh);
+	}
+
+	g_key_file_set_integer(remmina_plugin_manifest, remmina_plugin_manifest_group, "plugins", i + 1);
+}
+
 static gboolean remmina_plugin_manager_register_plugin(RemminaPlugin *plugin)
 {
 	TRACE_CALL("remmina_plugin_manager_register_plugin");
+	RemminaPlugin *stub;
+	guint i;
+
 	if (plugin->type == REMMINA_PLUGIN_TYPE_SECRET)
 	{
 		if (remmina_secret_plugin)
@@ -76,8 +162,27 @@ static gboolean remmina_plugin_manager_register_plugin(RemminaPlugin *plugin)
 		}
 		remmina_secret_plugin = (RemminaSecretPlugin*) plugin;
 	}
-	g_ptr_array_add(remmina_plugin_table, plugin);
-	g_ptr_array_sort(remmina_plugin_table, (GCompareFunc) remmina_plugin_manager_compare_func);
+	if (remmina_plugin_manifest_group)
+		remmina_plugin_manager_manifest_record(plugin);
+
+	stub = (RemminaPlugin*) g_hash_table_lookup(remmina_plugin_index[plugin->type], plugin->name);
+	if (stub && g_hash_table_remove(remmina_plugin_stubs, stub))
+	{
+		/* Take the place of the manifest entry, without reordering the table
+		 * for callers iterating it. The stub itself is kept, as they may
+		 * still hold it */
+		for (i = 0; i < remmina_plugin_table->len; i++)
+		{
+			if (g_ptr_array_index(remmina_plugin_table, i) == stub)
+				remmina_plugin_table->pdata[i] = plugin;
+		}
+	}
+	else
+	{
+		g_ptr_array_add(remmina_plugin_table, plugin);
+		g_ptr_array_sort(remmina_plugin_table, (GCompareFunc) remmina_plugin_manager_compare_func);
+	}
+	g_hash_table_replace(remmina_plugin_index[plugin->type], (gpointer) plugin->name, plugin);
 	g_print("Remmina plugin %s (type=%s) registered.\n", plugin->name, _(remmina_plugin_type_name[plugin->type]));
 	return TRUE;
 }
@@ -149,13 +254,26 @@ RemminaPluginService remmina_plugin_manager_service =
 
 		remmina_connection_window_open_from_file_full,
 		remmina_public_get_server_port,
-		remmina_masterthread_exec_is_main_thread
+		remmina_masterthread_exec_is_main_thread,
+
+		remmina_protocol_widget_stats_count,
+		remmina_protocol_widget_stats_gauge,
+		remmina_protocol_widget_stats_sample,
+		remmina_protocol_widget_is_visible,
+
+		remmina_protocol_widget_ssh_exec_batch_new,
+		remmina_protocol_widget_ssh_exec_batch_add,
+		remmina_protocol_widget_ssh_exec_batch_run,
+		remmina_protocol_widget_ssh_exec_batch_start,
+		remmina_protocol_widget_ssh_exec_batch_wait,
+		remmina_protocol_widget_ssh_exec_batch_free,
+		remmina_protocol_widget_ssh_exec_get_status
 
 };
 
-static void remmina_plugin_manager_load_plugin(const gchar *name)
+static gboolean remmina_plugin_manager_load_module(const gchar *name)
 {
-	TRACE_CALL("remmina_plugin_manager_load_plugin");
+	TRACE_CALL("remmina_plugin_manager_load_module");
 	GModule *module;
 	RemminaPluginEntryFunc entry;
 
@@ -165,22 +283,179 @@ static void remmina_plugin_manager_load_plugin(const gchar *name)
 	{
 		g_print("Failed to load plugin: %s.\n", name);
 		g_print("Error: %s\n", g_module_error());
-		return;
+		return FALSE;
 	}
 
 	if (!g_module_symbol(module, "remmina_plugin_entry", (gpointer*) &entry))
 	{
 		g_print("Failed to locate plugin entry: %s.\n", name);
-		return;
+		return FALSE;
 	}
 
 	if (!entry(&remmina_plugin_manager_service))
 	{
 		g_print("Plugin entry returned false: %s.\n", name);
-		return;
+		return FALSE;
 	}
 
 	/* We don't close the module because we will need it throughout the process lifetime */
+	return TRUE;
+}
+
+static gboolean remmina_plugin_manager_load_plugin(const gchar *name)
+{
+	TRACE_CALL("remmina_plugin_manager_load_plugin");
+	gchar *basename;
+	gboolean ret;
+	gint64 t;
+
+	t = remmina_startup_begin();
+	ret = remmina_plugin_manager_load_module(name);
+	if (remmina_startup_is_enabled())
+	{
+		basename = g_path_get_basename(name);
+		remmina_startup_end("plugin", basename, t);
+		g_free(basename);
+	}
+	return ret;
+}
+
+static void remmina_plugin_manager_open_module(RemminaPluginModule *module)
+{
+	TRACE_CALL("remmina_plugin_manager_open_module");
+	if (module->loaded)
+		return;
+	module->loaded = TRUE;
+	remmina_plugin_manager_load_plugin(module->path);
+}
+
+/* Open the modules providing plugins of a type, for callers needing all of them */
+static void remmina_plugin_manager_open_type(RemminaPluginType type)
+{
+	TRACE_CALL("remmina_plugin_manager_open_type");
+	GHashTableIter iter;
+	RemminaPlugin *stub;
+	RemminaPluginModule *module;
+	GPtrArray *modules;
+	guint i;
+
+	modules = g_ptr_array_new();
+	g_hash_table_iter_init(&iter, remmina_plugin_stubs);
+	while (g_hash_table_iter_next(&iter, (gpointer*) &stub, (gpointer*) &module))
+	{
+		if (stub->type == type)
+			g_ptr_array_add(modules, module);
+	}
+	for (i = 0; i < modules->len; i++)
+		remmina_plugin_manager_open_module((RemminaPluginModule*) g_ptr_array_index(modules, i));
+	g_ptr_array_free(modules, TRUE);
+}
+
+static gsize remmina_plugin_manager_plugin_size(RemminaPluginType type)
+{
+	TRACE_CALL("remmina_plugin_manager_plugin_size");
+	switch (type)
+	{
+		case REMMINA_PLUGIN_TYPE_PROTOCOL:
+			return sizeof(RemminaProtocolPlugin);
+		case REMMINA_PLUGIN_TYPE_ENTRY:
+			return sizeof(RemminaEntryPlugin);
+		case REMMINA_PLUGIN_TYPE_FILE:
+			return sizeof(RemminaFilePlugin);
+		case REMMINA_PLUGIN_TYPE_TOOL:
+			return sizeof(RemminaToolPlugin);
+		case REMMINA_PLUGIN_TYPE_PREF:
+			return sizeof(RemminaPrefPlugin);
+		case REMMINA_PLUGIN_TYPE_SECRET:
+			return sizeof(RemminaSecretPlugin);
+		default:
+			return 0;
+	}
+}
+
+/* Register the plugins of an unchanged module from the old manifest, and
+ * copy them to the new one. Returns FALSE when the module must be scanned */
+static gboolean remmina_plugin_manager_load_manifest(GKeyFile *old_manifest, const gchar *group, const gchar *path,
+		GStatBuf *st)
+{
+	TRACE_CALL("remmina_plugin_manager_load_manifest");
+	RemminaPluginModule *module;
+	RemminaProtocolPlugin *stub;
+	gboolean secret = FALSE;
+	gchar **keys;
+	gchar *value;
+	gint type;
+	gint i, n;
+
+	if (g_key_file_get_int64(old_manifest, group, "mtime", NULL) != (gint64) st->st_mtime
+			|| g_key_file_get_int64(old_manifest, group, "size", NULL) != (gint64) st->st_size)
+		return FALSE;
+
+	n = g_key_file_get_integer(old_manifest, group, "plugins", NULL);
+	for (i = 0; i < n; i++)
+	{
+		value = remmina_plugin_manager_manifest_get(old_manifest, group, i, "type");
+		type = (value ? atoi(value) : -1);
+		g_free(value);
+		if (remmina_plugin_manager_plugin_size(type) == 0)
+			return FALSE;
+	}
+
+	module = g_new0(RemminaPluginModule, 1);
+	module->path = g_strdup(path);
+
+	for (i = 0; i < n; i++)
+	{
+		value = remmina_plugin_manager_manifest_get(old_manifest, group, i, "type");
+		type = atoi(value);
+		g_free(value);
+
+		/* All plugin structures start with the RemminaPlugin fields */
+		stub = (RemminaProtocolPlugin*) g_malloc0(remmina_plugin_manager_plugin_size(type));
+		stub->type = type;
+		stub->name = remmina_plugin_manager_manifest_get(old_manifest, group, i, "name");
+		stub->description = remmina_plugin_manager_manifest_get(old_manifest, group, i, "description");
+		stub->domain = remmina_plugin_manager_manifest_get(old_manifest, group, i, "domain");
+		stub->version = remmina_plugin_manager_manifest_get(old_manifest, group, i, "version");
+		if (type == REMMINA_PLUGIN_TYPE_PROTOCOL)
+		{
+			stub->icon_name = remmina_plugin_manager_manifest_get(old_manifest, group, i, "icon_name");
+			stub->icon_name_ssh = remmina_plugin_manager_manifest_get(old_manifest, group, i, "icon_name_ssh");
+		}
+		if (!stub->name || g_hash_table_lookup(remmina_plugin_index[type], stub->name))
+		{
+			g_free((gchar*) stub->name);
+			continue;
+		}
+		/* The module binds its text domain when opened: descriptions of the
+		 * stubs are translated with g_dgettext() when shown, so bind it now */
+		if (stub->domain)
+		{
+			bindtextdomain(stub->domain, REMMINA_LOCALEDIR);
+			bind_textdomain_codeset(stub->domain, "UTF-8");
+		}
+
+		g_ptr_array_add(remmina_plugin_table, stub);
+		g_hash_table_insert(remmina_plugin_index[type], (gpointer) stub->name, stub);
+		g_hash_table_insert(remmina_plugin_stubs, stub, module);
+		if (type == REMMINA_PLUGIN_TYPE_SECRET)
+			secret = TRUE;
+	}
+
+	keys = g_key_file_get_keys(old_manifest, group, NULL, NULL);
+	for (i = 0; keys && keys[i]; i++)
+	{
+		value = g_key_file_get_value(old_manifest, group, keys[i], NULL);
+		g_key_file_set_value(remmina_plugin_manifest, group, keys[i], value);
+		g_free(value);
+	}
+	g_strfreev(keys);
+
+	/* The secret plugin is needed as soon as profiles are read */
+	if (secret)
+		remmina_plugin_manager_open_module(module);
+
+	return TRUE;
 }
 
 void remmina_plugin_manager_init(void)
@@ -189,8 +464,20 @@ void remmina_plugin_manager_init(void)
 	GDir *dir;
 	const gchar *name, *ptr;
 	gchar *fullpath;
+	gchar *manifest_file;
+	gchar *version;
+	gchar *content;
+	gsize length, new_length;
+	GKeyFile *old_manifest;
+	gchar **groups;
+	GStatBuf st;
+	gboolean changed = FALSE;
+	gint i;
 
 	remmina_plugin_table = g_ptr_array_new();
+	for (i = 0; i <= REMMINA_PLUGIN_TYPE_SECRET; i++)
+		remmina_plugin_index[i] = g_hash_table_new(g_str_hash, g_str_equal);
+	remmina_plugin_stubs = g_hash_table_new(NULL, NULL);
 
 	if (!g_module_supported())
 	{
@@ -201,32 +488,99 @@ void remmina_plugin_manager_init(void)
 	dir = g_dir_open(REMMINA_PLUGINDIR, 0, NULL);
 	if (dir == NULL)
 		return;
+
+	/* A manifest written by another version of Remmina is ignored */
+	manifest_file = g_strdup_printf("%s/.remmina/%s", g_get_home_dir(), REMMINA_PLUGIN_MANIFEST_FILE);
+	old_manifest = g_key_file_new();
+	g_key_file_load_from_file(old_manifest, manifest_file, G_KEY_FILE_NONE, NULL);
+	version = g_key_file_get_string(old_manifest, "remmina", "version", NULL);
+	if (g_strcmp0(version, VERSION) != 0)
+	{
+		g_key_file_free(old_manifest);
+		old_manifest = g_key_file_new();
+		changed = TRUE;
+	}
+	g_free(version);
+
+	remmina_plugin_manifest = g_key_file_new();
+	g_key_file_set_string(remmina_plugin_manifest, "remmina", "version", VERSION);
+
 	while ((name = g_dir_read_name(dir)) != NULL)
 	{
 		if ((ptr = strrchr(name, '.')) == NULL)
 			continue;
 		ptr++;
 		if (g_strcmp0(ptr, G_MODULE_SUFFIX) != 0)
-			continue; fullpath = g_strdup_printf(REMMINA_PLUGINDIR "/%s", name);
-		remmina_plugin_manager_load_plugin(fullpath);
+			continue;
+		fullpath = g_strdup_printf(REMMINA_PLUGINDIR "/%s", name);
+		if (g_stat(fullpath, &st) == 0)
+		{
+			if (!remmina_plugin_manager_load_manifest(old_manifest, name, fullpath, &st))
+			{
+				/* New or updated module: open it now and record its plugins */
+				changed = TRUE;
+				g_key_file_set_int64(remmina_plugin_manifest, name, "mtime", (gint64) st.st_mtime);
+				g_key_file_set_int64(remmina_plugin_manifest, name, "size", (gint64) st.st_size);
+				g_key_file_set_integer(remmina_plugin_manifest, name, "plugins", 0);
+				remmina_plugin_manifest_group = name;
+				/* A module failing to load is not cached, it is retried next time */
+				if (!remmina_plugin_manager_load_plugin(fullpath))
+					g_key_file_remove_group(remmina_plugin_manifest, name, NULL);
+				remmina_plugin_manifest_group = NULL;
+			}
+		}
 		g_free(fullpath);
 	}
 	g_dir_close(dir);
+
+	g_ptr_array_sort(remmina_plugin_table, (GCompareFunc) remmina_plugin_manager_compare_func);
+
+	/* Removed modules leave groups behind in the old manifest */
+	groups = g_key_file_get_groups(old_manifest, &length);
+	g_strfreev(groups);
+	groups = g_key_file_get_groups(remmina_plugin_manifest, &new_length);
+	g_strfreev(groups);
+	if (length != new_length)
+		changed = TRUE;
+
+	if (changed)
+	{
+		content = g_key_file_to_data(remmina_plugin_manifest, &length, NULL);
+		g_file_set_contents(manifest_file, content, length, NULL);
+		g_free(content);
+	}
+
+	g_key_file_free(old_manifest);
+	g_key_file_free(remmina_plugin_manifest);
+	remmina_plugin_manifest = NULL;
+	g_free(manifest_file);
+}
+
+/* Return a plugin without opening its module: only its descriptive fields
+ * (name, description, domain, version, protocol icons) may be used */
+RemminaPlugin* remmina_plugin_manager_get_plugin_info(RemminaPluginType type, const gchar *name)
+{
+	TRACE_CALL("remmina_plugin_manager_get_plugin_info");
+	if (!name)
+		return NULL;
+	return (RemminaPlugin*) g_hash_table_lookup(remmina_plugin_index[type], name);
 }
 
 RemminaPlugin* remmina_plugin_manager_get_plugin(RemminaPluginType type, const gchar *name)
 {
 	TRACE_CALL("remmina_plugin_manager_get_plugin");
 	RemminaPlugin *plugin;
-	gint i;
+	RemminaPluginModule *module;
 
-	for (i = 0; i < remmina_plugin_table->len; i++)
+	plugin = remmina_plugin_manager_get_plugin_info(type, name);
+	if (plugin && (module = g_hash_table_lookup(remmina_plugin_stubs, plugin)) != NULL)
 	{
-		plugin = (RemminaPlugin *) g_ptr_array_index(remmina_plugin_table, i);
-		if (plugin->type == type && g_strcmp0(plugin->name, name) == 0)
-		{
-			return plugin;
-		}
+		remmina_plugin_manager_open_module(module);
+		plugin = remmina_plugin_manager_get_plugin_info(type, name);
+	}
+	if (plugin && !g_hash_table_contains(remmina_plugin_stubs, plugin))
+	{
+		return plugin;
 	}
 	g_print("Plugin not found (type=%s, name=%s)\n", remmina_plugin_type_name[type], name);
 	return NULL;
@@ -319,11 +673,12 @@ RemminaFilePlugin* remmina_plugin_manager_get_import_file_handler(const gchar *f
 	RemminaFilePlugin *plugin;
 	gint i;
 
+	remmina_plugin_manager_open_type(REMMINA_PLUGIN_TYPE_FILE);
 	for (i = 0; i < remmina_plugin_table->len; i++)
 	{
 		plugin = (RemminaFilePlugin *) g_ptr_array_index(remmina_plugin_table, i);
 
-		if (plugin->type != REMMINA_PLUGIN_TYPE_FILE)
+		if (plugin->type != REMMINA_PLUGIN_TYPE_FILE || g_hash_table_contains(remmina_plugin_stubs, plugin))
 			continue;
 
 		if (plugin->import_test_func(file))
@@ -340,10 +695,11 @@ RemminaFilePlugin* remmina_plugin_manager_get_export_file_handler(RemminaFile *r
 	RemminaFilePlugin *plugin;
 	gint i;
 
+	remmina_plugin_manager_open_type(REMMINA_PLUGIN_TYPE_FILE);
 	for (i = 0; i < remmina_plugin_table->len; i++)
 	{
 		plugin = (RemminaFilePlugin *) g_ptr_array_index(remmina_plugin_table, i);
-		if (plugin->type != REMMINA_PLUGIN_TYPE_FILE)
+		if (plugin->type != REMMINA_PLUGIN_TYPE_FILE || g_hash_table_contains(remmina_plugin_stubs, plugin))
 			continue;
 		if (plugin->export_test_func(remminafile))
 		{
@@ -43,8 +43,12 @@ G_BEGIN_DECLS
 typedef gboolean (*RemminaPluginFunc)(gchar *name, RemminaPlugin *plugin, gpointer data);
 
 void remmina_plugin_manager_init(void);
+/* Opens the module of the plugin when it is only known from the manifest */
 RemminaPlugin* remmina_plugin_manager_get_plugin(RemminaPluginType type, const gchar *name);
+/* Never opens a module: only the descriptive fields of the plugin are valid */
+RemminaPlugin* remmina_plugin_manager_get_plugin_info(RemminaPluginType type, const gchar *name);
 gboolean remmina_plugin_manager_query_feature_by_type(RemminaPluginType ptype, const gchar* name, RemminaProtocolFeatureType ftype);
+/* Never opens a module, see remmina_plugin_manager_get_plugin_info() */
 void remmina_plugin_manager_for_each_plugin(RemminaPluginType type, RemminaPluginFunc func, gpointer data);
 void remmina_plugin_manager_show(GtkWindow *parent);
 RemminaFilePlugin* remmina_plugin_manager_get_import_file_handler(const gchar *file);
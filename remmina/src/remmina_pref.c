@@ -37,6 +37,7 @@
 #include <gdk/gdkkeysyms.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "remmina_string_array.h"
 #include "remmina_pref.h"
 #include "remmina/remmina_trace_calls.h"
@@ -49,6 +50,107 @@ RemminaPref remmina_pref;
 gchar *remmina_keymap_file;
 static GHashTable *remmina_keymap_table = NULL;
 
+/* Parsed content of remmina_pref_file, serving all the reads. Changes are
+ * written back by remmina_pref_flush() after REMMINA_PREF_FLUSH_DELAY ms,
+ * so that bursts of changes only rewrite the file once. Plugins may use
+ * remmina_pref_set_value() from their own threads, which may run with
+ * asynchronous cancellation: the lock is only taken there with cancellation
+ * deferred, or a cancelled thread would leave it locked forever. */
+#define REMMINA_PREF_FLUSH_DELAY 500
+static GKeyFile *remmina_pref_keyfile = NULL;
+static gchar *remmina_pref_file_content = NULL;
+static gboolean remmina_pref_dirty = FALSE;
+static guint remmina_pref_flush_source = 0;
+static GFileMonitor *remmina_pref_monitor = NULL;
+/* Counts the changes of remmina_pref_keyfile, for caches of its content */
+static gint remmina_pref_serial = 0;
+G_LOCK_DEFINE_STATIC(remmina_pref);
+
+static gboolean remmina_pref_flush_timeout(gpointer data)
+{
+	TRACE_CALL("remmina_pref_flush_timeout");
+	G_LOCK(remmina_pref);
+	remmina_pref_flush_source = 0;
+	G_UNLOCK(remmina_pref);
+	remmina_pref_flush();
+	return FALSE;
+}
+
+/* Must be called with the remmina_pref lock held */
+static void remmina_pref_changed(void)
+{
+	TRACE_CALL("remmina_pref_changed");
+	g_atomic_int_inc(&remmina_pref_serial);
+	remmina_pref_dirty = TRUE;
+	if (!remmina_pref_flush_source)
+		remmina_pref_flush_source = g_timeout_add(REMMINA_PREF_FLUSH_DELAY, remmina_pref_flush_timeout, NULL);
+}
+
+void remmina_pref_flush(void)
+{
+	TRACE_CALL("remmina_pref_flush");
+	gchar *content;
+	gsize length;
+
+	G_LOCK(remmina_pref);
+	if (!remmina_pref_dirty)
+	{
+		G_UNLOCK(remmina_pref);
+		return;
+	}
+	remmina_pref_dirty = FALSE;
+	if (remmina_pref_flush_source)
+	{
+		g_source_remove(remmina_pref_flush_source);
+		remmina_pref_flush_source = 0;
+	}
+	content = g_key_file_to_data(remmina_pref_keyfile, &length, NULL);
+	/* Remembered to tell our own writes from external edits */
+	g_free(remmina_pref_file_content);
+	remmina_pref_file_content = g_strdup(content);
+	G_UNLOCK(remmina_pref);
+
+	/* Written to a temporary file renamed over the old one */
+	g_file_set_contents(remmina_pref_file, content, length, NULL);
+	g_free(content);
+}
+
+static void remmina_pref_on_file_changed(GFileMonitor *monitor, GFile *file, GFile *other_file,
+		GFileMonitorEvent event_type, gpointer data)
+{
+	TRACE_CALL("remmina_pref_on_file_changed");
+	GKeyFile *gkeyfile;
+	gchar *content;
+	gsize length;
+
+	if (event_type != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT && event_type != G_FILE_MONITOR_EVENT_CREATED)
+		return;
+	if (!g_file_get_contents(remmina_pref_file, &content, &length, NULL))
+		return;
+
+	G_LOCK(remmina_pref);
+	/* Pending changes win over the external edit, they will overwrite it */
+	if (!remmina_pref_dirty && g_strcmp0(content, remmina_pref_file_content) != 0)
+	{
+		gkeyfile = g_key_file_new();
+		if (g_key_file_load_from_data(gkeyfile, content, length, G_KEY_FILE_NONE, NULL))
+		{
+			g_key_file_free(remmina_pref_keyfile);
+			remmina_pref_keyfile = gkeyfile;
+			g_atomic_int_inc(&remmina_pref_serial);
+			g_free(remmina_pref_file_content);
+			remmina_pref_file_content = content;
+			content = NULL;
+		}
+		else
+		{
+			g_key_file_free(gkeyfile);
+		}
+	}
+	G_UNLOCK(remmina_pref);
+	g_free(content);
+}
+
 /* We could customize this further if there are more requirements */
 static const gchar *default_keymap_data = "# Please check gdk/gdkkeysyms.h for a full list of all key names or hex key values\n"
 		"\n"
@@ -64,9 +166,6 @@ static void remmina_pref_gen_secret(void)
 	guchar s[32];
 	gint i;
 	GTimeVal gtime;
-	GKeyFile *gkeyfile;
-	gchar *content;
-	gsize length;
 
 	g_get_current_time(&gtime);
 	srand(gtime.tv_sec);
@@ -77,14 +176,10 @@ static void remmina_pref_gen_secret(void)
 	}
 	remmina_pref.secret = g_base64_encode(s, 32);
 
-	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	g_key_file_set_string(gkeyfile, "remmina_pref", "secret", remmina_pref.secret);
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	G_LOCK(remmina_pref);
+	g_key_file_set_string(remmina_pref_keyfile, "remmina_pref", "secret", remmina_pref.secret);
+	remmina_pref_changed();
+	G_UNLOCK(remmina_pref);
 }
 
 static guint remmina_pref_get_keyval_from_str(const gchar *str)
@@ -167,12 +262,22 @@ void remmina_pref_init(void)
 {
 	TRACE_CALL("remmina_pref_init");
 	GKeyFile *gkeyfile;
+	GFile *file;
+	gsize length;
 
 	remmina_pref_file = g_strdup_printf("%s/.remmina/remmina.pref", g_get_home_dir());
 	remmina_keymap_file = g_strdup_printf("%s/.remmina/remmina.keymap", g_get_home_dir());
 
 	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
+	if (g_file_get_contents(remmina_pref_file, &remmina_pref_file_content, &length, NULL))
+		g_key_file_load_from_data(gkeyfile, remmina_pref_file_content, length, G_KEY_FILE_NONE, NULL);
+	remmina_pref_keyfile = gkeyfile;
+
+	file = g_file_new_for_path(remmina_pref_file);
+	remmina_pref_monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+	if (remmina_pref_monitor)
+		g_signal_connect(remmina_pref_monitor, "changed", G_CALLBACK(remmina_pref_on_file_changed), NULL);
+	g_object_unref(file);
 
 	if (g_key_file_has_key(gkeyfile, "remmina_pref", "save_view_mode", NULL))
 		remmina_pref.save_view_mode = g_key_file_get_boolean(gkeyfile, "remmina_pref", "save_view_mode", NULL);
@@ -439,8 +544,6 @@ void remmina_pref_init(void)
 	else
 		remmina_pref.vte_shortcutkey_paste = GDK_KEY_v;
 
-	g_key_file_free(gkeyfile);
-
 	if (remmina_pref.secret == NULL)
 		remmina_pref_gen_secret();
 
@@ -451,12 +554,9 @@ void remmina_pref_save(void)
 {
 	TRACE_CALL("remmina_pref_save");
 	GKeyFile *gkeyfile;
-	gchar *content;
-	gsize length;
-
-	gkeyfile = g_key_file_new();
 
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
+	G_LOCK(remmina_pref);
+	gkeyfile = remmina_pref_keyfile;
 
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "save_view_mode", remmina_pref.save_view_mode);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "save_when_connect", remmina_pref.save_when_connect);
@@ -510,33 +610,25 @@ void remmina_pref_save(void)
 	g_key_file_set_string(gkeyfile, "remmina_pref", "vte_foreground_color", remmina_pref.vte_foreground_color ? remmina_pref.vte_foreground_color : "");
 	g_key_file_set_string(gkeyfile, "remmina_pref", "vte_background_color", remmina_pref.vte_background_color ? remmina_pref.vte_background_color : "");
 
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	remmina_pref_changed();
+	G_UNLOCK(remmina_pref);
 }
 
 void remmina_pref_add_recent(const gchar *protocol, const gchar *server)
 {
 	TRACE_CALL("remmina_pref_add_recent");
 	RemminaStringArray *array;
-	GKeyFile *gkeyfile;
 	gchar key[20];
 	gchar *val;
-	gchar *content;
-	gsize length;
 
 	if (remmina_pref.recent_maximum <= 0 || server == NULL || server[0] == 0)
 		return;
 
-	/* Load original value into memory */
-	gkeyfile = g_key_file_new();
-
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
+	G_LOCK(remmina_pref);
 
 	g_snprintf(key, sizeof(key), "recent_%s", protocol);
-	array = remmina_string_array_new_from_allocated_string(g_key_file_get_string(gkeyfile, "remmina_pref", key, NULL));
+	array = remmina_string_array_new_from_allocated_string(
+			g_key_file_get_string(remmina_pref_keyfile, "remmina_pref", key, NULL));
 
 	/* Add the new value */
 	remmina_string_array_remove(array, server);
@@ -548,32 +640,25 @@ void remmina_pref_add_recent(const gchar *protocol, const gchar *server)
 
 	/* Save */
 	val = remmina_string_array_to_string(array);
-	g_key_file_set_string(gkeyfile, "remmina_pref", key, val);
+	g_key_file_set_string(remmina_pref_keyfile, "remmina_pref", key, val);
 	g_free(val);
+	remmina_string_array_free(array);
 
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	remmina_pref_changed();
+	G_UNLOCK(remmina_pref);
 }
 
 gchar*
 remmina_pref_get_recent(const gchar *protocol)
 {
 	TRACE_CALL("remmina_pref_get_recent");
-	GKeyFile *gkeyfile;
 	gchar key[20];
 	gchar *val;
 
-	gkeyfile = g_key_file_new();
-
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-
 	g_snprintf(key, sizeof(key), "recent_%s", protocol);
-	val = g_key_file_get_string(gkeyfile, "remmina_pref", key, NULL);
-
-	g_key_file_free(gkeyfile);
+	G_LOCK(remmina_pref);
+	val = g_key_file_get_string(remmina_pref_keyfile, "remmina_pref", key, NULL);
+	G_UNLOCK(remmina_pref);
 
 	return val;
 }
@@ -581,33 +666,25 @@ remmina_pref_get_recent(const gchar *protocol)
 void remmina_pref_clear_recent(void)
 {
 	TRACE_CALL("remmina_pref_clear_recent");
-	GKeyFile *gkeyfile;
 	gchar **keys;
 	gint i;
-	gchar *content;
-	gsize length;
-
-	gkeyfile = g_key_file_new();
 
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	keys = g_key_file_get_keys(gkeyfile, "remmina_pref", NULL, NULL);
+	G_LOCK(remmina_pref);
+	keys = g_key_file_get_keys(remmina_pref_keyfile, "remmina_pref", NULL, NULL);
 	if (keys)
 	{
 		for (i = 0; keys[i]; i++)
 		{
 			if (strncmp(keys[i], "recent_", 7) == 0)
 			{
-				g_key_file_set_string(gkeyfile, "remmina_pref", keys[i], "");
+				g_key_file_set_string(remmina_pref_keyfile, "remmina_pref", keys[i], "");
 			}
 		}
 		g_strfreev(keys);
 	}
 
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	remmina_pref_changed();
+	G_UNLOCK(remmina_pref);
 }
 
 guint remmina_pref_keymap_get_keyval(const gchar *keymap, guint keyval)
@@ -670,32 +747,92 @@ gint remmina_pref_get_sshtunnel_port(void)
 void remmina_pref_set_value(const gchar *key, const gchar *value)
 {
 	TRACE_CALL("remmina_pref_set_value");
-	GKeyFile *gkeyfile;
-	gchar *content;
-	gsize length;
+	gchar *old_value;
+	gint oldtype;
 
-	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	g_key_file_set_string(gkeyfile, "remmina_pref", key, value);
-	content = g_key_file_to_data(gkeyfile, &length, NULL);
-	g_file_set_contents(remmina_pref_file, content, length, NULL);
-
-	g_key_file_free(gkeyfile);
-	g_free(content);
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+	G_LOCK(remmina_pref);
+	old_value = g_key_file_get_string(remmina_pref_keyfile, "remmina_pref", key, NULL);
+	if (g_strcmp0(old_value, value) != 0)
+	{
+		g_key_file_set_string(remmina_pref_keyfile, "remmina_pref", key, value);
+		remmina_pref_changed();
+	}
+	G_UNLOCK(remmina_pref);
+	pthread_setcanceltype(oldtype, NULL);
+	g_free(old_value);
 }
 
 gchar*
 remmina_pref_get_value(const gchar *key)
 {
 	TRACE_CALL("remmina_pref_get_value");
+	gchar *value;
+	gint oldtype;
+
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+	G_LOCK(remmina_pref);
+	value = g_key_file_get_string(remmina_pref_keyfile, "remmina_pref", key, NULL);
+	G_UNLOCK(remmina_pref);
+	pthread_setcanceltype(oldtype, NULL);
+
+	return value;
+}
+
+guint remmina_pref_get_serial(void)
+{
+	TRACE_CALL("remmina_pref_get_serial");
+	return (guint) g_atomic_int_get(&remmina_pref_serial);
+}
+
+GKeyFile*
+remmina_pref_get_group(const gchar *group, guint *serial)
+{
+	TRACE_CALL("remmina_pref_get_group");
 	GKeyFile *gkeyfile;
+	gchar **keys;
 	gchar *value;
+	gint oldtype;
+	gint i;
 
 	gkeyfile = g_key_file_new();
-	g_key_file_load_from_file(gkeyfile, remmina_pref_file, G_KEY_FILE_NONE, NULL);
-	value = g_key_file_get_string(gkeyfile, "remmina_pref", key, NULL);
-	g_key_file_free(gkeyfile);
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &oldtype);
+	G_LOCK(remmina_pref);
+	keys = (remmina_pref_keyfile ? g_key_file_get_keys(remmina_pref_keyfile, group, NULL, NULL) : NULL);
+	for (i = 0; keys && keys[i]; i++)
+	{
+		value = g_key_file_get_value(remmina_pref_keyfile, group, keys[i], NULL);
+		g_key_file_set_value(gkeyfile, group, keys[i], value);
+		g_free(value);
+	}
+	if (serial)
+		*serial = (guint) g_atomic_int_get(&remmina_pref_serial);
+	G_UNLOCK(remmina_pref);
+	pthread_setcanceltype(oldtype, NULL);
+	g_strfreev(keys);
 
-	return value;
+	return gkeyfile;
+}
+
+void remmina_pref_set_group(const gchar *group, GKeyFile *gkeyfile)
+{
+	TRACE_CALL("remmina_pref_set_group");
+	gchar **keys;
+	gchar *value;
+	gint i;
+
+	keys = g_key_file_get_keys(gkeyfile, group, NULL, NULL);
+	if (!keys)
+		return;
+	G_LOCK(remmina_pref);
+	for (i = 0; keys[i]; i++)
+	{
+		value = g_key_file_get_value(gkeyfile, group, keys[i], NULL);
+		g_key_file_set_value(remmina_pref_keyfile, group, keys[i], value);
+		g_free(value);
+	}
+	remmina_pref_changed();
+	G_UNLOCK(remmina_pref);
+	g_strfreev(keys);
 }
 
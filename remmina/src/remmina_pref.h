@@ -147,6 +147,8 @@ extern RemminaPref remmina_pref;
 
 void remmina_pref_init(void);
 void remmina_pref_save(void);
+/* Write pending changes now, instead of waiting for the debounce timer */
+void remmina_pref_flush(void);
 
 void remmina_pref_add_recent(const gchar *protocol, const gchar *server);
 gchar* remmina_pref_get_recent(const gchar *protocol);
@@ -160,6 +162,13 @@ gint remmina_pref_get_sshtunnel_port(void);
 
 void remmina_pref_set_value(const gchar *key, const gchar *value);
 gchar* remmina_pref_get_value(const gchar *key);
+/* Changes whenever the preferences change, in memory or by an external edit */
+guint remmina_pref_get_serial(void);
+/* Copy of a group of the preferences, with the serial it matches */
+GKeyFile* remmina_pref_get_group(const gchar *group, guint *serial);
+/* Copy the keys of a group of gkeyfile over the preferences, written with the
+ * next flush. Used for the [remmina] group holding the defaults of new files */
+void remmina_pref_set_group(const gchar *group, GKeyFile *gkeyfile);
 
 G_END_DECLS
 
@@ -296,7 +296,9 @@ static gboolean remmina_pref_dialog_add_pref_plugin(gchar *name, RemminaPlugin *
 	GtkWidget *widget;
 
 	priv = REMMINA_PREF_DIALOG(data)->priv;
-	pref_plugin = (RemminaPrefPlugin *) plugin;
+	pref_plugin = (RemminaPrefPlugin *) remmina_plugin_manager_get_plugin(REMMINA_PLUGIN_TYPE_PREF, name);
+	if (!pref_plugin)
+		return FALSE;
 
 	widget = gtk_label_new(pref_plugin->pref_label);
 	gtk_widget_show(widget);
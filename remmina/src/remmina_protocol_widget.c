@@ -45,6 +45,7 @@
 #include "remmina_connection_window.h"
 #include "remmina_protocol_widget.h"
 #include "remmina_masterthread_exec.h"
+#include "remmina_stats.h"
 #include "remmina/remmina_trace_calls.h"
 
 struct _RemminaProtocolWidgetPriv
@@ -68,9 +69,12 @@ struct _RemminaProtocolWidgetPriv
 	GtkWidget* chat_window;
 
 	gboolean closed;
+	gboolean hidden;
 
 	RemminaHostkeyFunc hostkey_func;
 	gpointer hostkey_func_data;
+
+	RemminaStats* stats;
 };
 
 G_DEFINE_TYPE(RemminaProtocolWidget, remmina_protocol_widget, GTK_TYPE_EVENT_BOX)
@@ -147,6 +151,7 @@ static void remmina_protocol_widget_destroy(RemminaProtocolWidget* gp, gpointer
 	remmina_protocol_widget_hide_init_dialog(gp);
 	g_free(gp->priv->features);
 	g_free(gp->priv->error_message);
+	remmina_stats_free(gp->priv->stats);
 	g_free(gp->priv);
 }
 
@@ -166,6 +171,11 @@ static void remmina_protocol_widget_disconnect(RemminaProtocolWidget* gp, gpoint
 {
 	TRACE_CALL("remmina_protocol_widget_disconnect");
 	remmina_protocol_widget_hide_init_dialog(gp);
+	if (gp->priv->remmina_file)
+	{
+		remmina_stats_dump(gp->priv->stats, remmina_file_get_string(gp->priv->remmina_file, "name"),
+				remmina_file_get_string(gp->priv->remmina_file, "protocol"));
+	}
 }
 
 void remmina_protocol_widget_grab_focus(RemminaProtocolWidget* gp)
@@ -188,6 +198,7 @@ static void remmina_protocol_widget_init(RemminaProtocolWidget* gp)
 	RemminaProtocolWidgetPriv *priv;
 
 	priv = g_new0(RemminaProtocolWidgetPriv, 1);
+	priv->stats = remmina_stats_new();
 	gp->priv = priv;
 
 	g_signal_connect(G_OBJECT(gp), "destroy", G_CALLBACK(remmina_protocol_widget_destroy), NULL);
@@ -600,28 +611,25 @@ gboolean remmina_protocol_widget_ssh_exec(RemminaProtocolWidget* gp, gboolean wa
 	TRACE_CALL("remmina_protocol_widget_ssh_exec");
 #ifdef HAVE_LIBSSH
 		RemminaSSHTunnel *tunnel = gp->priv->ssh_tunnel;
+		RemminaSSHExecBatch *batch;
+		RemminaSSHExec *exec;
 		ssh_channel channel;
 		gint status;
 		gboolean ret = FALSE;
 		gchar *cmd, *ptr;
 		va_list args;
 
-		if ((channel = channel_new (REMMINA_SSH (tunnel)->session)) == NULL)
-		{
-			return FALSE;
-		}
-
 		va_start (args, fmt);
 		cmd = g_strdup_vprintf (fmt, args);
 		va_end (args);
 
-		if (channel_open_session (channel) == SSH_OK &&
-				channel_request_exec (channel, cmd) == SSH_OK)
+		if (wait)
 		{
-			if (wait)
+			batch = remmina_ssh_exec_batch_new (REMMINA_SSH (tunnel));
+			exec = remmina_ssh_exec_batch_add (batch, cmd, NULL, NULL);
+			if (remmina_ssh_exec_batch_run (batch))
 			{
-				channel_send_eof (channel);
-				status = channel_get_exit_status (channel);
+				status = remmina_ssh_exec_get_status (exec);
 				ptr = strchr (cmd, ' ');
 				if (ptr) *ptr = '\0';
 				switch (status)
@@ -636,27 +644,119 @@ gboolean remmina_protocol_widget_ssh_exec(RemminaProtocolWidget* gp, gboolean wa
 					default:
 					remmina_ssh_set_application_error (REMMINA_SSH (tunnel),
 							_("Command %s failed on SSH server (status = %i)."), cmd,status);
-                break;
-            }
-        }
-        else
-        {
-            ret = TRUE;
-        }
-    }
-    else
-    {
-        remmina_ssh_set_error (REMMINA_SSH (tunnel), _("Failed to execute command: %s"));
-    }
-    g_free(cmd);
-    if (wait) channel_close (channel);
-    channel_free (channel);
-    return ret;
+					break;
+				}
+			}
+			remmina_ssh_exec_batch_free (batch);
+			g_free(cmd);
+			return ret;
+		}
+
+		if ((channel = channel_new (REMMINA_SSH (tunnel)->session)) == NULL)
+		{
+			g_free(cmd);
+			return FALSE;
+		}
+
+		if (channel_open_session (channel) == SSH_OK &&
+				channel_request_exec (channel, cmd) == SSH_OK)
+		{
+			ret = TRUE;
+		}
+		else
+		{
+			remmina_ssh_set_error (REMMINA_SSH (tunnel), _("Failed to execute command: %s"));
+		}
+		g_free(cmd);
+		channel_free (channel);
+		return ret;
+
+#else
+
+		return FALSE;
+
+#endif
+}
 
+RemminaSSHExecBatch* remmina_protocol_widget_ssh_exec_batch_new(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL("remmina_protocol_widget_ssh_exec_batch_new");
+#ifdef HAVE_LIBSSH
+	if (!gp->priv->ssh_tunnel)
+		return NULL;
+	return remmina_ssh_exec_batch_new (REMMINA_SSH (gp->priv->ssh_tunnel));
 #else
+	return NULL;
+#endif
+}
+
+RemminaSSHExec* remmina_protocol_widget_ssh_exec_batch_add(RemminaSSHExecBatch *batch, RemminaSSHExecOutputFunc output_func,
+		gpointer data, const gchar *fmt, ...)
+{
+	TRACE_CALL("remmina_protocol_widget_ssh_exec_batch_add");
+#ifdef HAVE_LIBSSH
+	RemminaSSHExec *exec;
+	gchar *cmd;
+	va_list args;
 
-    return FALSE;
+	va_start (args, fmt);
+	cmd = g_strdup_vprintf (fmt, args);
+	va_end (args);
 
+	exec = remmina_ssh_exec_batch_add (batch, cmd, output_func, data);
+	g_free(cmd);
+	return exec;
+#else
+	return NULL;
+#endif
+}
+
+gboolean remmina_protocol_widget_ssh_exec_batch_run(RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_protocol_widget_ssh_exec_batch_run");
+#ifdef HAVE_LIBSSH
+	return remmina_ssh_exec_batch_run (batch);
+#else
+	return FALSE;
+#endif
+}
+
+gboolean remmina_protocol_widget_ssh_exec_batch_start(RemminaSSHExecBatch *batch, RemminaSSHExecBatchFunc done_func,
+		gpointer data)
+{
+	TRACE_CALL("remmina_protocol_widget_ssh_exec_batch_start");
+#ifdef HAVE_LIBSSH
+	return remmina_ssh_exec_batch_start (batch, done_func, data);
+#else
+	return FALSE;
+#endif
+}
+
+gboolean remmina_protocol_widget_ssh_exec_batch_wait(RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_protocol_widget_ssh_exec_batch_wait");
+#ifdef HAVE_LIBSSH
+	return remmina_ssh_exec_batch_wait (batch);
+#else
+	return FALSE;
+#endif
+}
+
+void remmina_protocol_widget_ssh_exec_batch_free(RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_protocol_widget_ssh_exec_batch_free");
+#ifdef HAVE_LIBSSH
+	remmina_ssh_exec_batch_free (batch);
+#endif
+}
+
+gint remmina_protocol_widget_ssh_exec_get_status(RemminaSSHExec *exec)
+{
+	TRACE_CALL("remmina_protocol_widget_ssh_exec_get_status");
+#ifdef HAVE_LIBSSH
+	return remmina_ssh_exec_get_status (exec);
+#else
+	return -1;
 #endif
 }
 
@@ -831,6 +931,46 @@ gboolean remmina_protocol_widget_is_closed(RemminaProtocolWidget* gp)
 	return gp->priv->closed;
 }
 
+void remmina_protocol_widget_set_visible(RemminaProtocolWidget* gp, gboolean visible)
+{
+	TRACE_CALL("remmina_protocol_widget_set_visible");
+	if (gp->priv->hidden == !visible)
+		return;
+	gp->priv->hidden = !visible;
+	if (gp->priv->plugin && !gp->priv->closed)
+		remmina_protocol_widget_call_feature_by_type(gp, REMMINA_PROTOCOL_FEATURE_TYPE_VISIBILITY, 0);
+}
+
+gboolean remmina_protocol_widget_is_visible(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL("remmina_protocol_widget_is_visible");
+	return !gp->priv->hidden;
+}
+
+RemminaStats* remmina_protocol_widget_get_stats(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL("remmina_protocol_widget_get_stats");
+	return gp->priv->stats;
+}
+
+void remmina_protocol_widget_stats_count(RemminaProtocolWidget* gp, RemminaProtocolStat stat, gint64 delta)
+{
+	TRACE_CALL("remmina_protocol_widget_stats_count");
+	remmina_stats_count(gp->priv->stats, stat, delta);
+}
+
+void remmina_protocol_widget_stats_gauge(RemminaProtocolWidget* gp, RemminaProtocolStat stat, gint64 value)
+{
+	TRACE_CALL("remmina_protocol_widget_stats_gauge");
+	remmina_stats_gauge(gp->priv->stats, stat, value);
+}
+
+void remmina_protocol_widget_stats_sample(RemminaProtocolWidget* gp, RemminaProtocolStat stat, gint64 usec)
+{
+	TRACE_CALL("remmina_protocol_widget_stats_sample");
+	remmina_stats_sample(gp->priv->stats, stat, usec);
+}
+
 RemminaFile* remmina_protocol_widget_get_file(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL("remmina_protocol_widget_get_file");
@@ -1100,10 +1240,9 @@ void remmina_protocol_widget_chat_receive(RemminaProtocolWidget* gp, const gchar
 			RemminaMTExecData *d;
 			d = (RemminaMTExecData*)g_malloc( sizeof(RemminaMTExecData) );
 			d->func = FUNC_CHAT_RECEIVE;
-			d->p.chat_receive.gp = gp;
-			d->p.chat_receive.text = text;
-			remmina_masterthread_exec_and_wait(d);
-			g_free(d);
+			d->p.chat_receive.gp = g_object_ref(gp);
+			d->p.chat_receive.text = g_strdup(text);
+			remmina_masterthread_exec_post(d, NULL);
 			return;
 		}
 		remmina_chat_window_receive(REMMINA_CHAT_WINDOW(gp->priv->chat_window), _("Server"), text);
@@ -39,6 +39,7 @@
 #include "remmina_init_dialog.h"
 #include "remmina_file.h"
 #include "remmina_ssh.h"
+#include "remmina_stats.h"
 
 G_BEGIN_DECLS
 
@@ -90,8 +91,17 @@ gboolean remmina_protocol_widget_has_error(RemminaProtocolWidget *gp);
 gchar* remmina_protocol_widget_get_error_message(RemminaProtocolWidget *gp);
 void remmina_protocol_widget_set_error(RemminaProtocolWidget *gp, const gchar *fmt, ...);
 gboolean remmina_protocol_widget_is_closed(RemminaProtocolWidget *gp);
+/* A session is hidden when its tab is not the current one or its window is iconified */
+void remmina_protocol_widget_set_visible(RemminaProtocolWidget *gp, gboolean visible);
+gboolean remmina_protocol_widget_is_visible(RemminaProtocolWidget *gp);
 RemminaFile* remmina_protocol_widget_get_file(RemminaProtocolWidget *gp);
 
+/* Per-session performance statistics, safe to call from the plugin threads */
+RemminaStats* remmina_protocol_widget_get_stats(RemminaProtocolWidget *gp);
+void remmina_protocol_widget_stats_count(RemminaProtocolWidget *gp, RemminaProtocolStat stat, gint64 delta);
+void remmina_protocol_widget_stats_gauge(RemminaProtocolWidget *gp, RemminaProtocolStat stat, gint64 value);
+void remmina_protocol_widget_stats_sample(RemminaProtocolWidget *gp, RemminaProtocolStat stat, gint64 usec);
+
 void remmina_protocol_widget_open_connection(RemminaProtocolWidget *gp, RemminaFile *remminafile);
 gboolean remmina_protocol_widget_close_connection(RemminaProtocolWidget *gp);
 void remmina_protocol_widget_grab_focus(RemminaProtocolWidget *gp);
@@ -109,6 +119,17 @@ typedef gboolean (*RemminaHostkeyFunc)(RemminaProtocolWidget *gp, guint keyval,
 void remmina_protocol_widget_set_hostkey_func(RemminaProtocolWidget *gp, RemminaHostkeyFunc func, gpointer data);
 
 gboolean remmina_protocol_widget_ssh_exec(RemminaProtocolWidget *gp, gboolean wait, const gchar *fmt, ...);
+/* Batches of remote commands on the SSH tunnel session, see remmina_ssh_exec_batch_new().
+ * Until the batch is over, the tunnel must not relay yet: start it from the tunnel init callback */
+RemminaSSHExecBatch* remmina_protocol_widget_ssh_exec_batch_new(RemminaProtocolWidget *gp);
+RemminaSSHExec* remmina_protocol_widget_ssh_exec_batch_add(RemminaSSHExecBatch *batch, RemminaSSHExecOutputFunc output_func,
+		gpointer data, const gchar *fmt, ...);
+gboolean remmina_protocol_widget_ssh_exec_batch_run(RemminaSSHExecBatch *batch);
+gboolean remmina_protocol_widget_ssh_exec_batch_start(RemminaSSHExecBatch *batch, RemminaSSHExecBatchFunc done_func,
+		gpointer data);
+gboolean remmina_protocol_widget_ssh_exec_batch_wait(RemminaSSHExecBatch *batch);
+void remmina_protocol_widget_ssh_exec_batch_free(RemminaSSHExecBatch *batch);
+gint remmina_protocol_widget_ssh_exec_get_status(RemminaSSHExec *exec);
 
 /* Start a SSH tunnel if it's enabled. Returns a newly allocated string indicating:
  * 1. The actual destination (host:port) if SSH tunnel is disable
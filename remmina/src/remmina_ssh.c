@@ -69,6 +69,7 @@
 #ifdef HAVE_TERMIOS_H
 #include <termios.h>
 #endif
+#include <poll.h>
 #include "remmina_public.h"
 #include "remmina_log.h"
 #include "remmina_ssh.h"
@@ -535,6 +536,335 @@ remmina_ssh_free (RemminaSSH *ssh)
 	g_free(ssh);
 }
 
+/*************************** SSH Exec *********************************/
+
+enum
+{
+	REMMINA_SSH_EXEC_OPENING,
+	REMMINA_SSH_EXEC_REQUESTING,
+	REMMINA_SSH_EXEC_RUNNING,
+	REMMINA_SSH_EXEC_DONE
+};
+
+struct _RemminaSSHExec
+{
+	gchar *cmd;
+	ssh_channel channel;
+	gint state;
+	gint status;
+
+	RemminaSSHExecOutputFunc output_func;
+	gpointer user_data;
+	/* stdout and stderr read with the lock held, passed to output_func
+	 * once it is released */
+	GString *output[2];
+};
+
+struct _RemminaSSHExecBatch
+{
+	RemminaSSH *ssh;
+	GPtrArray *execs;
+
+	pthread_t thread;
+	RemminaSSHExecBatchFunc done_func;
+	gpointer done_data;
+
+	volatile gint cancelled;
+	gboolean ok;
+};
+
+RemminaSSHExecBatch*
+remmina_ssh_exec_batch_new (RemminaSSH *ssh)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_new");
+	RemminaSSHExecBatch *batch;
+
+	batch = g_new0 (RemminaSSHExecBatch, 1);
+	batch->ssh = ssh;
+	batch->execs = g_ptr_array_new ();
+	batch->ok = TRUE;
+	return batch;
+}
+
+RemminaSSHExec*
+remmina_ssh_exec_batch_add (RemminaSSHExecBatch *batch, const gchar *cmd, RemminaSSHExecOutputFunc output_func, gpointer data)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_add");
+	RemminaSSHExec *exec;
+
+	exec = g_new0 (RemminaSSHExec, 1);
+	exec->cmd = g_strdup (cmd);
+	exec->state = REMMINA_SSH_EXEC_OPENING;
+	exec->status = -1;
+	exec->output_func = output_func;
+	exec->user_data = data;
+	exec->output[0] = g_string_new (NULL);
+	exec->output[1] = g_string_new (NULL);
+	g_ptr_array_add (batch->execs, exec);
+	return exec;
+}
+
+static void
+remmina_ssh_exec_finish (RemminaSSHExecBatch *batch, RemminaSSHExec *exec)
+{
+	TRACE_CALL("remmina_ssh_exec_finish");
+	if (exec->status < 0 && exec->state != REMMINA_SSH_EXEC_RUNNING)
+	{
+		/* The command could not be started, the first error is kept */
+		if (batch->ok)
+			remmina_ssh_set_error (batch->ssh, _("Failed to execute command: %s"));
+		batch->ok = FALSE;
+	}
+	if (exec->channel)
+	{
+		channel_close (exec->channel);
+		channel_free (exec->channel);
+		exec->channel = NULL;
+	}
+	exec->state = REMMINA_SSH_EXEC_DONE;
+}
+
+/* Move each command as far as it can go without waiting, with the lock
+ * held. Returns the number of commands not done yet */
+static gint
+remmina_ssh_exec_batch_pump (RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_pump");
+	RemminaSSHExec *exec;
+	gchar buf[16384];
+	gint running = 0;
+	gint ret, len;
+	guint i;
+	gint j;
+
+	for (i = 0; i < batch->execs->len; i++)
+	{
+		exec = (RemminaSSHExec*) g_ptr_array_index (batch->execs, i);
+
+		if (exec->state == REMMINA_SSH_EXEC_OPENING)
+		{
+			ret = channel_open_session (exec->channel);
+			if (ret == SSH_AGAIN)
+			{
+				running++;
+				continue;
+			}
+			if (ret != SSH_OK)
+			{
+				remmina_ssh_exec_finish (batch, exec);
+				continue;
+			}
+			exec->state = REMMINA_SSH_EXEC_REQUESTING;
+		}
+
+		if (exec->state == REMMINA_SSH_EXEC_REQUESTING)
+		{
+			ret = channel_request_exec (exec->channel, exec->cmd);
+			if (ret == SSH_AGAIN)
+			{
+				running++;
+				continue;
+			}
+			if (ret != SSH_OK)
+			{
+				remmina_ssh_exec_finish (batch, exec);
+				continue;
+			}
+			/* The commands get no input */
+			channel_send_eof (exec->channel);
+			exec->state = REMMINA_SSH_EXEC_RUNNING;
+		}
+
+		if (exec->state == REMMINA_SSH_EXEC_RUNNING)
+		{
+			len = 0;
+			for (j = 0; j < 2 && len != SSH_ERROR; j++)
+			{
+				while ((len = channel_poll (exec->channel, j)) > 0)
+				{
+					len = channel_read_nonblocking (exec->channel, buf, MIN (len, (gint) sizeof (buf)), j);
+					if (len <= 0)
+						break;
+					if (exec->output_func)
+						g_string_append_len (exec->output[j], buf, len);
+				}
+			}
+			if (len == SSH_ERROR)
+			{
+				remmina_ssh_exec_finish (batch, exec);
+				continue;
+			}
+			/* The exit status comes after the output, and before the channel is closed */
+			if (channel_is_eof (exec->channel) || channel_is_closed (exec->channel))
+			{
+				exec->status = channel_get_exit_status (exec->channel);
+				if (exec->status >= 0 || channel_is_closed (exec->channel))
+				{
+					remmina_ssh_exec_finish (batch, exec);
+					continue;
+				}
+			}
+			running++;
+		}
+	}
+
+	return running;
+}
+
+/* Pass the output read by the last pump, without the lock */
+static void
+remmina_ssh_exec_batch_dispatch (RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_dispatch");
+	RemminaSSHExec *exec;
+	guint i;
+	gint j;
+
+	for (i = 0; i < batch->execs->len; i++)
+	{
+		exec = (RemminaSSHExec*) g_ptr_array_index (batch->execs, i);
+		for (j = 0; j < 2; j++)
+		{
+			if (exec->output[j]->len > 0)
+			{
+				exec->output_func (exec, exec->output[j]->str, exec->output[j]->len, j, exec->user_data);
+				g_string_truncate (exec->output[j], 0);
+			}
+		}
+	}
+}
+
+gboolean
+remmina_ssh_exec_batch_run (RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_run");
+	ssh_session session = batch->ssh->session;
+	RemminaSSHExec *exec;
+	struct pollfd fds;
+	gint running;
+	guint i;
+
+	LOCK_SSH (batch->ssh)
+	for (i = 0; i < batch->execs->len; i++)
+	{
+		exec = (RemminaSSHExec*) g_ptr_array_index (batch->execs, i);
+		if (exec->state != REMMINA_SSH_EXEC_OPENING)
+			continue;
+		if ((exec->channel = channel_new (session)) == NULL)
+			remmina_ssh_exec_finish (batch, exec);
+	}
+	/* Requests are sent without waiting for the replies */
+	ssh_set_blocking (session, 0);
+	UNLOCK_SSH (batch->ssh)
+
+	while (!g_atomic_int_get (&batch->cancelled))
+	{
+		LOCK_SSH (batch->ssh)
+		running = remmina_ssh_exec_batch_pump (batch);
+		UNLOCK_SSH (batch->ssh)
+
+		remmina_ssh_exec_batch_dispatch (batch);
+		if (running == 0)
+			break;
+
+		/* Bounded, as libssh may have buffered output waiting to be sent */
+		fds.fd = ssh_get_fd (session);
+		fds.events = POLLIN;
+		poll (&fds, 1, 100);
+	}
+
+	LOCK_SSH (batch->ssh)
+	for (i = 0; i < batch->execs->len; i++)
+	{
+		exec = (RemminaSSHExec*) g_ptr_array_index (batch->execs, i);
+		if (exec->state != REMMINA_SSH_EXEC_DONE)
+		{
+			/* Cancelled */
+			exec->status = -1;
+			exec->state = REMMINA_SSH_EXEC_RUNNING;
+			remmina_ssh_exec_finish (batch, exec);
+		}
+	}
+	ssh_set_blocking (session, 1);
+	UNLOCK_SSH (batch->ssh)
+
+	return batch->ok;
+}
+
+static gpointer
+remmina_ssh_exec_batch_thread (gpointer data)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_thread");
+	RemminaSSHExecBatch *batch = (RemminaSSHExecBatch*) data;
+
+	remmina_ssh_exec_batch_run (batch);
+	if (batch->done_func)
+		(*batch->done_func) (batch, batch->done_data);
+	return NULL;
+}
+
+gboolean
+remmina_ssh_exec_batch_start (RemminaSSHExecBatch *batch, RemminaSSHExecBatchFunc done_func, gpointer data)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_start");
+	batch->done_func = done_func;
+	batch->done_data = data;
+	if (pthread_create (&batch->thread, NULL, remmina_ssh_exec_batch_thread, batch))
+	{
+		batch->thread = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean
+remmina_ssh_exec_batch_wait (RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_wait");
+	if (batch->thread)
+	{
+		pthread_join (batch->thread, NULL);
+		batch->thread = 0;
+	}
+	return batch->ok;
+}
+
+void
+remmina_ssh_exec_batch_free (RemminaSSHExecBatch *batch)
+{
+	TRACE_CALL("remmina_ssh_exec_batch_free");
+	RemminaSSHExec *exec;
+	guint i;
+
+	g_atomic_int_set (&batch->cancelled, 1);
+	remmina_ssh_exec_batch_wait (batch);
+
+	for (i = 0; i < batch->execs->len; i++)
+	{
+		exec = (RemminaSSHExec*) g_ptr_array_index (batch->execs, i);
+		g_free(exec->cmd);
+		g_string_free (exec->output[0], TRUE);
+		g_string_free (exec->output[1], TRUE);
+		g_free(exec);
+	}
+	g_ptr_array_free (batch->execs, TRUE);
+	g_free(batch);
+}
+
+gint
+remmina_ssh_exec_get_status (RemminaSSHExec *exec)
+{
+	TRACE_CALL("remmina_ssh_exec_get_status");
+	return exec->status;
+}
+
+const gchar*
+remmina_ssh_exec_get_command (RemminaSSHExec *exec)
+{
+	TRACE_CALL("remmina_ssh_exec_get_command");
+	return exec->cmd;
+}
+
 /*************************** SSH Tunnel *********************************/
 struct _RemminaSSHTunnelBuffer
 {
@@ -1359,14 +1689,8 @@ remmina_ssh_shell_thread (gpointer data)
 {
 	TRACE_CALL("remmina_ssh_shell_thread");
 	RemminaSSHShell *shell = (RemminaSSHShell*) data;
-	fd_set fds;
-	struct timeval timeout;
 	ssh_channel channel = NULL;
-	ssh_channel ch[2], chout[2];
-	gchar *buf = NULL;
-	gint buf_len;
-	gint len;
-	gint i, ret;
+	gint ret;
 
 	LOCK_SSH (shell)
 
@@ -1403,64 +1727,7 @@ remmina_ssh_shell_thread (gpointer data)
 
 	UNLOCK_SSH (shell)
 
-	buf_len = 1000;
-	buf = g_malloc (buf_len + 1);
-
-	ch[0] = channel;
-	ch[1] = NULL;
-
-	while (!shell->closed)
-	{
-		timeout.tv_sec = 1;
-		timeout.tv_usec = 0;
-
-		FD_ZERO (&fds);
-		FD_SET (shell->master, &fds);
-
-		ret = ssh_select (ch, chout, shell->master + 1, &fds, &timeout);
-		if (ret == SSH_EINTR) continue;
-		if (ret == -1) break;
-
-		if (FD_ISSET (shell->master, &fds))
-		{
-			len = read (shell->master, buf, buf_len);
-			if (len <= 0) break;
-			LOCK_SSH (shell)
-			channel_write (channel, buf, len);
-			UNLOCK_SSH (shell)
-		}
-		for (i = 0; i < 2; i++)
-		{
-			LOCK_SSH (shell)
-			len = channel_poll (channel, i);
-			UNLOCK_SSH (shell)
-			if (len == SSH_ERROR || len == SSH_EOF)
-			{
-				shell->closed = TRUE;
-				break;
-			}
-			if (len <= 0) continue;
-			if (len > buf_len)
-			{
-				buf_len = len;
-				buf = (gchar*) g_realloc (buf, buf_len + 1);
-			}
-			LOCK_SSH (shell)
-			len = channel_read_nonblocking (channel, buf, len, i);
-			UNLOCK_SSH (shell)
-			if (len <= 0)
-			{
-				shell->closed = TRUE;
-				break;
-			}
-			while (len > 0)
-			{
-				ret = write (shell->master, buf, len);
-				if (ret <= 0) break;
-				len -= ret;
-			}
-		}
-	}
+	remmina_ssh_pty_relay_run (shell->relay, REMMINA_SSH (shell)->session, channel);
 
 	LOCK_SSH (shell)
 	shell->channel = NULL;
@@ -1468,7 +1735,6 @@ remmina_ssh_shell_thread (gpointer data)
 	channel_free (channel);
 	UNLOCK_SSH (shell)
 
-	g_free(buf);
 	shell->thread = 0;
 
 	if ( shell->exit_callback )
@@ -1503,6 +1769,13 @@ remmina_ssh_shell_open (RemminaSSHShell *shell, RemminaSSHExitFunc exit_callback
 	stermios.c_iflag &= ~(ICRNL);
 	tcsetattr (shell->slave, TCSANOW, &stermios);
 
+	shell->relay = remmina_ssh_pty_relay_new (shell->master, &REMMINA_SSH (shell)->ssh_mutex);
+	if (!shell->relay)
+	{
+		REMMINA_SSH (shell)->error = g_strdup ("Failed to create pipe.");
+		return FALSE;
+	}
+
 	shell->exit_callback = exit_callback;
 	shell->user_data = data;
 
@@ -1516,12 +1789,12 @@ void
 remmina_ssh_shell_set_size (RemminaSSHShell *shell, gint columns, gint rows)
 {
 	TRACE_CALL("remmina_ssh_shell_set_size");
-	LOCK_SSH (shell)
-	if (shell->channel)
+	/* Applied by the shell thread with its next batch, so the terminal
+	 * never waits for the session lock */
+	if (shell->relay)
 	{
-		channel_change_pty_size (shell->channel, columns, rows);
+		remmina_ssh_pty_relay_set_size (shell->relay, columns, rows);
 	}
-	UNLOCK_SSH (shell)
 }
 
 void
@@ -1533,9 +1806,14 @@ remmina_ssh_shell_free (RemminaSSHShell *shell)
 	shell->exit_callback = NULL;
 	if (thread)
 	{
-		shell->closed = TRUE;
+		remmina_ssh_pty_relay_stop (shell->relay);
 		pthread_join (thread, NULL);
 	}
+	if (shell->relay)
+	{
+		remmina_ssh_pty_relay_free (shell->relay);
+		shell->relay = NULL;
+	}
 	close (shell->master);
 	if (shell->exec)
 	{
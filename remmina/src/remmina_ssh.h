@@ -46,6 +46,7 @@
 #include <pthread.h>
 #include "remmina_file.h"
 #include "remmina_init_dialog.h"
+#include "remmina_ssh_pty_relay.h"
 
 G_BEGIN_DECLS
 
@@ -101,6 +102,39 @@ gchar* remmina_ssh_unconvert (RemminaSSH *ssh, const gchar *from);
 
 void remmina_ssh_free (RemminaSSH *ssh);
 
+/* -------------------- SSH Exec ----------------------- */
+
+/* Commands of a batch run over their own channels of the same session.
+ * All the channels are opened and the commands requested without waiting
+ * for each reply in turn, so their round trips overlap.
+ * While a batch runs, other threads may only use the session with
+ * ssh_mutex held, which the tunnel relay does not do. */
+
+RemminaSSHExecBatch* remmina_ssh_exec_batch_new (RemminaSSH *ssh);
+
+/* Queue a command. Its output goes to output_func, or is discarded if NULL */
+RemminaSSHExec* remmina_ssh_exec_batch_add (RemminaSSHExecBatch *batch, const gchar *cmd,
+		RemminaSSHExecOutputFunc output_func, gpointer data);
+
+/* Run the commands in the calling thread, until all of them are over.
+ * Returns FALSE if one of them could not be started */
+gboolean remmina_ssh_exec_batch_run (RemminaSSHExecBatch *batch);
+
+/* Run the commands in a new thread. done_func, if any, is called from
+ * that thread once all of them are over */
+gboolean remmina_ssh_exec_batch_start (RemminaSSHExecBatch *batch, RemminaSSHExecBatchFunc done_func, gpointer data);
+
+/* Wait for the thread of remmina_ssh_exec_batch_start(). Same result as
+ * remmina_ssh_exec_batch_run() */
+gboolean remmina_ssh_exec_batch_wait (RemminaSSHExecBatch *batch);
+
+/* Stop the commands still running, and free the batch with its commands */
+void remmina_ssh_exec_batch_free (RemminaSSHExecBatch *batch);
+
+/* The exit status of the command, -1 if it did not complete */
+gint remmina_ssh_exec_get_status (RemminaSSHExec *exec);
+const gchar* remmina_ssh_exec_get_command (RemminaSSHExec *exec);
+
 /* ------------------- SSH Tunnel ---------------------- */
 typedef struct _RemminaSSHTunnel RemminaSSHTunnel;
 typedef struct _RemminaSSHTunnelBuffer RemminaSSHTunnelBuffer;
@@ -220,7 +254,7 @@ typedef struct _RemminaSSHShell
 	gchar *exec;
 	pthread_t thread;
 	ssh_channel channel;
-	gboolean closed;
+	RemminaSSHPtyRelay *relay;
 	RemminaSSHExitFunc exit_callback;
 	gpointer user_data;
 }RemminaSSHShell;
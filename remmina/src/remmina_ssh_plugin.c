@@ -153,11 +153,10 @@ void remmina_plugin_ssh_vte_terminal_set_encoding_and_pty(VteTerminal *terminal,
 		RemminaMTExecData *d;
 		d = (RemminaMTExecData*)g_malloc( sizeof(RemminaMTExecData) );
 		d->func = FUNC_VTE_TERMINAL_SET_ENCODING_AND_PTY;
-		d->p.vte_terminal_set_encoding_and_pty.terminal = terminal;
-		d->p.vte_terminal_set_encoding_and_pty.codeset = codeset;
+		d->p.vte_terminal_set_encoding_and_pty.terminal = g_object_ref(terminal);
+		d->p.vte_terminal_set_encoding_and_pty.codeset = g_strdup(codeset);
 		d->p.vte_terminal_set_encoding_and_pty.slave = slave;
-		remmina_masterthread_exec_and_wait(d);
-		g_free(d);
+		remmina_masterthread_exec_post(d, NULL);
 		return;
 	}
 
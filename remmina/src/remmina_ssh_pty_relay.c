@@ -0,0 +1,265 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+
+#ifdef HAVE_LIBSSH
+
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include "remmina_ssh_pty_relay.h"
+#include "remmina/remmina_trace_calls.h"
+
+/* Keystrokes waiting for the remote window */
+#define REMMINA_SSH_PTY_RELAY_INPUT_SIZE (32 * 1024)
+/* The output buffer grows with what the channel has pending, which is
+ * bounded by the local window */
+#define REMMINA_SSH_PTY_RELAY_OUTPUT_MIN (32 * 1024)
+#define REMMINA_SSH_PTY_RELAY_OUTPUT_MAX (2 * 1024 * 1024)
+/* libssh may hold data the socket does not show anymore, so the poll
+ * never waits forever */
+#define REMMINA_SSH_PTY_RELAY_TIMEOUT 1000
+
+struct _RemminaSSHPtyRelay
+{
+	gint master;
+	pthread_mutex_t *lock;
+
+	gchar *in;
+	gsize in_len;
+
+	/* Channel output of the current batch */
+	gchar *out;
+	gsize out_len;
+	gsize out_size;
+
+	/* (columns << 16) | rows of a resize not applied yet, 0 if none */
+	volatile gint pending_size;
+	/* Written to wake up the poll */
+	gint wakeup[2];
+	volatile gint stopped;
+	gboolean error;
+};
+
+static void remmina_ssh_pty_relay_wakeup(RemminaSSHPtyRelay *relay)
+{
+	TRACE_CALL("remmina_ssh_pty_relay_wakeup");
+	if (write(relay->wakeup[1], "", 1) < 0)
+	{
+		/* The pipe is full, the relay is being woken up anyway */
+	}
+}
+
+RemminaSSHPtyRelay* remmina_ssh_pty_relay_new(gint master, pthread_mutex_t *lock)
+{
+	TRACE_CALL("remmina_ssh_pty_relay_new");
+	RemminaSSHPtyRelay *relay;
+
+	relay = g_new0(RemminaSSHPtyRelay, 1);
+	relay->master = master;
+	relay->lock = lock;
+
+	if (pipe(relay->wakeup) != 0)
+	{
+		g_free(relay);
+		return NULL;
+	}
+	fcntl(relay->wakeup[0], F_SETFL, fcntl(relay->wakeup[0], F_GETFL) | O_NONBLOCK);
+	fcntl(relay->wakeup[1], F_SETFL, fcntl(relay->wakeup[1], F_GETFL) | O_NONBLOCK);
+
+	relay->in = g_malloc(REMMINA_SSH_PTY_RELAY_INPUT_SIZE);
+	relay->out_size = REMMINA_SSH_PTY_RELAY_OUTPUT_MIN;
+	relay->out = g_malloc(relay->out_size);
+
+	return relay;
+}
+
+void remmina_ssh_pty_relay_free(RemminaSSHPtyRelay *relay)
+{
+	TRACE_CALL("remmina_ssh_pty_relay_free");
+	close(relay->wakeup[0]);
+	close(relay->wakeup[1]);
+	g_free(relay->in);
+	g_free(relay->out);
+	g_free(relay);
+}
+
+void remmina_ssh_pty_relay_set_size(RemminaSSHPtyRelay *relay, gint columns, gint rows)
+{
+	TRACE_CALL("remmina_ssh_pty_relay_set_size");
+	/* Only the last size matters, the previous ones are overwritten */
+	g_atomic_int_set(&relay->pending_size,
+			(CLAMP(columns, 1, 0x7fff) << 16) | CLAMP(rows, 1, 0xffff));
+	remmina_ssh_pty_relay_wakeup(relay);
+}
+
+void remmina_ssh_pty_relay_stop(RemminaSSHPtyRelay *relay)
+{
+	TRACE_CALL("remmina_ssh_pty_relay_stop");
+	g_atomic_int_set(&relay->stopped, 1);
+	remmina_ssh_pty_relay_wakeup(relay);
+}
+
+/* The part of a batch which needs the session, called with the lock held.
+ * Returns FALSE once the channel is closed. more is set when the output
+ * buffer is full before the channel is drained */
+static gboolean remmina_ssh_pty_relay_batch(RemminaSSHPtyRelay *relay, ssh_channel channel, gboolean *more)
+{
+	TRACE_CALL("remmina_ssh_pty_relay_batch");
+	guint size;
+	uint32_t window;
+	gint len;
+	gint i;
+
+	*more = FALSE;
+
+	size = g_atomic_int_and((volatile guint*) &relay->pending_size, 0);
+	if (size)
+		channel_change_pty_size(channel, size >> 16, size & 0xffff);
+
+	if (relay->in_len > 0 && (window = ssh_channel_window_size(channel)) > 0)
+	{
+		len = channel_write(channel, relay->in, MIN(relay->in_len, window));
+		if (len == SSH_ERROR)
+		{
+			relay->error = TRUE;
+			return FALSE;
+		}
+		relay->in_len -= len;
+		memmove(relay->in, relay->in + len, relay->in_len);
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		while ((len = channel_poll(channel, i)) > 0)
+		{
+			if (relay->out_len + len > relay->out_size && relay->out_size < REMMINA_SSH_PTY_RELAY_OUTPUT_MAX)
+			{
+				relay->out_size = MIN(MAX(relay->out_size * 2, relay->out_len + len), REMMINA_SSH_PTY_RELAY_OUTPUT_MAX);
+				relay->out = (gchar*) g_realloc(relay->out, relay->out_size);
+			}
+			if (relay->out_len == relay->out_size)
+			{
+				*more = TRUE;
+				break;
+			}
+			len = channel_read_nonblocking(channel, relay->out + relay->out_len,
+					MIN((gsize) len, relay->out_size - relay->out_len), i);
+			if (len <= 0)
+				break;
+			relay->out_len += len;
+		}
+		if (len == SSH_ERROR)
+			relay->error = TRUE;
+		if (len == SSH_ERROR || len == SSH_EOF)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+gboolean remmina_ssh_pty_relay_run(RemminaSSHPtyRelay *relay, ssh_session session, ssh_channel channel)
+{
+	TRACE_CALL("remmina_ssh_pty_relay_run");
+	struct pollfd fds[3];
+	gboolean alive = TRUE;
+	gboolean more = FALSE;
+	gchar buf[16];
+	gsize done;
+	ssize_t n;
+
+	while (alive && !g_atomic_int_get(&relay->stopped))
+	{
+		fds[0].fd = ssh_get_fd(session);
+		fds[0].events = POLLIN;
+		/* Stop reading keystrokes while the remote window is closed */
+		fds[1].fd = relay->master;
+		fds[1].events = (relay->in_len < REMMINA_SSH_PTY_RELAY_INPUT_SIZE ? POLLIN : 0);
+		fds[2].fd = relay->wakeup[0];
+		fds[2].events = POLLIN;
+
+		if (poll(fds, 3, (more ? 0 : REMMINA_SSH_PTY_RELAY_TIMEOUT)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			relay->error = TRUE;
+			break;
+		}
+		if (fds[2].revents & POLLIN)
+		{
+			while (read(relay->wakeup[0], buf, sizeof(buf)) > 0);
+		}
+		if ((fds[1].events & POLLIN) && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)))
+		{
+			n = read(relay->master, relay->in + relay->in_len, REMMINA_SSH_PTY_RELAY_INPUT_SIZE - relay->in_len);
+			/* The terminal went away */
+			if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN))
+				break;
+			if (n > 0)
+				relay->in_len += n;
+		}
+
+		if (relay->lock)
+			pthread_mutex_lock(relay->lock);
+		alive = remmina_ssh_pty_relay_batch(relay, channel, &more);
+		if (relay->lock)
+			pthread_mutex_unlock(relay->lock);
+
+		/* The whole batch in as few writes as the PTY accepts */
+		done = 0;
+		while (done < relay->out_len)
+		{
+			n = write(relay->master, relay->out + done, relay->out_len - done);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+			{
+				alive = FALSE;
+				break;
+			}
+			done += n;
+		}
+		relay->out_len = 0;
+	}
+
+	return !relay->error;
+}
+
+#endif /* HAVE_LIBSSH */
+
@@ -0,0 +1,75 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINASSHPTYRELAY_H__
+#define __REMMINASSHPTYRELAY_H__
+
+#include "config.h"
+
+#ifdef HAVE_LIBSSH
+
+#include <glib.h>
+#include <pthread.h>
+#include <libssh/libssh.h>
+
+G_BEGIN_DECLS
+
+/* Relay between an interactive SSH channel and the master side of a PTY.
+ * Each wake up is handled as one batch under the session lock: pending
+ * keystrokes are written within the remote window, then everything the
+ * channel has buffered is read at once, and written to the PTY with the
+ * lock released. */
+typedef struct _RemminaSSHPtyRelay RemminaSSHPtyRelay;
+
+/* lock is the mutex of the SSH session, or NULL if it is not shared */
+RemminaSSHPtyRelay* remmina_ssh_pty_relay_new(gint master, pthread_mutex_t *lock);
+void remmina_ssh_pty_relay_free(RemminaSSHPtyRelay *relay);
+
+/* Relay data until the channel is closed, an error occurs or the relay is
+ * stopped. Returns FALSE on error */
+gboolean remmina_ssh_pty_relay_run(RemminaSSHPtyRelay *relay, ssh_session session, ssh_channel channel);
+
+/* These can be called from any thread, without waiting for the session
+ * lock. A size set before remmina_ssh_pty_relay_run() is applied when it
+ * starts */
+void remmina_ssh_pty_relay_set_size(RemminaSSHPtyRelay *relay, gint columns, gint rows);
+void remmina_ssh_pty_relay_stop(RemminaSSHPtyRelay *relay);
+
+G_END_DECLS
+
+#endif /* HAVE_LIBSSH */
+
+#endif  /* __REMMINASSHPTYRELAY_H__  */
+
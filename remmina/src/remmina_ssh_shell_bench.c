@@ -0,0 +1,283 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+/* Throughput benchmark for the SSH shell relay.
+ *
+ * Connects to an SSH server, normally a local sshd, with the public key
+ * auto-detection of libssh (agent or default keys), and relays through a
+ * PTY as the SSH plugin does, with the slave side read as fast as possible
+ * in place of VTE:
+ *   remmina-ssh-shell-bench <host[:port]> <remote file> [keystrokes]
+ * The remote file is streamed with cat to report the throughput, then
+ * single keystrokes are sent to a remote cat, to report the time until
+ * their echo is back on the PTY. The host key is not verified. */
+
+/* Define this before stdlib.h to have posix_openpt and cfmakeraw */
+#define _GNU_SOURCE
+#include "config.h"
+#include <glib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libssh/libssh.h>
+#include "remmina_ssh_pty_relay.h"
+#include "remmina/remmina_trace_calls.h"
+
+typedef struct _RemminaSSHShellBench
+{
+	ssh_session session;
+	ssh_channel channel;
+	RemminaSSHPtyRelay *relay;
+	gint master;
+	gint slave;
+	pthread_t thread;
+	volatile gint done;
+} RemminaSSHShellBench;
+
+static gpointer remmina_ssh_shell_bench_thread(gpointer data)
+{
+	TRACE_CALL("remmina_ssh_shell_bench_thread");
+	RemminaSSHShellBench *bench = (RemminaSSHShellBench*) data;
+
+	if (!remmina_ssh_pty_relay_run(bench->relay, bench->session, bench->channel))
+		g_printerr("Relay error: %s\n", ssh_get_error(bench->session));
+	g_atomic_int_set(&bench->done, 1);
+	return NULL;
+}
+
+/* Run command on a new channel with a PTY, relayed in a thread */
+static gboolean remmina_ssh_shell_bench_start(RemminaSSHShellBench *bench, const gchar *command)
+{
+	TRACE_CALL("remmina_ssh_shell_bench_start");
+	struct termios stermios;
+
+	bench->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (bench->master == -1 || grantpt(bench->master) == -1 || unlockpt(bench->master) == -1
+			|| (bench->slave = open(ptsname(bench->master), O_RDWR | O_NOCTTY)) < 0)
+	{
+		g_printerr("Failed to create pty device\n");
+		return FALSE;
+	}
+	tcgetattr(bench->slave, &stermios);
+	cfmakeraw(&stermios);
+	tcsetattr(bench->slave, TCSANOW, &stermios);
+
+	bench->channel = ssh_channel_new(bench->session);
+	if (!bench->channel || ssh_channel_open_session(bench->channel) != SSH_OK
+			|| ssh_channel_request_pty(bench->channel) != SSH_OK
+			|| ssh_channel_request_exec(bench->channel, command) != SSH_OK)
+	{
+		g_printerr("Failed to run %s: %s\n", command, ssh_get_error(bench->session));
+		return FALSE;
+	}
+
+	bench->done = 0;
+	bench->relay = remmina_ssh_pty_relay_new(bench->master, NULL);
+	remmina_ssh_pty_relay_set_size(bench->relay, 80, 24);
+	pthread_create(&bench->thread, NULL, remmina_ssh_shell_bench_thread, bench);
+	return TRUE;
+}
+
+static void remmina_ssh_shell_bench_finish(RemminaSSHShellBench *bench)
+{
+	TRACE_CALL("remmina_ssh_shell_bench_finish");
+	remmina_ssh_pty_relay_stop(bench->relay);
+	pthread_join(bench->thread, NULL);
+	remmina_ssh_pty_relay_free(bench->relay);
+	ssh_channel_close(bench->channel);
+	ssh_channel_free(bench->channel);
+	close(bench->slave);
+	close(bench->master);
+}
+
+/* Read the slave side until the relay is over and the PTY is empty.
+ * end is the time of the last byte */
+static guint64 remmina_ssh_shell_bench_drain(RemminaSSHShellBench *bench, gint64 *end)
+{
+	TRACE_CALL("remmina_ssh_shell_bench_drain");
+	struct pollfd fds;
+	gchar buf[65536];
+	guint64 total = 0;
+	gint64 last;
+	ssize_t n;
+	gint ret;
+
+	fds.fd = bench->slave;
+	fds.events = POLLIN;
+	last = g_get_monotonic_time();
+	for (;;)
+	{
+		ret = poll(&fds, 1, 100);
+		if (ret < 0 && errno != EINTR)
+			break;
+		if (ret > 0)
+		{
+			n = read(bench->slave, buf, sizeof(buf));
+			if (n > 0)
+			{
+				total += n;
+				last = g_get_monotonic_time();
+			}
+			else if (n == 0 || errno != EINTR)
+			{
+				break;
+			}
+		}
+		else if (ret == 0 && g_atomic_int_get(&bench->done))
+		{
+			break;
+		}
+	}
+	*end = last;
+	return total;
+}
+
+/* Time from a keystroke written on the slave side to its echo */
+static gint64 remmina_ssh_shell_bench_keystroke(RemminaSSHShellBench *bench)
+{
+	TRACE_CALL("remmina_ssh_shell_bench_keystroke");
+	struct pollfd fds;
+	gint64 begin;
+	gchar c;
+
+	begin = g_get_monotonic_time();
+	if (write(bench->slave, "x", 1) != 1)
+		return -1;
+
+	fds.fd = bench->slave;
+	fds.events = POLLIN;
+	while (poll(&fds, 1, 5000) > 0)
+	{
+		if (read(bench->slave, &c, 1) == 1 && c == 'x')
+			return g_get_monotonic_time() - begin;
+	}
+	return -1;
+}
+
+static gint remmina_ssh_shell_bench_compare(gconstpointer a, gconstpointer b)
+{
+	TRACE_CALL("remmina_ssh_shell_bench_compare");
+	gint64 x = *(const gint64*) a;
+	gint64 y = *(const gint64*) b;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+int main(int argc, char **argv)
+{
+	TRACE_CALL("main");
+	RemminaSSHShellBench bench;
+	GArray *latencies;
+	gchar *host, *command, *ptr;
+	guint64 total;
+	gint64 begin, wall, t;
+	gint keystrokes, port, i;
+
+	if (argc < 3)
+	{
+		g_printerr("Usage: %s <host[:port]> <remote file> [keystrokes]\n", argv[0]);
+		return 1;
+	}
+	keystrokes = (argc > 3 ? atoi(argv[3]) : 100);
+
+	host = g_strdup(argv[1]);
+	port = 22;
+	ptr = strrchr(host, ':');
+	if (ptr)
+	{
+		*ptr = '\0';
+		port = atoi(ptr + 1);
+	}
+
+	memset(&bench, 0, sizeof(bench));
+	bench.session = ssh_new();
+	ssh_options_set(bench.session, SSH_OPTIONS_HOST, host);
+	ssh_options_set(bench.session, SSH_OPTIONS_PORT, &port);
+	if (ssh_connect(bench.session) != SSH_OK
+			|| ssh_userauth_publickey_auto(bench.session, NULL, NULL) != SSH_AUTH_SUCCESS)
+	{
+		g_printerr("Failed to log in to %s: %s\n", argv[1], ssh_get_error(bench.session));
+		return 1;
+	}
+
+	/* Throughput */
+	ptr = g_shell_quote(argv[2]);
+	command = g_strdup_printf("cat %s", ptr);
+	g_free(ptr);
+	if (!remmina_ssh_shell_bench_start(&bench, command))
+		return 1;
+	g_free(command);
+	begin = g_get_monotonic_time();
+	total = remmina_ssh_shell_bench_drain(&bench, &t);
+	wall = t - begin;
+	remmina_ssh_shell_bench_finish(&bench);
+
+	g_print("file         %s\n", argv[2]);
+	g_print("bytes        %" G_GUINT64_FORMAT "\n", total);
+	g_print("wall time    %.3f s\n", wall / 1000000.0);
+	g_print("throughput   %.1f MB/s\n", wall > 0 ? (gdouble) total / wall : 0);
+
+	/* Keystroke echo, from the remote PTY */
+	if (!remmina_ssh_shell_bench_start(&bench, "cat > /dev/null"))
+		return 1;
+	latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+	for (i = 0; i < keystrokes; i++)
+	{
+		t = remmina_ssh_shell_bench_keystroke(&bench);
+		if (t < 0)
+			break;
+		g_array_append_val(latencies, t);
+	}
+	remmina_ssh_shell_bench_finish(&bench);
+
+	if (latencies->len > 0)
+	{
+		g_array_sort(latencies, remmina_ssh_shell_bench_compare);
+		g_print("echo p50     %.2f ms\n", g_array_index(latencies, gint64, latencies->len / 2) / 1000.0);
+		g_print("echo max     %.2f ms\n", g_array_index(latencies, gint64, latencies->len - 1) / 1000.0);
+	}
+	g_print("keystrokes   %u\n", latencies->len);
+
+	g_array_free(latencies, TRUE);
+	ssh_disconnect(bench.session);
+	ssh_free(bench.session);
+	g_free(host);
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "remmina_startup.h"
+#include "remmina/remmina_trace_calls.h"
+
+typedef struct _RemminaStartupEvent
+{
+	const gchar *category;
+	gchar *name;
+	gint64 ts;
+	/* -1 for instant events */
+	gint64 dur;
+} RemminaStartupEvent;
+
+static gboolean remmina_startup_enabled = FALSE;
+static gboolean remmina_startup_bench = FALSE;
+static gboolean remmina_startup_finished = FALSE;
+static gchar *remmina_startup_file = NULL;
+static gint64 remmina_startup_origin = 0;
+static GArray *remmina_startup_events = NULL;
+/* Plugins may be loaded from any thread */
+G_LOCK_DEFINE_STATIC(remmina_startup);
+
+void remmina_startup_init(int argc, char **argv)
+{
+	TRACE_CALL("remmina_startup_init");
+	const gchar *filename;
+	gint i;
+
+	remmina_startup_origin = g_get_monotonic_time();
+
+	filename = g_getenv("REMMINA_STARTUP_TRACE");
+	if (filename && filename[0])
+		remmina_startup_file = g_strdup(filename);
+
+	/* Options are also parsed in remmina_on_command_line(), but the
+	 * startup phases run before it */
+	for (i = 1; i < argc; i++)
+	{
+		if (g_strcmp0(argv[i], "--startup-bench") == 0)
+		{
+			remmina_startup_bench = TRUE;
+		}
+		else if (g_str_has_prefix(argv[i], "--startup-trace="))
+		{
+			g_free(remmina_startup_file);
+			remmina_startup_file = g_strdup(argv[i] + strlen("--startup-trace="));
+		}
+		else if (g_strcmp0(argv[i], "--startup-trace") == 0 && i + 1 < argc)
+		{
+			g_free(remmina_startup_file);
+			remmina_startup_file = g_strdup(argv[++i]);
+		}
+	}
+
+	if (!remmina_startup_bench && !remmina_startup_file)
+		return;
+
+	remmina_startup_enabled = TRUE;
+	remmina_startup_events = g_array_new(FALSE, FALSE, sizeof(RemminaStartupEvent));
+}
+
+gboolean remmina_startup_is_enabled(void)
+{
+	TRACE_CALL("remmina_startup_is_enabled");
+	return remmina_startup_enabled;
+}
+
+gboolean remmina_startup_is_bench(void)
+{
+	TRACE_CALL("remmina_startup_is_bench");
+	return remmina_startup_bench;
+}
+
+gboolean remmina_startup_is_finished(void)
+{
+	TRACE_CALL("remmina_startup_is_finished");
+	return remmina_startup_finished;
+}
+
+static void remmina_startup_add(const gchar *category, const gchar *name, gint64 ts, gint64 dur)
+{
+	TRACE_CALL("remmina_startup_add");
+	RemminaStartupEvent event;
+
+	G_LOCK(remmina_startup);
+	if (remmina_startup_enabled)
+	{
+		event.category = category;
+		event.name = g_strdup(name);
+		event.ts = ts - remmina_startup_origin;
+		event.dur = dur;
+		g_array_append_val(remmina_startup_events, event);
+	}
+	G_UNLOCK(remmina_startup);
+}
+
+gint64 remmina_startup_begin(void)
+{
+	TRACE_CALL("remmina_startup_begin");
+	return (remmina_startup_enabled ? g_get_monotonic_time() : 0);
+}
+
+void remmina_startup_end(const gchar *category, const gchar *name, gint64 begin)
+{
+	TRACE_CALL("remmina_startup_end");
+	if (!remmina_startup_enabled || begin == 0)
+		return;
+	remmina_startup_add(category, name, begin, g_get_monotonic_time() - begin);
+}
+
+void remmina_startup_mark(const gchar *category, const gchar *name)
+{
+	TRACE_CALL("remmina_startup_mark");
+	if (!remmina_startup_enabled)
+		return;
+	remmina_startup_add(category, name, g_get_monotonic_time(), -1);
+}
+
+static gchar* remmina_startup_to_json(void)
+{
+	TRACE_CALL("remmina_startup_to_json");
+	RemminaStartupEvent *event;
+	GString *str;
+	gchar *s;
+	guint i;
+
+	str = g_string_new("{\"traceEvents\":[");
+	for (i = 0; i < remmina_startup_events->len; i++)
+	{
+		event = &g_array_index(remmina_startup_events, RemminaStartupEvent, i);
+		s = g_strescape(event->name, NULL);
+		g_string_append_printf(str, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":1,\"tid\":1,\"ts\":%" G_GINT64_FORMAT,
+				i ? "," : "", s, event->category, event->ts);
+		g_free(s);
+		if (event->dur < 0)
+			g_string_append(str, ",\"ph\":\"i\",\"s\":\"p\"}");
+		else
+			g_string_append_printf(str, ",\"ph\":\"X\",\"dur\":%" G_GINT64_FORMAT "}", event->dur);
+	}
+	g_string_append_printf(str, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"version\":\"%s\",\"bench\":%s}}\n",
+			VERSION, remmina_startup_bench ? "true" : "false");
+	return g_string_free(str, FALSE);
+}
+
+static gboolean remmina_startup_quit(gpointer data)
+{
+	TRACE_CALL("remmina_startup_quit");
+	/* The first command line is still handled within g_application_run() */
+	if (gtk_main_level() > 0)
+		gtk_main_quit();
+	else
+		g_application_quit(g_application_get_default());
+	return FALSE;
+}
+
+void remmina_startup_window_mapped(void)
+{
+	TRACE_CALL("remmina_startup_window_mapped");
+	RemminaStartupEvent *event;
+	gchar *json;
+	FILE *fp;
+	guint i;
+
+	if (!remmina_startup_enabled)
+		return;
+	remmina_startup_mark("window", "first_window_map");
+
+	G_LOCK(remmina_startup);
+	remmina_startup_enabled = FALSE;
+	remmina_startup_finished = TRUE;
+	G_UNLOCK(remmina_startup);
+
+	json = remmina_startup_to_json();
+	if (remmina_startup_file)
+	{
+		fp = fopen(remmina_startup_file, "w");
+		if (fp)
+		{
+			fputs(json, fp);
+			fclose(fp);
+		}
+		else
+		{
+			g_print("Unable to write the startup trace to %s\n", remmina_startup_file);
+		}
+	}
+	else
+	{
+		fputs(json, stdout);
+	}
+	g_free(json);
+
+	for (i = 0; i < remmina_startup_events->len; i++)
+	{
+		event = &g_array_index(remmina_startup_events, RemminaStartupEvent, i);
+		g_free(event->name);
+	}
+	g_array_free(remmina_startup_events, TRUE);
+	remmina_startup_events = NULL;
+
+	if (remmina_startup_bench)
+		g_idle_add(remmina_startup_quit, NULL);
+}
+
@@ -0,0 +1,61 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINASTARTUP_H__
+#define __REMMINASTARTUP_H__
+
+G_BEGIN_DECLS
+
+/* Startup timeline recorder, enabled by the REMMINA_STARTUP_TRACE
+ * environment variable or by the --startup-trace=FILE and --startup-bench
+ * command line options. The timeline is written as a JSON trace (Chrome
+ * trace event format) when the main window is first mapped. */
+void remmina_startup_init(int argc, char **argv);
+gboolean remmina_startup_is_enabled(void);
+/* With --startup-bench Remmina exits once the trace has been written */
+gboolean remmina_startup_is_bench(void);
+gboolean remmina_startup_is_finished(void);
+
+/* Returns the start time of a phase, to be passed to remmina_startup_end() */
+gint64 remmina_startup_begin(void);
+void remmina_startup_end(const gchar *category, const gchar *name, gint64 begin);
+void remmina_startup_mark(const gchar *category, const gchar *name);
+
+void remmina_startup_window_mapped(void);
+
+G_END_DECLS
+
+#endif  /* __REMMINASTARTUP_H__  */
+
@@ -0,0 +1,371 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "remmina_stats.h"
+#include "remmina/remmina_trace_calls.h"
+
+/* Histogram buckets are powers of two in microseconds, the last one
+ * collects everything above ~33 seconds */
+#define REMMINA_STATS_BUCKETS 26
+
+typedef enum
+{
+	REMMINA_STATS_KIND_COUNTER,
+	REMMINA_STATS_KIND_GAUGE,
+	REMMINA_STATS_KIND_HISTOGRAM
+} RemminaStatsKind;
+
+typedef struct _RemminaStatsInfo
+{
+	const gchar *name;
+	RemminaStatsKind kind;
+} RemminaStatsInfo;
+
+static const RemminaStatsInfo remmina_stats_info[REMMINA_PROTOCOL_STAT_LAST] =
+{
+	{ "bytes_in", REMMINA_STATS_KIND_COUNTER },
+	{ "bytes_out", REMMINA_STATS_KIND_COUNTER },
+	{ "frames", REMMINA_STATS_KIND_COUNTER },
+	{ "damage_pixels", REMMINA_STATS_KIND_COUNTER },
+	{ "input_events", REMMINA_STATS_KIND_COUNTER },
+	{ "dropped_frames", REMMINA_STATS_KIND_COUNTER },
+	{ "ui_queue_depth", REMMINA_STATS_KIND_GAUGE },
+	{ "event_queue_depth", REMMINA_STATS_KIND_GAUGE },
+	{ "decode_time", REMMINA_STATS_KIND_HISTOGRAM },
+	{ "paint_time", REMMINA_STATS_KIND_HISTOGRAM },
+	{ "input_latency", REMMINA_STATS_KIND_HISTOGRAM }
+};
+
+typedef struct _RemminaStatsHistogram
+{
+	guint64 buckets[REMMINA_STATS_BUCKETS];
+	guint64 count;
+	gint64 sum;
+	gint64 max;
+} RemminaStatsHistogram;
+
+struct _RemminaStats
+{
+	pthread_mutex_t mu;
+	gint64 start_time;
+
+	/* Counter total, or last gauge value */
+	gint64 value[REMMINA_PROTOCOL_STAT_LAST];
+	/* Highest gauge value seen */
+	gint64 peak[REMMINA_PROTOCOL_STAT_LAST];
+	RemminaStatsHistogram histogram[REMMINA_PROTOCOL_STAT_LAST];
+
+	/* Snapshot of the counters at the previous remmina_stats_to_text() call */
+	gint64 last_time;
+	gint64 last_value[REMMINA_PROTOCOL_STAT_LAST];
+};
+
+/* The counters are updated from plugin threads, which may run with
+ * asynchronous cancellation: a thread cancelled with the mutex held would
+ * block every later dump. Cancellation is deferred while it is held. */
+static void remmina_stats_lock(RemminaStats *stats, gint *oldtype)
+{
+	TRACE_CALL("remmina_stats_lock");
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, oldtype);
+	pthread_mutex_lock(&stats->mu);
+}
+
+static void remmina_stats_unlock(RemminaStats *stats, gint oldtype)
+{
+	TRACE_CALL("remmina_stats_unlock");
+	pthread_mutex_unlock(&stats->mu);
+	pthread_setcanceltype(oldtype, NULL);
+}
+
+static gint remmina_stats_bucket(gint64 usec)
+{
+	TRACE_CALL("remmina_stats_bucket");
+	gint i = 0;
+
+	while (usec > 0 && i < REMMINA_STATS_BUCKETS - 1)
+	{
+		usec >>= 1;
+		i++;
+	}
+	return i;
+}
+
+/* Upper bound of the bucket holding the requested percentile. Must be
+ * called with the stats mutex held. */
+static gint64 remmina_stats_percentile(RemminaStatsHistogram *h, gint percent)
+{
+	TRACE_CALL("remmina_stats_percentile");
+	guint64 target, seen;
+	gint i;
+
+	if (h->count == 0)
+		return 0;
+
+	target = (h->count * percent + 99) / 100;
+	seen = 0;
+	for (i = 0; i < REMMINA_STATS_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= target)
+			return MIN((gint64) 1 << i, h->max);
+	}
+	return h->max;
+}
+
+RemminaStats* remmina_stats_new(void)
+{
+	TRACE_CALL("remmina_stats_new");
+	RemminaStats *stats;
+
+	stats = g_new0(RemminaStats, 1);
+	pthread_mutex_init(&stats->mu, NULL);
+	stats->start_time = g_get_monotonic_time();
+	stats->last_time = stats->start_time;
+	return stats;
+}
+
+void remmina_stats_free(RemminaStats *stats)
+{
+	TRACE_CALL("remmina_stats_free");
+	if (!stats)
+		return;
+	pthread_mutex_destroy(&stats->mu);
+	g_free(stats);
+}
+
+void remmina_stats_reset(RemminaStats *stats)
+{
+	TRACE_CALL("remmina_stats_reset");
+	gint oldtype;
+
+	remmina_stats_lock(stats, &oldtype);
+	memset(stats->value, 0, sizeof(stats->value));
+	memset(stats->peak, 0, sizeof(stats->peak));
+	memset(stats->histogram, 0, sizeof(stats->histogram));
+	memset(stats->last_value, 0, sizeof(stats->last_value));
+	stats->start_time = g_get_monotonic_time();
+	stats->last_time = stats->start_time;
+	remmina_stats_unlock(stats, oldtype);
+}
+
+void remmina_stats_count(RemminaStats *stats, RemminaProtocolStat stat, gint64 delta)
+{
+	TRACE_CALL("remmina_stats_count");
+	gint oldtype;
+
+	if (!stats || stat >= REMMINA_PROTOCOL_STAT_LAST)
+		return;
+	remmina_stats_lock(stats, &oldtype);
+	stats->value[stat] += delta;
+	remmina_stats_unlock(stats, oldtype);
+}
+
+void remmina_stats_gauge(RemminaStats *stats, RemminaProtocolStat stat, gint64 value)
+{
+	TRACE_CALL("remmina_stats_gauge");
+	gint oldtype;
+
+	if (!stats || stat >= REMMINA_PROTOCOL_STAT_LAST)
+		return;
+	remmina_stats_lock(stats, &oldtype);
+	stats->value[stat] = value;
+	if (value > stats->peak[stat])
+		stats->peak[stat] = value;
+	remmina_stats_unlock(stats, oldtype);
+}
+
+void remmina_stats_sample(RemminaStats *stats, RemminaProtocolStat stat, gint64 usec)
+{
+	TRACE_CALL("remmina_stats_sample");
+	RemminaStatsHistogram *h;
+	gint oldtype;
+
+	if (!stats || stat >= REMMINA_PROTOCOL_STAT_LAST)
+		return;
+	if (usec < 0)
+		usec = 0;
+	remmina_stats_lock(stats, &oldtype);
+	h = &stats->histogram[stat];
+	h->buckets[remmina_stats_bucket(usec)]++;
+	h->count++;
+	h->sum += usec;
+	if (usec > h->max)
+		h->max = usec;
+	remmina_stats_unlock(stats, oldtype);
+}
+
+gint64 remmina_stats_get_value(RemminaStats *stats, RemminaProtocolStat stat)
+{
+	TRACE_CALL("remmina_stats_get_value");
+	gint64 value;
+	gint oldtype;
+
+	if (!stats || stat >= REMMINA_PROTOCOL_STAT_LAST)
+		return 0;
+	remmina_stats_lock(stats, &oldtype);
+	if (remmina_stats_info[stat].kind == REMMINA_STATS_KIND_HISTOGRAM)
+		value = stats->histogram[stat].count;
+	else
+		value = stats->value[stat];
+	remmina_stats_unlock(stats, oldtype);
+	return value;
+}
+
+gchar* remmina_stats_to_text(RemminaStats *stats)
+{
+	TRACE_CALL("remmina_stats_to_text");
+	GString *str;
+	gint64 now;
+	gdouble elapsed;
+	gdouble rate[REMMINA_PROTOCOL_STAT_LAST];
+	gint oldtype;
+	gint i;
+
+	str = g_string_new(NULL);
+
+	remmina_stats_lock(stats, &oldtype);
+	now = g_get_monotonic_time();
+	elapsed = (now - stats->last_time) / 1000000.0;
+	for (i = 0; i < REMMINA_PROTOCOL_STAT_LAST; i++)
+	{
+		rate[i] = elapsed > 0 ? (stats->value[i] - stats->last_value[i]) / elapsed : 0;
+		stats->last_value[i] = stats->value[i];
+	}
+	stats->last_time = now;
+
+	g_string_append_printf(str, "%.1f fps (%.1f dropped), %.2f Mpixel/s damage\n",
+			rate[REMMINA_PROTOCOL_STAT_FRAMES], rate[REMMINA_PROTOCOL_STAT_DROPPED_FRAMES],
+			rate[REMMINA_PROTOCOL_STAT_DAMAGE_PIXELS] / 1000000.0);
+	g_string_append_printf(str, "in %.1f KiB/s, out %.1f KiB/s\n",
+			rate[REMMINA_PROTOCOL_STAT_BYTES_IN] / 1024.0, rate[REMMINA_PROTOCOL_STAT_BYTES_OUT] / 1024.0);
+	for (i = 0; i < REMMINA_PROTOCOL_STAT_LAST; i++)
+	{
+		if (remmina_stats_info[i].kind != REMMINA_STATS_KIND_HISTOGRAM)
+			continue;
+		g_string_append_printf(str, "%s p50 %.1f ms, p95 %.1f ms, max %.1f ms\n", remmina_stats_info[i].name,
+				remmina_stats_percentile(&stats->histogram[i], 50) / 1000.0,
+				remmina_stats_percentile(&stats->histogram[i], 95) / 1000.0,
+				stats->histogram[i].max / 1000.0);
+	}
+	g_string_append_printf(str, "queues ui %" G_GINT64_FORMAT " (max %" G_GINT64_FORMAT "), event %" G_GINT64_FORMAT
+			" (max %" G_GINT64_FORMAT ")",
+			stats->value[REMMINA_PROTOCOL_STAT_UI_QUEUE_DEPTH], stats->peak[REMMINA_PROTOCOL_STAT_UI_QUEUE_DEPTH],
+			stats->value[REMMINA_PROTOCOL_STAT_EVENT_QUEUE_DEPTH], stats->peak[REMMINA_PROTOCOL_STAT_EVENT_QUEUE_DEPTH]);
+	remmina_stats_unlock(stats, oldtype);
+
+	return g_string_free(str, FALSE);
+}
+
+gchar* remmina_stats_to_json(RemminaStats *stats, const gchar *name, const gchar *protocol)
+{
+	TRACE_CALL("remmina_stats_to_json");
+	GString *str;
+	gchar *s;
+	RemminaStatsHistogram *h;
+	gint oldtype;
+	gint i, j;
+
+	str = g_string_new("{");
+
+	s = g_strescape(name ? name : "", NULL);
+	g_string_append_printf(str, "\"name\":\"%s\"", s);
+	g_free(s);
+	s = g_strescape(protocol ? protocol : "", NULL);
+	g_string_append_printf(str, ",\"protocol\":\"%s\"", s);
+	g_free(s);
+
+	remmina_stats_lock(stats, &oldtype);
+	g_string_append_printf(str, ",\"duration_us\":%" G_GINT64_FORMAT, g_get_monotonic_time() - stats->start_time);
+	for (i = 0; i < REMMINA_PROTOCOL_STAT_LAST; i++)
+	{
+		switch (remmina_stats_info[i].kind)
+		{
+			case REMMINA_STATS_KIND_COUNTER:
+				g_string_append_printf(str, ",\"%s\":%" G_GINT64_FORMAT, remmina_stats_info[i].name,
+						stats->value[i]);
+				break;
+			case REMMINA_STATS_KIND_GAUGE:
+				g_string_append_printf(str, ",\"%s\":{\"last\":%" G_GINT64_FORMAT ",\"max\":%" G_GINT64_FORMAT "}",
+						remmina_stats_info[i].name, stats->value[i], stats->peak[i]);
+				break;
+			case REMMINA_STATS_KIND_HISTOGRAM:
+				h = &stats->histogram[i];
+				g_string_append_printf(str, ",\"%s\":{\"count\":%" G_GUINT64_FORMAT ",\"sum_us\":%" G_GINT64_FORMAT
+						",\"max_us\":%" G_GINT64_FORMAT ",\"p50_us\":%" G_GINT64_FORMAT ",\"p95_us\":%"
+						G_GINT64_FORMAT ",\"p99_us\":%" G_GINT64_FORMAT ",\"buckets\":[",
+						remmina_stats_info[i].name, h->count, h->sum, h->max,
+						remmina_stats_percentile(h, 50), remmina_stats_percentile(h, 95),
+						remmina_stats_percentile(h, 99));
+				for (j = 0; j < REMMINA_STATS_BUCKETS; j++)
+				{
+					g_string_append_printf(str, j ? ",%" G_GUINT64_FORMAT : "%" G_GUINT64_FORMAT, h->buckets[j]);
+				}
+				g_string_append(str, "]}");
+				break;
+		}
+	}
+	remmina_stats_unlock(stats, oldtype);
+
+	g_string_append_c(str, '}');
+	return g_string_free(str, FALSE);
+}
+
+void remmina_stats_dump(RemminaStats *stats, const gchar *name, const gchar *protocol)
+{
+	TRACE_CALL("remmina_stats_dump");
+	const gchar *filename;
+	gchar *json;
+	FILE *fp;
+
+	filename = g_getenv("REMMINA_STATS_FILE");
+	if (!stats || !filename || !filename[0])
+		return;
+
+	fp = fopen(filename, "a");
+	if (!fp)
+	{
+		g_print("Unable to write statistics to %s\n", filename);
+		return;
+	}
+	json = remmina_stats_to_json(stats, name, protocol);
+	fprintf(fp, "%s\n", json);
+	fclose(fp);
+	g_free(json);
+}
+
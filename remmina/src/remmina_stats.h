@@ -0,0 +1,67 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2009-2011 Vic Lee
+ * Copyright (C) 2014-2015 Antenore Gatta, Fabio Castelli, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#ifndef __REMMINASTATS_H__
+#define __REMMINASTATS_H__
+
+#include "remmina/types.h"
+
+G_BEGIN_DECLS
+
+typedef struct _RemminaStats RemminaStats;
+
+RemminaStats* remmina_stats_new(void);
+void remmina_stats_free(RemminaStats *stats);
+void remmina_stats_reset(RemminaStats *stats);
+
+/* All the update functions can be called from any thread */
+void remmina_stats_count(RemminaStats *stats, RemminaProtocolStat stat, gint64 delta);
+void remmina_stats_gauge(RemminaStats *stats, RemminaProtocolStat stat, gint64 value);
+void remmina_stats_sample(RemminaStats *stats, RemminaProtocolStat stat, gint64 usec);
+
+gint64 remmina_stats_get_value(RemminaStats *stats, RemminaProtocolStat stat);
+
+/* Short human readable summary, used by the connection window overlay.
+ * Rates are computed against the previous call. */
+gchar* remmina_stats_to_text(RemminaStats *stats);
+/* Machine readable dump, one JSON object on a single line */
+gchar* remmina_stats_to_json(RemminaStats *stats, const gchar *name, const gchar *protocol);
+/* Append the JSON dump to the file named by the REMMINA_STATS_FILE environment variable, if any */
+void remmina_stats_dump(RemminaStats *stats, const gchar *name, const gchar *protocol);
+
+G_END_DECLS
+
+#endif  /* __REMMINASTATS_H__  */
+